@@ -67,6 +67,9 @@
 
 #define BOARD_REVISION 2
 
+// set to 0 to leave the red (motor on) LED unused
+#define ENABLE_LED 1
+
 extern int g_nRevBoard;
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -87,14 +90,26 @@ extern int g_nRevBoard;
 
 typedef long long          	INT64;
 typedef unsigned long long 	UINT64;
+#ifdef FDC_HOST_BUILD
+	// FatFs (ff.h) defines DWORD as uint32_t, which is only unsigned long on the RP2040
+	#include <stdint.h>
+
+	typedef uint32_t       	UINT32;
+	typedef int32_t        	INT32;
+#else
 typedef unsigned long      	UINT32;
 typedef long               	INT32;
+#endif
 typedef unsigned short     	UINT16;
 typedef short              	INT16;
 typedef unsigned char		    UINT8;
 typedef signed char        	INT8;
 typedef signed char        	SCHAR;
+#ifdef FDC_HOST_BUILD
+	typedef uint32_t       	DWORD;
+#else
 typedef unsigned long      	DWORD;
+#endif
 typedef unsigned short     	WORD;
 typedef unsigned char      	BYTE;
 typedef char		       	    CHAR;
@@ -143,6 +158,22 @@ typedef struct {
   uint32_t        dwTicks;
 } FDC_BusType;
 
+// binary bus trace (trace.bin) written by FlushTraceBuffer().  The file is a
+// TraceFileHeaderType followed by nEntries FDC_BusType records, all little endian.
+// Each record holds the bus state (with the data bus value), the number of
+// consecutive cycles with that state (Bus.b.Count) and the time since the previous
+// record in units of 1/nTickRate seconds.
+#define TRACE_FILE_SIGNATURE "F80TRACE"
+#define TRACE_FILE_VERSION   1
+
+typedef struct {
+	char     szSignature[8];
+	uint32_t nVersion;
+	uint32_t nEntrySize;	// sizeof(FDC_BusType)
+	uint32_t nEntries;
+	uint32_t nTickRate;		// ticks per second of FDC_BusType.dwTicks
+} TraceFileHeaderType;
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // enumerations
 
@@ -184,6 +215,7 @@ void TogglePin(int nCount);
 void InitVars(void);
 void DecodeBusData(FDC_BusType* pHistory, char* psz, int nType);
 void ReleaseWait(void);
+void fdc_isr(void);
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -6,25 +6,361 @@
 #include "Defines.h"
 #include "file.h"
 #include "sd_core.h"
+#include "diskio.h"
 #include "system.h"
 
-//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////////
+//
+// Block cache
+//
+// Each open file has FILE_CACHE_BLOCKS blocks of FILE_BLOCK_SIZE bytes aligned to the
+// SD-Card sectors.  FileRead() and FileWrite() copy to and from the blocks, so that
+// the unaligned sector writes of a DMK image (and the half sector writes of an HFE
+// image) modify a block that is only read once instead of having FatFs read the SD
+// sector for every write.  Writes to a block that is already dirty are combined and
+// the dirty blocks are written (in ascending order) by FileFlush(), FileClose() or
+// when the block is reused.
+//
+// Reads and writes of whole aligned blocks (track loads, HFE raw tracks) bypass the
+// cache.  Files opened without FA_READ are not cached.
+//
+// The mounted disk images also get a FatFs cluster link map (FileEnableFastSeek()),
+// so a seek to a far track does not read the FAT chain from the start of the file.
+// When the map shows that the image is contiguous, whole sector transfers inside
+// the image are made with disk_read()/disk_write() at the LBA of the data.
+// FileReadStart() uses disk_read_start() for those sectors, so the caller can do
+// other work while they are received by DMA.
+//
+////////////////////////////////////////////////////////////////////////////////////
 
-file  g_fFiles[MAX_FILES];
-FATFS g_FatFs;					/* FATFS work area (filesystem object) for logical drive */
+extern DWORD  disk_read_sectors;	// see glue.c
+
+file          g_fFiles[MAX_FILES];
+FATFS         g_FatFs;			/* FATFS work area (filesystem object) for logical drive */
+FileStatsType g_flStats;
 
 //-----------------------------------------------------------------------------
 void FileSystemInit(void)
 {
-	FRESULT fr;
-    int     i;
+	int i;
 
-	fr = f_mount(&g_FatFs, "", 0);
+	f_mount(&g_FatFs, "", 0);
 
 	for (i = 0; i < MAX_FILES; ++i)
 	{
 		g_fFiles[i].byIsOpen = FALSE;
 	}
+
+	memset(&g_flStats, 0, sizeof(g_flStats));
+}
+
+//-----------------------------------------------------------------------------
+static void FileSdSeek(file* fp, DWORD dwOffset)
+{
+	DWORD dwSectors = disk_read_sectors;
+
+	if (f_tell(&fp->f) == dwOffset)
+	{
+		return;
+	}
+
+	f_lseek(&fp->f, dwOffset);
+
+	++g_flStats.dwSeeks;
+	g_flStats.dwSeekReads += disk_read_sectors - dwSectors;
+}
+
+//-----------------------------------------------------------------------------
+// builds the cluster link map of the file, after which f_lseek() gets the cluster
+// from the map instead of following the FAT chain from the start of the file.
+// Fast seek is turned off if the file has more fragments than fit in dwLinkMap.
+//
+static BYTE FileBuildLinkMap(file* fp)
+{
+	FRESULT fr;
+
+	fp->dwLinkMap[0] = FILE_LINK_MAP_SIZE;
+	fp->f.cltbl      = fp->dwLinkMap;
+
+	fr = f_lseek(&fp->f, CREATE_LINKMAP);
+
+	++g_flStats.dwLinkMapBuilds;
+	fp->dwLinkMapItems = fp->dwLinkMap[0];	// the required size, also when the map is too small
+	fp->dwStartSector  = 0;
+
+	if (fr != FR_OK)
+	{
+		fp->f.cltbl    = NULL;
+		fp->byFastSeek = FALSE;
+		return FALSE;
+	}
+
+	// a single fragment (table size, fragment length, first cluster, 0) is a contiguous file
+	if ((fp->dwLinkMapItems == 4) && (fp->dwLinkMap[2] >= 2))
+	{
+		fp->dwStartSector = g_FatFs.database + (fp->dwLinkMap[2] - 2) * g_FatFs.csize;
+	}
+
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// used for the mounted disk images, returns FALSE if the link map could not be built
+//
+BYTE FileEnableFastSeek(file* fp)
+{
+	if ((fp == NULL) || (fp->byIsOpen == FALSE))
+	{
+		return FALSE;
+	}
+
+	fp->byFastSeek = TRUE;
+
+	return FileBuildLinkMap(fp);
+}
+
+//-----------------------------------------------------------------------------
+// TRUE if the transfer is made of whole sectors that are inside the clusters of a
+// contiguous file (dwStartSector != 0), so it can be made at the LBA of the data
+// with disk_read()/disk_write() instead of through FatFs
+//
+static BYTE FileIsDirect(file* fp, DWORD dwOffset, UINT nSize, DWORD dwLimit)
+{
+	if ((fp->dwStartSector == 0) || (nSize == 0))
+	{
+		return FALSE;
+	}
+
+	if (((dwOffset % FILE_BLOCK_SIZE) != 0) || ((nSize % FILE_BLOCK_SIZE) != 0))
+	{
+		return FALSE;
+	}
+
+	return ((dwOffset + nSize) <= dwLimit);
+}
+
+//-----------------------------------------------------------------------------
+// the FatFs sector buffer of the file must not hold data that a direct transfer
+// would miss (or overwrite later)
+//
+static void FileSyncFatFs(file* fp)
+{
+	if (fp->byFatFsWrite)
+	{
+		f_sync(&fp->f);
+		fp->byFatFsWrite = FALSE;
+	}
+}
+
+//-----------------------------------------------------------------------------
+static UINT FileSdRead(file* fp, DWORD dwOffset, BYTE* pby, UINT nSize)
+{
+	DWORD dwSize = f_size(&fp->f);
+	UINT  br = 0;
+
+	// the last sector of the file is allocated even if the file ends inside it
+	if (FileIsDirect(fp, dwOffset, nSize, (dwSize + FILE_BLOCK_SIZE - 1) & ~(FILE_BLOCK_SIZE - 1)))
+	{
+		FileSyncFatFs(fp);
+
+		if (disk_read(g_FatFs.pdrv, pby, fp->dwStartSector + (dwOffset / FILE_BLOCK_SIZE), nSize / FILE_BLOCK_SIZE) == RES_OK)
+		{
+			br = ((dwOffset + nSize) > dwSize) ? (dwSize - dwOffset) : nSize;
+
+			++g_flStats.dwDirectReads;
+			++g_flStats.dwSdReads;
+			g_flStats.dwSdReadBytes += br;
+
+			return br;
+		}
+
+		// try again through FatFs
+	}
+
+	FileSdSeek(fp, dwOffset);
+
+	f_read(&fp->f, pby, nSize, &br);
+
+	++g_flStats.dwSdReads;
+	g_flStats.dwSdReadBytes += br;
+
+	return br;
+}
+
+//-----------------------------------------------------------------------------
+static UINT FileSdWrite(file* fp, DWORD dwOffset, BYTE* pby, UINT nSize)
+{
+	UINT bw = 0;
+
+	// a direct write must not change the size of the file
+	if (FileIsDirect(fp, dwOffset, nSize, f_size(&fp->f)))
+	{
+		FileSyncFatFs(fp);
+
+		if (disk_write(g_FatFs.pdrv, pby, fp->dwStartSector + (dwOffset / FILE_BLOCK_SIZE), nSize / FILE_BLOCK_SIZE) == RES_OK)
+		{
+			// the FatFs sector buffer may hold one of the sectors that were written
+			fp->f.sect = 0;
+
+			++g_flStats.dwDirectWrites;
+			++g_flStats.dwSdWrites;
+			g_flStats.dwSdWriteBytes += nSize;
+
+			return nSize;
+		}
+	}
+
+	// FatFs can not add clusters to a file while its link map is in use
+	if (fp->byFastSeek && ((dwOffset + nSize) > f_size(&fp->f)))
+	{
+		fp->f.cltbl       = NULL;
+		fp->dwStartSector = 0;
+	}
+
+	FileSdSeek(fp, dwOffset);
+	f_write(&fp->f, pby, nSize, &bw);
+	fp->byFatFsWrite = TRUE;
+
+	++g_flStats.dwSdWrites;
+	g_flStats.dwSdWriteBytes += bw;
+
+	if (fp->byFastSeek && (fp->f.cltbl == NULL))
+	{
+		FileBuildLinkMap(fp);
+	}
+
+	return bw;
+}
+
+//-----------------------------------------------------------------------------
+static void FileInvalidateBlocks(file* fp)
+{
+	int i;
+
+	for (i = 0; i < FILE_CACHE_BLOCKS; ++i)
+	{
+		fp->fbBlocks[i].dwBlock = FILE_NO_BLOCK;
+		fp->fbBlocks[i].byDirty = FALSE;
+	}
+}
+
+//-----------------------------------------------------------------------------
+static void FileWriteBlock(file* fp, FileBlockType* pfb)
+{
+	if (!pfb->byDirty)
+	{
+		return;
+	}
+
+	FileSdWrite(fp, pfb->dwBlock * FILE_BLOCK_SIZE, pfb->byData, pfb->wLength);
+	pfb->byDirty = FALSE;
+}
+
+//-----------------------------------------------------------------------------
+// writes all dirty blocks in ascending order, so that consecutive blocks are
+// written by consecutive f_write() calls without a seek in between
+//
+void FileWriteBlocks(file* fp)
+{
+	FileBlockType* pfbNext;
+	int            i;
+
+	if ((fp == NULL) || !fp->byCached)
+	{
+		return;
+	}
+
+	while (TRUE)
+	{
+		pfbNext = NULL;
+
+		for (i = 0; i < FILE_CACHE_BLOCKS; ++i)
+		{
+			if (fp->fbBlocks[i].byDirty && ((pfbNext == NULL) || (fp->fbBlocks[i].dwBlock < pfbNext->dwBlock)))
+			{
+				pfbNext = &fp->fbBlocks[i];
+			}
+		}
+
+		if (pfbNext == NULL)
+		{
+			return;
+		}
+
+		FileWriteBlock(fp, pfbNext);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// returns the cached copy of the block, reading it from the SD-Card if required.
+// An unused block is taken if there is one, otherwise the least recently used.
+//
+static FileBlockType* FileGetBlock(file* fp, DWORD dwBlock)
+{
+	FileBlockType* pfb = NULL;
+	DWORD          dwStart = dwBlock * FILE_BLOCK_SIZE;
+	int            i;
+
+	for (i = 0; i < FILE_CACHE_BLOCKS; ++i)
+	{
+		if (fp->fbBlocks[i].dwBlock == dwBlock)
+		{
+			fp->fbBlocks[i].dwLastUsed = ++fp->dwStamp;
+			++g_flStats.dwBlockHits;
+			return &fp->fbBlocks[i];
+		}
+
+		if ((pfb == NULL) || (fp->fbBlocks[i].dwBlock == FILE_NO_BLOCK) ||
+			((pfb->dwBlock != FILE_NO_BLOCK) && (fp->fbBlocks[i].dwLastUsed < pfb->dwLastUsed)))
+		{
+			pfb = &fp->fbBlocks[i];
+		}
+	}
+
+	++g_flStats.dwBlockMisses;
+
+	FileWriteBlock(fp, pfb);
+
+	pfb->dwBlock    = dwBlock;
+	pfb->dwLastUsed = ++fp->dwStamp;
+	pfb->wLength    = 0;
+
+	// the part of the file that is only held in dirty blocks is not on the SD-Card yet
+	if (dwStart < f_size(&fp->f))
+	{
+		pfb->wLength = FileSdRead(fp, dwStart, pfb->byData, FILE_BLOCK_SIZE);
+	}
+
+	memset(pfb->byData + pfb->wLength, 0, FILE_BLOCK_SIZE - pfb->wLength);
+
+	return pfb;
+}
+
+//-----------------------------------------------------------------------------
+// writes back the cached blocks in the range, or discards them if byDiscard is TRUE.
+// Used before an aligned transfer that bypasses the cache.
+//
+static void FileSyncBlockRange(file* fp, DWORD dwFirst, DWORD dwCount, BYTE byDiscard)
+{
+	int i;
+
+	for (i = 0; i < FILE_CACHE_BLOCKS; ++i)
+	{
+		if ((fp->fbBlocks[i].dwBlock == FILE_NO_BLOCK) || (fp->fbBlocks[i].dwBlock < dwFirst) || (fp->fbBlocks[i].dwBlock >= (dwFirst + dwCount)))
+		{
+			continue;
+		}
+
+		if (byDiscard)
+		{
+			fp->fbBlocks[i].dwBlock = FILE_NO_BLOCK;
+			fp->fbBlocks[i].byDirty = FALSE;
+		}
+		else
+		{
+			FileWriteBlock(fp, &fp->fbBlocks[i]);
+		}
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -61,23 +397,33 @@ file* FileOpen(char* pszFileName, BYTE byMode)
 
 	if (fr == FR_OK)
 	{
-		g_fFiles[i].byIsOpen = TRUE;
+		g_fFiles[i].byIsOpen       = TRUE;
+		g_fFiles[i].byCached       = ((byMode & FA_READ) != 0);
+		g_fFiles[i].dwPos          = f_tell(&g_fFiles[i].f);
+		g_fFiles[i].dwSize         = f_size(&g_fFiles[i].f);
+		g_fFiles[i].dwStamp        = 0;
+		g_fFiles[i].byFastSeek     = FALSE;
+		g_fFiles[i].byFatFsWrite   = FALSE;
+		g_fFiles[i].dwLinkMapItems = 0;
+		g_fFiles[i].dwStartSector  = 0;
+		g_fFiles[i].byReadPending  = FALSE;
+		g_fFiles[i].nReadResult    = 0;
+		FileInvalidateBlocks(&g_fFiles[i]);
 		return &g_fFiles[i];
 	}
-	
+
 	return NULL;
 }
 
 //-----------------------------------------------------------------------------
 void FileClose(file* fp)
 {
-	int i;
-
 	if ((fp == NULL) || (fp->byIsOpen == FALSE))
 	{
 		return;
 	}
 
+	FileWriteBlocks(fp);
 	f_close(&fp->f);
 	fp->byIsOpen = FALSE;
 }
@@ -85,8 +431,6 @@ void FileClose(file* fp)
 //-----------------------------------------------------------------------------
 BYTE FileIsOpen(file *fp)
 {
-	int i;
-
 	if (fp == NULL)
 	{
 		return FALSE;
@@ -98,33 +442,276 @@ BYTE FileIsOpen(file *fp)
 //-----------------------------------------------------------------------------
 UINT32 FileRead(file* fp, BYTE* pby, UINT32 nSize)
 {
-	FRESULT fr;
-	UINT    br;
+	FileBlockType* pfb;
+	UINT32         nRead = 0;
+	UINT           br, nOffset, nCount;
 
 	if ((fp == NULL) || (fp->byIsOpen == 0))
 	{
 		return 0;
 	}
 
-	fr = f_read(&fp->f, pby, nSize, &br);
+	if (!fp->byCached)
+	{
+		br = FileSdRead(fp, fp->dwPos, pby, nSize);
+		fp->dwPos += br;
+		return br;
+	}
 
-	return br;
+	while ((nSize > 0) && (fp->dwPos < fp->dwSize))
+	{
+		nOffset = fp->dwPos % FILE_BLOCK_SIZE;
+
+		if ((nOffset == 0) && (nSize >= FILE_BLOCK_SIZE))
+		{
+			nCount = nSize - (nSize % FILE_BLOCK_SIZE);
+
+			FileSyncBlockRange(fp, fp->dwPos / FILE_BLOCK_SIZE, nCount / FILE_BLOCK_SIZE, FALSE);
+			++g_flStats.dwPassThrough;
+
+			br = FileSdRead(fp, fp->dwPos, pby, nCount);
+		}
+		else
+		{
+			pfb = FileGetBlock(fp, fp->dwPos / FILE_BLOCK_SIZE);
+
+			if (pfb->wLength <= nOffset)
+			{
+				break;
+			}
+
+			br = pfb->wLength - nOffset;
+
+			if (br > nSize)
+			{
+				br = nSize;
+			}
+
+			memcpy(pby, pfb->byData + nOffset, br);
+		}
+
+		if (br == 0)
+		{
+			break;
+		}
+
+		fp->dwPos += br;
+		pby       += br;
+		nSize     -= br;
+		nRead     += br;
+	}
+
+	return nRead;
+}
+
+//-----------------------------------------------------------------------------
+// starts a read of nSize bytes at the current position, FileReadComplete() returns
+// the number of bytes read.  The whole sectors of a contiguous file are read by DMA
+// (disk_read_start()) and the function returns TRUE while they are being received.
+// The partial sectors at each end are read through the block cache, the first one
+// before returning and the last one by FileReadComplete().  Anything else is read
+// before returning and the function returns FALSE.
+//
+// While a read is in progress pby must remain valid and no other File function
+// (except FileReadPoll()) may be called, as the SD-Card is selected by the read.
+//
+BYTE FileReadStart(file* fp, BYTE* pby, UINT32 nSize)
+{
+	UINT nHead, nCount;
+
+	if ((fp == NULL) || (fp->byIsOpen == 0))
+	{
+		return FALSE;
+	}
+
+	fp->byReadPending = FALSE;
+	fp->nReadResult   = 0;
+
+	if (!fp->byCached)
+	{
+		fp->nReadResult = FileRead(fp, pby, nSize);
+		return FALSE;
+	}
+
+	nHead = (FILE_BLOCK_SIZE - (fp->dwPos % FILE_BLOCK_SIZE)) % FILE_BLOCK_SIZE;
+
+	if (nHead > nSize)
+	{
+		nHead = nSize;
+	}
+
+	if (nHead > 0)
+	{
+		fp->nReadResult = FileRead(fp, pby, nHead);
+
+		if (fp->nReadResult < nHead)
+		{
+			return FALSE;
+		}
+
+		pby   += nHead;
+		nSize -= nHead;
+	}
+
+	nCount = nSize - (nSize % FILE_BLOCK_SIZE);
+
+	if ((nCount > 0) && (fp->dwPos < fp->dwSize))
+	{
+		FileSyncBlockRange(fp, fp->dwPos / FILE_BLOCK_SIZE, nCount / FILE_BLOCK_SIZE, FALSE);
+
+		if (FileIsDirect(fp, fp->dwPos, nCount, (f_size(&fp->f) + FILE_BLOCK_SIZE - 1) & ~(FILE_BLOCK_SIZE - 1)))
+		{
+			FileSyncFatFs(fp);
+
+			if (disk_read_start(g_FatFs.pdrv, pby, fp->dwStartSector + (fp->dwPos / FILE_BLOCK_SIZE), nCount / FILE_BLOCK_SIZE) == RES_OK)
+			{
+				fp->byReadPending = TRUE;
+				fp->pbyReadData   = pby;
+				fp->dwReadOffset  = fp->dwPos;
+				fp->nReadCount    = nCount;
+				fp->nReadTail     = nSize - nCount;
+
+				++g_flStats.dwAsyncReads;
+
+				return TRUE;
+			}
+		}
+	}
+
+	fp->nReadResult += FileRead(fp, pby, nSize);
+
+	return FALSE;
+}
+
+//-----------------------------------------------------------------------------
+// advances the read started by FileReadStart() (the DMA of each sector is started
+// once the SD-Card has sent its start token), returns TRUE while it is in progress.
+// Should be called from time to time by the code that runs during the read.
+//
+BYTE FileReadPoll(file* fp)
+{
+	return fp->byReadPending && disk_read_busy(g_FatFs.pdrv);
+}
+
+//-----------------------------------------------------------------------------
+// waits for the end of the read started by FileReadStart(), reads the partial
+// sector that follows the whole sectors and returns the number of bytes read
+//
+UINT32 FileReadComplete(file* fp)
+{
+	DWORD dwSize;
+	UINT  br;
+
+	if ((fp == NULL) || !fp->byReadPending)
+	{
+		return (fp != NULL) ? fp->nReadResult : 0;
+	}
+
+	fp->byReadPending = FALSE;
+
+	if (disk_read_finish(g_FatFs.pdrv) == RES_OK)
+	{
+		dwSize = f_size(&fp->f);
+		br     = ((fp->dwReadOffset + fp->nReadCount) > dwSize) ? (dwSize - fp->dwReadOffset) : fp->nReadCount;
+
+		++g_flStats.dwDirectReads;
+		++g_flStats.dwSdReads;
+		g_flStats.dwSdReadBytes += br;
+	}
+	else
+	{
+		// try again through FatFs
+		br = FileSdRead(fp, fp->dwReadOffset, fp->pbyReadData, fp->nReadCount);
+	}
+
+	++g_flStats.dwPassThrough;
+
+	fp->dwPos        = fp->dwReadOffset + br;
+	fp->nReadResult += br;
+
+	if ((br == fp->nReadCount) && (fp->nReadTail > 0))
+	{
+		fp->nReadResult += FileRead(fp, fp->pbyReadData + br, fp->nReadTail);
+	}
+
+	return fp->nReadResult;
 }
 
 //-----------------------------------------------------------------------------
 UINT32 FileWrite(file* fp, BYTE* pby, UINT32 nSize)
 {
-	FRESULT fr;
-	UINT    bw;
+	FileBlockType* pfb;
+	UINT32         nWritten = 0;
+	UINT           bw, nOffset, nCount;
 
 	if (fp == NULL)
 	{
 		return 0;
 	}
 
-	fr = f_write(&fp->f, pby, nSize, &bw);
+	if (!fp->byCached)
+	{
+		bw = FileSdWrite(fp, fp->dwPos, pby, nSize);
+		fp->dwPos += bw;
+		return bw;
+	}
 
-	return bw;
+	while (nSize > 0)
+	{
+		nOffset = fp->dwPos % FILE_BLOCK_SIZE;
+
+		if ((nOffset == 0) && (nSize >= FILE_BLOCK_SIZE))
+		{
+			nCount = nSize - (nSize % FILE_BLOCK_SIZE);
+
+			// the cached copies are completely replaced
+			FileSyncBlockRange(fp, fp->dwPos / FILE_BLOCK_SIZE, nCount / FILE_BLOCK_SIZE, TRUE);
+			++g_flStats.dwPassThrough;
+
+			bw = FileSdWrite(fp, fp->dwPos, pby, nCount);
+		}
+		else
+		{
+			pfb = FileGetBlock(fp, fp->dwPos / FILE_BLOCK_SIZE);
+			bw  = FILE_BLOCK_SIZE - nOffset;
+
+			if (bw > nSize)
+			{
+				bw = nSize;
+			}
+
+			memcpy(pfb->byData + nOffset, pby, bw);
+
+			if (pfb->byDirty)
+			{
+				++g_flStats.dwCombined;
+			}
+
+			pfb->byDirty = TRUE;
+
+			if (pfb->wLength < (nOffset + bw))
+			{
+				pfb->wLength = nOffset + bw;
+			}
+		}
+
+		if (bw == 0)
+		{
+			break;
+		}
+
+		fp->dwPos += bw;
+		pby       += bw;
+		nSize     -= bw;
+		nWritten  += bw;
+
+		if (fp->dwPos > fp->dwSize)
+		{
+			fp->dwSize = fp->dwPos;
+		}
+	}
+
+	return nWritten;
 }
 
 //-----------------------------------------------------------------------------
@@ -135,19 +722,32 @@ void FileSeek(file* fp, int nOffset)
 		return;
 	}
 
-	f_lseek(&fp->f, nOffset);
+	fp->dwPos = nOffset;
 }
 
 //-----------------------------------------------------------------------------
 void FileFlush(file* fp)
 {
+	FileWriteBlocks(fp);
 	f_sync(&fp->f);
+	fp->byFatFsWrite = FALSE;
 }
 
 //-----------------------------------------------------------------------------
 void FileTruncate(file* fp)
 {
+	FileWriteBlocks(fp);
+	FileInvalidateBlocks(fp);
+
+	f_lseek(&fp->f, fp->dwPos);
 	f_truncate(&fp->f);
+
+	fp->dwSize = fp->dwPos;
+
+	if (fp->byFastSeek)
+	{
+		FileBuildLinkMap(fp);
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -158,7 +758,7 @@ BYTE IsEOF(file* fp)
 		return TRUE;
 	}
 
-	return f_eof(&fp->f);
+	return (fp->dwPos >= fp->dwSize);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////
@@ -172,8 +772,13 @@ int FileReadLine(file* fp, char szLine[], int nMaxLen)
 		return -1;
 	}
 
+	// f_gets() reads at the FatFs position
+	FileWriteBlocks(fp);
+	f_lseek(&fp->f, fp->dwPos);
+
 	szLine[0] = 0;
 	f_gets(szLine, nMaxLen, &fp->f);						/* Get a string from the file */
+	fp->dwPos = f_tell(&fp->f);
 
 	// remove CR
 	psz = strchr(szLine, '\r');
@@ -586,11 +586,44 @@ void RecordBusHistory(DWORD dwBus, BYTE byData)
 	}
 }
 
+//-----------------------------------------------------------------------------
+// writes the captured bus cycles to trace.bin (see TraceFileHeaderType)
+//
+void FlushTraceBinary(void)
+{
+	TraceFileHeaderType thHeader;
+
+	g_fTraceFile = FileOpen("trace.bin", FA_WRITE | FA_CREATE_ALWAYS);
+
+	if (g_fTraceFile == NULL)
+	{
+		return;
+	}
+
+	FileSeek(g_fTraceFile, 0);
+	FileTruncate(g_fTraceFile);
+
+	memset(&thHeader, 0, sizeof(thHeader));
+	memcpy(thHeader.szSignature, TRACE_FILE_SIGNATURE, sizeof(thHeader.szSignature));
+	thHeader.nVersion   = TRACE_FILE_VERSION;
+	thHeader.nEntrySize = sizeof(FDC_BusType);
+	thHeader.nEntries   = g_nBusTraceIndex;
+	thHeader.nTickRate  = 1000000;	// time_us_32()
+
+	FileWrite(g_fTraceFile, (BYTE*)&thHeader, sizeof(thHeader));
+	FileWrite(g_fTraceFile, (BYTE*)g_btBusTrace, g_nBusTraceIndex * sizeof(FDC_BusType));
+
+	FileClose(g_fTraceFile);
+}
+
+//-----------------------------------------------------------------------------
 void FlushTraceBuffer(void)
 {
 	char szBuf[512];
 	int  i;
 
+	FlushTraceBinary();
+
 	g_fTraceFile = FileOpen("trace.txt", FA_WRITE | FA_CREATE_ALWAYS);
 
 	if (g_fTraceFile == NULL)
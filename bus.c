@@ -0,0 +1,452 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "fdc.h"
+
+#include "pico/stdlib.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// TRS-80 bus interface
+//
+// fdc_isr() is called by the PIO interrupt for each access to the FDC ports.  It
+// reads the bus, updates the FDC registers and places the result of a read cycle
+// on the data bus.  Everything else (commands, SD-Card access) is done by the main
+// loop in fdc.c.
+//
+// The pins and the PIO are only accessed through the Bus* macros below, so that
+// this file can be compiled with fdc.c, hfe.c, crc.c, cache.c and storage.c for a
+// host simulation (FDC_HOST_BUILD).  The simulation provides the Bus* functions,
+// ReleaseWait() and the pico/stdlib.h functions used by the FDC, and calls
+// fdc_isr() for each bus cycle it injects.  BusGetInputs() returns the levels of
+// DISKIN, DISKOUT, DRVSEL, RDNMI, WRNMI, A0, A1 and D0-D7 for that cycle (see
+// GPIO_IN_MASK).
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#ifdef FDC_HOST_BUILD
+	DWORD BusGetInputs(void);
+	void  BusPutData(BYTE byData);
+	void  BusSetLed(BYTE byOn);
+
+	#define BusSetDataOutput()
+	#define BusClearIntr()
+	#define BusGetCycles()		0
+#else
+	#include "hardware/pio.h"
+	#include "hardware/irq.h"
+	#include "hardware/structs/systick.h"
+
+	extern PIO  g_pio;
+	extern uint g_sm, g_offset;
+
+	#define BusGetInputs()		gpio_get_all()
+	#define BusSetDataOutput()	gpio_set_dir_out_masked(DATA_BUS_MASK)
+	#define BusPutData(by)		gpio_put_masked(DATA_BUS_MASK, (by) << D0_PIN)
+	#define BusSetLed(by)		gpio_put(RED_LED_PIN, by)
+	#define BusClearIntr()		{ irq_clear(PIO0_IRQ_0); pio_interrupt_clear(g_pio, 0); }
+	#define BusGetCycles()		systick_hw->cvr		// 24 bit down counter at the CPU clock (see main())
+#endif
+
+#if (ENABLE_TRACE_LOG == 1)
+	void RecordBusHistory(DWORD dwBus, BYTE byData);
+#endif
+
+#define HOST_SEQUENCE_COUNT 9
+
+BYTE g_byHostSequence[HOST_SEQUENCE_COUNT] = {0x80, 0x7F, 0x81, 0xFE, 0x82, 0xFD, 0x83, 0xFC, 0x84};
+
+//-----------------------------------------------------------------------------
+void DetectHostSequnce(BYTE byData)
+{
+	if ((g_FDC.nWrHostSequence < HOST_SEQUENCE_COUNT) && (g_byHostSequence[g_FDC.nWrHostSequence] == byData))
+	{
+		++g_FDC.nWrHostSequence;
+	}
+	else
+	{
+		g_FDC.nWrHostSequence = 0;
+		g_FDC.nRdHostSequence = 0;
+	}
+}
+
+#ifndef FDC_HOST_BUILD
+///////////////////////////////////////////////////////////////////////////////
+// restart pio code to release WAIT state
+void ReleaseWait(void)
+{
+	// push pin direction mask into tx fifo (this way the pio state machine does not need to generate it)
+	pio_sm_put(g_pio, g_sm, ~GPIO_IN_MASK >> WAIT_PIN);
+
+	// restart the pio state machine at its first instruction (the address for which is g_offset)
+	// set x, g_offset
+	//   [3 bit opcode]      = 111
+	//   [5 bits = delay]    = 00000
+	//   [3 bits detination] = 001 = x
+	//   [5 bits data]       = g_offset
+	//   -------------------------------
+	//   1110  0000 0010 0000 + [offset]
+	pio_sm_exec(g_pio, g_sm, 0xE020 + g_offset);
+
+	// mov pc, x
+	//   [3 bit opcode]      = 101
+	//   [5 bits = delay]    = 00000
+	//   [3 bits detination] = 101 = pc
+	//   [2 bits Op]         = 00  = None
+	//   [3 bits Source]     = 001 = x
+	//   -------------------------------
+	//   1010  0000 1010 0001
+	pio_sm_exec(g_pio, g_sm, 0xA0A1);
+}
+#endif
+
+//-----------------------------------------------------------------------------
+void __not_in_flash_func(fdc_isr)(void)
+{
+	DWORD dwBus;
+	WORD  wReg, wCom;
+	BYTE  byData;
+	BYTE  byReleaseWait;
+	BYTE  byReqCount;
+	BYTE  byUpdateStatus;
+	DWORD dwEvents;
+	DWORD dwStartCycles, dwCycles;
+
+	dwStartCycles = BusGetCycles();
+
+	dwBus  = BusGetInputs();
+	byData = (dwBus >> D0_PIN) & 0xFF;
+
+	byReleaseWait = 1;
+	byReqCount    = 0;
+
+	// set by each bus cycle that changes a value g_FDC.byStatusReg depends on
+	byUpdateStatus = 0;
+
+	// events for the main loop, posted once the cycle has been handled
+	dwEvents = 0;
+
+	// INTR_MASK (DISKIN, DISKOUT, WRNMI, RDNMI and DRVSEL bits 1)
+	// if ((dwBus & INTR_MASK) == INTR_MASK) then DRVSEL, RDNMI, WRNMI, DISKOUT and DISKIN are all high
+
+	if ((dwBus & DISKIN_MASK) == 0) // the DISKIN is low (READ from FDC), put data on bus
+	{
+		++byReqCount;
+
+		// make all pins outputs
+		BusSetDataOutput();
+
+		wReg = (dwBus >> A0_PIN) & 0x03;
+
+		switch (wReg)
+		{
+			case 0:
+				byData = g_FDC.byStatusReg;
+			
+				++g_FDC.nReadStatusCount;
+
+				// a write command waits for this many status reads before its first DRQ
+				if (g_FDC.nReadStatusCount == WRITE_DRQ_STATUS_READS)
+				{
+					dwEvents |= EVENT_DATA;
+				}
+
+				if (g_FDC.stStatus.byIntrRequest)
+				{
+					g_FDC.byNmiStatusReg = 0xFF; // inverted state of all bits low except INTRQ
+					g_FDC.stStatus.byIntrRequest = 0;
+				}
+
+				g_FDC.nWrHostSequence = 0;
+				break;
+
+			case 1:
+				byData = g_FDC.byTrack;
+				g_FDC.nWrHostSequence = 0;
+				break;
+
+			case 2:
+				byData = g_FDC.bySector;
+				g_FDC.nWrHostSequence = 0;
+				break;
+
+			case 3:
+				dwEvents |= EVENT_DATA;
+
+				if ((g_FDC.byDriveSel == 0x0F) && (g_FDC.nProcessFunction == psSendData))
+				{
+					byData = g_FDC.byTransferBuffer[g_FDC.nTrasferIndex];
+					++g_FDC.nTrasferIndex;
+					TimerStart(tmStateCounter, 10000);
+
+					if (g_FDC.nTrasferIndex >= g_FDC.nTransferSize)
+					{
+						g_FDC.nProcessFunction = psIdle;
+						g_FDC.stStatus.byDataRequest = 0;
+						byUpdateStatus = 1;
+
+						if (g_FDC.byBackupDriveSel != 0)
+						{
+							g_FDC.byDriveSel = g_FDC.byBackupDriveSel;
+							g_FDC.byBackupDriveSel = 0;
+						}
+					}
+				}
+				else if (g_FDC.byIsrDataRead)
+				{
+					// sector read in progress, hand out the next byte and keep DRQ
+					// set until the last byte of the sector has been read
+					byData = *g_ptdTrack->pbyReadPtr;
+					++g_ptdTrack->pbyReadPtr;
+					--g_ptdTrack->nReadCount;
+					++g_FDC.nDataRegReadCount;
+
+					if (g_ptdTrack->nReadCount <= 0)
+					{
+						g_FDC.stStatus.byDataRequest = 0;
+						g_FDC.byIsrDataRead          = 0;
+						byUpdateStatus = 1;
+					}
+				}
+				else
+				{
+					byData = g_FDC.byData;
+					g_FDC.stStatus.byDataRequest = 0;
+					++g_FDC.nDataRegReadCount;
+					byUpdateStatus = 1;
+
+					if (g_FDC.nWrHostSequence == HOST_SEQUENCE_COUNT)
+					{
+						byData = g_byHostSequence[g_FDC.nRdHostSequence];
+						++g_FDC.nRdHostSequence;
+					}
+				}
+
+				break;
+		}
+
+		BusPutData(byData);
+
+		#if (ENABLE_TRACE_LOG == 1)
+			RecordBusHistory(dwBus, byData);
+		#endif
+	}
+
+	if ((dwBus & RDNMI_MASK) == 0) // the RDNMI is low (read NMI latch from FDC), put data on bus
+	{
+		++byReqCount;
+
+		// make all pins outputs
+		BusSetDataOutput();
+
+		byData = g_FDC.byNmiStatusReg;
+
+		BusPutData(byData);
+
+		#if (ENABLE_TRACE_LOG == 1)
+			RecordBusHistory(dwBus, byData);
+		#endif
+	}
+	
+	if ((dwBus & DISKOUT_MASK) == 0) // DISKOUT (WRITE to FDC)
+	{
+		++byReqCount;
+
+		// command, track (TRACK 0 bit) and data (DRQ) register writes all affect the status
+		byUpdateStatus = 1;
+
+		wReg = (dwBus >> A0_PIN) & 0x03;
+
+		switch (wReg)
+		{
+			case 0: // address 0xF0/240, command register
+				dwEvents |= EVENT_COMMAND;
+
+				g_FDC.byCommandReg    = byData;
+				g_FDC.byCommandType   = FdcGetCommandType(byData);
+				g_FDC.byNmiStatusReg  = 0xFF;
+				g_FDC.nWrHostSequence = 0;
+				g_FDC.byIsrDataRead   = 0;
+				g_FDC.byIsrDataWrite  = 0;
+
+				if (g_FDC.stStatus.byIntrRequest)
+				{
+					g_FDC.byNmiStatusReg = 0xFF; // inverted state of all bits low except INTRQ
+					g_FDC.stStatus.byIntrRequest = 0;
+				}
+
+				memset(&g_FDC.stStatus, 0, sizeof(g_FDC.stStatus));
+
+				if (g_FDC.byDriveSel == 0x0F)
+				{
+					g_FDC.byCommandReceived      = 1;
+					g_FDC.stStatus.byBusy        = 1;
+					g_FDC.stStatus.byDataRequest = 0;
+				}
+				else
+				{
+					wCom = g_FDC.byCommandReg & 0xF0;
+
+					if (wCom == 0xD0) // 0xD0 is Force Interrupt command
+					{
+						g_nWaitTime             = time_us_64();
+						g_FDC.byCommandType     = 4;
+						g_ptdTrack->nReadSize     = 0;
+						g_ptdTrack->nReadCount    = 0;
+						g_ptdTrack->nWriteSize    = 0;
+						g_FDC.byCurCommand      = g_FDC.byCommandReg;
+						g_FDC.byIntrEnable      = g_FDC.byCurCommand & 0x0F;
+						g_FDC.nProcessFunction  = psIdle;
+						g_FDC.byCommandReceived = 0;
+						memset(&g_FDC.stStatus, 0, sizeof(g_FDC.stStatus));
+					}
+					else
+					{
+						g_FDC.byCommandReceived = 1;
+						g_FDC.stStatus.byBusy   = 1;
+					}
+				}
+
+				break;
+
+			case 1: // address 0xF1/241, track register
+				g_FDC.byTrack = byData;
+				g_FDC.nWrHostSequence = 0;
+				break;
+
+			case 2: // address 0xF2/242, sector register
+				g_FDC.bySector        = byData;
+				g_FDC.nWrHostSequence = 0;
+				break;
+
+			case 3: // address 0xF3/243, data register
+				dwEvents |= EVENT_DATA;
+
+				g_FDC.byData = byData;
+
+				if (g_FDC.byIsrDataWrite)
+				{
+					// sector or track write in progress, store the byte and keep DRQ
+					// set until the last byte has been received
+					if (g_ptdTrack->pbyWritePtr < (g_ptdTrack->byTrackData + sizeof(g_ptdTrack->byTrackData)))
+					{
+						*g_ptdTrack->pbyWritePtr = byData;
+						++g_ptdTrack->pbyWritePtr;
+					}
+
+					--g_ptdTrack->nWriteCount;
+
+					if (g_ptdTrack->nWriteCount <= 0)
+					{
+						g_FDC.stStatus.byDataRequest = 0;
+						g_FDC.byIsrDataWrite         = 0;
+					}
+
+					break;
+				}
+
+				g_FDC.stStatus.byDataRequest = 0;
+				DetectHostSequnce(byData);
+				break;
+		}
+
+		#if (ENABLE_TRACE_LOG == 1)
+			RecordBusHistory(dwBus, byData);
+		#endif
+	}
+
+	if ((dwBus & WRNMI_MASK) == 0) // WRNMI (WRITE to FDC)
+	{
+		++byReqCount;
+
+		g_FDC.byNmiMaskReg = byData;
+
+		if (byData & 0x80)
+		{
+			g_FDC.byNmiMaskReg = byData;
+		}
+		else
+		{
+			g_FDC.stStatus.byIntrRequest = 0;
+		}
+
+		#if (ENABLE_TRACE_LOG == 1)
+			RecordBusHistory(dwBus, byData);
+		#endif
+	}
+
+	if ((dwBus & DRVSEL_MASK) == 0) // DRVSEL (WRITE to FDC)
+	{
+		++byReqCount;
+		byUpdateStatus = 1;
+		dwEvents |= EVENT_DRIVE_SEL;
+
+		if (((byData & 0x0F) == 0x0F) && // host drive select?
+			(g_FDC.byBackupDriveSel == 0))
+		{
+			g_FDC.byBackupDriveSel = g_FDC.byDriveSel;
+		}
+
+		g_FDC.byDriveSel = byData;
+
+		++g_FDC.nDrvSelWriteCount;
+
+		// do not allow a wait output if WAITTIMEOUT, INTRQ or DRQ are active
+		if ((g_FDC.stStatus.byIntrRequest == 0) && (g_FDC.byIsrDataRead == 0) && (g_FDC.byIsrDataWrite == 0))
+		{
+			// in "real" hardware the wait is activated on rising edge of the DRV_SEL input
+			// here it is already activated by the PIO code on every FDC read/write operation
+			if ((byData & 0x40) != 0) // activate WAIT
+			{
+				TimerStart(tmWaitTimeout, 2000);
+				g_FDC.byWaitOutput = 1;
+				byReleaseWait = 0;
+			}
+		}
+
+		TimerStart(tmMotorOn, 2000000);
+
+		if (ENABLE_LED)
+		{
+			BusSetLed(0);
+		}
+
+		#if (ENABLE_TRACE_LOG == 1)
+			RecordBusHistory(dwBus, byData);
+		#endif
+	}
+
+	if (byReqCount > 1)
+	{
+		++byReqCount;
+	}
+
+	if (byReleaseWait)
+	{
+		// re-enable automatic WAIT generation
+		ReleaseWait(); // allow pio state machine to resume
+	}
+
+	if (byUpdateStatus)
+	{
+		FdcUpdateStatus();
+	}
+
+	if (dwEvents)
+	{
+		PostEvent(dwEvents);
+	}
+
+	BusClearIntr();
+
+	dwCycles = (dwStartCycles - BusGetCycles()) & 0x00FFFFFF;
+
+	++g_fsStats.dwIsrCalls;
+	g_fsStats.nIsrCycles += dwCycles;
+
+	if (dwCycles > g_fsStats.dwIsrCyclesMax)
+	{
+		g_fsStats.dwIsrCyclesMax = dwCycles;
+	}
+}
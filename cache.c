@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "fdc.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// Track cache
+//
+// Holds up to TRACK_CACHE_SLOTS decoded tracks keyed by (drive, side, track) so that
+// drive to drive copies and repeated visits to the directory track do not have to
+// read the track from the SD-Card again.  When all slots are in use the least
+// recently used slot is handed out for reuse.  It is the responsibility of the
+// caller to write back a dirty slot before reusing it.
+//
+// The RAM disk images (ramdisk.c) are held at the end of the TRACK_CACHE_RAM_BUDGET
+// bytes of g_tcrTrackCache, which is not a whole number of slots.  Only the
+// g_nTrackCacheSlots slots below the images are used by the cache.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+static union {
+	TrackType td[TRACK_CACHE_SLOTS];
+	BYTE      by[TRACK_CACHE_RAM_BUDGET];
+} g_tcrTrackCache;
+
+#define g_tdTrackCache g_tcrTrackCache.td
+
+int                 g_nTrackCacheSlots;		// slots not covered by RAM disk images
+TrackType*          g_ptdTrack;
+TrackCacheStatsType g_tcsStats;
+DWORD               g_dwTrackCacheStamp;
+
+//-----------------------------------------------------------------------------
+static void TrackCacheClearSlot(TrackType* ptdTrack)
+{
+	ptdTrack->nDrive       = -1;
+	ptdTrack->nSide        = -1;
+	ptdTrack->nTrack       = -1;
+	ptdTrack->byDirty      = 0;
+	ptdTrack->byPrefetched = 0;
+	ptdTrack->dwLastUsed   = 0;
+}
+
+//-----------------------------------------------------------------------------
+void TrackCacheInit(void)
+{
+	int i;
+
+	for (i = 0; i < TRACK_CACHE_SLOTS; ++i)
+	{
+		TrackCacheClearSlot(&g_tdTrackCache[i]);
+	}
+
+	memset(&g_tcsStats, 0, sizeof(g_tcsStats));
+
+	g_nTrackCacheSlots  = TRACK_CACHE_SLOTS;
+	g_dwTrackCacheStamp = 0;
+	g_ptdTrack          = &g_tdTrackCache[0];
+}
+
+//-----------------------------------------------------------------------------
+// returns the slot holding the specified track, or NULL if it is not in the cache
+//
+TrackType* TrackCacheFind(int nDrive, int nSide, int nTrack)
+{
+	int i;
+
+	for (i = 0; i < g_nTrackCacheSlots; ++i)
+	{
+		if ((g_tdTrackCache[i].nDrive == nDrive) && (g_tdTrackCache[i].nSide == nSide) && (g_tdTrackCache[i].nTrack == nTrack))
+		{
+			g_tdTrackCache[i].dwLastUsed = ++g_dwTrackCacheStamp;
+			++g_tcsStats.dwHits;
+
+			if (g_tdTrackCache[i].byPrefetched)
+			{
+				g_tdTrackCache[i].byPrefetched = 0;
+				++g_tcsStats.dwPrefetchHits;
+			}
+
+			return &g_tdTrackCache[i];
+		}
+	}
+
+	++g_tcsStats.dwMisses;
+
+	return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// same as TrackCacheFind() but does not update the access stamp or the counters
+//
+BYTE TrackCacheContains(int nDrive, int nSide, int nTrack)
+{
+	int i;
+
+	for (i = 0; i < g_nTrackCacheSlots; ++i)
+	{
+		if ((g_tdTrackCache[i].nDrive == nDrive) && (g_tdTrackCache[i].nSide == nSide) && (g_tdTrackCache[i].nTrack == nTrack))
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+//-----------------------------------------------------------------------------
+// returns the slot to be used for the next track load.  An unused slot is
+// returned if there is one, otherwise the least recently used slot.  The
+// active track (g_ptdTrack) is only returned if the cache has a single slot,
+// even when it is unused (a command may be about to load it).
+//
+TrackType* TrackCacheGetVictim(void)
+{
+	TrackType* ptdVictim = NULL;
+	int        i;
+
+	for (i = 0; i < g_nTrackCacheSlots; ++i)
+	{
+		if (&g_tdTrackCache[i] == g_ptdTrack)
+		{
+			continue;
+		}
+
+		if (g_tdTrackCache[i].nDrive < 0)
+		{
+			return &g_tdTrackCache[i];
+		}
+
+		if ((ptdVictim == NULL) || (g_tdTrackCache[i].dwLastUsed < ptdVictim->dwLastUsed))
+		{
+			ptdVictim = &g_tdTrackCache[i];
+		}
+	}
+
+	if (ptdVictim == NULL)
+	{
+		ptdVictim = g_ptdTrack;
+	}
+
+	if (ptdVictim->nDrive >= 0)
+	{
+		++g_tcsStats.dwEvictions;
+	}
+
+	return ptdVictim;
+}
+
+//-----------------------------------------------------------------------------
+TrackType* TrackCacheGetSlot(int nSlot)
+{
+	if ((nSlot < 0) || (nSlot >= g_nTrackCacheSlots))
+	{
+		return NULL;
+	}
+
+	return &g_tdTrackCache[nSlot];
+}
+
+//-----------------------------------------------------------------------------
+// tags a slot (normally one returned by TrackCacheGetVictim()) with the track it now holds
+//
+void TrackCacheAssign(TrackType* ptdTrack, int nDrive, int nSide, int nTrack)
+{
+	ptdTrack->nDrive       = nDrive;
+	ptdTrack->nSide        = nSide;
+	ptdTrack->nTrack       = nTrack;
+	ptdTrack->byDirty      = 0;
+	ptdTrack->nDirtyStart  = 0;
+	ptdTrack->nDirtyEnd    = 0;
+	ptdTrack->byPrefetched = 0;
+	ptdTrack->nTurboPosition = -1;
+	ptdTrack->dwLastUsed   = ++g_dwTrackCacheStamp;
+}
+
+//-----------------------------------------------------------------------------
+// discards all slots for the specified drive (-1 for all drives).
+// dirty slots must be written back before calling this.
+//
+void TrackCacheInvalidate(int nDrive)
+{
+	int i;
+
+	for (i = 0; i < g_nTrackCacheSlots; ++i)
+	{
+		if ((nDrive < 0) || (g_tdTrackCache[i].nDrive == nDrive))
+		{
+			g_tdTrackCache[i].nDrive  = -1;
+			g_tdTrackCache[i].nSide   = -1;
+			g_tdTrackCache[i].nTrack  = -1;
+			g_tdTrackCache[i].byDirty = 0;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+int TrackCacheSlotCount(void)
+{
+	return g_nTrackCacheSlots;
+}
+
+//-----------------------------------------------------------------------------
+// returns the end of the RAM of the track cache, the RAM disk images are held below it
+//
+BYTE* TrackCacheRamEnd(void)
+{
+	return g_tcrTrackCache.by + TRACK_CACHE_RAM_BUDGET;
+}
+
+//-----------------------------------------------------------------------------
+// sets the number of bytes at the end of the track cache RAM that are held by RAM
+// disk images.  The slots they cover are taken out of the cache and slots that are
+// no longer covered are returned to it empty.  The slots being taken out must have
+// been written back, and the storage worker must be idle.
+//
+void TrackCacheReserve(DWORD dwBytes)
+{
+	int nSlots, i;
+
+	nSlots = (TRACK_CACHE_RAM_BUDGET - dwBytes) / sizeof(TrackType);
+
+	// the tickets of a returned slot are whatever the image held, so they are set
+	// to a request that has completed
+	for (i = g_nTrackCacheSlots; i < nSlots; ++i)
+	{
+		TrackCacheClearSlot(&g_tdTrackCache[i]);
+		g_tdTrackCache[i].dwLoadTicket = StorageLastTicket();
+		g_tdTrackCache[i].dwIoTicket   = StorageLastTicket();
+	}
+
+	if (g_ptdTrack >= &g_tdTrackCache[nSlots])
+	{
+		g_ptdTrack = &g_tdTrackCache[0];
+	}
+
+	g_nTrackCacheSlots = nSlots;
+}
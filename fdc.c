@@ -11,6 +11,7 @@
 #include "fdc.h"
 #include "ff.h"
 #include "hardware/pio.h"
+#include "hardware/sync.h"
 #include "util.h"
 
 #include "pico/stdlib.h"
@@ -112,11 +113,26 @@ char* g_pszVersion = {"1.1.0"};
 
 FdcType    g_FDC;
 DriveType  g_dtDives[MAX_DRIVES];
-TrackType  g_tdTrack;
 SectorType g_stSector;
+FdcStatsType g_fsStats;
 
 uint64_t g_nMaxSeekTime;
 
+typedef struct {
+	int nDrive;
+	int nSide;
+	int nTrack;
+} PrefetchType;
+
+PrefetchType g_ptPrefetch[PREFETCH_DEPTH];
+int          g_nPrefetchCount;
+int          g_nPrefetchIndex;
+DWORD        g_dwLastCommandTime;
+int          g_nPrevProcessFunction;	// process function of the last pass of the state machine
+
+DWORD        g_dwMaxDirtyAge;		// us a modified track is held before it is written to the SD-Card
+BYTE         g_byPrevDriveSel;
+
 DWORD    g_dwPrevTraceCycleCount = 0;
 
 file*    g_fOpenFile;
@@ -128,10 +144,68 @@ BYTE     g_byBootConfigModified;
 char     g_szFindFilter[80];
 
 #define FIND_MAX_SIZE 100
+#define FIND_MAX_NAME 62		// FileOpen() refuses longer names, so they are not listed
+
+// the fields of a FILINFO that are listed (a FILINFO holds a 256 byte long name)
+typedef struct {
+	DWORD fsize;
+	WORD  fdate;
+	char  fname[FIND_MAX_NAME];
+} FindEntryType;
+
+FindEntryType g_fiFindResults[FIND_MAX_SIZE];
+int           g_nFindIndex;
+int           g_nFindCount;
+
+////////////////////////////////////////////////////////////////////////////////////
+// returns the number after the next comma in *ppsz (0 if there is none) and advances *ppsz to it
+static WORD FdcParseScale(char** ppsz)
+{
+	char* psz = *ppsz;
+
+	while ((*psz != 0) && (*psz != ','))
+	{
+		++psz;
+	}
+
+	if (*psz == ',')
+	{
+		++psz;
+	}
+
+	*ppsz = psz;
 
-FILINFO g_fiFindResults[FIND_MAX_SIZE];
-int     g_nFindIndex;
-int     g_nFindCount;
+	return atoi(psz);
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+// TIMINGn=TURBO (default), REALISTIC (or ACCURATE) or CUSTOM,step%,settle%,rotation%
+void FdcSetTimingProfile(DriveType* pdt, char* psz)
+{
+	psz = SkipBlanks(psz);
+
+	if (strncmp(psz, "CUSTOM", 6) == 0)
+	{
+		pdt->byTimingMode   = eTimingCustom;
+		pdt->wStepScale     = FdcParseScale(&psz);
+		pdt->wSettleScale   = FdcParseScale(&psz);
+		pdt->wRotationScale = FdcParseScale(&psz);
+	}
+	else if ((strncmp(psz, "REALISTIC", 9) == 0) || (strncmp(psz, "ACCURATE", 8) == 0))
+	{
+		pdt->byTimingMode   = eTimingRealistic;
+		pdt->wStepScale     = 100;
+		pdt->wSettleScale   = 100;
+		pdt->wRotationScale = 100;
+	}
+	else
+	{
+		pdt->byTimingMode   = eTimingTurbo;
+		pdt->wStepScale     = 0;
+		pdt->wSettleScale   = 0;
+		pdt->wRotationScale = 0;
+	}
+}
 
 ////////////////////////////////////////////////////////////////////////////////////
 void FdcProcessConfigEntry(char szLabel[], char* psz)
@@ -152,6 +226,20 @@ void FdcProcessConfigEntry(char szLabel[], char* psz)
 	{
 		CopyString(psz, g_dtDives[3].szFileName, sizeof(g_dtDives[3].szFileName)-2);
 	}
+	else if (strcmp(szLabel, "WRITEDELAY") == 0)
+	{
+		g_dwMaxDirtyAge = atoi(psz) * 1000;
+	}
+	else if ((strncmp(szLabel, "TIMING", 6) == 0) && (szLabel[6] >= '0') && (szLabel[6] <= '3') && (szLabel[7] == 0))
+	{
+		FdcSetTimingProfile(&g_dtDives[szLabel[6]-'0'], psz);
+	}
+	else if ((strncmp(szLabel, "RAM", 3) == 0) && (szLabel[3] >= '0') && (szLabel[3] <= '3') && (szLabel[4] == 0))
+	{
+		// RAMn=YES (or ON, 1) holds the image of drive n in RAM, see ramdisk.c
+		psz = SkipBlanks(psz);
+		g_dtDives[szLabel[3]-'0'].byRamDisk = (strncmp(psz, "YES", 3) == 0) || (strncmp(psz, "ON", 2) == 0) || (*psz == '1');
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -177,6 +265,25 @@ int FdcGetDriveIndex(int nDriveSel)
 	return -1;
 }
 
+//-----------------------------------------------------------------------------
+// returns TRUE if the disk in drive nDrive may not be written, either because the
+// media is protected or because the header of its HFE image does not allow writes
+//
+BYTE FdcIsWriteProtected(int nDrive)
+{
+	if (g_FDC.stStatus.byProtected)
+	{
+		return TRUE;
+	}
+
+	if ((g_dtDives[nDrive].nDriveFormat == eHFE) && (g_dtDives[nDrive].hfe.header.write_allowed == 0))
+	{
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
 //----------------------------------------------------------------------------
 BYTE FdcGetCommandType(BYTE byCommand)
 {
@@ -315,7 +422,7 @@ BYTE FdcGetStatus(void)
 		byStatus |= F_HEADLOAD;
 
 		// S6 (PROTECTED) default to 0
-		if (g_FDC.stStatus.byProtected || (g_dtDives[nDrive].nDriveFormat == eHFE))
+		if (FdcIsWriteProtected(nDrive))
 		{
 			byStatus |= 0x40;
 		}
@@ -387,6 +494,24 @@ BYTE FdcGetStatus(void)
 	return byStatus;
 }
 
+//-----------------------------------------------------------------------------
+// recalculates g_FDC.byStatusReg, the value fdc_isr() returns for a status register
+// read.  Status polls are by far the most frequent bus cycle, so the status byte is
+// not built on each read.  Instead it is updated by fdc_isr() after each bus cycle
+// that changes the FDC state and by the main loop after each pass.
+//
+// Interrupts are disabled so that a value calculated by the main loop can not
+// overwrite one stored by fdc_isr() in the middle of the calculation.
+//
+void __not_in_flash_func(FdcUpdateStatus)(void)
+{
+	UINT32 nInterrupts = save_and_disable_interrupts();
+
+	g_FDC.byStatusReg = FdcGetStatus();
+
+	restore_interrupts(nInterrupts);
+}
+
 //-----------------------------------------------------------------------------
 int FdcGetTrackOffset(int nDrive, int nSide, int nTrack)
 {
@@ -401,16 +526,16 @@ int FdcGetTrackOffset(int nDrive, int nSide, int nTrack)
 // calculates the index of the ID Address Mark for the specified physical sector.
 //
 // returns the index of the 0xFE byte in the sector byte sequence 0xA1, 0xA1, 0xA1, 0xFE
-// in the g_tdTrack.byTrackData[] address
+// in the ptdTrack->byTrackData[] address
 //
-int FdcGetIDAM_Index(int nSector)
+int FdcGetIDAM_Index(TrackType* ptdTrack, int nSector)
 {
 	BYTE* pby;
 	WORD  wIDAM;
 	int   nSectorOffset;
 
 	// get IDAM pointer for the specified track
-	pby = g_tdTrack.byTrackData + nSector * 2;
+	pby = ptdTrack->byTrackData + nSector * 2;
 
 	// get IDAM value for the specified track
 	wIDAM = (*(pby+1) << 8) + *pby;
@@ -421,41 +546,6 @@ int FdcGetIDAM_Index(int nSector)
 	return nSectorOffset;
 }
 
-//-----------------------------------------------------------------------------
-// determines the index of the Data Address Mark for the specified locical sector.
-//
-// returns the index of the 0xFE byte in the sector byte sequence 0xA1, 0xA1, 0xA1, 0xFE
-// in the g_tdTrack.byTrackData[] address for the specified sector.
-//
-int FdcGetSectorIDAM_Offset(int nSide, int nTrack, int nSector)
-{
-	BYTE* pby;
-	int   i, nOffset;
-
-	for (i = 0; i < 0x80; ++i)
-	{
-		nOffset = FdcGetIDAM_Index(i);
-
-		// bySectorData[nOffset-3] should be 0xA1
-		// bySectorData[nOffset-2] should be 0xA1
-		// bySectorData[nOffset-1] should be 0xA1
-		// bySectorData[nOffset]   should be 0xFE
-		// bySectorData[nOffset+1] is track address (should be the same as the nTrack parameter)
-		// bySectorData[nOffset+2] side number		(should be the same as the nSide parameter)
-		// bySectorData[nOffset+3] sector number    (should be the same as the nSector parameter)
-		// bySectorData[nOffset+4] byte length (log 2, minus seven), 0 => 128 bytes; 1 => 256 bytes; etc.
-
-		pby = g_tdTrack.byTrackData + nOffset;
-
-		if ((*(pby+1) == nTrack) && (*(pby+2) == nSide) && (*(pby+3) == nSector))
-		{
-			return nOffset;
-		}
-	}
-
-	return -1;
-}
-
 //-----------------------------------------------------------------------------
 // returns TRUE if the byte sequence starting at pbt is one of the following
 //					- 0xA1, 0xA1, 0xA1, 0xFB
@@ -494,293 +584,983 @@ BYTE FdcIsDataStartPatern(BYTE* pby)
 }
 
 //-----------------------------------------------------------------------------
-int FdcGetDAM_Offset(TrackType* ptdTrack, int nSectorIDAM)
+// returns the offset of the first 0xA1 of a 0xA1, 0xA1, 0xA1, 0xFB/0xF8 sequence
+// that starts at or after nStart and before nEnd, or -1 if there is none.
+//
+int FdcFindDAM_Offset(TrackType* ptdTrack, int nStart, int nEnd)
 {
-	int nDataOffset = nSectorIDAM;
-	
-	if (nSectorIDAM < 0)
+	if (nEnd > (ptdTrack->nTrackSize - 3))
 	{
-		return -1;
+		nEnd = ptdTrack->nTrackSize - 3;
 	}
 
-	// locate the byte sequence 0xA1, 0xA1, 0xA1, 0xFB/0xF8
-	while (nDataOffset < ptdTrack->nTrackSize)
+	while (nStart < nEnd)
 	{
-		if (FdcIsDataStartPatern(g_tdTrack.byTrackData+nDataOffset))
-		{
-			return nDataOffset;
-		}
-		else
+		if (FdcIsDataStartPatern(ptdTrack->byTrackData+nStart))
 		{
-			++nDataOffset;
+			return nStart;
 		}
+
+		++nStart;
 	}
-	
+
 	return -1;
 }
 
 //-----------------------------------------------------------------------------
-void FdcFillSectorOffset(TrackType* ptdTrack)
+void FdcClearSectorIndex(TrackType* ptdTrack)
 {
 	int i;
-	
+
 	for (i = 0; i < 0x80; ++i)
 	{
-		ptdTrack->nSectorIDAM[i] = FdcGetSectorIDAM_Offset(ptdTrack->nSide, ptdTrack->nTrack, i);
-		ptdTrack->nSectorDAM[i]  = FdcGetDAM_Offset(ptdTrack, ptdTrack->nSectorIDAM[i]);
+		ptdTrack->nSectorIDAM[i]        = -1;
+		ptdTrack->nSectorDAM[i]         = -1;
+		ptdTrack->nSectorSize[i]        = 0;
+		ptdTrack->bySectorIdCrcOk[i]    = 0;
+		ptdTrack->nSectorIDAM_BitPos[i] = -1;
+		ptdTrack->nSectorDAM_BitPos[i]  = -1;
 	}
 }
 
 //-----------------------------------------------------------------------------
-void FdcReadDmkTrack(int nDrive, int nSide, int nTrack)
+// returns the CRC of an address mark at pbyMark and the nSize bytes that follow it.
+// In double density the CRC also covers the three 0xA1 bytes in front of the mark.
+//
+WORD FdcCalculateMarkCRC(TrackType* ptdTrack, BYTE* pbyMark, int nSize)
 {
-	int nTrackOffset;
-	
-	g_tdTrack.nType = eDMK;
-
-	// check if specified track is already in memory
-	if ((g_tdTrack.nDrive == nDrive) && (g_tdTrack.nSide == nSide) && (g_tdTrack.nTrack == nTrack))
-	{
-		return;
-	}
-
-	if ((nDrive < 0) || (nDrive >= MAX_DRIVES) || (g_dtDives[nDrive].f == NULL))
+	if (ptdTrack->byDensity == eSD)
 	{
-		return;
+		return Calculate_CRC_CCITT(pbyMark, nSize+1);
 	}
 
-	nTrackOffset = FdcGetTrackOffset(nDrive, nSide, nTrack);
-
-	FileSeek(g_dtDives[nDrive].f, nTrackOffset);
-	FileRead(g_dtDives[nDrive].f, g_tdTrack.byTrackData, g_dtDives[nDrive].dmk.wTrackLength);
-
-	g_tdTrack.nDrive     = nDrive;
-	g_tdTrack.nSide      = nSide;
-	g_tdTrack.nTrack     = nTrack;
-	g_tdTrack.nTrackSize = g_dtDives[nDrive].dmk.wTrackLength;
-
-	FdcFillSectorOffset(&g_tdTrack);
+	return Calculate_CRC_CCITT(pbyMark-3, nSize+4);
 }
 
 //-----------------------------------------------------------------------------
-void FdcReadHfeTrack(int nDrive, int nSide, int nTrack)
+// adds one sector to the sector index of the track.  Used by both the DMK and HFE
+// track loaders so that the rest of the FDC only deals with a single layout.
+//
+// nIDAM is the offset of the 0xFE byte in the sequence 0xA1, 0xA1, 0xA1, 0xFE
+// nDAM  is the offset of the first 0xA1 in the sequence 0xA1, 0xA1, 0xA1, 0xFB/0xF8 (-1 if none)
+//
+// single density tracks hold 0x00 in place of each 0xA1.
+//
+// returns the sector number from the ID field, or -1 if the sector was not added
+// (ID field for a different track/side, or a second ID field with the same sector number).
+//
+int FdcIndexSector(TrackType* ptdTrack, int nIDAM, int nDAM)
 {
-	int nTrackOffset;
-	
-	g_tdTrack.nType = eHFE;
+	BYTE* pby;
+	WORD  wCRC16;
+	int   nSector;
 
-	// check if specified track is already in memory
-	if ((g_tdTrack.nDrive == nDrive) && (g_tdTrack.nSide == nSide) && (g_tdTrack.nTrack == nTrack))
+	if ((nIDAM < 3) || ((nIDAM + 7) > ptdTrack->nTrackSize))
 	{
-		return;
+		return -1;
 	}
 
-	if ((nDrive < 0) || (nDrive >= MAX_DRIVES) || (g_dtDives[nDrive].f == NULL))
+	// pby[0] 0xFE
+	// pby[1] track address (should be the same as ptdTrack->nTrack)
+	// pby[2] side number   (should be the same as ptdTrack->nSide)
+	// pby[3] sector number
+	// pby[4] byte length (log 2, minus seven), 0 => 128 bytes; 1 => 256 bytes; etc.
+	// pby[5..6] CRC (in double density the calculation starts with the three 0xA1 bytes preceeding the 0xFE)
+	pby = ptdTrack->byTrackData + nIDAM;
+
+	if ((*(pby+1) != ptdTrack->nTrack) || (*(pby+2) != ptdTrack->nSide))
 	{
-		return;
+		return -1;
 	}
 
-	LoadHfeTrack(g_dtDives[nDrive].f, nTrack, nSide, &g_dtDives[nDrive].hfe, &g_tdTrack, g_tdTrack.byTrackData, sizeof(g_tdTrack.byTrackData));
+	nSector = *(pby+3);
 
-	g_tdTrack.nDrive = nDrive;
-	g_tdTrack.nSide  = nSide;
-	g_tdTrack.nTrack = nTrack;
+	if ((nSector >= 0x80) || (ptdTrack->nSectorIDAM[nSector] >= 0))
+	{
+		return -1;
+	}
+
+	wCRC16 = FdcCalculateMarkCRC(ptdTrack, pby, 4);
+
+	ptdTrack->nSectorIDAM[nSector]     = nIDAM;
+	ptdTrack->nSectorDAM[nSector]      = nDAM;
+	ptdTrack->nSectorSize[nSector]     = 128 << (*(pby+4) & 0x03);
+	ptdTrack->bySectorIdCrcOk[nSector] = (wCRC16 == ((*(pby+5) << 8) + *(pby+6)));
+
+	return nSector;
 }
 
 //-----------------------------------------------------------------------------
-void FdcReadTrack(int nDrive, int nSide, int nTrack)
+// builds the sector index of a DMK track in a single pass over its IDAM pointer table.
+// the Data Address Mark of each sector is searched for between its ID field and the
+// next ID field.
+//
+// pfRead is the file of a read started by FileReadStart() that is advanced after
+// each sector, NULL if there is none.
+//
+void FdcIndexDmkTrack(TrackType* ptdTrack, file* pfRead)
 {
-	switch (g_dtDives[nDrive].nDriveFormat)
+	int i, nIDAM, nNext, nEnd;
+
+	FdcClearSectorIndex(ptdTrack);
+
+	nIDAM = FdcGetIDAM_Index(ptdTrack, 0);
+
+	for (i = 0; (i < DMK_IDAM_TABLE_SIZE) && (nIDAM != 0); ++i)
 	{
-		case eDMK:
-			FdcReadDmkTrack(nDrive, nSide, nTrack);
-			break;
+		nNext = 0;
 
-		case eHFE:
-			FdcReadHfeTrack(nDrive, nSide, nTrack);
-			break;
+		if ((i + 1) < DMK_IDAM_TABLE_SIZE)
+		{
+			nNext = FdcGetIDAM_Index(ptdTrack, i + 1);
+		}
+
+		nEnd = ptdTrack->nTrackSize;
+
+		if (nNext > nIDAM)
+		{
+			nEnd = nNext;
+		}
+
+		FdcIndexSector(ptdTrack, nIDAM, FdcFindDAM_Offset(ptdTrack, nIDAM + 7, nEnd));
+
+		if (pfRead != NULL)
+		{
+			FileReadPoll(pfRead);
+		}
+
+		nIDAM = nNext;
 	}
 }
 
 //-----------------------------------------------------------------------------
-int FindSectorIndex(int nSector, TrackType* ptrack)
+// starts reading a DMK track, the read is completed by FdcFinishTrackLoad().
+// the track of an image held in RAM is copied before it returns.
+//
+void FdcStartDmkTrack(TrackType* ptdTrack)
 {
-	int i;
+	int nDrive = ptdTrack->nDrive;
+
+	ptdTrack->nType       = eDMK;
+	ptdTrack->byDensity   = eDD;
+	ptdTrack->nFileOffset = FdcGetTrackOffset(nDrive, ptdTrack->nSide, ptdTrack->nTrack);
+	ptdTrack->nTrackSize  = g_dtDives[nDrive].dmk.wTrackLength;
+
+	ptdTrack->nIndexOffset    = DMK_IDAM_TABLE_SIZE * 2;
+	ptdTrack->nRevolutionSize = ptdTrack->nTrackSize - ptdTrack->nIndexOffset;
 
-	// locate sector
-	for (i = 0; i < MAX_SECTORS_PER_TRACK; ++i)
+	if (g_dtDives[nDrive].pbyRamImage != NULL)
 	{
-		if (ptrack->byTrackData[ptrack->nSectorIDAM[i]+6] == nSector)
-		{
-			return i;
-		}
+		RamDiskReadTrack(nDrive, ptdTrack->nFileOffset, ptdTrack->byTrackData, g_dtDives[nDrive].dmk.wTrackLength);
+		return;
 	}
 
-	return 0;
+	FileSeek(g_dtDives[nDrive].f, ptdTrack->nFileOffset);
+	FileReadStart(g_dtDives[nDrive].f, ptdTrack->byTrackData, g_dtDives[nDrive].dmk.wTrackLength);
 }
 
 //-----------------------------------------------------------------------------
-WORD FdcGetDmkSectorCRC(int nDrive, int nDataOffset)
+void FdcReadHfeTrack(TrackType* ptdTrack)
 {
-	WORD wCRC16;
+	int nDrive = ptdTrack->nDrive;
 
-	wCRC16  = g_tdTrack.byTrackData[nDataOffset+g_dtDives[nDrive].dmk.nSectorSize+4] << 8;
-	wCRC16 += g_tdTrack.byTrackData[nDataOffset+g_dtDives[nDrive].dmk.nSectorSize+5];
+	ptdTrack->nType      = eHFE;
+	ptdTrack->nTrackSize = sizeof(ptdTrack->byTrackData);
 
-	return wCRC16;
+	LoadHfeTrack(g_dtDives[nDrive].f, ptdTrack->nTrack, ptdTrack->nSide, &g_dtDives[nDrive].hfe, ptdTrack, ptdTrack->byTrackData, sizeof(ptdTrack->byTrackData));
 }
 
 //-----------------------------------------------------------------------------
-void FdcReadDmkSector(int nDriveSel, int nSide, int nTrack, int nSector)
+// Track loads are made in three steps by the storage worker on core1 (srLoadTrack
+// requests), so that the read of the next queued track can be in progress while
+// the current track is decoded:
+//
+//   FdcStartTrackLoad()  - starts reading a DMK track, the whole sectors of a
+//                          contiguous image are received by DMA after it returns.
+//   FdcFinishTrackLoad() - waits for the end of the read (reads an HFE track).
+//   FdcDecodeTrack()     - builds the sector index of a DMK track, advancing the
+//                          read of the next track after each sector.
+//
+// returns TRUE if the load has been started, FALSE if it is made by FdcFinishTrackLoad()
+// (HFE tracks, and DMK tracks held in RAM which have nothing to overlap)
+//
+BYTE FdcStartTrackLoad(TrackType* ptdTrack)
 {
-	BYTE* pby;
-	WORD  wCRC16;
-	int   nDrive, nDataOffset;
-
-	nDrive = FdcGetDriveIndex(nDriveSel);
-	
-	if (nDrive < 0)
+	if ((g_dtDives[ptdTrack->nDrive].nDriveFormat != eDMK) || (g_dtDives[ptdTrack->nDrive].pbyRamImage != NULL))
 	{
-		return;
+		return FALSE;
 	}
 
-	FdcReadTrack(nDrive, nSide, nTrack);
+	FdcStartDmkTrack(ptdTrack);
 
-	g_tdTrack.nFileOffset = FdcGetTrackOffset(nDrive, nSide, nTrack);
+	return TRUE;
+}
 
-	// get pointer to start of sector data
-	pby = g_tdTrack.byTrackData + g_tdTrack.nSectorIDAM[nSector];
+//-----------------------------------------------------------------------------
+// byStarted is the value returned by FdcStartTrackLoad() for this track, FALSE if
+// it has not been called
+//
+void FdcFinishTrackLoad(TrackType* ptdTrack, BYTE byStarted)
+{
+	int nDrive = ptdTrack->nDrive;
 
-	// g_FDC.byTrackData[nSide][g_FDC.nTrackSectorOffset-3] should be 0xA1 or 0xF5
-	// g_FDC.byTrackData[nSide][g_FDC.nTrackSectorOffset-2] should be 0xA1 or 0xF5
-	// g_FDC.byTrackData[nSide][g_FDC.nTrackSectorOffset-1] should be 0xA1 or 0xF5
-	// g_FDC.byTrackData[nSide][g_FDC.nTrackSectorOffset+0] should be 0xFE
-	// g_FDC.byTrackData[nSide][g_FDC.nTrackSectorOffset+1] is track address (should be the same as the nTrack parameter)
-	// g_FDC.byTrackData[nSide][g_FDC.nTrackSectorOffset+2] side number		 (should be the same as the nSide parameter)
-	// g_FDC.byTrackData[nSide][g_FDC.nTrackSectorOffset+3] sector number    (should be the same as the nSector parameter)
-	// g_FDC.byTrackData[nSide][g_FDC.nTrackSectorOffset+4] byte length (log 2, minus seven), 0 => 128 bytes; 1 => 256 bytes; etc.
+	switch (g_dtDives[nDrive].nDriveFormat)
+	{
+		case eDMK:
+			if (!byStarted)
+			{
+				FdcStartDmkTrack(ptdTrack);
+			}
 
-	g_stSector.nSectorSize = 128 << *(pby+4);
-	g_dtDives[nDrive].dmk.nSectorSize = g_stSector.nSectorSize;
+			if (g_dtDives[nDrive].pbyRamImage == NULL)
+			{
+				g_tcsStats.dwBytesRead += FileReadComplete(g_dtDives[nDrive].f);
+			}
+			break;
 
-	// g_FDC.byTrackData[g_FDC.nSectorOffset+5..6] CRC (calculation starts with the three 0xA1/0xF5 bytes preceeding the 0xFE)
-	g_FDC.stStatus.byCrcError = 0;
+		case eHFE:
+			FdcReadHfeTrack(ptdTrack);
+			break;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// ptdLoading is the track being read after FdcStartTrackLoad() returned TRUE for it
+// (its read is advanced while this track is decoded), NULL if there is none
+//
+void FdcDecodeTrack(TrackType* ptdTrack, TrackType* ptdLoading)
+{
+	file* pfRead = NULL;
 
-	if (g_tdTrack.nSectorIDAM[nSector] <= 0)
+	if (ptdLoading != NULL)
 	{
-		g_stSector.nSectorDataOffset = 0; // then there is a problem and we will let the Z80 deal with it
-		g_FDC.stStatus.byRecordType  = 0;
-		g_FDC.stStatus.byNotFound    = 1;
-		return;
+		pfRead = g_dtDives[ptdLoading->nDrive].f;
 	}
 
-	wCRC16 = Calculate_CRC_CCITT(pby-3, 8);
-	
-	if (wCRC16 != ((g_tdTrack.byTrackData[g_tdTrack.nSectorIDAM[nSector]+5] << 8) + g_tdTrack.byTrackData[g_tdTrack.nSectorIDAM[nSector]+6]))
+	if (ptdTrack->nType == eDMK)
 	{
-		g_FDC.stStatus.byCrcError = 1;
+		FdcIndexDmkTrack(ptdTrack, pfRead);
 	}
-	
-	nDataOffset = g_tdTrack.nSectorDAM[nSector];	// offset to first bytes of the sector data mark sequence (0xA1, 0xA1, 0xA1, 0xFB/0xF8)
-													//  - 0xFB (regular data); or
-													//  - 0xF8 (deleted data)
-													// actual data starts after the 0xFB/0xF8 byte
-	if (nDataOffset < 0)
+}
+
+//-----------------------------------------------------------------------------
+// records that nSize bytes at nOffset of byTrackData have been modified.  Multiple
+// modifications are merged into a single range that is written by FdcWriteBackTrack().
+//
+void FdcMarkTrackDirty(TrackType* ptdTrack, int nOffset, int nSize)
+{
+	if (ptdTrack->byDirty == 0)
 	{
-		g_stSector.nSectorDataOffset = 0; // then there is a problem and we will let the Z80 deal with it
-		g_FDC.stStatus.byRecordType  = 0;
-		g_FDC.stStatus.byNotFound    = 1;
+		ptdTrack->byDirty     = 1;
+		ptdTrack->nDirtyStart = nOffset;
+		ptdTrack->nDirtyEnd   = nOffset + nSize;
+		ptdTrack->dwDirtyTime = time_us_32();
 		return;
 	}
 
-	// nDataOffset is the index of the first 0xA1 byte in the 0xA1, 0xA1, 0xA1, 0xFB/0xF8 sequence
-
-	g_FDC.byRecordMark           = g_tdTrack.byTrackData[nDataOffset+3];
-	g_stSector.nSectorDataOffset = nDataOffset + 4;
-	g_FDC.stStatus.byNotFound    = 0;
-	g_FDC.stStatus.byRecordType  = 0xFB;	// will get set to g_FDC.byRecordMark after a few status reads
-
-	// perform a CRC on the sector data (including preceeding 4 bytes) and validate
-	wCRC16 = Calculate_CRC_CCITT(&g_tdTrack.byTrackData[nDataOffset], g_dtDives[nDrive].dmk.nSectorSize+4);
+	if (nOffset < ptdTrack->nDirtyStart)
+	{
+		ptdTrack->nDirtyStart = nOffset;
+	}
 
-	if (wCRC16 != FdcGetDmkSectorCRC(nDrive, nDataOffset))
+	if ((nOffset + nSize) > ptdTrack->nDirtyEnd)
 	{
-		g_FDC.stStatus.byCrcError = 1;
+		ptdTrack->nDirtyEnd = nOffset + nSize;
 	}
 }
 
 //-----------------------------------------------------------------------------
-void FdcReadHfeSector(int nDriveSel, int nSide, int nTrack, int nSector)
+// queues the modified range of a track to be written back to the SD-Card and marks it as clean
+//
+void FdcWriteBackTrack(TrackType* ptdTrack)
 {
-	BYTE* pby;
-	WORD  wCRC16;
-	int   i, nDrive, nDataOffset;
-
-	nDrive = FdcGetDriveIndex(nDriveSel);
-	
-	if (nDrive < 0)
+	if (ptdTrack->byDirty == 0)
 	{
 		return;
 	}
 
-	FdcReadTrack(nDrive, nSide, nTrack);
+	FdcWriteTrack(ptdTrack);
 
-	// g_FDC.byTrackData[nSide][g_FDC.nTrackSectorOffset-3] should be 0xA1 or 0xF5
-	// g_FDC.byTrackData[nSide][g_FDC.nTrackSectorOffset-2] should be 0xA1 or 0xF5
-	// g_FDC.byTrackData[nSide][g_FDC.nTrackSectorOffset-1] should be 0xA1 or 0xF5
-	// g_FDC.byTrackData[nSide][g_FDC.nTrackSectorOffset+0] should be 0xFE
-	// g_FDC.byTrackData[nSide][g_FDC.nTrackSectorOffset+1] is track address (should be the same as the nTrack parameter)
-	// g_FDC.byTrackData[nSide][g_FDC.nTrackSectorOffset+2] side number		 (should be the same as the nSide parameter)
-	// g_FDC.byTrackData[nSide][g_FDC.nTrackSectorOffset+3] sector number    (should be the same as the nSector parameter)
-	// g_FDC.byTrackData[nSide][g_FDC.nTrackSectorOffset+4] byte length (log 2, minus seven), 0 => 128 bytes; 1 => 256 bytes; etc.
-	// g_FDC.byTrackData[nSide][g_FDC.nSectorOffset+5..6] CRC (calculation starts with the three 0xA1/0xF5 bytes preceeding the 0xFE)
-	g_FDC.stStatus.byCrcError = 0;
+	ptdTrack->byDirty     = 0;
+	ptdTrack->nDirtyStart = 0;
+	ptdTrack->nDirtyEnd   = 0;
+	++g_tcsStats.dwWriteBacks;
+}
 
-	i = FindSectorIndex(nSector, &g_tdTrack);
+//-----------------------------------------------------------------------------
+static DWORD FdcEarliestDelay(DWORD dwDelay, DWORD dwAge, DWORD dwIdle)
+{
+	if (dwAge > dwIdle)
+	{
+		dwAge = dwIdle;
+	}
 
-	g_FDC.byRecordMark           = g_tdTrack.byTrackData[g_tdTrack.nSectorDAM[i] + 3];
-	g_stSector.nSectorDataOffset = g_tdTrack.nSectorDAM[FindSectorIndex(nSector, &g_tdTrack)] + 4;
-	g_stSector.nSectorSize       = 128 << g_tdTrack.byTrackData[g_tdTrack.nSectorIDAM[i] + 7];
-	g_FDC.stStatus.byNotFound    = 0;
-	g_FDC.stStatus.byRecordType  = 0xFB;	// will get set to g_FDC.byRecordMark after a few status reads
+	return (dwAge < dwDelay) ? dwAge : dwDelay;
 }
 
 //-----------------------------------------------------------------------------
-void FdcReadSector(int nDriveSel, int nSide, int nTrack, int nSector)
+// returns the time in us until the write-back of a held write is due, 0 if one is due
+// now and WRITEBACK_NONE if nothing is held.  A write is due WRITEBACK_IDLE_TIME after
+// the last command or g_dwMaxDirtyAge after its first modification.
+//
+DWORD FdcGetWriteBackDelay(void)
 {
-	int nDrive;
+	TrackType* ptdTrack;
+	DWORD      dwNow = time_us_32();
+	DWORD      dwIdle, dwDelay, dwAge;
+	int        i;
 
-	nDrive = FdcGetDriveIndex(nDriveSel);
+	dwIdle  = dwNow - g_dwLastCommandTime;
+	dwIdle  = (dwIdle >= WRITEBACK_IDLE_TIME) ? 0 : WRITEBACK_IDLE_TIME - dwIdle;
+	dwDelay = WRITEBACK_NONE;
 
-	switch (g_dtDives[nDrive].nDriveFormat)
+	for (i = 0; i < TrackCacheSlotCount(); ++i)
 	{
-		case eDMK:
-			FdcReadDmkSector(nDriveSel, nSide, nTrack, nSector);
-			break;
+		ptdTrack = TrackCacheGetSlot(i);
 
-		case eHFE:
-			FdcReadHfeSector(nDriveSel, nSide, nTrack, nSector);
-			break;
+		if (ptdTrack->byDirty)
+		{
+			dwAge   = dwNow - ptdTrack->dwDirtyTime;
+			dwAge   = (dwAge >= g_dwMaxDirtyAge) ? 0 : g_dwMaxDirtyAge - dwAge;
+			dwDelay = FdcEarliestDelay(dwDelay, dwAge, dwIdle);
+		}
 	}
+
+	// the RAM disk writes one run of blocks at a time, when the storage worker is idle
+	for (i = 0; i < MAX_DRIVES; ++i)
+	{
+		if ((g_dtDives[i].pbyRamImage != NULL) && (RamDiskDirtyBlocks(i) != 0))
+		{
+			dwAge   = dwNow - g_dtDives[i].dwRamDirtyTime;
+			dwAge   = (dwAge >= g_dwMaxDirtyAge) ? 0 : g_dwMaxDirtyAge - dwAge;
+			dwDelay = FdcEarliestDelay(dwDelay, dwAge, dwIdle);
+		}
+	}
+
+	return dwDelay;
 }
 
 //-----------------------------------------------------------------------------
-void FdcMountDmkDrive(int nDrive)
+// writes back modified tracks that have been held for longer than the max dirty
+// age, or all of them once the Z80 has stopped issuing commands.  The same applies
+// to the modified blocks of the RAM disk images.  tmWriteBack is started for the
+// next write that is not due yet, so the main loop can sleep until then.
+//
+void FdcServiceWriteBack(void)
 {
-	if (nDrive >= MAX_DRIVES)
-	{
-		return;
-	}
+	TrackType* ptdTrack;
+	DWORD      dwNow = time_us_32();
+	DWORD      dwDelay;
+	BYTE       byIdle;
+	int        i;
 
-	g_dtDives[nDrive].f = FileOpen(g_dtDives[nDrive].szFileName, FA_READ | FA_WRITE);
+	byIdle = ((dwNow - g_dwLastCommandTime) >= WRITEBACK_IDLE_TIME);
 
-	if (g_dtDives[nDrive].f == NULL)
+	for (i = 0; i < TrackCacheSlotCount(); ++i)
 	{
-		return;
+		ptdTrack = TrackCacheGetSlot(i);
+
+		if (ptdTrack->byDirty == 0)
+		{
+			continue;
+		}
+
+		if (byIdle || ((dwNow - ptdTrack->dwDirtyTime) >= g_dwMaxDirtyAge))
+		{
+			FdcWriteBackTrack(ptdTrack);
+		}
+	}
+
+	RamDiskServiceWriteBack(byIdle, g_dwMaxDirtyAge);
+
+	dwDelay = FdcGetWriteBackDelay();
+
+	if ((dwDelay != 0) && (dwDelay != WRITEBACK_NONE) && !TimerIsRunning(tmWriteBack))
+	{
+		TimerStart(tmWriteBack, dwDelay);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// writes back all dirty tracks of the specified drive (-1 for all drives)
+//
+void FdcFlushTrackCache(int nDrive)
+{
+	TrackType* ptdTrack;
+	int        i;
+
+	for (i = 0; i < TrackCacheSlotCount(); ++i)
+	{
+		ptdTrack = TrackCacheGetSlot(i);
+
+		if ((ptdTrack->nDrive >= 0) && ((nDrive < 0) || (ptdTrack->nDrive == nDrive)))
+		{
+			FdcWriteBackTrack(ptdTrack);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// returns the cache slot to hold the specified track, without reading the track.
+// used when the track contents are about to be replaced (Write Track).
+//
+TrackType* FdcGetTrackSlot(int nDrive, int nSide, int nTrack)
+{
+	TrackType* ptdTrack;
+
+	ptdTrack = TrackCacheFind(nDrive, nSide, nTrack);
+
+	if (ptdTrack != NULL)
+	{
+		return ptdTrack;
+	}
+
+	ptdTrack = TrackCacheGetVictim();
+	StorageWait(ptdTrack->dwIoTicket);
+	FdcWriteBackTrack(ptdTrack);
+	TrackCacheAssign(ptdTrack, nDrive, nSide, nTrack);
+
+	return ptdTrack;
+}
+
+//-----------------------------------------------------------------------------
+// queues a read of the specified track from the SD-Card into a free (or the least
+// recently used) cache slot.  The slot can not be used until the request with
+// ticket ptdTrack->dwLoadTicket has completed.
+//
+TrackType* FdcFillTrackSlot(int nDrive, int nSide, int nTrack)
+{
+	StorageRequestType sr;
+	TrackType*         ptdTrack;
+
+	ptdTrack = TrackCacheGetVictim();
+	StorageWait(ptdTrack->dwIoTicket);	// the worker may still be using the slot for its previous track
+	FdcWriteBackTrack(ptdTrack);
+	TrackCacheAssign(ptdTrack, nDrive, nSide, nTrack);
+
+	sr.nRequest  = srLoadTrack;
+	sr.ptdTrack  = ptdTrack;
+
+	ptdTrack->dwLoadTicket = StorageSubmit(&sr);
+	ptdTrack->dwIoTicket   = ptdTrack->dwLoadTicket;
+
+	return ptdTrack;
+}
+
+//-----------------------------------------------------------------------------
+int FdcGetNumSides(int nDrive)
+{
+	switch (g_dtDives[nDrive].nDriveFormat)
+	{
+		case eDMK:
+			return g_dtDives[nDrive].dmk.byNumSides;
+
+		case eHFE:
+			return g_dtDives[nDrive].hfe.header.number_of_sides;
+	}
+
+	return 1;
+}
+
+//-----------------------------------------------------------------------------
+void FdcAddPrefetch(int nDrive, int nSide, int nTrack)
+{
+	if (g_nPrefetchCount >= PREFETCH_DEPTH)
+	{
+		return;
+	}
+
+	if ((nTrack >= g_dtDives[nDrive].byNumTracks) || (nSide >= FdcGetNumSides(nDrive)))
+	{
+		return;
+	}
+
+	g_ptPrefetch[g_nPrefetchCount].nDrive = nDrive;
+	g_ptPrefetch[g_nPrefetchCount].nSide  = nSide;
+	g_ptPrefetch[g_nPrefetchCount].nTrack = nTrack;
+	++g_nPrefetchCount;
+}
+
+//-----------------------------------------------------------------------------
+// queues the tracks most likely to be requested after the specified one.
+// sequential reads of a double sided disk go side 0, side 1, then the next track.
+//
+void FdcSchedulePrefetch(int nDrive, int nSide, int nTrack)
+{
+	g_nPrefetchCount = 0;
+	g_nPrefetchIndex = 0;
+
+	if (nSide == 0)
+	{
+		FdcAddPrefetch(nDrive, 1, nTrack);
+		FdcAddPrefetch(nDrive, 0, nTrack+1);
+	}
+	else
+	{
+		FdcAddPrefetch(nDrive, 0, nTrack+1);
+		FdcAddPrefetch(nDrive, 1, nTrack+1);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// queues a read of one track into a spare cache slot.  Called from the state machine
+// only when no command is in progress and none has been for PREFETCH_IDLE_TIME us
+// (tmPrefetch has expired).  A read-ahead is only queued when
+// the storage worker is idle so that it never delays a track load requested by the Z80,
+// and only when the cache has a slot other than the active track to load it into.
+//
+void FdcServicePrefetch(void)
+{
+	TrackType*    ptdTrack;
+	PrefetchType* ppt;
+
+	if (g_nPrefetchIndex >= g_nPrefetchCount)
+	{
+		return;
+	}
+
+	if (TrackCacheSlotCount() < 2)
+	{
+		g_nPrefetchIndex = g_nPrefetchCount;
+		return;
+	}
+
+	if (TimerIsRunning(tmPrefetch))
+	{
+		return;
+	}
+
+	if (!StorageIsIdle())
+	{
+		return;
+	}
+
+	ppt = &g_ptPrefetch[g_nPrefetchIndex];
+	++g_nPrefetchIndex;
+
+	if (g_dtDives[ppt->nDrive].f == NULL)
+	{
+		return;
+	}
+
+	if (TrackCacheContains(ppt->nDrive, ppt->nSide, ppt->nTrack))
+	{
+		return;
+	}
+
+	ptdTrack = FdcFillTrackSlot(ppt->nDrive, ppt->nSide, ppt->nTrack);
+	ptdTrack->byPrefetched = 1;
+	++g_tcsStats.dwPrefetches;
+}
+
+//-----------------------------------------------------------------------------
+// makes the specified track the active track (g_ptdTrack), reading it from the
+// SD-Card only if it is not already held in the track cache.
+//
+void FdcReadTrack(int nDrive, int nSide, int nTrack)
+{
+	TrackType* ptdTrack;
+	BYTE       byNewTrack;
+
+	if ((nDrive < 0) || (nDrive >= MAX_DRIVES) || (g_dtDives[nDrive].f == NULL))
+	{
+		return;
+	}
+
+	byNewTrack = (g_ptdTrack->nDrive != nDrive) || (g_ptdTrack->nSide != nSide) || (g_ptdTrack->nTrack != nTrack);
+
+	// sector writes are held until the head moves to a different track
+	if (byNewTrack)
+	{
+		FdcWriteBackTrack(g_ptdTrack);
+	}
+
+	ptdTrack = TrackCacheFind(nDrive, nSide, nTrack);
+
+	if (ptdTrack == NULL)
+	{
+		ptdTrack = FdcFillTrackSlot(nDrive, nSide, nTrack);
+	}
+
+	// the slot may still be loading (a read-ahead or the request just queued)
+	StorageWait(ptdTrack->dwLoadTicket);
+
+	g_ptdTrack = ptdTrack;
+
+	if ((ENABLE_TRACK_PREFETCH) && (byNewTrack))
+	{
+		FdcSchedulePrefetch(nDrive, nSide, nTrack);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// rotational position model.
+//
+// FdcGetRotationCount() is the time in us since the last index pulse so the byte under
+// the head is the same fraction of the track as the rotation count is of g_dwRotationTime.
+// All offsets are offsets in ptdTrack->byTrackData.
+//
+DWORD FdcGetRotationCount(void)
+{
+	return ((DWORD)TimerGetTime() - g_FDC.dwIndexStart) % g_dwRotationTime;
+}
+
+//-----------------------------------------------------------------------------
+// called by the tmIndex timer at each edge of the index pulse
+//
+void FdcServiceIndex(void)
+{
+	DWORD dwCount = FdcGetRotationCount();
+
+	if (dwCount < g_dwIndexTime)
+	{
+		g_FDC.dwIndexStart     = (DWORD)TimerGetTime() - dwCount;	// keeps the difference from wrapping around
+		g_FDC.stStatus.byIndex = TimerIsRunning(tmMotorOn);
+		TimerStart(tmIndex, g_dwIndexTime - dwCount);
+	}
+	else
+	{
+		g_FDC.stStatus.byIndex = 0;
+		TimerStart(tmIndex, g_dwRotationTime - dwCount);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// called by the tmMotorOn timer approximately 2 seconds after the last DRV_SEL write
+//
+void FdcMotorOff(void)
+{
+	g_FDC.stStatus.byIndex = 0;
+
+	if (ENABLE_LED)
+	{
+		gpio_put(RED_LED_PIN, 1);
+	}
+}
+
+//-----------------------------------------------------------------------------
+int FdcGetHeadPosition(TrackType* ptdTrack)
+{
+	if ((ptdTrack->nRevolutionSize <= 0) || (g_dwRotationTime == 0))
+	{
+		return ptdTrack->nIndexOffset;
+	}
+
+	return ptdTrack->nIndexOffset + (int)(((UINT64)FdcGetRotationCount() * ptdTrack->nRevolutionSize) / g_dwRotationTime);
+}
+
+//-----------------------------------------------------------------------------
+// returns the number of bytes from nFrom to nOffset in the direction of rotation
+//
+int FdcGetTrackDistance(TrackType* ptdTrack, int nFrom, int nOffset)
+{
+	int nDistance;
+
+	if (ptdTrack->nRevolutionSize <= 0)
+	{
+		return 0;
+	}
+
+	nDistance = (nOffset - nFrom) % ptdTrack->nRevolutionSize;
+
+	if (nDistance < 0)
+	{
+		nDistance += ptdTrack->nRevolutionSize;
+	}
+
+	return nDistance;
+}
+
+//-----------------------------------------------------------------------------
+// returns the number of bytes from the head to nOffset in the direction of rotation
+//
+int FdcGetRotationalDistance(TrackType* ptdTrack, int nOffset)
+{
+	return FdcGetTrackDistance(ptdTrack, FdcGetHeadPosition(ptdTrack), nOffset);
+}
+
+//-----------------------------------------------------------------------------
+// returns the time in us until nOffset reaches the head
+//
+DWORD FdcGetRotationalDelay(TrackType* ptdTrack, int nOffset)
+{
+	if (ptdTrack->nRevolutionSize <= 0)
+	{
+		return 0;
+	}
+
+	return ((UINT64)FdcGetRotationalDistance(ptdTrack, nOffset) * g_dwRotationTime) / ptdTrack->nRevolutionSize;
+}
+
+//-----------------------------------------------------------------------------
+// returns the sector number of the next ID field to reach the head, or -1 if the
+// track has no ID fields.  In turbo mode the search starts at the end of the last
+// field accessed on the track (see FdcScheduleRotation()), so consecutive Read
+// Address commands return consecutive ID fields while the index keeps running.
+//
+int FdcGetNextIDAM_Sector(TrackType* ptdTrack)
+{
+	int nSector, nDistance, nFrom;
+	int nBest = -1;
+	int nBestDistance = 0;
+
+	nFrom = ptdTrack->nTurboPosition;
+
+	if (nFrom < 0)
+	{
+		nFrom = FdcGetHeadPosition(ptdTrack);
+	}
+
+	for (nSector = 0; nSector < 0x80; ++nSector)
+	{
+		if (ptdTrack->nSectorIDAM[nSector] < 0)
+		{
+			continue;
+		}
+
+		// the 0xA1 (0x00) sync bytes in front of the 0xFE
+		nDistance = FdcGetTrackDistance(ptdTrack, nFrom, ptdTrack->nSectorIDAM[nSector] - 3);
+
+		if ((nBest < 0) || (nDistance < nBestDistance))
+		{
+			nBest         = nSector;
+			nBestDistance = nDistance;
+		}
+	}
+
+	return nBest;
+}
+
+//-----------------------------------------------------------------------------
+// returns nScale percent of dwTime
+//
+DWORD FdcScaleTime(DWORD dwTime, WORD wScale)
+{
+	return ((UINT64)dwTime * wScale) / 100;
+}
+
+//-----------------------------------------------------------------------------
+// called by type 2 and 3 commands.  If the E flag is set the head settle time of the
+// drive's timing profile is added to the next FdcScheduleRotation().
+//
+void FdcStartHeadSettle(int nDrive)
+{
+	g_FDC.dwSettleTime = 0;
+
+	if ((nDrive < 0) || (nDrive >= MAX_DRIVES))
+	{
+		return;
+	}
+
+	if ((g_FDC.byCurCommand & 0x04) != 0)
+	{
+		g_FDC.dwSettleTime = FdcScaleTime(HEAD_SETTLE_TIME, g_dtDives[nDrive].wSettleScale);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// starts tmSectorArrival for an access to the field at nOffset of the active track.
+//
+// With rotational delays enabled by the timing profile of the drive the transfer waits
+// for the head to settle and then for the field to reach the head.  Otherwise it starts
+// after the head settle time and the end of the field (nEnd) is recorded as the turbo
+// position of the track, the index pulse is not moved.
+//
+void FdcScheduleRotation(int nOffset, int nEnd)
+{
+	DriveType* pdt;
+	DWORD      dwDelay, dwSettle, dwArrival;
+
+	dwSettle  = g_FDC.dwSettleTime;
+	dwArrival = dwSettle;
+	g_FDC.dwSettleTime = 0;
+
+	if ((g_ptdTrack->nDrive < 0) || (g_ptdTrack->nDrive >= MAX_DRIVES))
+	{
+		TimerStart(tmSectorArrival, dwArrival);
+		return;
+	}
+
+	pdt = &g_dtDives[g_ptdTrack->nDrive];
+
+	if ((pdt->wRotationScale == 0) || (g_dwRotationTime == 0))
+	{
+		g_ptdTrack->nTurboPosition = nEnd;
+	}
+	else
+	{
+		g_ptdTrack->nTurboPosition = -1;
+
+		// the first time the field reaches the head after it has settled
+		dwDelay = FdcGetRotationalDelay(g_ptdTrack, nOffset);
+		dwDelay = (dwDelay + g_dwRotationTime - (dwSettle % g_dwRotationTime)) % g_dwRotationTime;
+
+		dwArrival += FdcScaleTime(dwDelay, pdt->wRotationScale);
+	}
+
+	if (dwArrival != 0)
+	{
+		++g_fsStats.dwRotationalWaits;
+		g_fsStats.nRotationalWaitTime += dwArrival;
+	}
+
+	TimerStart(tmSectorArrival, dwArrival);
+}
+
+//-----------------------------------------------------------------------------
+// FdcScheduleRotation() for the sector located by FdcLocateSector()
+//
+void FdcScheduleSectorRotation(void)
+{
+	if (g_FDC.stStatus.byNotFound || (g_FDC.bySector >= 0x80))
+	{
+		TimerStop(tmSectorArrival);
+		g_FDC.dwSettleTime = 0;
+		return;
+	}
+
+	// from the sync bytes of the ID field to the end of the data field CRC
+	FdcScheduleRotation(g_ptdTrack->nSectorIDAM[g_FDC.bySector] - 3, g_stSector.nSectorDataOffset + g_stSector.nSectorSize + 2);
+}
+
+//-----------------------------------------------------------------------------
+// returns TRUE once the field scheduled by FdcScheduleRotation() has reached the head.
+// The expiry of tmSectorArrival posts EVENT_TIMER, so the main loop does not have to
+// poll while the disk turns.
+//
+BYTE FdcSectorHasArrived(void)
+{
+	return !TimerIsRunning(tmSectorArrival);
+}
+
+//-----------------------------------------------------------------------------
+// sets up g_stSector and the status bits for the specified sector of the active
+// track (g_ptdTrack) using the sector index built when the track was loaded.
+//
+void FdcLocateSector(int nSector)
+{
+	WORD wCRC16;
+	int  nDataOffset;
+
+	g_FDC.stStatus.byCrcError = 0;
+
+	if ((nSector >= 0x80) || (g_ptdTrack->nSectorIDAM[nSector] < 0) || (g_ptdTrack->nSectorDAM[nSector] < 0))
+	{
+		g_stSector.nSectorDataOffset = 0; // then there is a problem and we will let the Z80 deal with it
+		g_FDC.stStatus.byRecordType  = 0;
+		g_FDC.stStatus.byNotFound    = 1;
+		return;
+	}
+
+	g_stSector.nSectorSize = g_ptdTrack->nSectorSize[nSector];
+
+	if (g_ptdTrack->bySectorIdCrcOk[nSector] == 0)
+	{
+		g_FDC.stStatus.byCrcError = 1;
+	}
+	
+	nDataOffset = g_ptdTrack->nSectorDAM[nSector];	// offset to first bytes of the sector data mark sequence (0xA1, 0xA1, 0xA1, 0xFB/0xF8)
+													//  - 0xFB (regular data); or
+													//  - 0xF8 (deleted data)
+													// actual data starts after the 0xFB/0xF8 byte
+
+	g_FDC.byRecordMark           = g_ptdTrack->byTrackData[nDataOffset+3];
+	g_stSector.nSectorDataOffset = nDataOffset + 4;
+	g_FDC.stStatus.byNotFound    = 0;
+	g_FDC.stStatus.byRecordType  = 0xFB;	// will get set to g_FDC.byRecordMark after a few status reads
+
+	// perform a CRC on the sector data (including the data mark) and validate
+	wCRC16 = FdcCalculateMarkCRC(g_ptdTrack, &g_ptdTrack->byTrackData[nDataOffset+3], g_stSector.nSectorSize);
+
+	if (wCRC16 != ((g_ptdTrack->byTrackData[nDataOffset+g_stSector.nSectorSize+4] << 8) + g_ptdTrack->byTrackData[nDataOffset+g_stSector.nSectorSize+5]))
+	{
+		g_FDC.stStatus.byCrcError = 1;
+	}
+}
+
+//-----------------------------------------------------------------------------
+void FdcReadDmkSector(int nDriveSel, int nSide, int nTrack, int nSector)
+{
+	int nDrive;
+
+	nDrive = FdcGetDriveIndex(nDriveSel);
+	
+	if (nDrive < 0)
+	{
+		return;
+	}
+
+	FdcReadTrack(nDrive, nSide, nTrack);
+
+	g_ptdTrack->nFileOffset = FdcGetTrackOffset(nDrive, nSide, nTrack);
+
+	FdcLocateSector(nSector);
+
+	if (g_FDC.stStatus.byNotFound == 0)
+	{
+		g_dtDives[nDrive].dmk.nSectorSize = g_stSector.nSectorSize;
+	}
+}
+
+//-----------------------------------------------------------------------------
+void FdcReadHfeSector(int nDriveSel, int nSide, int nTrack, int nSector)
+{
+	int nDrive;
+
+	nDrive = FdcGetDriveIndex(nDriveSel);
+	
+	if (nDrive < 0)
+	{
+		return;
+	}
+
+	FdcReadTrack(nDrive, nSide, nTrack);
+	FdcLocateSector(nSector);
+}
+
+//-----------------------------------------------------------------------------
+void FdcReadSector(int nDriveSel, int nSide, int nTrack, int nSector)
+{
+	int nDrive;
+
+	nDrive = FdcGetDriveIndex(nDriveSel);
+
+	if (nDrive < 0)
+	{
+		g_FDC.stStatus.byNotFound = 1;
+		return;
+	}
+
+	switch (g_dtDives[nDrive].nDriveFormat)
+	{
+		case eDMK:
+			FdcReadDmkSector(nDriveSel, nSide, nTrack, nSector);
+			break;
+
+		case eHFE:
+			FdcReadHfeSector(nDriveSel, nSide, nTrack, nSector);
+			break;
+	}
+}
+
+//-----------------------------------------------------------------------------
+void FdcMountDmkDrive(int nDrive)
+{
+	if (nDrive >= MAX_DRIVES)
+	{
+		return;
+	}
+
+	g_dtDives[nDrive].f = FileOpen(g_dtDives[nDrive].szFileName, FA_READ | FA_WRITE);
+
+	if (g_dtDives[nDrive].f == NULL)
+	{
+		return;
 	}
 
 	g_dtDives[nDrive].nDriveFormat = eDMK;
 
+	FileEnableFastSeek(g_dtDives[nDrive].f);
 	FileRead(g_dtDives[nDrive].f, g_dtDives[nDrive].dmk.byDmkDiskHeader, sizeof(g_dtDives[nDrive].dmk.byDmkDiskHeader));
 
 	g_dtDives[nDrive].dmk.byWriteProtected = g_dtDives[nDrive].dmk.byDmkDiskHeader[0];
@@ -821,7 +1601,6 @@ void FdcMountDmkDrive(int nDrive)
 	// bytes 0x05 - 0x0B are reserved
 	
 	// bytes 0x0B - 0x0F are zero for virtual disks; and 0x12345678 for real disks;
-
 }
 
 //-----------------------------------------------------------------------------
@@ -841,6 +1620,11 @@ void FdcMountHfeDrive(int nDrive)
 
 	g_dtDives[nDrive].nDriveFormat = eHFE;
 
+	FileEnableFastSeek(g_dtDives[nDrive].f);
+
+	// the file object may have held a different image
+	HfeInvalidateRawTrack();
+
     FileRead(g_dtDives[nDrive].f, (BYTE*)&g_dtDives[nDrive].hfe.header, sizeof(g_dtDives[nDrive].hfe.header));
     FileSeek(g_dtDives[nDrive].f, g_dtDives[nDrive].hfe.header.track_list_offset*0x200);
     FileRead(g_dtDives[nDrive].f, (BYTE*)&g_dtDives[nDrive].hfe.trackLUT, sizeof(g_dtDives[nDrive].hfe.trackLUT));
@@ -849,41 +1633,102 @@ void FdcMountHfeDrive(int nDrive)
 }
 
 //-----------------------------------------------------------------------------
-void FdcMountDrive(int nDrive)
+// opens the image of drive *(int*)pArg and reads its header, called on the storage worker
+//
+static UINT32 FdcOpenDrive(void* pArg)
+{
+	int nDrive = *(int*)pArg;
+
+	g_dtDives[nDrive].nDriveFormat = eUnknown;
+
+	if (stristr(g_dtDives[nDrive].szFileName, ".dmk") != NULL)
+	{
+		FdcMountDmkDrive(nDrive);
+	}
+	else if (stristr(g_dtDives[nDrive].szFileName, ".hfe") != NULL)
+	{
+		FdcMountHfeDrive(nDrive);
+	}
+
+	return (g_dtDives[nDrive].f != NULL);
+}
+
+//-----------------------------------------------------------------------------
+void FdcMountDrive(int nDrive)
+{
+	if (!StorageCallFunction(FdcOpenDrive, &nDrive))
+	{
+		return;
+	}
+
+	if ((g_dtDives[nDrive].nDriveFormat == eDMK) && g_dtDives[nDrive].byRamDisk)
+	{
+		RamDiskMount(nDrive);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// closes the file (file*)pArg, called on the storage worker
+//
+static UINT32 FdcCloseFile(void* pArg)
+{
+	FileClose((file*)pArg);
+
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+// returns TRUE if the file named (char*)pArg exists, called on the storage worker
+//
+static UINT32 FdcFileExists(void* pArg)
+{
+	return FileExists((char*)pArg);
+}
+
+//-----------------------------------------------------------------------------
+// opens the file named in the transfer buffer for the host file commands with the
+// FatFs mode *(BYTE*)pArg, called on the storage worker
+//
+static UINT32 FdcOpenHostFile(void* pArg)
 {
-	g_dtDives[nDrive].nDriveFormat = eUnknown;
-
-	if (stristr(g_dtDives[nDrive].szFileName, ".dmk") != NULL)
-	{
-		FdcMountDmkDrive(nDrive);
-	}
-	else if (stristr(g_dtDives[nDrive].szFileName, ".hfe") != NULL)
+	if (g_fOpenFile != NULL)
 	{
-		FdcMountHfeDrive(nDrive);
+		FileClose(g_fOpenFile);
 	}
+
+	g_fOpenFile = FileOpen((char*)g_FDC.byTransferBuffer, *(BYTE*)pArg);
+
+	return (g_fOpenFile != NULL);
 }
 
 //-----------------------------------------------------------------------------
-void FdcSaveBootCfg(char* pszIniFile)
+// writes the name of the ini file (char*)pArg to boot.cfg, called on the storage worker
+//
+static UINT32 FdcSaveBootCfg(void* pArg)
 {
+	char* pszIniFile = (char*)pArg;
 	file* f;
 
 	f = FileOpen("boot.cfg", FA_WRITE | FA_CREATE_ALWAYS);
 	
 	if (f == NULL)
 	{
-		return;
+		return FALSE;
 	}
 
 	g_byBootConfigModified = TRUE;
 
 	strcpy(g_szBootConfig, pszIniFile);
-	FileWrite(f, pszIniFile, strlen(pszIniFile));
+	FileWrite(f, (BYTE*)pszIniFile, strlen(pszIniFile));
 	FileClose(f);
+
+	return TRUE;
 }
 
 //-----------------------------------------------------------------------------
-void FdcLoadIni(void)
+// reads boot.cfg and the ini file it names, called on the storage worker
+//
+static UINT32 FdcLoadIni(void* pArg)
 {
 	file* f;
 	char  szLine[256];
@@ -899,21 +1744,21 @@ void FdcLoadIni(void)
 	
 	if (f == NULL)
 	{
-		return;
+		return FALSE;
 	}
 
 	// open the ini file specified in boot.cfg
-	nLen = FileReadLine(f, (BYTE*)g_szBootConfig, sizeof(g_szBootConfig)-2);
+	nLen = FileReadLine(f, g_szBootConfig, sizeof(g_szBootConfig)-2);
 	FileClose(f);
 
 	f = FileOpen(g_szBootConfig, FA_READ);
 	
 	if (f == NULL)
 	{
-		return;
+		return FALSE;
 	}
 	
-	nLen = FileReadLine(f, (BYTE*)szLine, 126);
+	nLen = FileReadLine(f, szLine, 126);
 	
 	while (nLen >= 0)
 	{
@@ -930,10 +1775,12 @@ void FdcLoadIni(void)
 			FdcProcessConfigEntry(szLabel, psz);
 		}
 
-		nLen = FileReadLine(f, (BYTE*)szLine, 126);
+		nLen = FileReadLine(f, szLine, 126);
 	}
 	
 	FileClose(f);
+
+	return TRUE;
 }
 
 //-----------------------------------------------------------------------------
@@ -941,19 +1788,32 @@ void FdcInit(void)
 {
 	int i;
 
+	StorageWaitIdle();
+
 	memset(&g_FDC, 0, sizeof(g_FDC));
 	g_FDC.stStatus.byBusy = 1;
 
-	g_tdTrack.nDrive = -1;
-	g_tdTrack.nSide  = -1;
-	g_tdTrack.nTrack = -1;
+	TimerSetCallback(tmWaitTimeout, FdcReleaseWait);
+	TimerSetCallback(tmMotorOn, FdcMotorOff);
+	TimerSetCallback(tmIndex, FdcServiceIndex);
+	FdcServiceIndex();
+
+	TrackCacheInit();
+	RamDiskInit();
+	memset(&g_fsStats, 0, sizeof(g_fsStats));
+	g_fsStats.nStatsStart = TimerGetTime();
+	memset(&g_flStats, 0, sizeof(g_flStats));
 
 	for (i = 0; i < MAX_DRIVES; ++i)
 	{
 		memset(&g_dtDives[i], 0, sizeof(DriveType));
 	}
 
-	FdcLoadIni();
+	g_dwMaxDirtyAge  = WRITEBACK_MAX_DIRTY_AGE;
+	g_byPrevDriveSel = 0;
+	g_nPrevProcessFunction = psIdle;
+
+	StorageCallFunction(FdcLoadIni, NULL);
 
 	for (i = 0; i < MAX_DRIVES; ++i)
 	{
@@ -971,15 +1831,14 @@ void FdcInit(void)
 
 	g_FDC.bySdCardPresent = sd_byCardInialized;
 
-	g_nMaxSeekTime = 0;
+	g_nMaxSeekTime   = 0;
+	g_nPrefetchCount = 0;
+	g_nPrefetchIndex = 0;
 }
 
 //-----------------------------------------------------------------------------
 void FdcReleaseCommandWait(void)
 {
-	DWORD dwBus;
-	int   nCount;
-	
 	if (g_FDC.byReleaseWait == 0)
 	{
 		return;
@@ -988,6 +1847,9 @@ void FdcReleaseCommandWait(void)
 	g_FDC.byReleaseWait = 0;
 	g_FDC.byWaitOutput  = 0;	// when 1 => wait line is being held low;
 
+	// the Z80 may read the status as soon as it leaves the WAIT state
+	FdcUpdateStatus();
+
 	// re-enable automatic WAIT generation
 	ReleaseWait(); // allow pio state machine to resume
 }
@@ -995,15 +1857,15 @@ void FdcReleaseCommandWait(void)
 //-----------------------------------------------------------------------------
 void FdcReleaseWait(void)
 {
-	DWORD dwBus;
-	int   nCount;
-
-	g_FDC.dwWaitTimeoutCount = 0;
+	TimerStop(tmWaitTimeout);
 	
 	if (g_FDC.byWaitOutput)
 	{
 		g_FDC.byWaitOutput = 0;
 
+		// the Z80 may read the status as soon as it leaves the WAIT state
+		FdcUpdateStatus();
+
 		// re-enable automatic WAIT generation
 		ReleaseWait(); // allow pio state machine to resume
 	}
@@ -1037,12 +1899,18 @@ void FdcGenerateDRQ(void)
 void FdcCloseAllFiles(void)
 {
 	int i;
+
+	FdcFlushTrackCache(-1);
+	StorageWaitIdle();
+	TrackCacheInvalidate(-1);
 	
 	for (i = 0; i < MAX_DRIVES; ++i)
 	{
+		RamDiskRelease(i);
+
 		if (g_dtDives[i].f != NULL)
 		{
-			FileClose(g_dtDives[i].f);
+			StorageCallFunction(FdcCloseFile, g_dtDives[i].f);
 			g_dtDives[i].f = NULL;
 		}
 
@@ -1051,7 +1919,7 @@ void FdcCloseAllFiles(void)
 	
 	if (g_fOpenFile != NULL)
 	{
-		FileClose(g_fOpenFile);
+		StorageCallFunction(FdcCloseFile, g_fOpenFile);
 		g_fOpenFile = NULL;
 	}
 }
@@ -1064,35 +1932,6 @@ void FdcReset(void)
 	FdcReleaseWait();
 }
 
-//-----------------------------------------------------------------------------
-// Command code 0 0 0 0 h V r1 r0
-//
-// h = 1 - load head at begining; 0 - unload head at begining;
-// V = 1 - verify on destination track
-// r1/r0 - steppeing motor rate
-//
-void FdcProcessRestoreCommand(void)
-{
-	int nDrive;
-	int nSide = 0;
-
-	if ((g_FDC.byDriveSel & 0x10) != 0)
-	{
-		nSide = 1;
-	}
-
-	g_FDC.byTrack = 255;
-	g_FDC.byCommandType = 1;
-	nDrive = FdcGetDriveIndex(g_FDC.byDriveSel);
-
-	FdcReadTrack(nDrive, nSide, 0);
-	FdcReleaseCommandWait();
-
-	g_FDC.stStatus.byBusy = 0; // clear busy flag
-	g_FDC.byTrack         = 0;
-	FdcGenerateIntr();
-}
-
 //-----------------------------------------------------------------------------
 int GetStepRate(BYTE byCommandReg)
 {
@@ -1120,6 +1959,87 @@ int GetStepRate(BYTE byCommandReg)
 	return nStepRate;
 }
 
+//-----------------------------------------------------------------------------
+void FdcServiceHeadMove(void)
+{
+	if (TimerIsRunning(tmHeadMove))
+	{
+		FdcWaitForEvent();
+		return;
+	}
+
+	g_FDC.stStatus.byBusy  = 0; // clear busy flag
+	g_FDC.nProcessFunction = psIdle;
+
+	FdcGenerateIntr();
+}
+
+//-----------------------------------------------------------------------------
+// completes a type 1 command after the step (and head settle) delays of the drive's
+// timing profile.  The delay is timed by tmHeadMove, FdcServiceHeadMove() completes
+// the command on the pass of the main loop woken by its expiry.
+//
+// V = 1 - the head settle time is added before the (emulated) verify
+//
+void FdcStartHeadMove(int nDrive, int nSteps)
+{
+	DWORD dwDelay = 0;
+
+	if ((nDrive >= 0) && (nDrive < MAX_DRIVES))
+	{
+		dwDelay = FdcScaleTime(nSteps * GetStepRate(g_FDC.byCommandReg) * 1000, g_dtDives[nDrive].wStepScale);
+
+		if ((g_FDC.byCurCommand & 0x04) != 0)
+		{
+			dwDelay += FdcScaleTime(HEAD_SETTLE_TIME, g_dtDives[nDrive].wSettleScale);
+		}
+	}
+
+	if (dwDelay != 0)
+	{
+		++g_fsStats.dwHeadMoves;
+		g_fsStats.nHeadMoveTime += dwDelay;
+	}
+
+	TimerStart(tmHeadMove, dwDelay);
+	g_FDC.nProcessFunction = psHeadMove;
+	g_FDC.nServiceState    = 0;
+
+	// complete the command now if there is no delay
+	FdcServiceHeadMove();
+}
+
+//-----------------------------------------------------------------------------
+// Command code 0 0 0 0 h V r1 r0
+//
+// h = 1 - load head at begining; 0 - unload head at begining;
+// V = 1 - verify on destination track
+// r1/r0 - steppeing motor rate
+//
+void FdcProcessRestoreCommand(void)
+{
+	int nDrive;
+	int nSteps;
+	int nSide = 0;
+
+	if ((g_FDC.byDriveSel & 0x10) != 0)
+	{
+		nSide = 1;
+	}
+
+	nSteps = g_FDC.byTrack;
+
+	g_FDC.byTrack = 255;
+	g_FDC.byCommandType = 1;
+	nDrive = FdcGetDriveIndex(g_FDC.byDriveSel);
+
+	FdcReadTrack(nDrive, nSide, 0);
+	FdcReleaseCommandWait();
+
+	g_FDC.byTrack = 0;
+	FdcStartHeadMove(nDrive, nSteps);
+}
+
 //-----------------------------------------------------------------------------
 // Command code 0 0 0 1 h V r1 r0
 //
@@ -1132,9 +2052,8 @@ int GetStepRate(BYTE byCommandReg)
 void FdcProcessSeekCommand(void)
 {
 	uint64_t nStart, nEnd, nDiff;
-	int nTimeOut;
+	int nSteps;
 	int nDrive;
-	int nStepRate;
 	int nSide = 0;
 
 	if ((g_FDC.byDriveSel & 0x10) != 0)
@@ -1144,11 +2063,6 @@ void FdcProcessSeekCommand(void)
 
 	g_FDC.byCommandType = 1;
 	nDrive = FdcGetDriveIndex(g_FDC.byDriveSel);
-	
-	if (nDrive != g_tdTrack.nDrive)
-	{
-		g_tdTrack.nDrive = -1;
-	}
 
 	if (g_FDC.byData >= g_dtDives[nDrive].byNumTracks)
 	{
@@ -1159,19 +2073,16 @@ void FdcProcessSeekCommand(void)
 		return;
 	}
 
-	nStepRate = GetStepRate(g_FDC.byCommandReg);
-
 	if (g_FDC.byTrack > g_FDC.byData)
 	{
-		nTimeOut = nStepRate * (g_FDC.byTrack - g_FDC.byData);
+		nSteps = g_FDC.byTrack - g_FDC.byData;
 	}
 	else
 	{
-		nTimeOut = nStepRate * (g_FDC.byData - g_FDC.byTrack);
+		nSteps = g_FDC.byData - g_FDC.byTrack;
 	}
 
 	nStart = time_us_64();
-	g_nWaitTime  = time_us_64() + (nTimeOut * 1000);
 
 	FdcReadTrack(nDrive, nSide, g_FDC.byData);
 	FdcReleaseCommandWait();
@@ -1184,12 +2095,17 @@ void FdcProcessSeekCommand(void)
 		 g_nMaxSeekTime = nDiff;
 	}
 
-//	while (time_us_64() < g_nWaitTime);
+	++g_tcsStats.dwSeekCount;
+	g_tcsStats.nSeekTimeTotal += nDiff;
+
+	if (nDiff > g_tcsStats.dwSeekTimeMax)
+	{
+		g_tcsStats.dwSeekTimeMax = nDiff;
+	}
 
 	g_FDC.byTrack = g_FDC.byData;
 	g_FDC.stStatus.bySeekError = 0;
-	g_FDC.stStatus.byBusy      = 0; // clear busy flag
-	FdcGenerateIntr();
+	FdcStartHeadMove(nDrive, nSteps);
 }
 
 //-----------------------------------------------------------------------------
@@ -1203,7 +2119,6 @@ void FdcProcessSeekCommand(void)
 void FdcProcessStepCommand(void)
 {
 	int nDrive;
-	int nStepRate;
 	int nSide = 0;
 
 	if ((g_FDC.byDriveSel & 0x10) != 0)
@@ -1231,18 +2146,11 @@ void FdcProcessStepCommand(void)
 		}
 	}
 
-	nStepRate   = GetStepRate(g_FDC.byCommandReg);
-	g_nWaitTime = time_us_64() + (nStepRate * 1000);
-
 	FdcReadTrack(nDrive, nSide, g_FDC.byTrack);
 	FdcReleaseCommandWait();
 
-	while (time_us_64() < g_nWaitTime);
-
 	g_FDC.stStatus.bySeekError = 0;
-	g_FDC.stStatus.byBusy = 0; // clear busy flag
-
-	FdcGenerateIntr();
+	FdcStartHeadMove(nDrive, 1);
 }
 
 //-----------------------------------------------------------------------------
@@ -1257,7 +2165,6 @@ void FdcProcessStepInCommand(void)
 {
 	BYTE byData;
 	int  nDrive;
-	int  nStepRate;
 	int  nSide = 0;
 
 	if ((g_FDC.byDriveSel & 0x10) != 0)
@@ -1286,25 +2193,13 @@ void FdcProcessStepInCommand(void)
 	}
 
 	nDrive = FdcGetDriveIndex(g_FDC.byDriveSel);
-	
-	if (nDrive != g_tdTrack.nDrive)
-	{
-		g_tdTrack.nDrive = -1;
-	}
-
-	nStepRate   = GetStepRate(g_FDC.byCommandReg);
-	g_nWaitTime = time_us_64() + (nStepRate * 1000);
 
 	FdcReadTrack(nDrive, nSide, byData);
 	FdcReleaseCommandWait();
 
-	while (time_us_64() < g_nWaitTime);
-
 	g_FDC.byTrack = byData;
 	g_FDC.stStatus.bySeekError = 0;
-	g_FDC.stStatus.byBusy = 0; // clear busy flag
-	
-	FdcGenerateIntr();
+	FdcStartHeadMove(nDrive, 1);
 }
 
 //-----------------------------------------------------------------------------
@@ -1319,7 +2214,6 @@ void FdcProcessStepOutCommand(void)
 {
 	BYTE byData;
 	int  nDrive;
-	int  nStepRate;
 	int  nSide = 0;
 
 	if ((g_FDC.byDriveSel & 0x10) != 0)
@@ -1348,21 +2242,32 @@ void FdcProcessStepOutCommand(void)
 	}
 
 	nDrive = FdcGetDriveIndex(g_FDC.byDriveSel);
-	
-	if (nDrive != g_tdTrack.nDrive)
-	{
-		g_tdTrack.nDrive = -1;
-	}
-
-	nStepRate   = GetStepRate(g_FDC.byCommandReg);
-	g_nWaitTime = time_us_64() + (nStepRate * 1000);
 
 	FdcReadTrack(nDrive, nSide, byData);
 	FdcReleaseCommandWait();
 
-	while (time_us_64() < g_nWaitTime);
+	FdcStartHeadMove(nDrive, 1);
+}
 
-	FdcGenerateIntr();
+//-----------------------------------------------------------------------------
+// starts the transfer of the sector found by FdcLocateSector() to the Z80
+//
+void FdcStartSectorRead(void)
+{
+	g_FDC.nReadStatusCount       = 0;
+	TimerStart(tmStateCounter, 1000);
+	g_FDC.stStatus.byDataRequest = 0;
+
+	// number of byte to be transfered to the computer before
+	// setting the Data Address Mark status bit (1 if Deleted Data)
+	g_ptdTrack->nReadSize     = g_stSector.nSectorSize;
+	g_ptdTrack->pbyReadPtr    = g_ptdTrack->byTrackData + g_stSector.nSectorDataOffset;
+	g_ptdTrack->nReadCount    = g_ptdTrack->nReadSize;
+	g_FDC.nProcessFunction  = psReadSector;
+	g_FDC.nServiceState     = 0;
+	g_FDC.nDataRegReadCount = 0;
+
+	FdcScheduleSectorRotation();
 }
 
 //-----------------------------------------------------------------------------
@@ -1394,18 +2299,8 @@ void FdcProcessReadSectorCommand(void)
 		return;
 	}		
 	
-	g_FDC.nReadStatusCount       = 0;
-	g_FDC.dwStateCounter         = 1000;
-	g_FDC.stStatus.byDataRequest = 0;
-
-	// number of byte to be transfered to the computer before
-	// setting the Data Address Mark status bit (1 if Deleted Data)
-	g_tdTrack.nReadSize     = g_stSector.nSectorSize;
-	g_tdTrack.pbyReadPtr    = g_tdTrack.byTrackData + g_stSector.nSectorDataOffset;
-	g_tdTrack.nReadCount    = g_tdTrack.nReadSize;
-	g_FDC.nProcessFunction  = psReadSector;
-	g_FDC.nServiceState     = 0;
-	g_FDC.nDataRegReadCount = 0;
+	FdcStartHeadSettle(nDrive);
+	FdcStartSectorRead();
 
 	// Note: computer now reads the data register for each of the sector data bytes
 	//       once the last data byte is transfered status bit-5 is set if the
@@ -1414,6 +2309,23 @@ void FdcProcessReadSectorCommand(void)
 	//       Actual data transfer in handle in the FdcServiceRead() function.
 }
 
+//-----------------------------------------------------------------------------
+// starts the transfer of the sector found by FdcLocateSector() to the Z80
+//
+void FdcStartSectorWrite(void)
+{
+	g_FDC.stStatus.byDataRequest = 0;
+	g_stSector.nSector           = g_FDC.bySector;
+	g_ptdTrack->pbyWritePtr        = g_ptdTrack->byTrackData + g_stSector.nSectorDataOffset;
+	g_ptdTrack->nWriteCount        = g_stSector.nSectorSize;
+	g_ptdTrack->nWriteSize         = g_stSector.nSectorSize;	// number of byte to be transfered to the computer before
+															// setting the Data Address Mark status bit (1 if Deleted Data)
+	g_FDC.nProcessFunction       = psWriteSector;
+	g_FDC.nServiceState          = 0;
+
+	FdcScheduleSectorRotation();
+}
+
 //-----------------------------------------------------------------------------
 // Command code 1 0 0 m F2 E F1 a0
 //
@@ -1442,16 +2354,34 @@ void FdcProcessWriteSectorCommand(void)
 	// read specified sector so that it can be modified
 	FdcReadSector(g_FDC.byDriveSel, nSide, g_FDC.byTrack, g_FDC.bySector);
 
-	g_FDC.stStatus.byDataRequest = 0;
-	g_stSector.nSector           = g_FDC.bySector;
-	g_stSector.nSectorSize       = g_dtDives[nDrive].dmk.nSectorSize;
-	g_tdTrack.nFileOffset        = FdcGetTrackOffset(nDrive, nSide, g_FDC.byTrack);
-	g_tdTrack.pbyWritePtr        = g_tdTrack.byTrackData + g_stSector.nSectorDataOffset;
-	g_tdTrack.nWriteCount        = g_stSector.nSectorSize;
-	g_tdTrack.nWriteSize         = g_stSector.nSectorSize;	// number of byte to be transfered to the computer before
-															// setting the Data Address Mark status bit (1 if Deleted Data)
-	g_FDC.nProcessFunction       = psWriteSector;
-	g_FDC.nServiceState          = 0;
+	// no drive selected, or the sector is not on the track (the sector data offset
+	// is not valid), end the command with Record Not Found
+	if ((nDrive < 0) || (g_dtDives[nDrive].f == NULL) || g_FDC.stStatus.byNotFound)
+	{
+		g_FDC.stStatus.byNotFound = 1;
+		g_FDC.stStatus.byBusy     = 0;
+		FdcReleaseCommandWait();
+		FdcGenerateIntr();
+		return;
+	}
+
+	// the disk is write protected, end the command with Write Protect
+	if (FdcIsWriteProtected(nDrive))
+	{
+		g_FDC.stStatus.byProtected = 1;
+		g_FDC.stStatus.byBusy      = 0;
+		FdcReleaseCommandWait();
+		FdcGenerateIntr();
+		return;
+	}
+
+	// a previous write of this track may still be in progress on the storage worker
+	StorageWait(g_ptdTrack->dwIoTicket);
+
+	g_ptdTrack->nFileOffset = FdcGetTrackOffset(nDrive, nSide, g_FDC.byTrack);
+
+	FdcStartHeadSettle(nDrive);
+	FdcStartSectorWrite();
 
 	if ((g_FDC.byCurCommand & 0x01) == 0)
 	{
@@ -1474,10 +2404,35 @@ void FdcProcessWriteSectorCommand(void)
 //
 void FdcProcessReadAddressCommand(void)
 {
+	int nSide  = 0;
+	int nDrive = FdcGetDriveIndex(g_FDC.byDriveSel);
+	int nSector, nIDAM;
+
 	g_FDC.byCommandType = 3;
-	
-	// send the first ID field of the current track to the computer
-	
+
+	if ((g_FDC.byDriveSel & 0x10) != 0)
+	{
+		nSide = 1;
+	}
+
+	FdcReadTrack(nDrive, nSide, g_FDC.byTrack);
+	FdcReleaseCommandWait();
+
+	// send the next ID field to pass under the head to the computer
+	nSector = FdcGetNextIDAM_Sector(g_ptdTrack);
+
+	if ((nDrive < 0) || (g_dtDives[nDrive].f == NULL) || (nSector < 0))
+	{
+		g_FDC.stStatus.byNotFound = 1;
+		g_FDC.stStatus.byBusy     = 0;
+		return;
+	}
+
+	nIDAM = g_ptdTrack->nSectorIDAM[nSector];
+
+	g_FDC.stStatus.byNotFound = 0;
+	g_FDC.stStatus.byCrcError = (g_ptdTrack->bySectorIdCrcOk[nSector] == 0);
+
 	// Byte 1 : Track Address
 	// Byte 2 : Side Number
 	// Byte 3 : Sector Address
@@ -1485,12 +2440,15 @@ void FdcProcessReadAddressCommand(void)
 	// Byte 5 : CRC1
 	// Byte 6 : CRC2
 
-	g_tdTrack.pbyReadPtr = &g_tdTrack.byTrackData[FdcGetIDAM_Index(0) + 1];
-	g_tdTrack.nReadSize  = 6;
-	g_tdTrack.nReadCount = 6;
+	g_ptdTrack->pbyReadPtr = &g_ptdTrack->byTrackData[nIDAM + 1];
+	g_ptdTrack->nReadSize  = 6;
+	g_ptdTrack->nReadCount = 6;
+
+	FdcStartHeadSettle(nDrive);
+	FdcScheduleRotation(nIDAM - 3, nIDAM + 7);
 
 	g_FDC.nReadStatusCount       = 0;
-	g_FDC.dwStateCounter         = 1000;
+	TimerStart(tmStateCounter, 1000);
 	g_FDC.stStatus.byDataRequest = 0;
 
 	// number of byte to be transfered to the computer before
@@ -1517,21 +2475,80 @@ void FdcProcessReadAddressCommand(void)
 void FdcProcessForceInterruptCommand(void)
 {
 	g_FDC.byCommandType  = 4;
-	g_tdTrack.nReadSize  = 0;
-	g_tdTrack.nReadCount = 0;
-	g_tdTrack.nWriteSize = 0;
+	g_ptdTrack->nReadSize  = 0;
+	g_ptdTrack->nReadCount = 0;
+	g_ptdTrack->nWriteSize = 0;
 	g_FDC.byIntrEnable   = g_FDC.byCurCommand & 0x0F;
 	memset(&g_FDC.stStatus, 0, sizeof(g_FDC.stStatus));
 }
 
-//-----------------------------------------------------------------------------
-// Command code 1 1 1 0 0 E 0 0
-//
-// E = 1 - 15ms delay; 0 - no 15ms delay;
-//
-void FdcProcessReadTrackCommand(void)
-{
-	g_FDC.byCommandType = 3;
+//-----------------------------------------------------------------------------
+// Command code 1 1 1 0 0 E 0 0
+//
+// E = 1 - 15ms delay; 0 - no 15ms delay;
+//
+// transfers the complete track (gaps, sync bytes, address marks, data and CRCs) to the Z80.
+// A DMK track is sent as it is held in the image (without the IDAM pointer table).  For an
+// HFE track the gaps are decoded from the flux data by the storage worker first, the ID and
+// data fields are already in the track buffer.
+//
+void FdcProcessReadTrackCommand(void)
+{
+	StorageRequestType sr;
+	int nDrive;
+	int nSide = 0;
+	int nSize;
+
+	g_FDC.byCommandType = 3;
+
+	if ((g_FDC.byDriveSel & 0x10) != 0)
+	{
+		nSide = 1;
+	}
+
+	nDrive = FdcGetDriveIndex(g_FDC.byDriveSel);
+
+	if ((nDrive < 0) || (g_dtDives[nDrive].f == NULL))
+	{
+		g_FDC.stStatus.byBusy = 0;
+		return;
+	}
+
+	FdcReadTrack(nDrive, nSide, g_FDC.byTrack);
+
+	if (g_ptdTrack->nType == eHFE)
+	{
+		sr.nRequest = srLoadHfeTrackStream;
+		sr.ptdTrack = g_ptdTrack;
+
+		nSize = StorageCall(&sr);
+	}
+	else
+	{
+		g_ptdTrack->pbyReadPtr = g_ptdTrack->byTrackData + DMK_IDAM_TABLE_SIZE * 2;
+		nSize = g_ptdTrack->nTrackSize - DMK_IDAM_TABLE_SIZE * 2;
+	}
+
+	FdcReleaseCommandWait();
+
+	if (nSize <= 0)
+	{
+		g_FDC.stStatus.byBusy = 0;
+		return;
+	}
+
+	g_ptdTrack->nReadSize  = nSize;
+	g_ptdTrack->nReadCount = nSize;
+
+	// the track is read from the index pulse
+	FdcStartHeadSettle(nDrive);
+	FdcScheduleRotation(g_ptdTrack->nIndexOffset, g_ptdTrack->nIndexOffset);
+
+	g_FDC.nReadStatusCount       = 0;
+	g_FDC.stStatus.byDataRequest = 0;
+	g_FDC.nProcessFunction       = psReadTrack;
+	g_FDC.nServiceState          = 0;
+	g_FDC.nDataRegReadCount      = 0;
 }
 
 //-----------------------------------------------------------------------------
@@ -1541,6 +2558,7 @@ void FdcProcessReadTrackCommand(void)
 //
 void FdcProcessWriteTrackCommand(void)
 {
+	int nDrive;
 	int nSide = 0;
 
 	g_FDC.byCommandType = 3;
@@ -1550,28 +2568,96 @@ void FdcProcessWriteTrackCommand(void)
 		nSide = 1;
 	}
 
-	memset(g_tdTrack.byTrackData+0x80, 0, sizeof(g_tdTrack.byTrackData)-0x80);
+	nDrive = FdcGetDriveIndex(g_FDC.byDriveSel);
+
+	if ((nDrive < 0) || (g_dtDives[nDrive].f == NULL))
+	{
+		g_FDC.stStatus.byBusy = 0;
+		FdcReleaseCommandWait();
+		FdcGenerateIntr();
+		return;
+	}
+
+	// HFE images can only have existing sectors rewritten, formatting a track would
+	// require the flux stream to be rebuilt.  The format utility sees a write
+	// protected disk.
+	if ((g_dtDives[nDrive].nDriveFormat == eHFE) || FdcIsWriteProtected(nDrive))
+	{
+		g_FDC.stStatus.byProtected = 1;
+		g_FDC.stStatus.byBusy      = 0;
+		FdcReleaseCommandWait();
+		FdcGenerateIntr();
+		return;
+	}
+
+	// the track is about to be replaced, so take a cache slot for it without reading it
+	g_ptdTrack = FdcGetTrackSlot(nDrive, nSide, g_FDC.byTrack);
+	StorageWait(g_ptdTrack->dwIoTicket);
+
+	memset(g_ptdTrack->byTrackData+0x80, 0, sizeof(g_ptdTrack->byTrackData)-0x80);
 	
-	g_tdTrack.nDrive       = FdcGetDriveIndex(g_FDC.byDriveSel);
-	g_tdTrack.nSide        = nSide;
-	g_tdTrack.nTrack       = g_FDC.byTrack;
-	g_tdTrack.pbyWritePtr  = g_tdTrack.byTrackData + 0x80;
-	g_tdTrack.nWriteSize   = g_dtDives[g_tdTrack.nDrive].dmk.wTrackLength;
-	g_tdTrack.nWriteCount  = g_tdTrack.nWriteSize;
+	g_ptdTrack->nType        = g_dtDives[nDrive].nDriveFormat;
+	g_ptdTrack->byDensity    = eDD;
+	g_ptdTrack->nTrackSize   = g_dtDives[nDrive].dmk.wTrackLength;
+	g_ptdTrack->nIndexOffset    = DMK_IDAM_TABLE_SIZE * 2;
+	g_ptdTrack->nRevolutionSize = g_ptdTrack->nTrackSize - g_ptdTrack->nIndexOffset;
+	g_ptdTrack->pbyWritePtr  = g_ptdTrack->byTrackData + 0x80;
+	g_ptdTrack->nWriteSize   = g_dtDives[g_ptdTrack->nDrive].dmk.wTrackLength;
+	g_ptdTrack->nWriteCount  = g_ptdTrack->nWriteSize;
 	g_FDC.nProcessFunction = psWriteTrack;
 	g_FDC.nServiceState    = 0;
 }
 
+//-----------------------------------------------------------------------------
+// appends the lines of the ini file named in boot.cfg to the status response
+// (char*)pArg, called on the storage worker
+//
+static UINT32 FdcAppendBootConfig(void* pArg)
+{
+	char* pszResponse = (char*)pArg;
+	int   nMaxLen     = sizeof(g_FDC.byTransferBuffer)-2;
+	file* f;
+	char  szLine[256];
+	int   nLen;
+
+	f = FileOpen(g_szBootConfig, FA_READ);
+	
+	if (f == NULL)
+	{
+		strcat_s(pszResponse, nMaxLen, "Unable to open specified ini file");
+		return FALSE;
+	}
+
+	nLen = FileReadLine(f, szLine, 126);
+	
+	while (nLen >= 0)
+	{
+		if (nLen > 2)
+		{
+			strcat_s(pszResponse, nMaxLen, szLine);
+			strcat_s(pszResponse, nMaxLen, "\r");
+		}
+
+		nLen = FileReadLine(f, szLine, 126);
+	}
+	
+	FileClose(f);
+
+	return TRUE;
+}
+
 //-----------------------------------------------------------------------------
 void FdcProcessReadStatus(void)
 {
-	char szBuf[64];
-	int  i;
+	char  szBuf[64];
+	char* pszResponse;
+	int   nMaxLen;
+	int   i;
 	
 	g_FDC.byCommandType = 2;
 
 	g_FDC.nReadStatusCount  = 0;
-	g_FDC.dwStateCounter    = 100000;
+	TimerStart(tmStateCounter, 100000);
 	g_FDC.nProcessFunction  = psSendData;
 	g_FDC.nServiceState     = 0;
 	g_FDC.stStatus.byDataRequest = 0;
@@ -1579,58 +2665,41 @@ void FdcProcessReadStatus(void)
 	g_FDC.byTransferBuffer[0] = 0;
 	g_FDC.byTransferBuffer[1] = 0;
 	
-	strcpy((char*)(g_FDC.byTransferBuffer+1), "Pico FDC Version ");
-	strcat((char*)(g_FDC.byTransferBuffer+1), g_pszVersion);
-	strcat((char*)(g_FDC.byTransferBuffer+1), "\r");
-	strcat((char*)(g_FDC.byTransferBuffer+1), "BootIni=");
-	strcat((char*)(g_FDC.byTransferBuffer+1), g_szBootConfig);
-	strcat((char*)(g_FDC.byTransferBuffer+1), "\r");
+	// the response is bounded by the transfer buffer (leading 0 and terminating 0)
+	pszResponse = (char*)(g_FDC.byTransferBuffer+1);
+	nMaxLen     = sizeof(g_FDC.byTransferBuffer)-2;
+
+	strcat_s(pszResponse, nMaxLen, "Pico FDC Version ");
+	strcat_s(pszResponse, nMaxLen, g_pszVersion);
+	strcat_s(pszResponse, nMaxLen, "\r");
+	strcat_s(pszResponse, nMaxLen, "BootIni=");
+	strcat_s(pszResponse, nMaxLen, g_szBootConfig);
+	strcat_s(pszResponse, nMaxLen, "\r");
+	snprintf(szBuf, sizeof(szBuf), "SD clock=%lu\r", (unsigned long)g_dwSdClockRate);
+	strcat_s(pszResponse, nMaxLen, szBuf);
 
 	if (g_byBootConfigModified)
 	{
-		file* f;
-		char  szLine[256];
-		char  szSection[16];
-		char  szLabel[128];
-		char* psz;
-		int   nLen, nLeft, nRead;
-
-		f = FileOpen(g_szBootConfig, FA_READ);
-		
-		if (f == NULL)
-		{
-			strcat((char*)(g_FDC.byTransferBuffer+1), "Unable to open specified ini file");
-		}
-		else
-		{
-			nLen = FileReadLine(f, (BYTE*)szLine, nRead);
-			
-			while (nLen >= 0)
-			{
-				if (nLen > 2)
-				{
-					strcat_s((char*)(g_FDC.byTransferBuffer+1),  sizeof(g_FDC.byTransferBuffer)-2, szLine);
-					strcat_s((char*)(g_FDC.byTransferBuffer+1),  sizeof(g_FDC.byTransferBuffer)-2, "\r");
-				}
-
-				nLen = FileReadLine(f, (BYTE*)szLine, 126);
-			}
-			
-			FileClose(f);
-		}
+		StorageCallFunction(FdcAppendBootConfig, pszResponse);
 	}
 	else
 	{
 		for (i = 0; i < MAX_DRIVES; ++i)
 		{
-			sprintf(szBuf, "%d: ", i);
-			strcat((char*)(g_FDC.byTransferBuffer+1), szBuf);
-			strcat((char*)(g_FDC.byTransferBuffer+1), g_dtDives[i].szFileName);
-			strcat((char*)(g_FDC.byTransferBuffer+1), "\r");
+			snprintf(szBuf, sizeof(szBuf), "%d: ", i);
+			strcat_s(pszResponse, nMaxLen, szBuf);
+			strcat_s(pszResponse, nMaxLen, g_dtDives[i].szFileName);
+
+			if (g_dtDives[i].pbyRamImage != NULL)
+			{
+				strcat_s(pszResponse, nMaxLen, " (RAM)");
+			}
+
+			strcat_s(pszResponse, nMaxLen, "\r");
 		}
 	}
 
-	g_FDC.nTransferSize          = strlen((char*)(g_FDC.byTransferBuffer+1)) + 2;
+	g_FDC.nTransferSize          = strlen(pszResponse) + 2;
 	g_FDC.byTransferBuffer[0]    = g_FDC.nTransferSize;
 	g_FDC.nTrasferIndex          = 0;
 	g_FDC.stStatus.byDataRequest = 1;
@@ -1642,40 +2711,28 @@ void FdcProcessReadStatus(void)
 //-----------------------------------------------------------------------------
 int FdcFileListCmp(const void * a, const void * b)
 {
-	FILINFO* f1 = (FILINFO*) a;
-	FILINFO* f2 = (FILINFO*) b;
+	FindEntryType* f1 = (FindEntryType*) a;
+	FindEntryType* f2 = (FindEntryType*) b;
 
 	return stricmp(f1->fname, f2->fname);
 }
 
 //-----------------------------------------------------------------------------
-void FdcProcessFindFirst(char* pszFilter)
+// lists the files of the root directory that match g_szFindFilter into g_fiFindResults,
+// called on the storage worker.  Returns the FatFs result of f_findfirst().
+//
+static UINT32 FdcScanDirectory(void* pArg)
 {
     FRESULT fr;  // Return value
-	
-	g_FDC.byCommandType = 2;
-
-	g_nFindIndex = 0;
-	g_nFindCount = 0;
-
-	strcpy((char*)(g_FDC.byTransferBuffer+1), "too soon");
-	g_FDC.byTransferBuffer[0] = strlen((char*)(g_FDC.byTransferBuffer+1)) + 2;
 
     memset(&g_dj, 0, sizeof(g_dj));
     memset(&g_fno, 0, sizeof(g_fno));
-	memset(g_fiFindResults, 0, sizeof(g_fiFindResults));
-
-	strcpy(g_szFindFilter, pszFilter);
 
     fr = f_findfirst(&g_dj, &g_fno, "0:", "*");
 
     if (FR_OK != fr)
 	{
-		strcpy((char*)(g_FDC.byTransferBuffer+1), "No matching file found.");
-		g_FDC.byTransferBuffer[0] = strlen((char*)(g_FDC.byTransferBuffer+1));
-		g_FDC.stStatus.byDataRequest = 0;
-		g_FDC.stStatus.byBusy        = 0;
-        return;
+        return fr;
     }
 
 	while ((fr == FR_OK) && (g_fno.fname[0] != 0) && (g_nFindCount < FIND_MAX_SIZE))
@@ -1686,9 +2743,11 @@ void FdcProcessFindFirst(char* pszFilter)
 		}
 		else
 		{
-			if ((g_szFindFilter[0] == '*') || (stristr(g_fno.fname, g_szFindFilter) != NULL))
+			if (((g_szFindFilter[0] == '*') || (stristr(g_fno.fname, g_szFindFilter) != NULL)) && (strlen(g_fno.fname) < FIND_MAX_NAME))
 			{
-				memcpy(&g_fiFindResults[g_nFindCount], &g_fno, sizeof(FILINFO));
+				g_fiFindResults[g_nFindCount].fsize = g_fno.fsize;
+				g_fiFindResults[g_nFindCount].fdate = g_fno.fdate;
+				strcpy(g_fiFindResults[g_nFindCount].fname, g_fno.fname);
 				++g_nFindCount;
 			}
 		}
@@ -1701,9 +2760,36 @@ void FdcProcessFindFirst(char* pszFilter)
 
 	f_closedir(&g_dj);
 
+	return FR_OK;
+}
+
+//-----------------------------------------------------------------------------
+void FdcProcessFindFirst(char* pszFilter)
+{
+	g_FDC.byCommandType = 2;
+
+	g_nFindIndex = 0;
+	g_nFindCount = 0;
+
+	strcpy((char*)(g_FDC.byTransferBuffer+1), "too soon");
+	g_FDC.byTransferBuffer[0] = strlen((char*)(g_FDC.byTransferBuffer+1)) + 2;
+
+	memset(g_fiFindResults, 0, sizeof(g_fiFindResults));
+
+	strcpy(g_szFindFilter, pszFilter);
+
+    if (StorageCallFunction(FdcScanDirectory, NULL) != FR_OK)
+	{
+		strcpy((char*)(g_FDC.byTransferBuffer+1), "No matching file found.");
+		g_FDC.byTransferBuffer[0] = strlen((char*)(g_FDC.byTransferBuffer+1));
+		g_FDC.stStatus.byDataRequest = 0;
+		g_FDC.stStatus.byBusy        = 0;
+        return;
+    }
+
 	if (g_nFindCount > 0)
 	{
-		qsort(g_fiFindResults, g_nFindCount, sizeof(FILINFO), FdcFileListCmp);
+		qsort(g_fiFindResults, g_nFindCount, sizeof(FindEntryType), FdcFileListCmp);
 
 		sprintf((char*)(g_FDC.byTransferBuffer+1), "%2d/%02d/%d %7d %s",
 				((g_fiFindResults[g_nFindIndex].fdate >> 5) & 0xF) + 1,
@@ -1720,7 +2806,7 @@ void FdcProcessFindFirst(char* pszFilter)
 	g_FDC.nTrasferIndex       = 0;
 	
 	g_FDC.nReadStatusCount       = 0;
-	g_FDC.dwStateCounter         = 100000;
+	TimerStart(tmStateCounter, 100000);
 	g_FDC.nProcessFunction       = psSendData;
 	g_FDC.nServiceState          = 0;
 	g_FDC.stStatus.byDataRequest = 1;
@@ -1732,9 +2818,6 @@ void FdcProcessFindFirst(char* pszFilter)
 //-----------------------------------------------------------------------------
 void FdcProcessFindNext(void)
 {
-    FRESULT fr = FR_OK;  /* Return value */
-	BYTE    bFound = FALSE;
-	
 	g_FDC.byCommandType = 2;
 
 	if (g_nFindIndex < g_nFindCount)
@@ -1758,7 +2841,7 @@ void FdcProcessFindNext(void)
 	g_FDC.nTrasferIndex       = 0;
 	
 	g_FDC.nReadStatusCount       = 0;
-	g_FDC.dwStateCounter         = 100000;
+	TimerStart(tmStateCounter, 100000);
 	g_FDC.nProcessFunction       = psSendData;
 	g_FDC.nServiceState          = 0;
 	g_FDC.stStatus.byDataRequest = 1;
@@ -1802,12 +2885,19 @@ void FdcProcessReadFile(void)
 {
 	g_FDC.byCommandType = 2;
 
-	g_FDC.byTransferBuffer[0] = FileRead(g_fOpenFile, g_FDC.byTransferBuffer+1, 250);
+	StorageRequestType sr;
+
+	sr.nRequest = srFileRead;
+	sr.f        = g_fOpenFile;
+	sr.pbyData  = g_FDC.byTransferBuffer+1;
+	sr.nSize    = 250;
+
+	g_FDC.byTransferBuffer[0] = StorageCall(&sr);
 	g_FDC.nTransferSize       = g_FDC.byTransferBuffer[0] + 1;
 	g_FDC.nTrasferIndex       = 0;
 
 	g_FDC.nReadStatusCount       = 0;
-	g_FDC.dwStateCounter         = 100000;
+	TimerStart(tmStateCounter, 100000);
 	g_FDC.nProcessFunction       = psSendData;
 	g_FDC.nServiceState          = 0;
 	g_FDC.stStatus.byDataRequest = 1;
@@ -1836,7 +2926,7 @@ void FdcProcessCloseFile(void)
 {
 	if (g_fOpenFile != NULL)
 	{
-		FileClose(g_fOpenFile);
+		StorageCallFunction(FdcCloseFile, g_fOpenFile);
 		g_fOpenFile = NULL;
 	}
 
@@ -1884,9 +2974,289 @@ void FdcProcessGetTime(void)
 	
 }
 
+//-----------------------------------------------------------------------------
+// page 0 - track cache and seek counters
+//
+void FdcGetCacheCounters(char* psz, int nMaxLen)
+{
+	DWORD dwSeekAvg = 0;
+
+	if (g_tcsStats.dwSeekCount != 0)
+	{
+		dwSeekAvg = g_tcsStats.nSeekTimeTotal / g_tcsStats.dwSeekCount;
+	}
+
+	snprintf(psz, nMaxLen, "Track cache: %d slots\rHits=%lu Misses=%lu\rEvictions=%lu WriteBacks=%lu\rSD bytes read=%lu Overlapped=%lu\rPrefetch=%lu Useful=%lu\rSeeks=%lu Avg=%luus Max=%luus\r",
+			TrackCacheSlotCount(),
+			(unsigned long)g_tcsStats.dwHits,
+			(unsigned long)g_tcsStats.dwMisses,
+			(unsigned long)g_tcsStats.dwEvictions,
+			(unsigned long)g_tcsStats.dwWriteBacks,
+			(unsigned long)g_tcsStats.dwBytesRead,
+			(unsigned long)g_tcsStats.dwOverlappedLoads,
+			(unsigned long)g_tcsStats.dwPrefetches,
+			(unsigned long)g_tcsStats.dwPrefetchHits,
+			(unsigned long)g_tcsStats.dwSeekCount,
+			(unsigned long)dwSeekAvg,
+			(unsigned long)g_tcsStats.dwSeekTimeMax);
+}
+
+//-----------------------------------------------------------------------------
+// page 1 - data transfer counters
+//
+void FdcGetTransferCounters(char* psz, int nMaxLen)
+{
+	DWORD dwReadRate  = 0;
+	DWORD dwTrackRate = 0;
+	DWORD dwSectorAvg = 0;
+	DWORD dwFormatAvg = 0;
+	DWORD dwIsrAvg    = 0;
+
+	if (g_fsStats.nSectorReadTime != 0)
+	{
+		dwReadRate = ((UINT64)g_fsStats.dwSectorReadBytes * 1000000) / g_fsStats.nSectorReadTime;
+	}
+
+	if (g_fsStats.nTrackReadTime != 0)
+	{
+		dwTrackRate = ((UINT64)g_fsStats.dwTrackReadBytes * 1000000) / g_fsStats.nTrackReadTime;
+	}
+
+	if (g_fsStats.dwSectorWrites != 0)
+	{
+		dwSectorAvg = g_fsStats.nSectorWriteTime / g_fsStats.dwSectorWrites;
+	}
+
+	if (g_fsStats.dwTrackWrites != 0)
+	{
+		dwFormatAvg = g_fsStats.nTrackWriteTime / g_fsStats.dwTrackWrites;
+	}
+
+	if (g_fsStats.dwIsrCalls != 0)
+	{
+		dwIsrAvg = g_fsStats.nIsrCycles / g_fsStats.dwIsrCalls;
+	}
+
+	snprintf(psz, nMaxLen, "Sector reads=%lu %lu bytes/s\rTrack reads=%lu %lu bytes/s\rSector writes=%lu Avg=%luus\rTrack writes=%lu Avg=%luus\rSD writes=%lu %lu bytes\rISR cycles Avg=%lu Max=%lu\r",
+			(unsigned long)g_fsStats.dwSectorReads,
+			(unsigned long)dwReadRate,
+			(unsigned long)g_fsStats.dwTrackReads,
+			(unsigned long)dwTrackRate,
+			(unsigned long)g_fsStats.dwSectorWrites,
+			(unsigned long)dwSectorAvg,
+			(unsigned long)g_fsStats.dwTrackWrites,
+			(unsigned long)dwFormatAvg,
+			(unsigned long)g_fsStats.dwSdWrites,
+			(unsigned long)g_fsStats.dwSdWriteBytes,
+			(unsigned long)dwIsrAvg,
+			(unsigned long)g_fsStats.dwIsrCyclesMax);
+}
+
+//-----------------------------------------------------------------------------
+// page 2 - drive timing profiles and the delays they added
+//
+void FdcGetTimingCounters(char* psz, int nMaxLen)
+{
+	DWORD dwRotationAvg = 0;
+	DWORD dwHeadMoveAvg = 0;
+	int   i, nLen;
+
+	if (g_fsStats.dwRotationalWaits != 0)
+	{
+		dwRotationAvg = g_fsStats.nRotationalWaitTime / g_fsStats.dwRotationalWaits;
+	}
+
+	if (g_fsStats.dwHeadMoves != 0)
+	{
+		dwHeadMoveAvg = g_fsStats.nHeadMoveTime / g_fsStats.dwHeadMoves;
+	}
+
+	snprintf(psz, nMaxLen, "Rotational waits=%lu Avg=%luus\rHead moves=%lu Avg=%luus\r",
+			(unsigned long)g_fsStats.dwRotationalWaits,
+			(unsigned long)dwRotationAvg,
+			(unsigned long)g_fsStats.dwHeadMoves,
+			(unsigned long)dwHeadMoveAvg);
+
+	for (i = 0; i < MAX_DRIVES; ++i)
+	{
+		nLen = strlen(psz);
+
+		snprintf(psz+nLen, nMaxLen-nLen, "Drive%d step=%u%% settle=%u%% rotation=%u%%\r",
+				i,
+				g_dtDives[i].wStepScale,
+				g_dtDives[i].wSettleScale,
+				g_dtDives[i].wRotationScale);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// page 3 - main loop counters
+//
+void FdcGetLoopCounters(char* psz, int nMaxLen)
+{
+	UINT64 nElapsed = TimerGetTime() - g_fsStats.nStatsStart;
+	DWORD  dwLoopRate = 0;
+	DWORD  dwIdle = 0;
+
+	if (nElapsed != 0)
+	{
+		dwLoopRate = ((UINT64)g_fsStats.dwLoopCount * 1000000) / nElapsed;
+		dwIdle     = (g_fsStats.nIdleTime * 100) / nElapsed;
+	}
+
+	snprintf(psz, nMaxLen, "Main loop=%lu/s\rIdle=%lu%% Sleeps=%lu\r",
+			(unsigned long)dwLoopRate,
+			(unsigned long)dwIdle,
+			(unsigned long)g_fsStats.dwSleeps);
+}
+
+//-----------------------------------------------------------------------------
+// page 4 - SD-Card operations and the file block cache
+//
+void FdcGetFileCounters(char* psz, int nMaxLen)
+{
+	DWORD dwSeekReads = 0;
+	int   i, nLen;
+
+	// in 1/100 of a sector
+	if (g_flStats.dwSeeks != 0)
+	{
+		dwSeekReads = ((UINT64)g_flStats.dwSeekReads * 100) / g_flStats.dwSeeks;
+	}
+
+	snprintf(psz, nMaxLen, "SD reads=%lu %lu bytes\rSD writes=%lu %lu bytes\rBlock hits=%lu Misses=%lu\rPass through=%lu Combined=%lu\rDirect reads=%lu writes=%lu\rSeeks=%lu FAT reads/seek=%lu.%02lu\rLink maps:",
+			(unsigned long)g_flStats.dwSdReads,
+			(unsigned long)g_flStats.dwSdReadBytes,
+			(unsigned long)g_flStats.dwSdWrites,
+			(unsigned long)g_flStats.dwSdWriteBytes,
+			(unsigned long)g_flStats.dwBlockHits,
+			(unsigned long)g_flStats.dwBlockMisses,
+			(unsigned long)g_flStats.dwPassThrough,
+			(unsigned long)g_flStats.dwCombined,
+			(unsigned long)g_flStats.dwDirectReads,
+			(unsigned long)g_flStats.dwDirectWrites,
+			(unsigned long)g_flStats.dwSeeks,
+			(unsigned long)dwSeekReads / 100,
+			(unsigned long)dwSeekReads % 100);
+
+	// items used by the link map of each mounted image, '-' if it does not have one
+	// and 'C' if the image is contiguous (direct access)
+	for (i = 0; i < MAX_DRIVES; ++i)
+	{
+		nLen = strlen(psz);
+
+		if ((g_dtDives[i].f != NULL) && g_dtDives[i].f->byFastSeek)
+		{
+			snprintf(psz+nLen, nMaxLen-nLen, " %lu%s", (unsigned long)g_dtDives[i].f->dwLinkMapItems, (g_dtDives[i].f->dwStartSector != 0) ? "C" : "");
+		}
+		else
+		{
+			snprintf(psz+nLen, nMaxLen-nLen, " -");
+		}
+	}
+
+	nLen = strlen(psz);
+	snprintf(psz+nLen, nMaxLen-nLen, "\r");
+}
+
+//-----------------------------------------------------------------------------
+// page 5 - RAM disk images
+//
+void FdcGetRamDiskCounters(char* psz, int nMaxLen)
+{
+	int i, nLen;
+
+	snprintf(psz, nMaxLen, "RAM disk free=%lu bytes\rImages=%lu Refused=%lu\rLast load=%luus\rTrack reads=%lu writes=%lu\rWrite backs=%lu %lu bytes\rDirty blocks:",
+			(unsigned long)RamDiskFree(),
+			(unsigned long)g_rdStats.dwImages,
+			(unsigned long)g_rdStats.dwRefused,
+			(unsigned long)g_rdStats.dwLoadTime,
+			(unsigned long)g_rdStats.dwTrackReads,
+			(unsigned long)g_rdStats.dwTrackWrites,
+			(unsigned long)g_rdStats.dwWriteBacks,
+			(unsigned long)g_rdStats.dwWriteBackBytes);
+
+	// blocks of each image not yet written to the SD-Card, '-' if the drive is not held in RAM
+	for (i = 0; i < MAX_DRIVES; ++i)
+	{
+		nLen = strlen(psz);
+
+		if (g_dtDives[i].pbyRamImage != NULL)
+		{
+			snprintf(psz+nLen, nMaxLen-nLen, " %d", RamDiskDirtyBlocks(i));
+		}
+		else
+		{
+			snprintf(psz+nLen, nMaxLen-nLen, " -");
+		}
+	}
+
+	nLen = strlen(psz);
+	snprintf(psz+nLen, nMaxLen-nLen, "\r");
+}
+
+//-----------------------------------------------------------------------------
+// the sector register selects which page of counters is returned
+//
+void FdcProcessReadCounters(void)
+{
+	char* psz     = (char*)(g_FDC.byTransferBuffer+1);
+	int   nMaxLen = sizeof(g_FDC.byTransferBuffer) - 3;
+
+	g_FDC.byCommandType = 2;
+
+	switch (g_FDC.bySector)
+	{
+		case 0:
+			FdcGetCacheCounters(psz, nMaxLen);
+			break;
+
+		case 1:
+			FdcGetTransferCounters(psz, nMaxLen);
+			break;
+
+		case 2:
+			FdcGetTimingCounters(psz, nMaxLen);
+			break;
+
+		case 3:
+			FdcGetLoopCounters(psz, nMaxLen);
+			break;
+
+		case 4:
+			FdcGetFileCounters(psz, nMaxLen);
+			break;
+
+		case 5:
+			FdcGetRamDiskCounters(psz, nMaxLen);
+			break;
+
+		default:
+			*psz = 0;
+			break;
+	}
+
+	g_FDC.nTransferSize       = strlen((char*)(g_FDC.byTransferBuffer+1)) + 2;
+	g_FDC.byTransferBuffer[0] = g_FDC.nTransferSize;
+	g_FDC.nTrasferIndex       = 0;
+
+	g_FDC.nReadStatusCount       = 0;
+	TimerStart(tmStateCounter, 100000);
+	g_FDC.nProcessFunction       = psSendData;
+	g_FDC.nServiceState          = 0;
+	g_FDC.stStatus.byDataRequest = 1;
+	g_FDC.stStatus.byBusy        = 0;
+
+	// Actual data transfer in handle in the FdcServiceSendData() function.
+}
+
 //-----------------------------------------------------------------------------
 void FdcProcessCommand(void)
 {
+	g_dwLastCommandTime     = time_us_32();
+	TimerStart(tmPrefetch, PREFETCH_IDLE_TIME);
+	g_FDC.byIsrDataRead     = 0;
+	g_FDC.byIsrDataWrite    = 0;
 	g_FDC.nServiceState     = 0;
 	g_FDC.nProcessFunction  = psIdle;
 	g_FDC.byCurCommand      = g_FDC.byCommandReg;
@@ -1894,6 +3264,7 @@ void FdcProcessCommand(void)
 
 	if (g_FDC.byDriveSel == 0x0F) // special request to this host processor
 	{
+		// the file access of these is queued to the storage worker (StorageCallFunction())
 		switch (g_FDC.byCurCommand)
 		{
 			case 1: // read firmware version
@@ -1936,6 +3307,10 @@ void FdcProcessCommand(void)
 				FdcProcessGetTime();
 				break;
 
+			case 11: // read performance counters (sector register selects the page)
+				FdcProcessReadCounters();
+				break;
+
 			case 0x80:
 				FdcProcessFindFirst(".INI");
 				break;
@@ -2011,6 +3386,29 @@ void FdcProcessCommand(void)
 	}
 }
 
+//-----------------------------------------------------------------------------
+// called when a sector transfer of a Read Sector or Write Sector command is complete.
+//
+// for a multiple record command (m = 1) the sector register is advanced and the next
+// sector is located in the track already in memory.  Returns TRUE if the command
+// continues with that sector, FALSE if the command is done (single record command
+// or the next sector is not on the track, which sets Record Not Found).
+// A Force Interrupt from the Z80 ends the command at any time.
+//
+BYTE FdcNextRecord(void)
+{
+	if ((g_FDC.byCurCommand & 0x10) == 0)
+	{
+		return FALSE;
+	}
+
+	++g_FDC.bySector;
+
+	FdcLocateSector(g_FDC.bySector);
+
+	return (g_FDC.stStatus.byNotFound == 0);
+}
+
 //-----------------------------------------------------------------------------
 void FdcServiceReadSector(void)
 {
@@ -2029,59 +3427,57 @@ void FdcServiceReadSector(void)
 
 		case 2: // wait for 5 reads with the record mark provide in the read
 			++g_FDC.nServiceState;
-			g_FDC.dwStateCounter = 100;
+			TimerStart(tmStateCounter, 100);
 			break;
 
-		case 3: // wait for data byte to be read (if available)
-			if (g_FDC.stStatus.byDataRequest != 0)	// wait for byte to be read by Z80
+		case 3: // hand the data over to fdc_isr(), which serves each data register read
+				// directly from g_ptdTrack->pbyReadPtr and keeps DRQ set until the last byte
+			if (!FdcSectorHasArrived())
 			{
-				if (g_FDC.dwStateCounter == 0)		// don't wait forever
-				{
-					g_FDC.stStatus.byDataRequest = 0;
-					g_FDC.stStatus.byDataLost    = 1;
-				}
-				
+				FdcWaitForEvent();
 				break;
 			}
 
-			g_FDC.dwStateCounter = 100;
+			g_FDC.dwTransferStart = time_us_32();
+
+			if (g_ptdTrack->nReadCount > 0)
+			{
+				g_FDC.byIsrDataRead = 1;
+				FdcGenerateDRQ();
+			}
+
 			++g_FDC.nServiceState;
 			break;
 
-		case 4:
-			// if WAIT is not active then wait for DRVSEL write operation, but don't wait forever
-			if ((g_tdTrack.nReadCount > 0) && (g_FDC.byWaitOutput == 0) && (g_FDC.dwStateCounter != 0))
+		case 4: // wait for the last byte to be read by the Z80 (or a Force Interrupt)
+			if (g_FDC.byIsrDataRead)
 			{
+				FdcWaitForEvent();
 				break;
 			}
 
-			g_FDC.byData = *g_tdTrack.pbyReadPtr;
-			g_FDC.dwStateCounter = 100;
+			++g_fsStats.dwSectorReads;
+			g_fsStats.dwSectorReadBytes += g_ptdTrack->nReadSize;
+			g_fsStats.nSectorReadTime   += time_us_32() - g_FDC.dwTransferStart;
 
-			if (g_tdTrack.nReadCount > 0)
+			// a CRC error terminates a multiple record read
+			if ((g_FDC.stStatus.byCrcError == 0) && FdcNextRecord())
 			{
-				++g_tdTrack.pbyReadPtr;
-				--g_tdTrack.nReadCount;
-
-				if (g_tdTrack.nReadCount == 0)
-				{
-					g_FDC.nDataRegReadCount = 0;
-				}
-
-				FdcGenerateDRQ();
-				--g_FDC.nServiceState;
+				FdcStartSectorRead();
 				break;
 			}
 
+			g_FDC.nDataRegReadCount = 0;
 			g_FDC.nDrvSelWriteCount = 0;
 			g_FDC.nReadStatusCount  = 0;
-			g_FDC.dwStateCounter    = 20;
+			TimerStart(tmStateCounter, 20);
 			++g_FDC.nServiceState;
 			break;
 
 		case 5:
-			if (g_FDC.dwStateCounter != 0) // don't wait forever
+			if (TimerIsRunning(tmStateCounter)) // don't wait forever
 			{
+				FdcWaitForEvent();
 				break;
 			}
 
@@ -2095,32 +3491,83 @@ void FdcServiceReadSector(void)
 }
 
 //-----------------------------------------------------------------------------
-void WriteDmkSectorData(int nSector)
+void FdcServiceReadTrack(void)
+{
+	switch (g_FDC.nServiceState)
+	{
+		case 0: // hand the track over to fdc_isr(), see FdcServiceReadSector()
+			if (!FdcSectorHasArrived())
+			{
+				FdcWaitForEvent();
+				break;
+			}
+
+			g_FDC.dwTransferStart = time_us_32();
+			g_FDC.byIsrDataRead   = 1;
+
+			FdcGenerateDRQ();
+			++g_FDC.nServiceState;
+			break;
+
+		case 1: // wait for the last byte to be read by the Z80 (or a Force Interrupt)
+			if (g_FDC.byIsrDataRead)
+			{
+				FdcWaitForEvent();
+				break;
+			}
+
+			++g_fsStats.dwTrackReads;
+			g_fsStats.dwTrackReadBytes += g_ptdTrack->nReadSize;
+			g_fsStats.nTrackReadTime   += time_us_32() - g_FDC.dwTransferStart;
+
+			TimerStart(tmStateCounter, 20);
+			++g_FDC.nServiceState;
+			break;
+
+		case 2:
+			if (TimerIsRunning(tmStateCounter))
+			{
+				FdcWaitForEvent();
+				break;
+			}
+
+			FdcGenerateIntr();
+
+			g_FDC.stStatus.byBusy  = 0; // clear busy flag
+			g_FDC.nServiceState    = 0;
+			g_FDC.nProcessFunction = psIdle;
+			break;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// DMK and HFE both hold the sector in byTrackData with the same layout
+//
+void WriteTrackSectorData(int nSector)
 {
 	int  nDataOffset;
 
-	if ((g_tdTrack.nDrive < 0) || (g_tdTrack.nDrive >= MAX_DRIVES))
+	if ((g_ptdTrack->nDrive < 0) || (g_ptdTrack->nDrive >= MAX_DRIVES))
 	{
 		return;
 	}
 
-	if (g_dtDives[g_tdTrack.nDrive].f == NULL)
+	if (g_dtDives[g_ptdTrack->nDrive].f == NULL)
 	{
 		return;
 	}
 
 	// TODO: check to see if disk image is read only
 
-	nDataOffset = g_tdTrack.nSectorDAM[nSector];
+	nDataOffset = g_ptdTrack->nSectorDAM[nSector];
 
 	if (nDataOffset < 0)
 	{
 		return;
 	}
 	
-	FileSeek(g_dtDives[g_tdTrack.nDrive].f, g_tdTrack.nFileOffset+nDataOffset);
-	FileWrite(g_dtDives[g_tdTrack.nDrive].f, g_tdTrack.byTrackData+nDataOffset, g_stSector.nSectorSize+6);
-	FileFlush(g_dtDives[g_tdTrack.nDrive].f);
+	// data address mark, sector data and CRC.  Written to the SD-Card later by FdcWriteBackTrack().
+	FdcMarkTrackDirty(g_ptdTrack, nDataOffset, g_stSector.nSectorSize+6);
 }
 
 //-----------------------------------------------------------------------------
@@ -2131,10 +3578,8 @@ void WriteSectorData(int nSector)
 	switch (g_dtDives[nDrive].nDriveFormat)
 	{
 		case eDMK:
-			WriteDmkSectorData(nSector);
-			break;
-
 		case eHFE:
+			WriteTrackSectorData(nSector);
 			break;
 	}
 }
@@ -2147,28 +3592,28 @@ void FdcGenerateSectorCRC(int nSector, int nSectorSize)
 
 	// now locate the 0xA1, 0xA1, 0xA1, 0xFB sequence that marks the start of sector data
 
-	nDataOffset = g_tdTrack.nSectorDAM[nSector];
+	nDataOffset = g_ptdTrack->nSectorDAM[nSector];
 	
 	if (nDataOffset < 0)
 	{
 		return;
 	}
 
-	// CRC consists of the 0xA1, 0xA1, 0xA1, 0xFB sequence and the sector data
-	wCRC16 = Calculate_CRC_CCITT(&g_tdTrack.byTrackData[nDataOffset], nSectorSize+4);
+	// CRC consists of the 0xA1, 0xA1, 0xA1, 0xFB sequence (only the 0xFB in single density) and the sector data
+	wCRC16 = FdcCalculateMarkCRC(g_ptdTrack, &g_ptdTrack->byTrackData[nDataOffset+3], nSectorSize);
 		
-	g_tdTrack.byTrackData[nDataOffset+nSectorSize+4] = wCRC16 >> 8;
-	g_tdTrack.byTrackData[nDataOffset+nSectorSize+5] = wCRC16 & 0xFF;
+	g_ptdTrack->byTrackData[nDataOffset+nSectorSize+4] = wCRC16 >> 8;
+	g_ptdTrack->byTrackData[nDataOffset+nSectorSize+5] = wCRC16 & 0xFF;
 }
 
 //-----------------------------------------------------------------------------
 void FdcUpdateDataAddressMark(int nSector, int nSectorSize)
 {
-	int  nDataOffset, i;
+	int  nDataOffset;
 
 	// get offset of the 0xA1, 0xA1, 0xA1, 0xFB sequence that marks the start of sector data
 
-	nDataOffset = g_tdTrack.nSectorDAM[nSector];
+	nDataOffset = g_ptdTrack->nSectorDAM[nSector];
 
 	if (nDataOffset < 0)
 	{
@@ -2176,17 +3621,10 @@ void FdcUpdateDataAddressMark(int nSector, int nSectorSize)
 	}
 
 	// nDataOffset is the index of the first 0xA1 byte in the 0xA1, 0xA1, 0xA1, 0xFB sequence
+	// (0x00, 0x00, 0x00, 0xFB in single density)
 
 	// update sector data mark (0xFB/0xF8)
-
-	for (i = 0; i < 4; ++i)
-	{
-		if (g_tdTrack.byTrackData[nDataOffset+i] != 0xA1)
-		{
-			g_tdTrack.byTrackData[nDataOffset+i] = g_stSector.bySectorDataAddressMark;
-			i = 4;
-		}
-	}
+	g_ptdTrack->byTrackData[nDataOffset+3] = g_stSector.bySectorDataAddressMark;
 }
 
 //-----------------------------------------------------------------------------
@@ -2195,76 +3633,67 @@ void FdcServiceWriteSector(void)
 	switch (g_FDC.nServiceState)
 	{
 		case 0:
-			if ((g_FDC.nReadStatusCount < 25) && (g_FDC.dwStateCounter != 0))
+			if ((g_FDC.nReadStatusCount < WRITE_DRQ_STATUS_READS) && TimerIsRunning(tmStateCounter))
 			{
+				FdcWaitForEvent();
 				break;
 			}
 
-			// indicate to the Z80 that we are ready for the first data byte
-			FdcGenerateDRQ();
-			++g_FDC.nServiceState;
-			break;
-		
-		case 1:
-			if (g_FDC.stStatus.byDataRequest != 0) // wait for byte to be placed in the data register by the Z80
+			if (!FdcSectorHasArrived())
 			{
+				FdcWaitForEvent();
 				break;
 			}
 
-			g_FDC.dwStateCounter = 1000;
+			// hand the data register over to fdc_isr(), which stores each byte written
+			// by the Z80 at g_ptdTrack->pbyWritePtr and keeps DRQ set until the last byte
+			g_FDC.dwTransferStart = time_us_32();
+			g_FDC.byIsrDataWrite  = 1;
+
+			// indicate to the Z80 that we are ready for the first data byte
+			FdcGenerateDRQ();
 			++g_FDC.nServiceState;
 			break;
-
-		case 2:
-			if ((g_FDC.byWaitOutput == 0) && (g_FDC.dwStateCounter != 0)) // don't wait forever
-			{
-				break;
-			}
-
-			*g_tdTrack.pbyWritePtr = g_FDC.byData;
-
-			if (g_tdTrack.nWriteCount > 0)
+		
+		case 1: // wait for the last byte to be written by the Z80 (or a Force Interrupt)
+			if (g_FDC.byIsrDataWrite)
 			{
-				++g_tdTrack.pbyWritePtr;
-				--g_tdTrack.nWriteCount;
-
-				if (g_tdTrack.nWriteCount == 0)
-				{
-					++g_FDC.nServiceState;
-					break;
-				}
-				else if (g_tdTrack.nWriteCount == 1)
-				{
-					g_FDC.byHoldWaitOnDataWrite = 1; // request that wait be held after last data write in the write sequnce
-				}
-
-				--g_FDC.nServiceState;
-				FdcGenerateDRQ();
+				FdcWaitForEvent();
 				break;
 			}
 
-			g_FDC.dwStateCounter = 200;
 			++g_FDC.nServiceState;
 			break;
 
-		case 3:
+		case 2:
 			FdcUpdateDataAddressMark(g_stSector.nSector, g_stSector.nSectorSize);
 			
 			// perform a CRC on the sector data (including preceeding 4 bytes) and update sector CRC value
 			FdcGenerateSectorCRC(g_stSector.nSector, g_stSector.nSectorSize);
 			
-			// flush sector to SD-Card
+			// mark the sector for write-back to the SD-Card
 			WriteSectorData(g_stSector.nSector);
 		
 			FdcReleaseWait();
+
+			++g_fsStats.dwSectorWrites;
+			g_fsStats.nSectorWriteTime += time_us_32() - g_FDC.dwTransferStart;
+
+			if (FdcNextRecord())
+			{
+				FdcStartSectorWrite();
+				g_FDC.nReadStatusCount = WRITE_DRQ_STATUS_READS;	// the Z80 is already waiting for DRQ
+				break;
+			}
 		
 			++g_FDC.nServiceState;
-			g_FDC.dwStateCounter = 200;
+			TimerStart(tmStateCounter, 200);
 			break;
 		
-		case 4:
-			if (g_FDC.dwStateCounter != 0)
+		case 3:
+			if (TimerIsRunning(tmStateCounter))
 			{
+				FdcWaitForEvent();
 				break;
 			}
 
@@ -2366,6 +3795,8 @@ void FdcBuildIdamTable(TrackType* ptdTrack)
 //-----------------------------------------------------------------------------
 void FdcWriteDmkTrack(TrackType* ptdTrack)
 {
+	StorageRequestType sr;
+
 	if ((ptdTrack->nDrive < 0) || (ptdTrack->nDrive >= MAX_DRIVES))
 	{
 		return;
@@ -2378,9 +3809,91 @@ void FdcWriteDmkTrack(TrackType* ptdTrack)
 
 	ptdTrack->nFileOffset = FdcGetTrackOffset(ptdTrack->nDrive, ptdTrack->nSide, ptdTrack->nTrack);
 
-	FileSeek(g_dtDives[ptdTrack->nDrive].f, ptdTrack->nFileOffset);
-	FileWrite(g_dtDives[ptdTrack->nDrive].f, ptdTrack->byTrackData, ptdTrack->nTrackSize);
-	FileFlush(g_dtDives[ptdTrack->nDrive].f);
+	// an image held in RAM is written to the SD-Card later by RamDiskServiceWriteBack()
+	if (g_dtDives[ptdTrack->nDrive].pbyRamImage != NULL)
+	{
+		RamDiskWrite(ptdTrack->nDrive, ptdTrack->nFileOffset + ptdTrack->nDirtyStart, ptdTrack->byTrackData + ptdTrack->nDirtyStart, ptdTrack->nDirtyEnd - ptdTrack->nDirtyStart);
+		return;
+	}
+
+	// only the modified range is written, the storage worker reads it from byTrackData
+	// so the track must not be modified again until ptdTrack->dwIoTicket has completed.
+	sr.nRequest = srWriteBack;
+	sr.f        = g_dtDives[ptdTrack->nDrive].f;
+	sr.nOffset  = ptdTrack->nFileOffset + ptdTrack->nDirtyStart;
+	sr.pbyData  = ptdTrack->byTrackData + ptdTrack->nDirtyStart;
+	sr.nSize    = ptdTrack->nDirtyEnd - ptdTrack->nDirtyStart;
+
+	ptdTrack->dwIoTicket = StorageSubmit(&sr);
+}
+
+//-----------------------------------------------------------------------------
+// called by the storage worker to re-encode the modified sectors of an HFE track
+//
+UINT32 FdcSaveHfeTrack(TrackType* ptdTrack, int nStart, int nEnd)
+{
+	if ((ptdTrack->nDrive < 0) || (ptdTrack->nDrive >= MAX_DRIVES))
+	{
+		return 0;
+	}
+
+	if (g_dtDives[ptdTrack->nDrive].f == NULL)
+	{
+		return 0;
+	}
+
+	return SaveHfeTrack(g_dtDives[ptdTrack->nDrive].f, &g_dtDives[ptdTrack->nDrive].hfe, ptdTrack, nStart, nEnd);
+}
+
+//-----------------------------------------------------------------------------
+// called by the storage worker for srLoadHfeTrackStream requests.  Sets ptdTrack->pbyReadPtr
+// to the first byte of the track and returns the track length.
+//
+UINT32 FdcLoadHfeTrackStream(TrackType* ptdTrack)
+{
+	int nStart, nSize;
+
+	if ((ptdTrack->nDrive < 0) || (ptdTrack->nDrive >= MAX_DRIVES))
+	{
+		return 0;
+	}
+
+	if (g_dtDives[ptdTrack->nDrive].f == NULL)
+	{
+		return 0;
+	}
+
+	nSize = LoadHfeTrackStream(g_dtDives[ptdTrack->nDrive].f, &g_dtDives[ptdTrack->nDrive].hfe, ptdTrack, ptdTrack->byTrackData, sizeof(ptdTrack->byTrackData), &nStart);
+
+	ptdTrack->pbyReadPtr = ptdTrack->byTrackData + nStart;
+
+	return nSize;
+}
+
+//-----------------------------------------------------------------------------
+void FdcWriteHfeTrack(TrackType* ptdTrack)
+{
+	StorageRequestType sr;
+
+	if ((ptdTrack->nDrive < 0) || (ptdTrack->nDrive >= MAX_DRIVES))
+	{
+		return;
+	}
+
+	if (g_dtDives[ptdTrack->nDrive].f == NULL)
+	{
+		return;
+	}
+
+	// the dirty range is in byTrackData (decoded) offsets, only the 512 byte
+	// blocks of the HFE file that hold the modified sectors are written.
+	sr.nRequest = srWriteBackHfe;
+	sr.ptdTrack = ptdTrack;
+	sr.f        = g_dtDives[ptdTrack->nDrive].f;
+	sr.nOffset  = ptdTrack->nDirtyStart;
+	sr.nSize    = ptdTrack->nDirtyEnd - ptdTrack->nDirtyStart;
+
+	ptdTrack->dwIoTicket = StorageSubmit(&sr);
 }
 
 //-----------------------------------------------------------------------------
@@ -2393,6 +3906,7 @@ void FdcWriteTrack(TrackType* ptdTrack)
 			break;
 
 		case eHFE:
+			FdcWriteHfeTrack(ptdTrack);
 			break;
 	}
 }
@@ -2403,74 +3917,52 @@ void FdcServiceWriteTrack(void)
 	switch (g_FDC.nServiceState)
 	{
 		case 0:
-			if ((g_FDC.nReadStatusCount < 25) && (g_FDC.dwStateCounter != 0))
+			if ((g_FDC.nReadStatusCount < WRITE_DRQ_STATUS_READS) && TimerIsRunning(tmStateCounter))
 			{
+				FdcWaitForEvent();
 				break;
 			}
 
+			// hand the data register over to fdc_isr(), see FdcServiceWriteSector()
+			g_FDC.dwTransferStart = time_us_32();
+			g_FDC.byIsrDataWrite  = 1;
+
 			// indicate to the Z80 that we are ready for the first data byte
 			FdcGenerateDRQ();
 			++g_FDC.nServiceState;
 			break;
 		
-		case 1:
-			if (g_FDC.stStatus.byDataRequest != 0) // wait for byte to be placed in the data register by the Z80
+		case 1: // wait for the last byte to be written by the Z80 (or a Force Interrupt)
+			if (g_FDC.byIsrDataWrite)
 			{
+				FdcWaitForEvent();
 				break;
 			}
 
-			g_FDC.dwStateCounter = 1000;
 			++g_FDC.nServiceState;
 			break;
 
 		case 2:
-			if ((g_FDC.byWaitOutput == 0) && (g_FDC.dwStateCounter != 0)) // don't wait forever
-			{
-				break;
-			}
-
-			*g_tdTrack.pbyWritePtr = g_FDC.byData;
-
-			if (g_tdTrack.nWriteCount > 0)
-			{
-				++g_tdTrack.pbyWritePtr;
-				--g_tdTrack.nWriteCount;
-
-				if (g_tdTrack.nWriteCount == 0)
-				{
-					++g_FDC.nServiceState;
-					break;
-				}
-				else if (g_tdTrack.nWriteCount == 1)
-				{
-					g_FDC.byHoldWaitOnDataWrite = 1; // request that wait be held after last data write in the write sequnce
-				}
-
-				--g_FDC.nServiceState;
-				FdcGenerateDRQ();
-				break;
-			}
-
-			g_FDC.dwStateCounter = 200;
-			++g_FDC.nServiceState;
-			break;
-
-		case 3:
-			FdcProcessTrackData(&g_tdTrack);	// scan track data to generate CRC values
-			FdcBuildIdamTable(&g_tdTrack);		// scan track data to build the IDAM table
-			FdcFillSectorOffset(&g_tdTrack);
+			FdcProcessTrackData(g_ptdTrack);	// scan track data to generate CRC values
+			FdcBuildIdamTable(g_ptdTrack);		// scan track data to build the IDAM table
+			FdcIndexDmkTrack(g_ptdTrack, NULL);
 
 			// flush track to SD-Card
-			FdcWriteTrack(&g_tdTrack);
+			FdcMarkTrackDirty(g_ptdTrack, 0, g_ptdTrack->nTrackSize);
+			FdcWriteBackTrack(g_ptdTrack);
 			FdcReleaseWait();
+
+			++g_fsStats.dwTrackWrites;
+			g_fsStats.nTrackWriteTime += time_us_32() - g_FDC.dwTransferStart;
 		
-			g_FDC.dwStateCounter = 200;
+			TimerStart(tmStateCounter, 200);
 			++g_FDC.nServiceState;
 			break;
 
-		case 4:
-			if (g_FDC.dwStateCounter != 0)
+		case 3:
+			if (TimerIsRunning(tmStateCounter))
 			{
+				FdcWaitForEvent();
 				break;
 			}
 
@@ -2494,14 +3986,14 @@ void FdcServiceMountImage(void)
 	switch (g_FDC.nServiceState)
 	{
 		case 0:
-			g_FDC.dwStateCounter         = 100000;
+			TimerStart(tmStateCounter, 100000);
 			g_FDC.stStatus.byDataRequest = 1;
 			g_FDC.stStatus.byBusy        = 0;
 			++g_FDC.nServiceState;
 			break;
 
 		case 1: // first byte received is the size of the data to be received
-			if (g_FDC.dwStateCounter == 0) // don't wait forever
+			if (!TimerIsRunning(tmStateCounter)) // don't wait forever
 			{
 				g_FDC.nProcessFunction = psIdle;
 				break;
@@ -2515,14 +4007,14 @@ void FdcServiceMountImage(void)
 			nSize  = g_FDC.byData;
 			nIndex = 0;
 			
-			g_FDC.dwStateCounter         = 100000;
+			TimerStart(tmStateCounter, 100000);
 			g_FDC.stStatus.byDataRequest = 1;
 			g_FDC.stStatus.byBusy        = 0;
 			++g_FDC.nServiceState;
 			break;
 
 		case 2: // now request each data byte
-			if (g_FDC.dwStateCounter == 0) // don't wait forever
+			if (!TimerIsRunning(tmStateCounter)) // don't wait forever
 			{
 				g_FDC.nProcessFunction = psIdle;
 				break;
@@ -2563,20 +4055,29 @@ void FdcServiceMountImage(void)
 				}
 				
 				// if test if it is an ini file
-				if (stristr(g_FDC.byTransferBuffer, ".ini"))
+				if (stristr((char*)g_FDC.byTransferBuffer, ".ini"))
 				{
-					FdcSaveBootCfg((char*)psz);
+					StorageCallFunction(FdcSaveBootCfg, (char*)psz);
 				}
-				else if (FileExists((char*)psz))
+				else if (StorageCallFunction(FdcFileExists, (char*)psz))
 				{
 					strcpy(g_dtDives[nDrive].szFileName, (char*)psz);
-					FileClose(g_dtDives[nDrive].f);
+					FdcFlushTrackCache(nDrive);
+					StorageWaitIdle();
+					TrackCacheInvalidate(nDrive);
+					RamDiskRelease(nDrive);
+
+					if (g_dtDives[nDrive].f != NULL)
+					{
+						StorageCallFunction(FdcCloseFile, g_dtDives[nDrive].f);
+					}
+
 					g_dtDives[nDrive].f = NULL;
 					FdcMountDrive(nDrive);
 				}
 			}
 			
-			g_FDC.dwStateCounter  = 100000;
+			TimerStart(tmStateCounter, 100000);
 			g_FDC.stStatus.byBusy = 0;
 			break;
 	}
@@ -2593,14 +4094,14 @@ void FdcServiceOpenFile(void)
 	switch (g_FDC.nServiceState)
 	{
 		case 0:
-			g_FDC.dwStateCounter         = 10000;
+			TimerStart(tmStateCounter, 10000);
 			g_FDC.stStatus.byDataRequest = 1;
 			g_FDC.stStatus.byBusy        = 0;
 			++g_FDC.nServiceState;
 			break;
 
 		case 1: // first byte received is the size of the data to be received
-			if (g_FDC.dwStateCounter == 0) // don't wait forever
+			if (!TimerIsRunning(tmStateCounter)) // don't wait forever
 			{
 				g_FDC.nProcessFunction = psIdle;
 				break;
@@ -2614,14 +4115,14 @@ void FdcServiceOpenFile(void)
 			nSize  = g_FDC.byData;
 			nIndex = 0;
 			
-			g_FDC.dwStateCounter         = 10000;
+			TimerStart(tmStateCounter, 10000);
 			g_FDC.stStatus.byDataRequest = 1;
 			g_FDC.stStatus.byBusy        = 0;
 			++g_FDC.nServiceState;
 			break;
 
 		case 2: // now request each data byte
-			if (g_FDC.dwStateCounter == 0) // don't wait forever
+			if (!TimerIsRunning(tmStateCounter)) // don't wait forever
 			{
 				g_FDC.nProcessFunction = psIdle;
 				break;
@@ -2685,16 +4186,11 @@ void FdcServiceOpenFile(void)
 
 					++psz;
 				}
-				
-				if (g_fOpenFile != NULL)
-				{
-					FileClose(g_fOpenFile);
-				}
-				
-				g_fOpenFile = FileOpen((char*)g_FDC.byTransferBuffer, byMode);
+
+				StorageCallFunction(FdcOpenHostFile, &byMode);
 			}
 			
-			g_FDC.dwStateCounter  = 10000;
+			TimerStart(tmStateCounter, 10000);
 			g_FDC.stStatus.byBusy = 0;
 			break;
 	}
@@ -2705,18 +4201,19 @@ void FdcServiceWriteFile(void)
 {
 	static int nIndex;
 	static int nSize;
+	StorageRequestType sr;
 
 	switch (g_FDC.nServiceState)
 	{
 		case 0:
-			g_FDC.dwStateCounter         = 10000;
+			TimerStart(tmStateCounter, 10000);
 			g_FDC.stStatus.byDataRequest = 1;
 			g_FDC.stStatus.byBusy        = 0;
 			++g_FDC.nServiceState;
 			break;
 
 		case 1: // first byte received is the size of the data to be received
-			if (g_FDC.dwStateCounter == 0) // don't wait forever
+			if (!TimerIsRunning(tmStateCounter)) // don't wait forever
 			{
 				g_FDC.nProcessFunction = psIdle;
 				break;
@@ -2730,14 +4227,14 @@ void FdcServiceWriteFile(void)
 			nSize  = g_FDC.byData;
 			nIndex = 0;
 			
-			g_FDC.dwStateCounter         = 10000;
+			TimerStart(tmStateCounter, 10000);
 			g_FDC.stStatus.byDataRequest = 1;
 			g_FDC.stStatus.byBusy        = 0;
 			++g_FDC.nServiceState;
 			break;
 
 		case 2: // now request each data byte
-			if (g_FDC.dwStateCounter == 0) // don't wait forever
+			if (!TimerIsRunning(tmStateCounter)) // don't wait forever
 			{
 				g_FDC.nProcessFunction = psIdle;
 				break;
@@ -2761,11 +4258,16 @@ void FdcServiceWriteFile(void)
 				
 				if (g_fOpenFile != NULL)
 				{
-					FileWrite(g_fOpenFile, g_FDC.byTransferBuffer, nSize);
+					sr.nRequest = srFileWrite;
+					sr.f        = g_fOpenFile;
+					sr.pbyData  = g_FDC.byTransferBuffer;
+					sr.nSize    = nSize;
+
+					StorageCall(&sr);
 				}
 			}
 			
-			g_FDC.dwStateCounter  = 10000;
+			TimerStart(tmStateCounter, 10000);
 			g_FDC.stStatus.byBusy = 0;
 			break;
 	}
@@ -2781,14 +4283,14 @@ void FdcServiceSetTime(void)
 	switch (g_FDC.nServiceState)
 	{
 		case 0:
-			g_FDC.dwStateCounter         = 10000;
+			TimerStart(tmStateCounter, 10000);
 			g_FDC.stStatus.byDataRequest = 1;
 			g_FDC.stStatus.byBusy        = 0;
 			++g_FDC.nServiceState;
 			break;
 
 		case 1: // first byte received is the size of the data to be received
-			if (g_FDC.dwStateCounter == 0) // don't wait forever
+			if (!TimerIsRunning(tmStateCounter)) // don't wait forever
 			{
 				g_FDC.nProcessFunction = psIdle;
 				break;
@@ -2802,14 +4304,14 @@ void FdcServiceSetTime(void)
 			nSize  = g_FDC.byData;
 			nIndex = 0;
 			
-			g_FDC.dwStateCounter         = 10000;
+			TimerStart(tmStateCounter, 10000);
 			g_FDC.stStatus.byDataRequest = 1;
 			g_FDC.stStatus.byBusy        = 0;
 			++g_FDC.nServiceState;
 			break;
 
 		case 2: // now request each data byte
-			if (g_FDC.dwStateCounter == 0) // don't wait forever
+			if (!TimerIsRunning(tmStateCounter)) // don't wait forever
 			{
 				g_FDC.nProcessFunction = psIdle;
 				break;
@@ -2834,7 +4336,7 @@ void FdcServiceSetTime(void)
 				g_FDC.nProcessFunction = psIdle;
 			}
 			
-			g_FDC.dwStateCounter  = 10000;
+			TimerStart(tmStateCounter, 10000);
 			g_FDC.stStatus.byBusy = 0;
 			break;
 	}
@@ -2844,7 +4346,7 @@ void FdcServiceSetTime(void)
 // primary data transfer is handled in fdc_isr()
 void FdcServiceSendData(void)
 {
-	if (g_FDC.dwStateCounter != 0) // don't wait forever
+	if (TimerIsRunning(tmStateCounter)) // don't wait forever
 	{
 		return;
 	}
@@ -2855,7 +4357,61 @@ void FdcServiceSendData(void)
 }
 
 //-----------------------------------------------------------------------------
-void FdcServiceStateMachine(void)
+// called by a process function that has nothing to do until a timer expires or the
+// Z80 accesses a register of the FDC, both of which post an event
+//
+void FdcWaitForEvent(void)
+{
+	g_FDC.byProcessWaiting = 1;
+}
+
+//-----------------------------------------------------------------------------
+// returns TRUE when the state machine has nothing to do until the next event,
+// in which case the main loop may sleep in EventWait().  Work that is only due
+// later (a head move, a sector reaching the head, a held write or a read-ahead)
+// waits for its timer, whose expiry posts EVENT_TIMER.
+//
+BYTE FdcIsIdle(void)
+{
+	if (g_FDC.byCommandReceived || g_FDC.byResetFDC)
+	{
+		return FALSE;
+	}
+
+	if ((g_FDC.nProcessFunction != psIdle) && !g_FDC.byProcessWaiting)
+	{
+		return FALSE;
+	}
+
+	if ((g_FDC.bySdCardPresent != sd_byCardInialized) || ((g_FDC.byDriveSel & 0x0F) != g_byPrevDriveSel))
+	{
+		return FALSE;
+	}
+
+	if (g_FDC.nProcessFunction != psIdle)
+	{
+		return TRUE;
+	}
+
+	// write back and read-ahead are serviced while idle.  The completion of a storage
+	// request wakes the main loop (see StorageSignal()).
+	if ((g_nPrefetchIndex < g_nPrefetchCount) && !TimerIsRunning(tmPrefetch) && StorageIsIdle())
+	{
+		return FALSE;
+	}
+
+	if ((FdcGetWriteBackDelay() == 0) && StorageIsIdle())
+	{
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// dwEvents are the events returned by EventTake() for this pass of the main loop
+//
+void FdcServiceStateMachine(DWORD dwEvents)
 {
 	// test is we have has a reset pulse of at least 0.5ms
 	if (g_FDC.byResetFDC)
@@ -2865,7 +4421,18 @@ void FdcServiceStateMachine(void)
 		return;
 	}
 
-	TestSdCardInsertion();
+	// card detection mounts the file system, which the storage worker may be using
+	if (dwEvents & EVENT_CARD_DETECT)
+	{
+		if (StorageIsIdle())
+		{
+			TestSdCardInsertion();
+		}
+		else
+		{
+			PostEvent(EVENT_CARD_DETECT); // try again on the next pass
+		}
+	}
 
 	if (g_FDC.bySdCardPresent != sd_byCardInialized)
 	{
@@ -2881,6 +4448,13 @@ void FdcServiceStateMachine(void)
 		g_FDC.bySdCardPresent = sd_byCardInialized;
 	}
 
+	// held sector writes are written back as soon as a different drive is selected
+	if ((g_FDC.byDriveSel & 0x0F) != g_byPrevDriveSel)
+	{
+		FdcFlushTrackCache(-1);
+		g_byPrevDriveSel = g_FDC.byDriveSel & 0x0F;
+	}
+
 	// check if we have a command to process
 	if (g_FDC.byCommandReceived != 0)
 	{
@@ -2888,9 +4462,27 @@ void FdcServiceStateMachine(void)
 		return;
 	}
 
+	g_FDC.byProcessWaiting = 0;
+
+	// the idle time of the read-ahead counts from the end of the last command, a burst
+	// of sector reads has gaps of a few us between its commands
+	if ((g_FDC.nProcessFunction == psIdle) && (g_nPrevProcessFunction != psIdle))
+	{
+		TimerStart(tmPrefetch, PREFETCH_IDLE_TIME);
+	}
+
+	g_nPrevProcessFunction = g_FDC.nProcessFunction;
+
 	switch (g_FDC.nProcessFunction)
 	{
 		case psIdle:
+			FdcServiceWriteBack();
+
+			if (ENABLE_TRACK_PREFETCH)
+			{
+				FdcServicePrefetch();
+			}
+
 			break;
 		
 		case psReadSector:
@@ -2905,6 +4497,14 @@ void FdcServiceStateMachine(void)
 			FdcServiceWriteTrack();
 			break;
 		
+		case psReadTrack:
+			FdcServiceReadTrack();
+			break;
+		
+		case psHeadMove:
+			FdcServiceHeadMove();
+			break;
+		
 		case psSendData:
 			FdcServiceSendData();
 			break;
@@ -6,11 +6,13 @@ extern "C" {
 #endif
 
 #include "file.h"
+#include "timers.h"
 
 /* global defines ========================================================*/
 
 #define MAX_DRIVES 4
 #define DMK_HEADER_SIZE 16
+#define DMK_IDAM_TABLE_SIZE 64		// number of IDAM pointers at the start of each DMK track
 
 #define BLOCK_SIZE 512
 #define NUM_BLOCKS 32
@@ -92,6 +94,8 @@ enum {
 	psReadSector = 1,
 	psWriteSector,
 	psWriteTrack,
+	psReadTrack,
+	psHeadMove,
 	psSendData,
 	psMountImage,
 	psOpenFile,
@@ -105,6 +109,14 @@ enum {
 	eHD,
 };
 
+// drive timing profiles, TIMINGn= in the ini file.  Each profile scales the step, head
+// settle and rotational delays of a real drive by a percentage (0 => no delay).
+enum {
+	eTimingTurbo = 0,				// TURBO - no delays, the next sector is always under the head
+	eTimingRealistic,				// REALISTIC (or ACCURATE) - the delays of a real drive (100%)
+	eTimingCustom,					// CUSTOM,step%,settle%,rotation%
+};
+
 enum {
 	eUnknown = 0,
 	eDMK,
@@ -191,11 +203,27 @@ typedef struct {
 	int    nSectorSize;
 } DmkDriveType;
 
+// RAMn=YES in the ini file holds the DMK image of drive n in RAM (see ramdisk.c)
+#define RAM_DISK_BLOCK_SIZE   512		// the modified parts of an image are tracked in blocks of this size
+#define RAM_DISK_MAX_BLOCKS   512		// largest image that can be tracked (in practice the free track cache RAM is the limit)
+#define RAM_DISK_WRITE_BLOCKS 8			// blocks written to the SD-Card by each background write-back request
+
 typedef struct {
 	file* f;
 	char  szFileName[128];
 	int   nDriveFormat;
 	BYTE  byNumTracks;
+	BYTE  byTimingMode;				// eTimingTurbo, eTimingRealistic or eTimingCustom
+	WORD  wStepScale;				// % of the step rate of type 1 commands
+	WORD  wSettleScale;				// % of the head settle time (V flag of type 1, E flag of type 2 and 3 commands)
+	WORD  wRotationScale;			// % of the time for the sector to reach the head
+
+	BYTE  byRamDisk;				// RAMn=YES, hold the image in RAM when it is mounted
+	BYTE* pbyRamImage;				// the image held in RAM, NULL if the drive is read from the SD-Card
+	DWORD dwRamImageSize;
+	DWORD dwRamDirty[RAM_DISK_MAX_BLOCKS/32];	// blocks of the image modified in RAM and not yet written to the SD-Card
+	DWORD dwRamDirtyTime;			// time_us_32() of the oldest modification not yet written
+	DWORD dwRamIoTicket;			// storage worker ticket of the last write-back that reads pbyRamImage
 
 	union {
 		DmkDriveType dmk;
@@ -204,7 +232,8 @@ typedef struct {
 } DriveType;
 
 typedef struct {
-	int nType;
+	int  nType;
+	BYTE byDensity;					// eSD (FM) or eDD (MFM), selects how the CRC of an address mark is calculated
 
 	int nDrive;
 	int nSide;
@@ -218,21 +247,121 @@ typedef struct {
 
 	int nFileOffset;				// byte offset from the start of the file to the start of this track
 
-	int nSectorIDAM[0x80];			// byte offset from start of track buffer for each ID Address Mark
-	int nSectorDAM[0x80];			// byte offset from start of track buffer for each Data Address Mark
+	// sector index, indexed by the sector number of the ID field (see FdcIndexSector())
+	int  nSectorIDAM[0x80];			// byte offset from start of track buffer of the 0xFE of each ID Address Mark, -1 if not present
+	int  nSectorDAM[0x80];			// byte offset from start of track buffer of the first 0xA1 of each Data Address Mark, -1 if not present
+	int  nSectorSize[0x80];			// number of data bytes of each sector
+	BYTE bySectorIdCrcOk[0x80];		// 1 => the CRC of the ID field is valid
 
-	int nSectorIDAM_BitPos[0x80];	// bit offset from start of track buffer for each ID Address Mark
-	int nSectorDAM_BitPos[0x80];	// bit offset from start of track buffer for each Data Address Mark
+	int nSectorIDAM_BitPos[0x80];	// bit offset from start of the raw HFE track for each ID Address Mark
+	int nSectorDAM_BitPos[0x80];	// bit offset from start of the raw HFE track for each Data Address Mark
 
 	BYTE* pbyReadPtr;
 	BYTE* pbyWritePtr;
 
+	BYTE  byDirty;					// 1 => byTrackData has been modified and not yet written to the SD-Card
+	int   nDirtyStart;				// offset in byTrackData of the first modified byte
+	int   nDirtyEnd;				// offset in byTrackData one past the last modified byte
+	DWORD dwDirtyTime;				// time_us_32() at which the track was first modified
+	DWORD dwLastUsed;				// track cache access stamp, the slot with the lowest value is evicted first
+	BYTE  byPrefetched;				// 1 => loaded by read-ahead and not yet requested by the Z80
+	DWORD dwLoadTicket;				// storage worker ticket of the request that loads byTrackData
+	DWORD dwIoTicket;				// storage worker ticket of the last request that uses byTrackData
+
+	// rotational position model (see FdcGetHeadPosition())
+	int   nIndexOffset;				// offset in byTrackData of the byte that follows the index pulse
+	int   nRevolutionSize;			// number of bytes that pass under the head in one revolution
+	int   nTurboPosition;			// turbo timing: offset of the end of the last field accessed, where the
+									// next Read Address starts its search (-1 => from the head position)
+
 	int   nTrackSize;
 	BYTE  byTrackData[MAX_TRACK_SIZE];
 } TrackType;
 
 #define MAX_SECTOR_SIZE 256
 
+// RAM set aside for decoded tracks.  Each slot holds one TrackType so the number of
+// tracks that can be held in memory at once is the budget divided by the slot size.
+// RAM disk images are held at the end of the same RAM, the slots they cover are taken
+// out of the cache while the image is mounted (see TrackCacheReserve()).  The budget
+// is the least that holds a 40 track single sided image (RAM_DISK_MIN_IMAGE_SIZE)
+// plus TRACK_CACHE_MIN_SLOTS: 149744 bytes with the 19168 byte slots of the ILP32
+// map, 7 slots when no image is mounted.  Together with the other static buffers
+// (HFE 42 KB, File.c 20 KB, fdc.c 10 KB) it leaves ~34 KB of the 256 KB of main
+// SRAM for the SDK, the SD driver and the heap.
+#define RAM_DISK_MIN_IMAGE_SIZE (16 + 40 * 0x0CC0)
+#define TRACK_CACHE_MIN_SLOTS   1
+#define TRACK_CACHE_RAM_BUDGET  (RAM_DISK_MIN_IMAGE_SIZE + TRACK_CACHE_MIN_SLOTS * sizeof(TrackType))
+#define TRACK_CACHE_SLOTS       (TRACK_CACHE_RAM_BUDGET / sizeof(TrackType))
+
+// set to 1 to read the tracks most likely to be requested next into spare cache
+// slots while the FDC is idle (the opposite side of the current track and track+1)
+#define ENABLE_TRACK_PREFETCH 1
+#define PREFETCH_DEPTH        2
+#define PREFETCH_IDLE_TIME    1000	// us without a new command before a read-ahead is started (tmPrefetch)
+
+// status reads by the Z80 after a write command before the first DRQ (or tmStateCounter)
+#define WRITE_DRQ_STATUS_READS 25
+
+// sector writes are held in the track cache and written to the SD-Card as a single
+// range when the track or drive changes, the FDC has been idle for WRITEBACK_IDLE_TIME
+// or the oldest modification is older than the max dirty age (WRITEDELAY= in the ini
+// file, in ms).
+#define WRITEBACK_IDLE_TIME      50000	// us
+#define WRITEBACK_MAX_DIRTY_AGE 500000	// us, default when WRITEDELAY is not specified
+#define WRITEBACK_NONE      0xFFFFFFFF	// FdcGetWriteBackDelay() when no write is held
+
+#define HEAD_SETTLE_TIME 15000	// us, WD1793 head settle delay at 1MHz
+
+typedef struct {
+	DWORD dwHits;					// track requests satisfied from the cache
+	DWORD dwMisses;					// track requests that required a read from the SD-Card
+	DWORD dwEvictions;				// slots reused for a different track
+	DWORD dwWriteBacks;				// dirty slots written back to the SD-Card
+	DWORD dwBytesRead;				// bytes read from the SD-Card to fill slots
+	DWORD dwPrefetches;				// tracks loaded by read-ahead
+	DWORD dwPrefetchHits;			// read-ahead tracks that were later requested (useful prefetches)
+	DWORD dwOverlappedLoads;		// track reads started while the previous track was decoded
+	DWORD dwSeekCount;				// number of seek commands
+	DWORD dwSeekTimeMax;			// longest time taken to load the seek destination track (us)
+	UINT64 nSeekTimeTotal;			// total time taken to load the seek destination tracks (us)
+} TrackCacheStatsType;
+
+// number of entries in the storage worker request queue (must be a power of 2)
+#define STORAGE_QUEUE_SIZE 8
+
+enum {
+	srLoadTrack = 1,				// read and decode ptdTrack from the SD-Card
+	srWriteBack,					// seek to nOffset, write nSize bytes at pbyData and flush
+	srFileRead,						// read nSize bytes into pbyData at the current file position
+	srFileWrite,					// write nSize bytes at pbyData at the current file position
+	srWriteBackHfe,					// re-encode the sectors of ptdTrack in [nOffset, nOffset+nSize) and write the modified blocks
+	srLoadHfeTrackStream,			// decode the gaps of ptdTrack so that byTrackData holds the complete track (Read Track)
+	srCall,							// call pCall(pArg), file access made on behalf of core0 (mount, ini, host file commands)
+};
+
+typedef struct {
+	DWORD dwImages;					// images loaded into RAM at mount
+	DWORD dwRefused;				// images with RAMn=YES that did not fit and are read from the SD-Card
+	DWORD dwLoadTime;				// time taken to read the last image into RAM (us)
+	DWORD dwTrackReads;				// track loads copied from RAM
+	DWORD dwTrackWrites;			// tracks written back into RAM
+	DWORD dwWriteBacks;				// write requests queued for the modified blocks of the images
+	DWORD dwWriteBackBytes;			// bytes written by those requests
+} RamDiskStatsType;
+
+typedef struct {
+	int        nRequest;
+	TrackType* ptdTrack;
+	file*      f;
+	int        nOffset;
+	BYTE*      pbyData;
+	int        nSize;
+	UINT32     (*pCall)(void* pArg);	// srCall only, must not wait for the storage worker
+	void*      pArg;
+	UINT32     nResult;				// set by the worker
+} StorageRequestType;
+
 typedef struct {
 	int   nSector;
 	int   nSectorSize;
@@ -292,20 +421,15 @@ typedef struct {
 	BYTE  byWaitOutput;		// when 1 => wait line is being held low;
 							//      0 => wait line is released;
 
-	DWORD dwWaitTimeoutCount;
-	DWORD dwRotationCount;
+	DWORD dwIndexStart;		// TimerGetTime() at the start of an index pulse, the rotational position is
+							// measured from it (see FdcGetRotationCount()).
+							// the drive motor is ON while tmMotorOn is running (reloaded by each DRV_SEL write),
+							// WAIT and the state timeouts are tmWaitTimeout and tmStateCounter (see timers.h).
 
-	DWORD dwMotorOnTimer;	// when not zero the drive motor is considered to be ON.
-							// when it reaches zero (after approximately 2 seconds) the motor is considered OFF.
-							// the 2 second count is reloated each time the DRV_SEL latch is written too.
-
-	DWORD dwResetCount;		// increments when the FDC RESET input is low, is set to zero when FDC RESET is high
-							// this can be used to determine if the FDC has received a RESET pulse
-	BYTE  byResetFDC;
+	BYTE  byResetFDC;		// set when the FDC RESET input has been low for g_dwResetTime (tmReset)
 
 	int   nProcessFunction;
 	int   nServiceState;
-	DWORD dwStateCounter;
 
 	int   nReadStatusCount;
 	int   nDrvSelWriteCount;
@@ -317,31 +441,125 @@ typedef struct {
 
 	int   nDataRegReadCount;
 
+	BYTE  byStatusReg;		// status register value returned by fdc_isr(), see FdcUpdateStatus()
+
+	BYTE  byIsrDataRead;	// 1 => data register reads are served by fdc_isr() directly from g_ptdTrack->pbyReadPtr
+	BYTE  byIsrDataWrite;	// 1 => data register writes are stored by fdc_isr() directly at g_ptdTrack->pbyWritePtr
+	BYTE  byProcessWaiting;	// 1 => the process function waits for a timer or the Z80 (see FdcWaitForEvent())
+	DWORD dwTransferStart;	// time_us_32() at which the current sector transfer was started
+	DWORD dwSettleTime;		// head settle delay (us) to be added to the next FdcScheduleRotation()
+							// the head move and the sector arrival are timed by tmHeadMove and tmSectorArrival
+
 	BYTE  byTransferBuffer[256];
 	int   nTransferSize;
 	int   nTrasferIndex;
 } FdcType;
 
+typedef struct {
+	DWORD  dwSectorReads;			// number of completed sector (and address) reads
+	DWORD  dwSectorReadBytes;		// bytes transfered to the Z80 by those reads
+	UINT64 nSectorReadTime;			// time from the first DRQ to the last data byte read (us)
+	DWORD  dwSectorWrites;			// number of completed sector writes
+	UINT64 nSectorWriteTime;		// time from the first DRQ to the sector being written to the SD-Card (us)
+	DWORD  dwTrackReads;			// number of completed Read Track commands
+	DWORD  dwTrackReadBytes;		// bytes transfered to the Z80 by those reads
+	UINT64 nTrackReadTime;			// time from the first DRQ to the last data byte read (us)
+	DWORD  dwTrackWrites;			// number of completed Write Track (format) commands
+	UINT64 nTrackWriteTime;			// time from the first DRQ to the track being written to the SD-Card (us)
+	DWORD  dwSdWrites;				// write requests completed by the storage worker
+	DWORD  dwSdWriteBytes;			// bytes written to the SD-Card by those requests
+	DWORD  dwRotationalWaits;		// sector and address reads/writes delayed by the timing profile of the drive
+	UINT64 nRotationalWaitTime;		// total time those commands waited for head settle and the sector to reach the head (us)
+	DWORD  dwHeadMoves;				// type 1 commands delayed by the timing profile of the drive
+	UINT64 nHeadMoveTime;			// total time of those delays (us)
+	DWORD  dwIsrCalls;				// number of fdc_isr() calls
+	UINT64 nIsrCycles;				// total CPU cycles spent in fdc_isr()
+	DWORD  dwIsrCyclesMax;			// longest fdc_isr() call in CPU cycles
+	UINT64 nStatsStart;				// TimerGetTime() when the counters were cleared
+	DWORD  dwLoopCount;				// passes of the main loop
+	DWORD  dwSleeps;				// passes that ended in EventWait()
+	UINT64 nIdleTime;				// total time slept in EventWait() (us)
+} FdcStatsType;
+
 /* ==============================================================*/
 
 extern FdcType   g_FDC;
-extern TrackType g_tdTrack;
+extern DriveType g_dtDives[MAX_DRIVES];
+extern FdcStatsType g_fsStats;
+extern TrackType* g_ptdTrack;
+extern TrackCacheStatsType g_tcsStats;
+extern RamDiskStatsType g_rdStats;
 
 /* function prototypes ==========================================*/
 
-void LoadHfeTrack(file* pFile, int nTrack, int nSide, HfeDriveType* pdisk, TrackType* ptrack, BYTE* pbyTrackData, int nMaxLen);
+void       TrackCacheInit(void);
+TrackType* TrackCacheFind(int nDrive, int nSide, int nTrack);
+BYTE       TrackCacheContains(int nDrive, int nSide, int nTrack);
+TrackType* TrackCacheGetVictim(void);
+TrackType* TrackCacheGetSlot(int nSlot);
+void       TrackCacheAssign(TrackType* ptdTrack, int nDrive, int nSide, int nTrack);
+void       TrackCacheInvalidate(int nDrive);
+int        TrackCacheSlotCount(void);
+void       TrackCacheReserve(DWORD dwBytes);
+BYTE*      TrackCacheRamEnd(void);
+
+void   RamDiskInit(void);
+DWORD  RamDiskFree(void);
+BYTE   RamDiskMount(int nDrive);
+void   RamDiskRelease(int nDrive);
+void   RamDiskReadTrack(int nDrive, int nOffset, BYTE* pby, int nSize);
+void   RamDiskWrite(int nDrive, int nOffset, BYTE* pby, int nSize);
+void   RamDiskServiceWriteBack(BYTE byIdle, DWORD dwMaxDirtyAge);
+void   RamDiskFlush(int nDrive);
+BYTE   RamDiskIsDirty(void);
+int    RamDiskDirtyBlocks(int nDrive);
+
+void   StorageInit(void);
+void   StorageWorker(void);
+BYTE   StorageServiceQueue(void);
+DWORD  StorageSubmit(StorageRequestType* psr);
+BYTE   StorageIsComplete(DWORD dwTicket);
+BYTE   StorageIsIdle(void);
+void   StorageWait(DWORD dwTicket);
+void   StorageWaitIdle(void);
+DWORD  StorageLastTicket(void);
+UINT32 StorageCall(StorageRequestType* psr);
+UINT32 StorageCallFunction(UINT32 (*pCall)(void* pArg), void* pArg);
+
+void   LoadHfeTrack(file* pFile, int nTrack, int nSide, HfeDriveType* pdisk, TrackType* ptrack, BYTE* pbyTrackData, int nMaxLen);
+UINT32 SaveHfeTrack(file* pFile, HfeDriveType* pdisk, TrackType* ptrack, int nStart, int nEnd);
+void   HfeInvalidateRawTrack(void);
+int    LoadHfeTrackStream(file* pFile, HfeDriveType* pdisk, TrackType* ptrack, BYTE* pbyTrackData, int nMaxLen, int* pnStart);
 
 BYTE FdcGetCommandType(BYTE byCommand);
 void FdcGenerateIntr(void);
 BYTE FdcGetStatus(void);
+void FdcUpdateStatus(void);
 void FdcStartCapture(void);
 void FdcInit(void);
 void FdcReset(void);
 void FdcProcessCommand(void);
-void FdcServiceStateMachine(void);
+BYTE FdcIsIdle(void);
+void FdcWaitForEvent(void);
+DWORD FdcGetWriteBackDelay(void);
+void FdcServiceStateMachine(DWORD dwEvents);
 void FdcProcessConfigEntry(char szLabel[], char* psz);
 void FdcReleaseWait(void);
 void FdcCloseAllFiles(void);
+void FdcWriteTrack(TrackType* ptdTrack);
+void FdcWriteBackTrack(TrackType* ptdTrack);
+void FdcMarkTrackDirty(TrackType* ptdTrack, int nOffset, int nSize);
+void FdcFlushTrackCache(int nDrive);
+TrackType* FdcFillTrackSlot(int nDrive, int nSide, int nTrack);
+BYTE FdcStartTrackLoad(TrackType* ptdTrack);
+void FdcFinishTrackLoad(TrackType* ptdTrack, BYTE byStarted);
+void FdcDecodeTrack(TrackType* ptdTrack, TrackType* ptdLoading);
+UINT32 FdcSaveHfeTrack(TrackType* ptdTrack, int nStart, int nEnd);
+UINT32 FdcLoadHfeTrackStream(TrackType* ptdTrack);
+void FdcClearSectorIndex(TrackType* ptdTrack);
+int  FdcIndexSector(TrackType* ptdTrack, int nIDAM, int nDAM);
+void FdcIndexDmkTrack(TrackType* ptdTrack, file* pfRead);
+int  FdcGetIDAM_Index(TrackType* ptdTrack, int nSector);
 
 #ifdef __cplusplus
 }
@@ -9,20 +9,79 @@ extern "C" {
 
 #define MAX_FILES 6
 
+// block cache, FILE_CACHE_BLOCKS blocks of FILE_BLOCK_SIZE bytes for each open file (minimum 1)
+#define FILE_BLOCK_SIZE   512
+#define FILE_NO_BLOCK     0xFFFFFFFF
+
+#ifndef FILE_CACHE_BLOCKS
+	#define FILE_CACHE_BLOCKS 4
+#endif
+
+// cluster link map (FatFs fast seek) of a mounted image, 2 items per fragment plus 2
+#define FILE_LINK_MAP_SIZE 128
+
 typedef struct {
-    BYTE byIsOpen;
-    FIL  f;
+	DWORD dwBlock;					// file offset / FILE_BLOCK_SIZE, FILE_NO_BLOCK when unused
+	WORD  wLength;					// number of bytes of the block that are part of the file
+	BYTE  byDirty;					// the block must be written to the SD-Card before it is reused
+	DWORD dwLastUsed;
+	BYTE  byData[FILE_BLOCK_SIZE];
+} FileBlockType;
+
+typedef struct {
+    BYTE  byIsOpen;
+	BYTE  byCached;					// FALSE for files opened without FA_READ, access goes directly to FatFs
+	DWORD dwPos;					// current position (the FatFs position is only used for SD-Card access)
+	DWORD dwSize;					// file size including the data held in dirty blocks
+	DWORD dwStamp;
+	BYTE  byFastSeek;				// dwLinkMap is in use, see FileEnableFastSeek()
+	BYTE  byFatFsWrite;				// the FatFs sector buffer may be dirty (f_write() since the last f_sync())
+	DWORD dwLinkMapItems;			// items required by the link map of the file (0 if not built)
+	DWORD dwStartSector;			// LBA of the first sector of a contiguous file, 0 if not contiguous
+	DWORD dwLinkMap[FILE_LINK_MAP_SIZE];
+	BYTE  byReadPending;			// a read started by FileReadStart() is in progress (disk_read_start())
+	BYTE* pbyReadData;				// buffer of the sectors being read
+	DWORD dwReadOffset;				// file offset of the sectors being read
+	UINT  nReadCount;				// bytes of whole sectors being read
+	UINT  nReadTail;				// bytes after them, read by FileReadComplete()
+	UINT  nReadResult;				// bytes read so far by FileReadStart()/FileReadComplete()
+    FIL   f;
+	FileBlockType fbBlocks[FILE_CACHE_BLOCKS];
 } file;
 
+typedef struct {
+	DWORD dwSdReads;				// f_read() calls
+	DWORD dwSdReadBytes;
+	DWORD dwSdWrites;				// f_write() calls
+	DWORD dwSdWriteBytes;
+	DWORD dwBlockHits;				// FileRead()/FileWrite() block accesses found in the cache
+	DWORD dwBlockMisses;
+	DWORD dwPassThrough;			// aligned multi-block reads/writes that bypassed the cache
+	DWORD dwCombined;				// writes to a block that was already dirty
+	DWORD dwSeeks;					// f_lseek() calls
+	DWORD dwSeekReads;				// SD sectors read by those calls (the FAT sectors of the cluster chain)
+	DWORD dwLinkMapBuilds;			// cluster link maps built (at mount and after a file has grown)
+	DWORD dwDirectReads;			// disk_read() calls made at the LBA of a contiguous file
+	DWORD dwDirectWrites;			// disk_write() calls made at the LBA of a contiguous file
+	DWORD dwAsyncReads;				// disk_read_start() calls made by FileReadStart()
+} FileStatsType;
+
+extern FileStatsType g_flStats;
+
 //-----------------------------------------------------------------------------
 void   FileSystemInit(void);
 file*  FileOpen(char* pszFileName, BYTE byMode);
 void   FileClose(file* fp);
 BYTE   FileIsOpen(file *fp);
 UINT32 FileRead(file* fp, BYTE* pby, UINT32 nSize);
+BYTE   FileReadStart(file* fp, BYTE* pby, UINT32 nSize);
+BYTE   FileReadPoll(file* fp);
+UINT32 FileReadComplete(file* fp);
 UINT32 FileWrite(file* fp, BYTE* pby, UINT32 nSize);
 void   FileSeek(file* fp, int nOffset);
 void   FileFlush(file* fp);
+void   FileWriteBlocks(file* fp);
+BYTE   FileEnableFastSeek(file* fp);
 void   FileTruncate(file* fp);
 int    FileReadLine(file* fp, char szLine[], int nMaxLen);
 
@@ -30,6 +30,31 @@ int  g_nHfeSide;
 int  g_nHfeLowWriteAddress;
 int  g_nHfeHighWriteAddress;
 
+// 512 byte blocks of g_byRawTrackData modified since the last write-back
+BYTE g_byHfeBlockModified[(MAX_TRACK_LEN*2)/512];
+
+// image file and track currently held in g_byRawTrackData (both sides)
+file* g_pHfeRawFile;
+int   g_nHfeRawTrack = -1;
+
+// decoder lookup tables, built by HfeInitTables()
+BYTE g_byHfeBitReverse[256];	// raw HFE bytes hold the first flux bit in bit 0, reversed they hold it in bit 7
+BYTE g_byMfmDataBits[256];		// data bits (bits 6, 4, 2 and 0) of half an MFM cell word packed into a nibble
+BYTE g_byFmDataBits[256];		// data bits (bits 4 and 0) of a quarter of an FM cell word packed into 2 bits
+BYTE g_byHfeTablesInit;
+
+// sync word search state machines.  The state is the number of leading bits of the sync
+// word that match the most recent flux bits.  Each entry is indexed by the current state
+// and the next 8 flux bits and holds either the next state (bits 0-3) or, if the sync word
+// ends within those 8 bits, the number of bits up to and including its last bit (bits 4-7).
+#define HFE_SYNC_STATES 16
+
+// the first 16 flux bits of all FM address marks (data 0xF8-0xFE with clock 0xC7)
+#define FM_SYNC (FM_MARK_FE >> 16)
+
+BYTE g_byMfmSyncTable[HFE_SYNC_STATES][256];
+BYTE g_byFmSyncTable[HFE_SYNC_STATES][256];
+
 ////////////////////////////////////////////////////////////////////////////////////
 // [    512     ] [    512     ] [    512     ] [    512     ] 
 // [Side0][Side1] [Side0][Side1] [Side0][Side1] [Side0][Side1]
@@ -61,6 +86,15 @@ void __not_in_flash_func(PutHfeByte)(int nPos, BYTE by)
 		nPos += 256;
 	}
 
+	// the unmodified sectors inside the dirty range of a track are encoded again
+	// with the same flux bits, their blocks are not written back
+	if (g_byRawTrackData[nPos] == by)
+	{
+		return;
+	}
+
+	g_byHfeBlockModified[nPos / 512] = 1;
+
 	// update track write pointers
 	if (nPos > g_nHfeHighWriteAddress)
 	{
@@ -75,12 +109,142 @@ void __not_in_flash_func(PutHfeByte)(int nPos, BYTE by)
 	g_byRawTrackData[nPos] = by;
 }
 
+////////////////////////////////////////////////////////////////////////////////////
+// returns the longest leading part of wSync that is matched by the last nLen bits of dwBits
+static int HfeMatchSyncPrefix(WORD wSync, DWORD dwBits, int nLen)
+{
+	int k;
+
+	for (k = nLen; k > 0; --k)
+	{
+		if ((dwBits & ((1 << k) - 1)) == (wSync >> (16 - k)))
+		{
+			return k;
+		}
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+// returns the sync search state for the flux bits held in the low 16 bits of fm
+int HfeGetSyncState(UINT fm)
+{
+	return HfeMatchSyncPrefix(MFM_MARK_A1, fm & 0xFFFF, HFE_SYNC_STATES - 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+static void HfeBuildSyncTable(BYTE byTable[HFE_SYNC_STATES][256], WORD wSync)
+{
+	DWORD dwBits;
+	int   i, j, nState;
+
+	for (nState = 0; nState < HFE_SYNC_STATES; ++nState)
+	{
+		for (i = 0; i < 256; ++i)
+		{
+			// the bits matched so far followed by the new bits
+			dwBits = wSync >> (16 - nState);
+			byTable[nState][i] = 0;
+
+			for (j = 1; j <= 8; ++j)
+			{
+				dwBits = (dwBits << 1) | ((i >> (8 - j)) & 1);
+
+				if ((nState + j) >= 16)
+				{
+					if ((dwBits & 0xFFFF) == wSync)
+					{
+						byTable[nState][i] = j << 4;
+						break;
+					}
+				}
+
+				byTable[nState][i] = HfeMatchSyncPrefix(wSync, dwBits, (nState + j) < 15 ? (nState + j) : 15);
+			}
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+void HfeInitTables(void)
+{
+	int i, j;
+
+	if (g_byHfeTablesInit)
+	{
+		return;
+	}
+
+	HfeBuildSyncTable(g_byMfmSyncTable, MFM_MARK_A1);
+	HfeBuildSyncTable(g_byFmSyncTable, FM_SYNC);
+
+	for (i = 0; i < 256; ++i)
+	{
+		g_byHfeBitReverse[i] = 0;
+		g_byMfmDataBits[i]   = 0;
+		g_byFmDataBits[i]    = 0;
+
+		for (j = 0; j < 8; ++j)
+		{
+			if (i & (1 << j))
+			{
+				g_byHfeBitReverse[i] |= 0x80 >> j;
+			}
+		}
+
+		for (j = 0; j < 4; ++j)
+		{
+			if (i & (1 << (j * 2)))
+			{
+				g_byMfmDataBits[i] |= 1 << j;
+			}
+		}
+
+		for (j = 0; j < 2; ++j)
+		{
+			if (i & (1 << (j * 4)))
+			{
+				g_byFmDataBits[i] |= 1 << j;
+			}
+		}
+	}
+
+	g_byHfeTablesInit = TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+// returns the 8 flux bits starting at bit position bitpos of the current side,
+// the first bit in bit 7
+static inline BYTE __not_in_flash_func(GetHfeBits8)(int bitpos)
+{
+	int   off = bitpos >> 3;
+	DWORD dw;
+
+	dw = (g_byHfeBitReverse[GetHfeByte(off)] << 8) | g_byHfeBitReverse[GetHfeByte(off+1)];
+
+	return (BYTE)(dw >> (8 - (bitpos & 7)));
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+// returns the 16 flux bits starting at bit position bitpos of the current side,
+// the first bit in bit 15
+static inline UINT16 __not_in_flash_func(GetHfeBits16)(int bitpos)
+{
+	int   off = bitpos >> 3;
+	DWORD dw;
+
+	dw = (g_byHfeBitReverse[GetHfeByte(off)] << 16) | (g_byHfeBitReverse[GetHfeByte(off+1)] << 8) | g_byHfeBitReverse[GetHfeByte(off+2)];
+
+	return (UINT16)(dw >> (8 - (bitpos & 7)));
+}
+
 ////////////////////////////////////////////////////////////////////////////////////
 void write_next_mfm(int* pbitpos, unsigned short* pmfm)
 {
 	int off = (*pbitpos >> 3);
 	int bit = (*pbitpos & 7);
-	BYTE by = GetHfeByte(*pbitpos);
+	BYTE by = GetHfeByte(off);
  
 	unsigned char mask = (1 << bit);
 
@@ -93,7 +257,7 @@ void write_next_mfm(int* pbitpos, unsigned short* pmfm)
 		by &= ~mask;
 	}
 
-	PutHfeByte(*pbitpos, by);
+	PutHfeByte(off, by);
 
 	*pmfm <<= 1;
     
@@ -105,7 +269,7 @@ void write_next_fm(int* pbitpos, unsigned int* pfm)
 {
 	int off = (*pbitpos >> 3);
 	int bit = (*pbitpos & 7);
- 	BYTE by = GetHfeByte(*pbitpos);
+ 	BYTE by = GetHfeByte(off);
 
 	unsigned char mask = (1 << bit);
 
@@ -118,7 +282,7 @@ void write_next_fm(int* pbitpos, unsigned int* pfm)
 		by &= ~mask;
 	}
 
-	PutHfeByte(*pbitpos, by);
+	PutHfeByte(off, by);
 
 	*pfm <<= 1;
 
@@ -214,67 +378,573 @@ void fm_write(int* pbitpos, unsigned char data, unsigned char clock)
 }
 
 ////////////////////////////////////////////////////////////////////////////////////
+// returns the data bits of a 16 bit MFM cell word (clock bits are discarded)
 unsigned char __not_in_flash_func(sep_mfm)(unsigned short mfm)
 {
-    register int i;
-    register char data;
-    register unsigned short fm;
+	return (g_byMfmDataBits[mfm >> 8] << 4) | g_byMfmDataBits[mfm & 0xFF];
+}
 
-	data = 0;
-    fm   = mfm << 1;
+////////////////////////////////////////////////////////////////////////////////////
+// returns the data byte of the cell word in *pmfm and loads the next 16 flux bits into *pmfm
+unsigned char __not_in_flash_func(read_byte_mfm)(int* pbitpos, unsigned short* pmfm)
+{
+    unsigned char data;
+
+    data = sep_mfm(*pmfm);
+
+    *pmfm = GetHfeBits16(*pbitpos);
+    *pbitpos += 16;
+
+    return data;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+// returns the data bits of 16 bits of an FM cell word (clock bits are discarded)
+unsigned char __not_in_flash_func(sep_fm)(unsigned short fm)
+{
+	return (g_byFmDataBits[fm >> 8] << 2) | g_byFmDataBits[fm & 0xFF];
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+// returns the data byte of the 32 bit FM cell word at *pbitpos and advances *pbitpos past it
+unsigned char __not_in_flash_func(read_byte_fm)(int* pbitpos)
+{
+	unsigned char data;
 
-	for (i = 0; i < 8; i++)
+	data = (sep_fm(GetHfeBits16(*pbitpos)) << 4) | sep_fm(GetHfeBits16(*pbitpos + 16));
+
+	*pbitpos += 32;
+
+	return data;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+// forgets which track is held in g_byRawTrackData.  Called when an image is mounted
+// as the file object may be reused for a different image.
+void HfeInvalidateRawTrack(void)
+{
+	g_pHfeRawFile  = NULL;
+	g_nHfeRawTrack = -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+// reads both sides of a track into g_byRawTrackData, returns FALSE if it does not fit
+BYTE HfeReadRawTrack(file* pFile, HfeDriveType* pdisk, int nTrack)
+{
+	int nReadTotal, nReadPos;
+
+	g_nHfeLowWriteAddress  = 0x10000000;
+	g_nHfeHighWriteAddress = 0;
+	memset(g_byHfeBlockModified, 0, sizeof(g_byHfeBlockModified));
+
+	HfeInvalidateRawTrack();
+
+	nReadTotal = pdisk->trackLUT[nTrack].track_len;
+
+	if (nReadTotal > sizeof(g_byRawTrackData))
 	{
-		data <<= 1;
+		return FALSE;
+	}
 
-        if (fm & 0x8000)
-        {
-            data |= 1;
-        }
+	nReadPos = pdisk->trackLUT[nTrack].offset * 0x200;
 
-		fm <<= 2;
+   	FileSeek(pFile, nReadPos);
+    FileRead(pFile, g_byRawTrackData, nReadTotal);
+
+	g_tcsStats.dwBytesRead += nReadTotal;
+
+	g_pHfeRawFile  = pFile;
+	g_nHfeRawTrack = nTrack;
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+// MFM encodes nSize bytes at pby into the current side of the raw track starting at
+// bit nBitPos.  pby[-1] must be the byte preceeding the first one (for its clock bit).
+// The first byte of the gap that follows is re-encoded so that its clock bit matches
+// the new last byte.
+void HfeEncodeBytes(int nBitPos, BYTE* pby, int nSize)
+{
+	BYTE prev = *(pby-1);
+	int  i;
+
+	for (i = 0; i < nSize; ++i)
+	{
+		prev = mfm_write(&nBitPos, pby[i], 0, prev);
 	}
 
-	return data;
+	mfm_write(&nBitPos, sep_mfm(GetHfeBits16(nBitPos)), 0, prev);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////
-unsigned char __not_in_flash_func(read_byte_mfm)(int* pbitpos, unsigned short* pmfm)
+// FM encodes nSize bytes at pby into the current side of the raw track starting at
+// bit nBitPos.  The first byte is an address mark and is written with the 0xC7 clock.
+void HfeEncodeFmBytes(int nBitPos, BYTE* pby, int nSize)
 {
-    unsigned char data;
-    register int off, bit;
-    register unsigned short mfm;
-    register unsigned char  by;
+	int i;
 
-    data = sep_mfm(*pmfm);
+	fm_write(&nBitPos, pby[0], 0xC7);
 
-    mfm = *pmfm;
-    off = (*pbitpos >> 3);
-	by  = GetHfeByte(off);
-    bit = 1 << (*pbitpos & 7);
+	for (i = 1; i < nSize; ++i)
+	{
+		fm_write(&nBitPos, pby[i], 0xFF);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+// writes the sectors of ptrack whose data fields lie between nStart and nEnd (offsets
+// in ptrack->byTrackData) back to the image.  The data fields are MFM or FM encoded into
+// the raw track and only the 512 byte blocks that changed are written to the file.
+//
+// returns the number of bytes written
+UINT32 SaveHfeTrack(file* pFile, HfeDriveType* pdisk, TrackType* ptrack, int nStart, int nEnd)
+{
+	UINT32 nWritten = 0;
+	int    nSector, nDAM, nBlock, nCount, nSize;
+	int    nFileOffset;
+
+	HfeInitTables();
 
-    for (int i = 0; i < 16; i++)
+	if ((g_pHfeRawFile != pFile) || (g_nHfeRawTrack != ptrack->nTrack))
 	{
-        mfm <<= 1;
+		if (!HfeReadRawTrack(pFile, pdisk, ptrack->nTrack))
+		{
+			return 0;
+		}
+	}
 
-        if (by & bit)
-        {
-            mfm |= 1;
-        }
+	g_nHfeSide = ptrack->nSide;
 
-        bit <<= 1;
+	for (nSector = 0; nSector < 0x80; ++nSector)
+	{
+		nDAM = ptrack->nSectorDAM[nSector];
 
-        if (bit >= 0x100)
-        {
-            ++off;
-			by  = GetHfeByte(off);
-            bit = 1;
-        }
+		if ((nDAM < nStart) || (nDAM >= nEnd) || (ptrack->nSectorDAM_BitPos[nSector] < 0))
+		{
+			continue;
+		}
+
+		// byTrackData[nDAM] holds 3 sync bytes, mark, data, CRC.  In MFM nSectorDAM_BitPos
+		// is the first bit of the second 0xA1 and the mark follows the third 0xA1, in FM
+		// it is the first bit of the mark.
+		if (ptrack->byDensity == eSD)
+		{
+			HfeEncodeFmBytes(ptrack->nSectorDAM_BitPos[nSector], ptrack->byTrackData + nDAM + 3, ptrack->nSectorSize[nSector] + 3);
+		}
+		else
+		{
+			HfeEncodeBytes(ptrack->nSectorDAM_BitPos[nSector] + 32, ptrack->byTrackData + nDAM + 3, ptrack->nSectorSize[nSector] + 3);
+		}
+	}
+
+	nFileOffset = pdisk->trackLUT[ptrack->nTrack].offset * 0x200;
+	nBlock      = 0;
+
+	while (nBlock < (int)sizeof(g_byHfeBlockModified))
+	{
+		if (g_byHfeBlockModified[nBlock] == 0)
+		{
+			++nBlock;
+			continue;
+		}
+
+		// write each run of modified blocks with a single request
+		nCount = 0;
+
+		while (((nBlock + nCount) < (int)sizeof(g_byHfeBlockModified)) && g_byHfeBlockModified[nBlock + nCount])
+		{
+			g_byHfeBlockModified[nBlock + nCount] = 0;
+			++nCount;
+		}
+
+		nSize = nCount * 512;
+
+		// the buffer past the end of the track was not read from the file
+		if ((nBlock * 512 + nSize) > pdisk->trackLUT[ptrack->nTrack].track_len)
+		{
+			nSize = pdisk->trackLUT[ptrack->nTrack].track_len - nBlock * 512;
+		}
+
+		if (nSize > 0)
+		{
+			FileSeek(pFile, nFileOffset + nBlock * 512);
+			nWritten += FileWrite(pFile, g_byRawTrackData + nBlock * 512, nSize);
+		}
+
+		nBlock += nCount;
+	}
+
+	if (nWritten != 0)
+	{
+		FileFlush(pFile);
+	}
+
+	g_nHfeLowWriteAddress  = 0x10000000;
+	g_nHfeHighWriteAddress = 0;
+
+	return nWritten;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+// returns the track_encoding of the specified track and side, taking the alternate
+// encoding of track 0 into account (a single density boot track on a double density disk)
+int HfeGetTrackEncoding(HfeDriveType* pdisk, int nTrack, int nSide)
+{
+	if (nTrack == 0)
+	{
+		if ((nSide == 0) && (pdisk->header.track0s0_altencoding == 0x00))
+		{
+			return pdisk->header.track0s0_encoding;
+		}
+
+		if ((nSide == 1) && (pdisk->header.track0s1_altencoding == 0x00))
+		{
+			return pdisk->header.track0s1_encoding;
+		}
+	}
+
+	return pdisk->header.track_encoding;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+// adds a sector to the track index and records where its fields are in the raw track
+static void HfeIndexSector(TrackType* ptrack, int nIDAM, int nIDAM_BitPos, int nDAM, int nDAM_BitPos)
+{
+	int nIndex = FdcIndexSector(ptrack, nIDAM, nDAM);
+
+	if (nIndex >= 0)
+	{
+		ptrack->nSectorIDAM_BitPos[nIndex] = nIDAM_BitPos;
+		ptrack->nSectorDAM_BitPos[nIndex]  = nDAM_BitPos;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+// decodes the current side of an FM (single density) track in g_byRawTrackData.
+//
+// Each data bit is 4 flux bits (0, clock, 0, data) so a byte is 32 flux bits and is
+// stored at byte offset bitpos/32 of pbyTrackData.  Address marks are found by searching
+// for FM_SYNC and then comparing the complete 32 bit mark.  The three bytes in front of
+// each mark are set to 0x00 (the FM sync field) so that the track has the same layout as
+// an MFM track.
+void DecodeHfeFmTrack(TrackType* ptrack, BYTE* pbyTrackData, int nMaxLen, int nFluxLen)
+{
+	DWORD dwMark;
+	BYTE  by, byNext, mark;
+	int   bitpos, mark_bitpos, nBytePos, nSector, nSectorSize, nSize;
+	int   nIDAM, nIDAM_BitPos;
+	int   nSyncState, k, i;
+	UINT  fm;
+
+	bitpos       = 0;
+	nSector      = 0;
+	fm           = 0;
+	nIDAM        = -1;	// offset of the 0xFE of the last ID field found, until its DAM is found
+	nIDAM_BitPos = -1;
+	nSectorSize  = 0;
+	nSyncState   = 0;
+
+	while ((bitpos < nFluxLen) && (nSector < MAX_SECTORS_PER_TRACK))
+	{
+		if ((nFluxLen - bitpos) >= 8)
+		{
+			by     = GetHfeBits8(bitpos);
+			byNext = g_byFmSyncTable[nSyncState][by];
+			k      = byNext >> 4;
+
+			if (k == 0) // no sync word in these 8 bits
+			{
+				fm          = (fm << 8) | by;
+				bitpos     += 8;
+				nSyncState  = byNext & 0x0F;
+				continue;
+			}
+
+			fm      = (fm << k) | (by >> (8 - k));
+			bitpos += k;
+		}
+		else
+		{
+			fm = (fm << 1) | (GetHfeBits8(bitpos) >> 7);
+			++bitpos;
+
+			if ((UINT16)fm != FM_SYNC)
+			{
+				continue;
+			}
+		}
+
+		nSyncState  = HfeMatchSyncPrefix(FM_SYNC, fm & 0xFFFF, HFE_SYNC_STATES - 1);
+		mark_bitpos = bitpos - 16;
+		nBytePos    = mark_bitpos / 32;
+
+		if (((nFluxLen - mark_bitpos) < 32) || (nBytePos < 3))
+		{
+			continue;
+		}
+
+		dwMark = (FM_SYNC << 16) | GetHfeBits16(bitpos);
+
+		if ((dwMark == FM_MARK_FE) && ((nFluxLen - mark_bitpos) >= (32 * 7)) && ((nBytePos + 7) <= nMaxLen))
+		{
+			// an ID field without a data field
+			if (nIDAM >= 0)
+			{
+				HfeIndexSector(ptrack, nIDAM, nIDAM_BitPos, -1, -1);
+			}
+
+			nIDAM        = nBytePos;
+			nIDAM_BitPos = mark_bitpos;
+			bitpos       = mark_bitpos;
+
+			// 0x00, 0x00, 0x00, 0xFE, track, side, sector, size, CRC16 (high), CRC16 (low)
+			pbyTrackData[nBytePos-3] = 0x00;
+			pbyTrackData[nBytePos-2] = 0x00;
+			pbyTrackData[nBytePos-1] = 0x00;
+
+			for (i = 0; i < 7; ++i)
+			{
+				pbyTrackData[nBytePos+i] = read_byte_fm(&bitpos);
+			}
+
+			nSectorSize = pbyTrackData[nBytePos+4] & 0x03;
+			nSyncState  = 0;
+		}
+		else if ((dwMark == FM_MARK_FB) || (dwMark == FM_MARK_FA) || (dwMark == FM_MARK_F9) || (dwMark == FM_MARK_F8))
+		{
+			nSize = 128 << nSectorSize;
+
+			if (((nFluxLen - mark_bitpos) < (32 * (nSize + 3))) || ((nBytePos + nSize + 3) > nMaxLen))
+			{
+				continue;
+			}
+
+			bitpos = mark_bitpos;
+			mark   = read_byte_fm(&bitpos);
+
+			// 0x00, 0x00, 0x00, mark, data, CRC16 (high), CRC16 (low)
+			pbyTrackData[nBytePos-3] = 0x00;
+			pbyTrackData[nBytePos-2] = 0x00;
+			pbyTrackData[nBytePos-1] = 0x00;
+			pbyTrackData[nBytePos]   = mark;
+
+			for (i = 1; i < (nSize + 3); ++i)
+			{
+				pbyTrackData[nBytePos+i] = read_byte_fm(&bitpos);
+			}
+
+			if (nIDAM >= 0)
+			{
+				HfeIndexSector(ptrack, nIDAM, nIDAM_BitPos, nBytePos - 3, mark_bitpos);
+			}
+
+			nIDAM      = -1;
+			nSyncState = 0;
+			++nSector;
+		}
+	}
+
+	// an ID field at the end of the track without a data field
+	if (nIDAM >= 0)
+	{
+		HfeIndexSector(ptrack, nIDAM, nIDAM_BitPos, -1, -1);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+// decodes the bytes [nStart, nEnd) of the current side of the raw track.  Byte nAnchor
+// is at bit nAnchorBitPos and each byte is nCellBits flux bits (16 MFM, 32 FM).
+static void HfeDecodeGap(BYTE* pbyTrackData, int nStart, int nEnd, int nAnchor, int nAnchorBitPos, int nCellBits, int nFluxLen)
+{
+	int bitpos, i;
+
+	for (i = nStart; i < nEnd; ++i)
+	{
+		bitpos = nAnchorBitPos + (i - nAnchor) * nCellBits;
+
+		if (bitpos < 0)
+		{
+			continue;
+		}
+
+		if ((bitpos + nCellBits) > nFluxLen)
+		{
+			break;
+		}
+
+		if (nCellBits == 16)
+		{
+			pbyTrackData[i] = sep_mfm(GetHfeBits16(bitpos));
+		}
+		else
+		{
+			pbyTrackData[i] = read_byte_fm(&bitpos);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+// fills in the gaps between the fields decoded by LoadHfeTrack() so that ptrack->byTrackData
+// holds the complete byte stream of the track for the Read Track command.
+//
+// The ID and data fields are left as they are (they may hold sector writes that have not
+// been encoded into the raw track yet).  Like the WD1793, which re-aligns to the byte
+// boundary at each address mark, the gap after a field continues with the alignment of that
+// field.  The gap in front of the first field is aligned to the first field.
+//
+// returns the number of bytes in the stream, *pnStart is set to the offset of its first byte
+int LoadHfeTrackStream(file* pFile, HfeDriveType* pdisk, TrackType* ptrack, BYTE* pbyTrackData, int nMaxLen, int* pnStart)
+{
+	int nFieldStart[MAX_SECTORS_PER_TRACK*2];
+	int nFieldEnd[MAX_SECTORS_PER_TRACK*2];
+	int nFieldBitPos[MAX_SECTORS_PER_TRACK*2];
+	int nFields, nFluxLen, nCellBits, nMarkBits, nFirst, nLen;
+	int nAnchor, nAnchorBitPos, nPos;
+	int nSector, i, j;
+
+	HfeInitTables();
+
+	*pnStart = 0;
+
+	if ((g_pHfeRawFile != pFile) || (g_nHfeRawTrack != ptrack->nTrack))
+	{
+		if (!HfeReadRawTrack(pFile, pdisk, ptrack->nTrack))
+		{
+			return 0;
+		}
+	}
+
+	g_nHfeSide = ptrack->nSide;
+
+	nFluxLen = pdisk->trackLUT[ptrack->nTrack].track_len * 4;	// track_len holds both sides
+
+    if (nFluxLen > (sizeof(g_byRawTrackData)*4))
+    {
+       nFluxLen = sizeof(g_byRawTrackData)*4;
     }
-    
-    *pbitpos += 16;
-    *pmfm = mfm;
-    return data;
+
+	// bit position of the mark relative to nSector[ID]DAM_BitPos
+	if (ptrack->byDensity == eSD)
+	{
+		nCellBits = 32;
+		nMarkBits = 0;
+	}
+	else
+	{
+		nCellBits = 16;
+		nMarkBits = 32;
+	}
+
+	// collect the fields (sync bytes, mark, data and CRC) sorted by their position on the track
+	nFields = 0;
+
+	for (nSector = 0; nSector < 0x80; ++nSector)
+	{
+		for (j = 0; j < 2; ++j)
+		{
+			int nStart, nEnd, nBitPos;
+
+			if (j == 0)
+			{
+				if ((ptrack->nSectorIDAM[nSector] < 0) || (ptrack->nSectorIDAM_BitPos[nSector] < 0))
+				{
+					continue;
+				}
+
+				nStart  = ptrack->nSectorIDAM[nSector] - 3;
+				nEnd    = ptrack->nSectorIDAM[nSector] + 7;
+				nBitPos = ptrack->nSectorIDAM_BitPos[nSector];
+			}
+			else
+			{
+				if ((ptrack->nSectorDAM[nSector] < 0) || (ptrack->nSectorDAM_BitPos[nSector] < 0))
+				{
+					continue;
+				}
+
+				nStart  = ptrack->nSectorDAM[nSector];
+				nEnd    = nStart + ptrack->nSectorSize[nSector] + 6;
+				nBitPos = ptrack->nSectorDAM_BitPos[nSector];
+			}
+
+			if (nFields >= (MAX_SECTORS_PER_TRACK*2))
+			{
+				break;
+			}
+
+			// first sync byte of the field
+			nBitPos += nMarkBits - 3 * nCellBits;
+
+			for (i = nFields; (i > 0) && (nFieldStart[i-1] > nStart); --i)
+			{
+				nFieldStart[i]  = nFieldStart[i-1];
+				nFieldEnd[i]    = nFieldEnd[i-1];
+				nFieldBitPos[i] = nFieldBitPos[i-1];
+			}
+
+			nFieldStart[i]  = nStart;
+			nFieldEnd[i]    = nEnd;
+			nFieldBitPos[i] = nBitPos;
+			++nFields;
+		}
+	}
+
+	nAnchor       = 0;
+	nAnchorBitPos = 0;
+
+	if (nFields > 0)
+	{
+		nAnchor       = nFieldStart[0];
+		nAnchorBitPos = nFieldBitPos[0];
+	}
+
+	// the fields are not at the same offset as in the raw track, so the stream starts
+	// with the byte that holds the first flux bits of the track
+	nFirst = nAnchor - nAnchorBitPos / nCellBits;
+
+	if (nFirst < 0)
+	{
+		nFirst = 0;
+	}
+
+	nPos = nFirst;
+	nLen = nFirst + nFluxLen / nCellBits;
+
+	if (nLen > nMaxLen)
+	{
+		nLen = nMaxLen;
+	}
+
+	for (i = 0; i < nFields; ++i)
+	{
+		if (nFieldStart[i] >= nLen)
+		{
+			break;
+		}
+
+		if (nPos < nFieldStart[i])
+		{
+			HfeDecodeGap(pbyTrackData, nPos, nFieldStart[i], nAnchor, nAnchorBitPos, nCellBits, nFluxLen);
+		}
+
+		nAnchor       = nFieldStart[i];
+		nAnchorBitPos = nFieldBitPos[i];
+
+		if (nPos < nFieldEnd[i])
+		{
+			nPos = nFieldEnd[i];
+		}
+	}
+
+	if (nPos < nLen)
+	{
+		HfeDecodeGap(pbyTrackData, nPos, nLen, nAnchor, nAnchorBitPos, nCellBits, nFluxLen);
+	}
+
+	*pnStart = nFirst;
+
+	return nLen - nFirst;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////
@@ -285,50 +955,96 @@ void LoadHfeTrack(file* pFile, int nTrack, int nSide, HfeDriveType* pdisk, Track
 	UINT   fm;
 	BYTE   mark;
 	int    bitpos, nFluxLen, nSector, nSectorSize;
-	int    nReadTotal, nReadPos;
+	int    nIDAM, nIDAM_BitPos, nEncoding;
+	int    nSyncState;
 
-	g_nHfeLowWriteAddress  = 0x10000000;
-	g_nHfeHighWriteAddress = 0;
+	HfeInitTables();
 
 	g_nHfeSide = nSide;
-	nReadTotal = pdisk->trackLUT[nTrack].track_len;
 
-	if (nReadTotal > sizeof(g_byRawTrackData))
+	FdcClearSectorIndex(ptrack);
+
+	ptrack->nIndexOffset    = 0;
+	ptrack->nRevolutionSize = 0;
+
+	// both sides of a track are held in g_byRawTrackData, so the second side is
+	// usually decoded without reading the SD-Card again
+	if ((g_pHfeRawFile != pFile) || (g_nHfeRawTrack != nTrack))
 	{
-		return;
+		if (!HfeReadRawTrack(pFile, pdisk, nTrack))
+		{
+			return;
+		}
 	}
 
-	nReadPos = pdisk->trackLUT[nTrack].offset * 0x200;
+	nFluxLen = pdisk->trackLUT[nTrack].track_len * 4;	// track_len holds both sides
 
-   	FileSeek(pFile, nReadPos);
-    FileRead(pFile, g_byRawTrackData, nReadTotal);
+    if (nFluxLen > (sizeof(g_byRawTrackData)*4))
+    {
+       nFluxLen = sizeof(g_byRawTrackData)*4;
+    }
+
+	nEncoding = HfeGetTrackEncoding(pdisk, nTrack, nSide);
+
+	if ((nEncoding == ISOIBM_FM_ENCODING) || (nEncoding == EMU_FM_ENCODING))
+	{
+		ptrack->byDensity       = eSD;
+		ptrack->nRevolutionSize = nFluxLen / 32;
+		DecodeHfeFmTrack(ptrack, pbyTrackData, nMaxLen, nFluxLen);
+		return;
+	}
+
+	ptrack->byDensity       = eDD;
+	ptrack->nRevolutionSize = nFluxLen / 16;
 
 	bitpos   = 0;
-	nFluxLen = pdisk->trackLUT[nTrack].track_len * 8;
 	nSector  = 0;
 	mfm      = 0;
 	fm       = 0;
-
-    if (nFluxLen > (sizeof(g_byRawTrackData)*8))
-    {
-       nFluxLen = sizeof(g_byRawTrackData)*8;
-    }
+	nIDAM    = -1;	// offset of the 0xFE of the last ID field found, until its DAM is found
+	nIDAM_BitPos = 0;
+	nSectorSize  = 0;
+	nSyncState   = HfeGetSyncState(fm);
 
 	while ((bitpos < nFluxLen) && (nSector < MAX_SECTORS_PER_TRACK))
 	{
-	    fm <<= 1;
+		BYTE by, byNext;
+		int  k;
 
-        if (GetHfeByte(bitpos >> 3) & (1 << (bitpos & 7)))
-        {
-            fm |= 1;
-        }
+		if ((nFluxLen - bitpos) >= 8)
+		{
+			// search for the sync word 8 flux bits at a time
+			by     = GetHfeBits8(bitpos);
+			byNext = g_byMfmSyncTable[nSyncState][by];
+			k      = byNext >> 4;
 
-        ++bitpos;
+			if (k == 0) // no sync word in these 8 bits
+			{
+				fm          = (fm << 8) | by;
+				bitpos     += 8;
+				nSyncState  = byNext & 0x0F;
+				continue;
+			}
+
+			// sync word ends at bit k
+			fm      = (fm << k) | (by >> (8 - k));
+			bitpos += k;
+		}
+		else
+		{
+			// less than 8 bits left on the track, test one at a time
+			fm = (fm << 1) | (GetHfeBits8(bitpos) >> 7);
+			++bitpos;
+
+			if ((UINT16)fm != MFM_MARK_A1)
+			{
+				continue;
+			}
+		}
 
 		mfm = (unsigned short)fm;		// Note: this is legitimate, same flux data
 
 		// floppy has multiple A1 marks
-		if (mfm == MFM_MARK_A1)
 		{
 			int mark_bitpos = bitpos;
 			int mark_count  = 0;
@@ -364,8 +1080,14 @@ void LoadHfeTrack(file* pFile, int nTrack, int nSide, HfeDriveType* pdisk, Track
 				BYTE* pby;
 				int   nIDAM_BytePos, i;
 
-				ptrack->nSectorIDAM_BitPos[nSector] = bitpos - 64;  // starting bit index of the first 0xA1
-				nIDAM_BytePos = ptrack->nSectorIDAM_BitPos[nSector] / 16;
+				// an ID field without a data field
+				if (nIDAM >= 0)
+				{
+					HfeIndexSector(ptrack, nIDAM, nIDAM_BitPos, -1, -1);
+				}
+
+				nIDAM_BitPos  = bitpos - 64;  // starting bit index of the first 0xA1
+				nIDAM_BytePos = nIDAM_BitPos / 16;
 
 				// copy to raw track data buffer
 				pby = pbyTrackData + nIDAM_BytePos;
@@ -389,18 +1111,17 @@ void LoadHfeTrack(file* pFile, int nTrack, int nSide, HfeDriveType* pdisk, Track
 					++pby;
 				}
 
-				ptrack->nSectorIDAM[nSector] = nIDAM_BytePos;
-
-				nSectorSize = *(pby - 3);
+				nIDAM       = nIDAM_BytePos + 3;
+				nSectorSize = *(pby - 3) & 0x03;
 			}
 			else if ((mark_count == 3) && ((mark == 0xFB) || (mark == 0xF8))) // then we found a DAM
 			{
 				BYTE* pby;
 				int   nSize = 128 << nSectorSize;
-				int   nDAM_BytePos;
+				int   nDAM_BytePos, nDAM_BitPos;
 
-				ptrack->nSectorDAM_BitPos[nSector] = bitpos - 64;  // starting bit index of the first 0xA1
-				nDAM_BytePos = ptrack->nSectorDAM_BitPos[nSector] / 16;
+				nDAM_BitPos  = bitpos - 64;  // starting bit index of the first 0xA1
+				nDAM_BytePos = nDAM_BitPos / 16;
 
 				if (nSize <= (nMaxLen-nDAM_BytePos))
 				{
@@ -421,8 +1142,12 @@ void LoadHfeTrack(file* pFile, int nTrack, int nSide, HfeDriveType* pdisk, Track
 					*pby = read_byte_mfm(&bitpos, &mfm); ++pby; // low byte
 				}
 
-				ptrack->nSectorDAM[nSector] = nDAM_BytePos;
+				if (nIDAM >= 0)
+				{
+					HfeIndexSector(ptrack, nIDAM, nIDAM_BitPos, nDAM_BytePos, nDAM_BitPos);
+				}
 
+				nIDAM = -1;
 				++nSector;
 			}
 			else
@@ -431,7 +1156,14 @@ void LoadHfeTrack(file* pFile, int nTrack, int nSide, HfeDriveType* pdisk, Track
 			}
 
 			// Fix up the reading state (mostly, really should have 16 extra bits)
-			fm = mfm;
+			fm         = mfm;
+			nSyncState = HfeGetSyncState(fm);
 		}
 	}
+
+	// an ID field at the end of the track without a data field
+	if (nIDAM >= 0)
+	{
+		HfeIndexSector(ptrack, nIDAM, nIDAM_BitPos, -1, -1);
+	}
 }
@@ -0,0 +1,391 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glob.h>
+#include <sys/stat.h>
+
+#include "Defines.h"
+#include "file.h"
+#include "sd_core.h"
+#include "diskio.h"
+#include "sim.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// SD-Card for the host simulation
+//
+// The card is a FAT volume held in host memory.  HostDiskLoadDir() formats it and
+// copies the files of a host directory (the root directory of the SD-Card) to it,
+// HostDiskSaveDir() copies the files of the volume back.  FatFs, File.c and the
+// FDC access the volume through the disk_* functions below, as they access the
+// SD-Card through glue.c on the RP2040.
+//
+// Each disk access adds the time the SD-Card would take to the busy time of the
+// card (g_hdStats.nBusyTime), see HostDiskSetTiming().  sim.c moves the virtual
+// clock forward by that time once the storage worker is idle, so the time spent on
+// the SD-Card is part of the emulated time of a run.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#define HOST_DISK_SECTOR_SIZE 512
+
+BYTE   sd_byCardInialized = 1;
+DWORD  g_dwSdCardMaxPresenceCount;
+DWORD  g_dwSdClockRate = 25000000;
+
+DWORD  disk_read_sectors;		// see glue.c
+
+HostDiskStatsType g_hdStats;
+
+static BYTE*  g_pbyHostDisk;
+static DWORD  g_dwHostDiskSectors;
+
+static DWORD  g_dwAccessTime     = 300;	// us before the first block of a command
+static DWORD  g_dwReadBlockTime  = 214;	// us per 512 byte block read (25 MHz SPI plus the gap between blocks)
+static DWORD  g_dwWriteBlockTime = 414;	// us per block written (transfer plus programming)
+
+static BYTE*  g_pbyReadStart;			// disk_read_start() in progress
+static LBA_t  g_nReadStartSector;
+static UINT   g_nReadStartCount;
+
+//-----------------------------------------------------------------------------
+// sets the SD-Card timing model, all in us
+//
+void HostDiskSetTiming(DWORD dwAccessTime, DWORD dwReadBlockTime, DWORD dwWriteBlockTime)
+{
+	g_dwAccessTime     = dwAccessTime;
+	g_dwReadBlockTime  = dwReadBlockTime;
+	g_dwWriteBlockTime = dwWriteBlockTime;
+}
+
+//-----------------------------------------------------------------------------
+// creates an empty FAT volume of dwSectors sectors (the SD-Card is "inserted")
+//
+BYTE HostDiskCreate(DWORD dwSectors)
+{
+	static BYTE byWork[FF_MAX_SS * 8];
+	MKFS_PARM   opt = {FM_FAT32, 1, 0, 0, 0};
+
+	free(g_pbyHostDisk);
+
+	g_pbyHostDisk       = calloc(dwSectors, HOST_DISK_SECTOR_SIZE);
+	g_dwHostDiskSectors = dwSectors;
+
+	if (g_pbyHostDisk == NULL)
+	{
+		return FALSE;
+	}
+
+	if (f_mkfs("", &opt, byWork, sizeof(byWork)) != FR_OK)
+	{
+		return FALSE;
+	}
+
+	memset(&g_hdStats, 0, sizeof(g_hdStats));
+
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// copies a host file to the root directory of the volume (FileSystemInit() must
+// have been called)
+//
+BYTE HostDiskAddFile(char* pszPath, char* pszName)
+{
+	static BYTE byBuf[0x10000];
+	FILE*       fp;
+	FIL         f;
+	size_t      nSize;
+	UINT        nWritten;
+	BYTE        byOk = TRUE;
+
+	fp = fopen(pszPath, "rb");
+
+	if (fp == NULL)
+	{
+		return FALSE;
+	}
+
+	if (f_open(&f, pszName, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+	{
+		fclose(fp);
+		return FALSE;
+	}
+
+	while ((nSize = fread(byBuf, 1, sizeof(byBuf), fp)) > 0)
+	{
+		if ((f_write(&f, byBuf, nSize, &nWritten) != FR_OK) || (nWritten != nSize))
+		{
+			byOk = FALSE;
+			break;
+		}
+	}
+
+	f_close(&f);
+	fclose(fp);
+
+	return byOk;
+}
+
+//-----------------------------------------------------------------------------
+// formats a volume large enough for the files of the host directory pszDir and
+// copies them to its root directory (sub directories are not copied)
+//
+BYTE HostDiskLoadDir(char* pszDir)
+{
+	char        szPattern[1024];
+	glob_t      gl;
+	struct stat st;
+	DWORD       dwSectors = 0;
+	char*       pszName;
+	size_t      i;
+
+	if ((stat(pszDir, &st) != 0) || !S_ISDIR(st.st_mode))
+	{
+		return FALSE;
+	}
+
+	// dirent.h can not be used with ff.h (both define DIR)
+	snprintf(szPattern, sizeof(szPattern), "%s/*", pszDir);
+
+	if (glob(szPattern, 0, NULL, &gl) != 0)
+	{
+		gl.gl_pathc = 0;
+		gl.gl_pathv = NULL;
+	}
+
+	for (i = 0; i < gl.gl_pathc; ++i)
+	{
+		if ((stat(gl.gl_pathv[i], &st) == 0) && S_ISREG(st.st_mode))
+		{
+			dwSectors += st.st_size / HOST_DISK_SECTOR_SIZE + 8;
+		}
+	}
+
+	// at least 64 MB (FAT32 needs 65525 clusters) plus room for the files to grow
+	dwSectors = dwSectors * 2 + 64 * 2048;
+
+	if (!HostDiskCreate(dwSectors))
+	{
+		globfree(&gl);
+		return FALSE;
+	}
+
+	FileSystemInit();
+
+	for (i = 0; i < gl.gl_pathc; ++i)
+	{
+		pszName = strrchr(gl.gl_pathv[i], '/') + 1;
+
+		if ((stat(gl.gl_pathv[i], &st) == 0) && S_ISREG(st.st_mode) && !HostDiskAddFile(gl.gl_pathv[i], pszName))
+		{
+			printf("unable to copy %s\n", gl.gl_pathv[i]);
+		}
+	}
+
+	if (gl.gl_pathv != NULL)
+	{
+		globfree(&gl);
+	}
+
+	memset(&g_hdStats, 0, sizeof(g_hdStats));
+
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// copies the files of the root directory of the volume to the host directory pszDir
+//
+BYTE HostDiskSaveDir(char* pszDir)
+{
+	static BYTE byBuf[0x10000];
+	char        szPath[1024];
+	DIR         dir;
+	FILINFO     fno;
+	FIL         f;
+	FILE*       fp;
+	UINT        nRead;
+
+	if (f_opendir(&dir, "/") != FR_OK)
+	{
+		return FALSE;
+	}
+
+	while ((f_readdir(&dir, &fno) == FR_OK) && (fno.fname[0] != 0))
+	{
+		if (fno.fattrib & AM_DIR)
+		{
+			continue;
+		}
+
+		snprintf(szPath, sizeof(szPath), "%s/%s", pszDir, fno.fname);
+
+		if (f_open(&f, fno.fname, FA_READ) != FR_OK)
+		{
+			continue;
+		}
+
+		fp = fopen(szPath, "wb");
+
+		if (fp != NULL)
+		{
+			while ((f_read(&f, byBuf, sizeof(byBuf), &nRead) == FR_OK) && (nRead > 0))
+			{
+				fwrite(byBuf, 1, nRead, fp);
+			}
+
+			fclose(fp);
+		}
+
+		f_close(&f);
+	}
+
+	f_closedir(&dir);
+
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+DSTATUS disk_initialize(BYTE pdrv)
+{
+	return (g_pbyHostDisk != NULL) ? 0 : STA_NOINIT;
+}
+
+//-----------------------------------------------------------------------------
+DSTATUS disk_status(BYTE pdrv)
+{
+	return (g_pbyHostDisk != NULL) ? 0 : STA_NOINIT;
+}
+
+//-----------------------------------------------------------------------------
+DRESULT disk_read(BYTE pdrv, BYTE* buff, LBA_t sector, UINT count)
+{
+	if ((g_pbyHostDisk == NULL) || ((sector + count) > g_dwHostDiskSectors))
+	{
+		return RES_PARERR;
+	}
+
+	memcpy(buff, g_pbyHostDisk + (size_t)sector * HOST_DISK_SECTOR_SIZE, (size_t)count * HOST_DISK_SECTOR_SIZE);
+
+	disk_read_sectors += count;
+	++g_hdStats.dwReads;
+	g_hdStats.dwReadSectors += count;
+	g_hdStats.nBusyTime     += g_dwAccessTime + count * g_dwReadBlockTime;
+
+	return RES_OK;
+}
+
+//-----------------------------------------------------------------------------
+DRESULT disk_write(BYTE pdrv, const BYTE* buff, LBA_t sector, UINT count)
+{
+	if ((g_pbyHostDisk == NULL) || ((sector + count) > g_dwHostDiskSectors))
+	{
+		return RES_PARERR;
+	}
+
+	memcpy(g_pbyHostDisk + (size_t)sector * HOST_DISK_SECTOR_SIZE, buff, (size_t)count * HOST_DISK_SECTOR_SIZE);
+
+	++g_hdStats.dwWrites;
+	g_hdStats.dwWriteSectors += count;
+	g_hdStats.nBusyTime      += g_dwAccessTime + count * g_dwWriteBlockTime;
+
+	return RES_OK;
+}
+
+//-----------------------------------------------------------------------------
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void* buff)
+{
+	switch (cmd)
+	{
+		case CTRL_SYNC:
+			return RES_OK;
+
+		case GET_SECTOR_COUNT:
+			*(LBA_t*)buff = g_dwHostDiskSectors;
+			return RES_OK;
+
+		case GET_SECTOR_SIZE:
+			*(WORD*)buff = HOST_DISK_SECTOR_SIZE;
+			return RES_OK;
+
+		case GET_BLOCK_SIZE:
+			*(DWORD*)buff = 1;
+			return RES_OK;
+	}
+
+	return RES_PARERR;
+}
+
+//-----------------------------------------------------------------------------
+// the read is made by disk_read_finish(), the card is never busy in between
+//
+DRESULT disk_read_start(BYTE pdrv, BYTE* buff, LBA_t sector, UINT count)
+{
+	if ((g_pbyHostDisk == NULL) || ((sector + count) > g_dwHostDiskSectors))
+	{
+		return RES_PARERR;
+	}
+
+	g_pbyReadStart     = buff;
+	g_nReadStartSector = sector;
+	g_nReadStartCount  = count;
+	++g_hdStats.dwAsyncReads;
+
+	return RES_OK;
+}
+
+//-----------------------------------------------------------------------------
+int disk_read_busy(BYTE pdrv)
+{
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+DRESULT disk_read_finish(BYTE pdrv)
+{
+	if (g_pbyReadStart == NULL)
+	{
+		return RES_ERROR;
+	}
+
+	disk_read(pdrv, g_pbyReadStart, g_nReadStartSector, g_nReadStartCount);
+	g_pbyReadStart = NULL;
+
+	return RES_OK;
+}
+
+//-----------------------------------------------------------------------------
+DWORD get_fattime(void)
+{
+	// 2024-01-01 00:00:00
+	return ((DWORD)(2024 - 1980) << 25) | ((DWORD)1 << 21) | ((DWORD)1 << 16);
+}
+
+//-----------------------------------------------------------------------------
+// sd_core.c is not part of the host build, the card is always present
+//
+BYTE IsSdCardInserted(void)
+{
+	return (g_pbyHostDisk != NULL);
+}
+
+//-----------------------------------------------------------------------------
+BYTE IsSdCardWriteProtected(void)
+{
+	return FALSE;
+}
+
+//-----------------------------------------------------------------------------
+void TestSdCardInsertion(void)
+{
+}
+
+//-----------------------------------------------------------------------------
+void IdentifySdCard(void)
+{
+}
+
+//-----------------------------------------------------------------------------
+void SDHC_Init(void)
+{
+}
@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "fdc.h"
+#include "sim.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// fdc_host <directory> [script]
+//
+// Runs the FDC core with the files of <directory> as the SD-Card (boot.cfg, the ini
+// file and the images) and injects the bus cycles listed in the script (stdin when
+// no script is given).  One statement per line, numbers in hex, '#' starts a comment:
+//
+//   select <drvsel>               DRVSEL cycle (0x81 = drive 0, MFM)
+//   out <reg> <value>             DISKOUT cycle (reg 0 command, 1 track, 2 sector, 3 data)
+//   in <reg>                      DISKIN cycle, prints the value read
+//   nmi [<mask>]                  WRNMI cycle with <mask>, RDNMI cycle without
+//   cmd <command>                 writes the command register and waits for not busy
+//   seek <track>                  Seek command
+//   read <track> <sector> [size]  Read Sector command, prints the first bytes
+//   write <track> <sector> <fill> [size]
+//   run <us>                      runs the main loop without bus cycles
+//   stats                         prints the simulation and SD-Card counters
+//   save                          copies the files of the SD-Card back to <directory>
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+static char* g_pszDir;
+
+//-----------------------------------------------------------------------------
+static void PrintStats(void)
+{
+	printf("time %llu us, %lu cycles, %lu loop passes, %lu sleeps (%llu us)\n",
+		(unsigned long long)TimerGetTime(), (unsigned long)g_simStats.dwCycles, (unsigned long)g_simStats.dwLoops,
+		(unsigned long)g_simStats.dwSleeps, (unsigned long long)g_simStats.nSleepTime);
+	printf("WAIT held %lu times, %llu us (max %lu us), %lu NMI\n",
+		(unsigned long)g_simStats.dwWaitHolds, (unsigned long long)g_simStats.nWaitTime,
+		(unsigned long)g_simStats.dwWaitMax, (unsigned long)g_simStats.dwNmiPulses);
+	printf("SD-Card %lu reads (%lu sectors), %lu writes (%lu sectors), %llu us busy\n",
+		(unsigned long)g_hdStats.dwReads, (unsigned long)g_hdStats.dwReadSectors,
+		(unsigned long)g_hdStats.dwWrites, (unsigned long)g_hdStats.dwWriteSectors, (unsigned long long)g_hdStats.nBusyTime);
+	printf("track cache %lu hits, %lu misses\n", (unsigned long)g_tcsStats.dwHits, (unsigned long)g_tcsStats.dwMisses);
+}
+
+//-----------------------------------------------------------------------------
+static void PrintData(BYTE byStatus, BYTE* pby, int nSize)
+{
+	int i;
+
+	printf("status %02X:", byStatus);
+
+	for (i = 0; (i < nSize) && (i < 16); ++i)
+	{
+		printf(" %02X", pby[i]);
+	}
+
+	printf("\n");
+}
+
+//-----------------------------------------------------------------------------
+static void ExecuteLine(char* pszLine)
+{
+	BYTE         byBuf[1024];
+	char         szOp[16];
+	unsigned int n1 = 0, n2 = 0, n3 = 0, n4 = 0;
+	int          nArgs;
+	BYTE         byStatus;
+
+	nArgs = sscanf(pszLine, "%15s %x %x %x %x", szOp, &n1, &n2, &n3, &n4) - 1;
+
+	if ((nArgs < 0) || (szOp[0] == '#'))
+	{
+		return;
+	}
+
+	if (strcmp(szOp, "select") == 0)
+	{
+		SimDriveSelect(n1);
+	}
+	else if (strcmp(szOp, "out") == 0)
+	{
+		SimOut(n1, n2);
+	}
+	else if (strcmp(szOp, "in") == 0)
+	{
+		printf("in %X = %02X\n", n1, SimIn(n1));
+	}
+	else if (strcmp(szOp, "nmi") == 0)
+	{
+		if (nArgs > 0)
+		{
+			SimWriteNmiMask(n1);
+		}
+		else
+		{
+			printf("nmi = %02X\n", SimReadNmiStatus());
+		}
+	}
+	else if (strcmp(szOp, "cmd") == 0)
+	{
+		SimOut(SIM_REG_STATUS, n1);
+		printf("status %02X\n", SimWaitNotBusy(5000000));
+	}
+	else if (strcmp(szOp, "seek") == 0)
+	{
+		printf("status %02X\n", SimSeek(n1));
+	}
+	else if (strcmp(szOp, "read") == 0)
+	{
+		n3 = (nArgs > 2) ? n3 : 256;
+		memset(byBuf, 0, sizeof(byBuf));
+		byStatus = SimReadSector(n1, n2, byBuf, (n3 < sizeof(byBuf)) ? n3 : sizeof(byBuf));
+		PrintData(byStatus, byBuf, n3);
+	}
+	else if (strcmp(szOp, "write") == 0)
+	{
+		n4 = (nArgs > 3) ? n4 : 256;
+		memset(byBuf, n3, sizeof(byBuf));
+		printf("status %02X\n", SimWriteSector(n1, n2, byBuf, (n4 < sizeof(byBuf)) ? n4 : sizeof(byBuf)));
+	}
+	else if (strcmp(szOp, "run") == 0)
+	{
+		SimRun(n1);
+	}
+	else if (strcmp(szOp, "stats") == 0)
+	{
+		PrintStats();
+	}
+	else if (strcmp(szOp, "save") == 0)
+	{
+		FdcCloseAllFiles();
+		HostDiskSaveDir(g_pszDir);
+	}
+	else
+	{
+		printf("unknown statement: %s", pszLine);
+	}
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	char  szLine[256];
+	FILE* fp = stdin;
+
+	if (argc < 2)
+	{
+		printf("usage: fdc_host <directory> [script]\n");
+		return 1;
+	}
+
+	g_pszDir = argv[1];
+
+	if (!SimInit(g_pszDir))
+	{
+		printf("unable to read %s\n", g_pszDir);
+		return 1;
+	}
+
+	SimStartFdc();
+
+	if (argc > 2)
+	{
+		fp = fopen(argv[2], "r");
+
+		if (fp == NULL)
+		{
+			printf("unable to open %s\n", argv[2]);
+			return 1;
+		}
+	}
+
+	while (fgets(szLine, sizeof(szLine), fp) != NULL)
+	{
+		ExecuteLine(szLine);
+	}
+
+	if (fp != stdin)
+	{
+		fclose(fp);
+	}
+
+	return 0;
+}
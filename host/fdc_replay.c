@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "fdc.h"
+#include "sim.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// fdc_replay <directory> <trace.bin>
+//
+// Runs the FDC core with the files of <directory> as the SD-Card (boot.cfg, the ini
+// file and the images the trace was captured with) and replays the bus cycles of a
+// trace captured by Trace.c, e.g. a TRSDOS 6 boot or a BACKUP run.  Reports the
+// latency of each command type, the time the FDC held WAIT and the emulated time
+// of the run against the time of the capture.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+static char* g_pszCommandName[16] = {
+	"Restore", "Seek", "Step", "Step", "Step In", "Step In", "Step Out", "Step Out",
+	"Read Sector", "Read Sector (multi)", "Write Sector", "Write Sector (multi)",
+	"Read Address", "Force Interrupt", "Read Track", "Write Track"
+};
+
+//-----------------------------------------------------------------------------
+static void PrintReport(ReplayStatsType* prs)
+{
+	ReplayCommandStatsType* pcs;
+	int                     i;
+
+	printf("%-22s %8s %12s %10s\n", "command", "count", "avg us", "max us");
+
+	for (i = 0; i < 16; ++i)
+	{
+		pcs = &prs->csCommands[i];
+
+		if (pcs->dwCount == 0)
+		{
+			continue;
+		}
+
+		printf("%-22s %8lu %12.1f %10lu\n", g_pszCommandName[i], (unsigned long)pcs->dwCount,
+			(double)pcs->nTotalTime / pcs->dwCount, (unsigned long)pcs->dwMaxTime);
+	}
+
+	printf("\n%lu cycles replayed, %lu records skipped, %lu reads differ from the trace\n",
+		(unsigned long)prs->dwCycles, (unsigned long)prs->dwSkipped, (unsigned long)prs->dwDataMismatches);
+	printf("WAIT held %lu times, %llu us (max %lu us)\n",
+		(unsigned long)g_simStats.dwWaitHolds, (unsigned long long)g_simStats.nWaitTime, (unsigned long)g_simStats.dwWaitMax);
+	printf("trace time %llu us, emulated time %llu us\n",
+		(unsigned long long)prs->nTraceTime, (unsigned long long)prs->nEmulatedTime);
+	printf("SD-Card %lu reads, %lu writes, %llu us busy\n",
+		(unsigned long)g_hdStats.dwReads, (unsigned long)g_hdStats.dwWrites, (unsigned long long)g_hdStats.nBusyTime);
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	TraceFileHeaderType thHeader;
+	FDC_BusType*        pbtEntries;
+	ReplayStatsType     rs;
+	int                 nResult;
+
+	if (argc < 3)
+	{
+		printf("usage: fdc_replay <directory> <trace.bin>\n");
+		return 1;
+	}
+
+	nResult = ReplayLoadTrace(argv[2], &thHeader, &pbtEntries);
+
+	if (nResult != replayOk)
+	{
+		printf("%s: %s\n", argv[2], ReplayErrorText(nResult));
+		return 1;
+	}
+
+	if (!SimInit(argv[1]))
+	{
+		printf("unable to read %s\n", argv[1]);
+		return 1;
+	}
+
+	SimStartFdc();
+
+	printf("%lu records, %lu ticks per second\n", (unsigned long)thHeader.nEntries, (unsigned long)thHeader.nTickRate);
+
+	ReplayRun(pbtEntries, thHeader.nEntries, thHeader.nTickRate, &rs);
+	PrintReport(&rs);
+
+	free(pbtEntries);
+
+	return 0;
+}
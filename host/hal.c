@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "timers.h"
+#include "sim.h"
+
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+#include "hardware/structs/scb.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// Pico SDK functions for the host simulation
+//
+// The pins read by the FDC are the input levels set by sim.c (g_dwSimInputs) and
+// the outputs are recorded in g_dwSimOutputs.  time_us_32()/time_us_64() return the
+// virtual clock of timers.c, so the time only moves when the simulation advances it
+// and a run is deterministic.  sleep_us() advances the clock.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+pio_hw_t     g_pioHost;
+systick_hw_t g_systickHost;
+scb_hw_t     g_scbHost;
+
+//-----------------------------------------------------------------------------
+void gpio_init(uint gpio)
+{
+}
+
+//-----------------------------------------------------------------------------
+void gpio_init_mask(uint32_t mask)
+{
+}
+
+//-----------------------------------------------------------------------------
+void gpio_set_dir(uint gpio, bool out)
+{
+}
+
+//-----------------------------------------------------------------------------
+void gpio_set_pulls(uint gpio, bool up, bool down)
+{
+}
+
+//-----------------------------------------------------------------------------
+void gpio_pull_up(uint gpio)
+{
+}
+
+//-----------------------------------------------------------------------------
+bool gpio_get(uint gpio)
+{
+	return (g_dwSimInputs >> gpio) & 1;
+}
+
+//-----------------------------------------------------------------------------
+uint32_t gpio_get_all(void)
+{
+	return g_dwSimInputs;
+}
+
+//-----------------------------------------------------------------------------
+void gpio_put(uint gpio, bool value)
+{
+	if ((gpio == NMI_PIN) && value)
+	{
+		++g_simStats.dwNmiPulses;
+	}
+
+	if (value)
+	{
+		g_dwSimOutputs |= 1u << gpio;
+	}
+	else
+	{
+		g_dwSimOutputs &= ~(1u << gpio);
+	}
+}
+
+//-----------------------------------------------------------------------------
+void gpio_put_masked(uint32_t mask, uint32_t value)
+{
+	g_dwSimOutputs = (g_dwSimOutputs & ~mask) | (value & mask);
+}
+
+//-----------------------------------------------------------------------------
+void gpio_set_dir_out_masked(uint32_t mask)
+{
+}
+
+//-----------------------------------------------------------------------------
+void gpio_set_irq_enabled(uint gpio, uint32_t event_mask, bool enabled)
+{
+}
+
+//-----------------------------------------------------------------------------
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t event_mask, bool enabled, gpio_irq_callback_t callback)
+{
+}
+
+//-----------------------------------------------------------------------------
+uint32_t time_us_32(void)
+{
+	return (uint32_t)TimerGetTime();
+}
+
+//-----------------------------------------------------------------------------
+uint64_t time_us_64(void)
+{
+	return TimerGetTime();
+}
+
+//-----------------------------------------------------------------------------
+void sleep_us(uint64_t us)
+{
+	TimerAdvance((DWORD)us);
+}
+
+//-----------------------------------------------------------------------------
+void sleep_ms(uint32_t ms)
+{
+	TimerAdvance(ms * 1000);
+}
+
+//-----------------------------------------------------------------------------
+void busy_wait_us(uint64_t us)
+{
+	TimerAdvance((DWORD)us);
+}
+
+//-----------------------------------------------------------------------------
+void tight_loop_contents(void)
+{
+}
+
+//-----------------------------------------------------------------------------
+absolute_time_t get_absolute_time(void)
+{
+	return TimerGetTime();
+}
+
+//-----------------------------------------------------------------------------
+absolute_time_t make_timeout_time_ms(uint32_t ms)
+{
+	return TimerGetTime() + (uint64_t)ms * 1000;
+}
+
+//-----------------------------------------------------------------------------
+int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to)
+{
+	return (int64_t)(to - from);
+}
+
+//-----------------------------------------------------------------------------
+bool stdio_init_all(void)
+{
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// bus cycles are injected by sim.c on the thread of the main loop, nothing can
+// interrupt the code that disables interrupts
+//
+uint32_t save_and_disable_interrupts(void)
+{
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+void restore_interrupts(uint32_t status)
+{
+}
+
+//-----------------------------------------------------------------------------
+uint32_t clock_get_hz(enum clock_index clk_index)
+{
+	return 125000000;
+}
+
+//-----------------------------------------------------------------------------
+void pio_sm_put(PIO pio, uint sm, uint32_t data)
+{
+	pio->dwTxFifo = data;
+}
+
+//-----------------------------------------------------------------------------
+void pio_sm_exec(PIO pio, uint sm, uint instr)
+{
+}
+
+//-----------------------------------------------------------------------------
+uint pio_claim_unused_sm(PIO pio, bool required)
+{
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+uint pio_add_program(PIO pio, const pio_program_t* program)
+{
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled)
+{
+}
+
+//-----------------------------------------------------------------------------
+void pio_interrupt_clear(PIO pio, uint irq)
+{
+}
+
+//-----------------------------------------------------------------------------
+void pio_set_irq0_source_enabled(PIO pio, int source, bool enabled)
+{
+}
+
+//-----------------------------------------------------------------------------
+void irq_clear(uint irq)
+{
+}
+
+//-----------------------------------------------------------------------------
+void irq_set_exclusive_handler(uint irq, irq_handler_t handler)
+{
+}
+
+//-----------------------------------------------------------------------------
+void irq_set_enabled(uint irq, bool enabled)
+{
+}
+
+//-----------------------------------------------------------------------------
+// the FDC resets the RP2040 when the RESET input of the FDC has been held low
+//
+void system_reset(void)
+{
+	printf("system reset at %llu us\n", (unsigned long long)TimerGetTime());
+	exit(0);
+}
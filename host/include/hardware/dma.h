@@ -0,0 +1,47 @@
+#ifndef _HOST_HARDWARE_DMA_H
+#define _HOST_HARDWARE_DMA_H
+
+#include "pico/stdlib.h"
+
+// DMA of the SD-Card SPI driver, implemented by the SPI mock (host/tests/spimock.c)
+
+#define DMA_IRQ_0 11
+#define DMA_IRQ_1 12
+
+#define DREQ_SPI0_TX 16
+#define DREQ_SPI0_RX 17
+#define DREQ_SPI1_TX 18
+#define DREQ_SPI1_RX 19
+
+enum dma_channel_transfer_size {
+	DMA_SIZE_8 = 0,
+	DMA_SIZE_16 = 1,
+	DMA_SIZE_32 = 2
+};
+
+typedef struct {
+	uint32_t ctrl;
+} dma_channel_config;
+
+typedef struct {
+	volatile uint32_t ints0;
+	volatile uint32_t ints1;
+} dma_hw_t;
+
+extern dma_hw_t* dma_hw;
+
+int                dma_claim_unused_channel(bool required);
+dma_channel_config dma_channel_get_default_config(uint channel);
+void               channel_config_set_read_increment(dma_channel_config* c, bool incr);
+void               channel_config_set_write_increment(dma_channel_config* c, bool incr);
+void               channel_config_set_transfer_data_size(dma_channel_config* c, enum dma_channel_transfer_size size);
+void               channel_config_set_dreq(dma_channel_config* c, uint dreq);
+void               dma_channel_configure(uint channel, const dma_channel_config* config, volatile void* write_addr,
+                                         const volatile void* read_addr, uint transfer_count, bool trigger);
+void               dma_start_channel_mask(uint32_t chan_mask);
+bool               dma_channel_is_busy(uint channel);
+void               dma_channel_wait_for_finish_blocking(uint channel);
+void               dma_channel_set_irq0_enabled(uint channel, bool enabled);
+void               dma_channel_set_irq1_enabled(uint channel, bool enabled);
+
+#endif
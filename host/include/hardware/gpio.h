@@ -0,0 +1,12 @@
+#ifndef _HOST_HARDWARE_GPIO_H
+#define _HOST_HARDWARE_GPIO_H
+
+#include <sys/types.h>		// u_int8_t (sd_spi.c), declared by the headers of newlib
+
+#include "pico/stdlib.h"
+
+#define GPIO_FUNC_SPI 1
+
+void gpio_set_function(uint gpio, int fn);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef _HOST_HARDWARE_IRQ_H
+#define _HOST_HARDWARE_IRQ_H
+
+#include "pico/stdlib.h"
+
+#define PIO0_IRQ_0 7
+
+#define PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY 0x80
+
+typedef void (*irq_handler_t)(void);
+
+void irq_clear(uint irq);
+void irq_set_exclusive_handler(uint irq, irq_handler_t handler);
+void irq_set_enabled(uint irq, bool enabled);
+void irq_add_shared_handler(uint irq, irq_handler_t handler, uint8_t order_priority);
+
+#endif
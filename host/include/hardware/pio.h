@@ -0,0 +1,24 @@
+#ifndef _HOST_HARDWARE_PIO_H
+#define _HOST_HARDWARE_PIO_H
+
+#include "pico/stdlib.h"
+
+typedef struct { uint32_t dwTxFifo; } pio_hw_t;
+typedef pio_hw_t* PIO;
+typedef struct { uint32_t dwUnused; } pio_sm_config;
+typedef struct { const uint16_t* instructions; uint8_t length; int8_t origin; } pio_program_t;
+
+extern pio_hw_t g_pioHost;
+
+#define pio0 (&g_pioHost)
+#define pis_interrupt0 8
+
+void pio_sm_put(PIO pio, uint sm, uint32_t data);
+void pio_sm_exec(PIO pio, uint sm, uint instr);
+uint pio_claim_unused_sm(PIO pio, bool required);
+uint pio_add_program(PIO pio, const pio_program_t* program);
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled);
+void pio_interrupt_clear(PIO pio, uint irq);
+void pio_set_irq0_source_enabled(PIO pio, int source, bool enabled);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef _HOST_HARDWARE_SPI_H
+#define _HOST_HARDWARE_SPI_H
+
+#include "pico/stdlib.h"
+
+// SPI of the SD-Card driver, implemented by the SPI mock (host/tests/spimock.c)
+
+typedef struct spi_inst spi_inst_t;
+
+typedef struct {
+	volatile uint32_t dr;
+} spi_hw_t;
+
+#define spi0 ((spi_inst_t*)0)
+#define spi1 ((spi_inst_t*)1)
+
+typedef enum {
+	SPI_CPHA_0 = 0,
+	SPI_CPHA_1 = 1
+} spi_cpha_t;
+
+typedef enum {
+	SPI_CPOL_0 = 0,
+	SPI_CPOL_1 = 1
+} spi_cpol_t;
+
+typedef enum {
+	SPI_LSB_FIRST = 0,
+	SPI_MSB_FIRST = 1
+} spi_order_t;
+
+spi_hw_t* spi_get_hw(spi_inst_t* spi);
+uint      spi_get_index(spi_inst_t* spi);
+uint      spi_init(spi_inst_t* spi, uint baudrate);
+uint      spi_set_baudrate(spi_inst_t* spi, uint baudrate);
+void      spi_set_format(spi_inst_t* spi, uint data_bits, spi_cpol_t cpol, spi_cpha_t cpha, spi_order_t order);
+int       spi_write_blocking(spi_inst_t* spi, const uint8_t* src, size_t len);
+int       spi_write_read_blocking(spi_inst_t* spi, const uint8_t* src, uint8_t* dst, size_t len);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef _HOST_HARDWARE_STRUCTS_SCB_H
+#define _HOST_HARDWARE_STRUCTS_SCB_H
+
+#include "pico/stdlib.h"
+
+typedef struct {
+	volatile uint32_t aircr;
+} scb_hw_t;
+
+extern scb_hw_t g_scbHost;
+
+#define scb_hw (&g_scbHost)
+
+#endif
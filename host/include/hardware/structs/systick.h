@@ -0,0 +1,17 @@
+#ifndef _HOST_HARDWARE_STRUCTS_SYSTICK_H
+#define _HOST_HARDWARE_STRUCTS_SYSTICK_H
+
+#include "pico/stdlib.h"
+
+typedef struct {
+	volatile uint32_t csr;
+	volatile uint32_t rvr;
+	volatile uint32_t cvr;
+	volatile uint32_t calib;
+} systick_hw_t;
+
+extern systick_hw_t g_systickHost;
+
+#define systick_hw (&g_systickHost)
+
+#endif
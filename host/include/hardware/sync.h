@@ -0,0 +1,13 @@
+#ifndef _HOST_HARDWARE_SYNC_H
+#define _HOST_HARDWARE_SYNC_H
+
+#include "pico/stdlib.h"
+
+#define __dmb()	__sync_synchronize()
+#define __sev()
+#define __wfe()
+
+uint32_t save_and_disable_interrupts(void);
+void     restore_interrupts(uint32_t status);
+
+#endif
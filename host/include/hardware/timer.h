@@ -0,0 +1,8 @@
+#ifndef _HOST_HARDWARE_TIMER_H
+#define _HOST_HARDWARE_TIMER_H
+
+#include "pico/stdlib.h"
+
+// the host build of timers.c uses its virtual clock instead of a hardware alarm
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef _HOST_PICO_MUTEX_H
+#define _HOST_PICO_MUTEX_H
+
+#include "pico/stdlib.h"
+
+// the SD-Card driver runs on a single thread in the SPI mock, the mutexes do nothing
+
+typedef struct {
+	int nOwner;
+} mutex_t;
+
+#define auto_init_mutex(name) static mutex_t name
+
+void mutex_init(mutex_t* mtx);
+void mutex_enter_blocking(mutex_t* mtx);
+bool mutex_try_enter(mutex_t* mtx, uint32_t* owner_out);
+void mutex_exit(mutex_t* mtx);
+bool mutex_is_initialized(mutex_t* mtx);
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef _HOST_PICO_SEM_H
+#define _HOST_PICO_SEM_H
+
+#include "pico/stdlib.h"
+
+// released by the DMA interrupt on the RP2040, the SPI mock completes the DMA instead
+
+typedef struct {
+	int nPermits;
+} semaphore_t;
+
+void sem_init(semaphore_t* sem, int16_t initial_permits, int16_t max_permits);
+bool sem_release(semaphore_t* sem);
+bool sem_acquire_timeout_ms(semaphore_t* sem, uint32_t timeout_ms);
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef _HOST_PICO_STDLIB_H
+#define _HOST_PICO_STDLIB_H
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// Pico SDK functions used by the FDC core, for the host simulation (FDC_HOST_BUILD).
+// The implementations are in host/hal.c.  Time is the virtual clock of timers.c.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef unsigned int uint;
+typedef uint64_t     absolute_time_t;
+
+#define __not_in_flash_func(f)	f
+#define __time_critical_func(f)	f
+#define count_of(a)				(sizeof(a) / sizeof((a)[0]))
+
+#define GPIO_IN  0
+#define GPIO_OUT 1
+
+#define GPIO_IRQ_EDGE_FALL 0x4u
+#define GPIO_IRQ_EDGE_RISE 0x8u
+
+typedef void (*gpio_irq_callback_t)(uint gpio, uint32_t event_mask);
+
+void     gpio_init(uint gpio);
+void     gpio_init_mask(uint32_t mask);
+void     gpio_set_dir(uint gpio, bool out);
+void     gpio_set_pulls(uint gpio, bool up, bool down);
+void     gpio_pull_up(uint gpio);
+bool     gpio_get(uint gpio);
+uint32_t gpio_get_all(void);
+void     gpio_put(uint gpio, bool value);
+void     gpio_put_masked(uint32_t mask, uint32_t value);
+void     gpio_set_dir_out_masked(uint32_t mask);
+void     gpio_set_irq_enabled(uint gpio, uint32_t event_mask, bool enabled);
+void     gpio_set_irq_enabled_with_callback(uint gpio, uint32_t event_mask, bool enabled, gpio_irq_callback_t callback);
+
+uint32_t time_us_32(void);
+uint64_t time_us_64(void);
+void     sleep_us(uint64_t us);
+void     sleep_ms(uint32_t ms);
+void     busy_wait_us(uint64_t us);
+void     tight_loop_contents(void);
+
+absolute_time_t get_absolute_time(void);
+absolute_time_t make_timeout_time_ms(uint32_t ms);
+int64_t         absolute_time_diff_us(absolute_time_t from, absolute_time_t to);
+
+static inline absolute_time_t from_us_since_boot(uint64_t us)
+{
+	return us;
+}
+
+static inline uint64_t to_us_since_boot(absolute_time_t t)
+{
+	return t;
+}
+
+bool stdio_init_all(void);
+
+#endif
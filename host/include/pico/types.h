@@ -0,0 +1,6 @@
+#ifndef _HOST_PICO_TYPES_H
+#define _HOST_PICO_TYPES_H
+
+#include "pico/stdlib.h"
+
+#endif
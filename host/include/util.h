@@ -0,0 +1,21 @@
+#ifndef _UTIL_H_
+#define _UTIL_H_
+
+// replaces FatFs_SPI/include/util.h (Cortex-M0 inline assembly) for the host build
+
+#include <stddef.h>
+#include <stdint.h>
+
+static inline int wrap_ix(int index, int n)
+{
+	return ((index % n) + n) % n;
+}
+
+#ifndef COUNT_OF
+#define COUNT_OF(x) ((sizeof(x)/sizeof(0[x])) / ((size_t)(!(sizeof(x) % sizeof(0[x])))))
+#endif
+
+// ends the simulation (see host/hal.c)
+void system_reset(void);
+
+#endif
@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "fdc.h"
+#include "sim.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// Replay of the bus traces captured by Trace.c (trace.bin)
+//
+// ReplayLoadTrace() reads a trace file and checks its TraceFileHeaderType against
+// the FDC_BusType of this build.  ReplayRun() injects the captured cycles with
+// sim.c.  Each record is Bus.b.Count identical cycles spread over dwTicks, the time
+// to the next record.  When the FDC held WAIT the Z80 was stalled, so the records
+// that follow start later by that time.  The emulated time of the run is the trace
+// time plus the time the FDC kept the Z80 waiting, plus the time the main loop was
+// behind the trace (the SD-Card time is charged to the clock in one step, see sim.c).
+//
+// The latency of a command is the time from the write of the command register to
+// the end of busy.  The main loop runs in 1 us steps while a command is busy so
+// the end is not rounded up to the next status read of the trace.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+static char* g_pszReplayError[] = {
+	"ok",
+	"unable to read the file",
+	"not a trace file (signature)",
+	"unsupported trace version",
+	"entry size does not match FDC_BusType",
+	"tick rate is 0",
+	"file shorter than the entry count",
+	"out of memory"
+};
+
+//-----------------------------------------------------------------------------
+char* ReplayErrorText(int nError)
+{
+	if ((nError < 0) || (nError >= (int)(sizeof(g_pszReplayError) / sizeof(g_pszReplayError[0]))))
+	{
+		return "unknown error";
+	}
+
+	return g_pszReplayError[nError];
+}
+
+//-----------------------------------------------------------------------------
+// reads the trace file pszPath.  On success *ppbtEntries is a buffer of
+// pthHeader->nEntries entries allocated with malloc().
+//
+int ReplayLoadTrace(char* pszPath, TraceFileHeaderType* pthHeader, FDC_BusType** ppbtEntries)
+{
+	FILE*        fp;
+	FDC_BusType* pbt;
+
+	*ppbtEntries = NULL;
+
+	fp = fopen(pszPath, "rb");
+
+	if (fp == NULL)
+	{
+		return replayErrorFile;
+	}
+
+	if (fread(pthHeader, sizeof(TraceFileHeaderType), 1, fp) != 1)
+	{
+		fclose(fp);
+		return replayErrorFile;
+	}
+
+	if (memcmp(pthHeader->szSignature, TRACE_FILE_SIGNATURE, sizeof(pthHeader->szSignature)) != 0)
+	{
+		fclose(fp);
+		return replayErrorSignature;
+	}
+
+	if (pthHeader->nVersion != TRACE_FILE_VERSION)
+	{
+		fclose(fp);
+		return replayErrorVersion;
+	}
+
+	if (pthHeader->nEntrySize != sizeof(FDC_BusType))
+	{
+		fclose(fp);
+		return replayErrorEntrySize;
+	}
+
+	if (pthHeader->nTickRate == 0)
+	{
+		fclose(fp);
+		return replayErrorTickRate;
+	}
+
+	pbt = malloc((size_t)pthHeader->nEntries * sizeof(FDC_BusType) + 1);
+
+	if (pbt == NULL)
+	{
+		fclose(fp);
+		return replayErrorMemory;
+	}
+
+	if (fread(pbt, sizeof(FDC_BusType), pthHeader->nEntries, fp) != pthHeader->nEntries)
+	{
+		free(pbt);
+		fclose(fp);
+		return replayErrorTruncated;
+	}
+
+	fclose(fp);
+
+	*ppbtEntries = pbt;
+
+	return replayOk;
+}
+
+//-----------------------------------------------------------------------------
+// ends the latency measurement of the command in progress once it is no longer busy
+//
+static void ReplayCheckCommand(ReplayStatsType* prs)
+{
+	ReplayCommandStatsType* pcs;
+	DWORD                   dwTime;
+
+	if (!prs->byCommandBusy || g_FDC.stStatus.byBusy)
+	{
+		return;
+	}
+
+	prs->byCommandBusy = FALSE;
+
+	pcs    = &prs->csCommands[prs->byCommand >> 4];
+	dwTime = (DWORD)(TimerGetTime() - prs->nCommandStart);
+
+	++pcs->dwCount;
+	pcs->nTotalTime += dwTime;
+
+	if (dwTime > pcs->dwMaxTime)
+	{
+		pcs->dwMaxTime = dwTime;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// runs the main loop until the emulated time reaches nTime
+//
+static void ReplayRunUntil(ReplayStatsType* prs, UINT64 nTime)
+{
+	UINT64 nNow;
+
+	while ((nNow = TimerGetTime()) < nTime)
+	{
+		if (prs->byCommandBusy)
+		{
+			SimRun(1);
+			ReplayCheckCommand(prs);
+		}
+		else
+		{
+			SimRun((DWORD)(nTime - nNow));
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// injects one captured cycle, returns FALSE if the record has no (or more than
+// one) active strobe
+//
+static BYTE ReplayCycle(ReplayStatsType* prs, FDC_BusBitsType* pBus)
+{
+	int  nReg = pBus->b.A0 | (pBus->b.A1 << 1);
+	int  nStrobes;
+	BYTE byData;
+
+	nStrobes = !pBus->b.DISK_IN_RE + !pBus->b.DISK_OUT_WE + !pBus->b.DVRSEL + !pBus->b.WRNMI + !pBus->b.RDNMI;
+
+	if (nStrobes != 1)
+	{
+		return FALSE;
+	}
+
+	if (pBus->b.DISK_IN_RE == 0)
+	{
+		byData = SimIn(nReg);
+
+		// the value read by the Z80 when the trace was captured
+		if ((nReg != SIM_REG_STATUS) && (byData != pBus->b.DATA))
+		{
+			++prs->dwDataMismatches;
+		}
+	}
+	else if (pBus->b.DISK_OUT_WE == 0)
+	{
+		if (nReg == SIM_REG_STATUS)
+		{
+			// a command written while the previous one is busy ends its measurement
+			prs->byCommandBusy = FALSE;
+			prs->byCommand     = pBus->b.DATA;
+			prs->nCommandStart = TimerGetTime();
+		}
+
+		SimOut(nReg, pBus->b.DATA);
+
+		if (nReg == SIM_REG_STATUS)
+		{
+			prs->byCommandBusy = TRUE;
+		}
+	}
+	else if (pBus->b.DVRSEL == 0)
+	{
+		SimDriveSelect(pBus->b.DATA);
+	}
+	else if (pBus->b.WRNMI == 0)
+	{
+		SimWriteNmiMask(pBus->b.DATA);
+	}
+	else
+	{
+		SimReadNmiStatus();
+	}
+
+	ReplayCheckCommand(prs);
+
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// injects the nEntries captured records at pbtEntries (dwTicks in units of
+// 1/nTickRate seconds) into the FDC, which must have been started (SimStartFdc())
+//
+void ReplayRun(FDC_BusType* pbtEntries, DWORD nEntries, DWORD nTickRate, ReplayStatsType* prs)
+{
+	FDC_BusType* pbt;
+	UINT64       nStart, nNext, nStep, nWaitTime;
+	DWORD        i;
+	int          n;
+
+	memset(prs, 0, sizeof(ReplayStatsType));
+
+	nStart = TimerGetTime();
+	nNext  = nStart;
+
+	for (i = 0; i < nEntries; ++i)
+	{
+		pbt   = &pbtEntries[i];
+		nStep = (UINT64)pbt->dwTicks * 1000000 / nTickRate;
+
+		prs->nTraceTime += nStep;
+
+		// the first record of a capture holds the state before the first cycle
+		if (pbt->Bus.b.Count == 0)
+		{
+			nNext += nStep;
+			continue;
+		}
+
+		nStep /= pbt->Bus.b.Count;
+
+		for (n = 0; n < pbt->Bus.b.Count; ++n)
+		{
+			ReplayRunUntil(prs, nNext);
+
+			nWaitTime = g_simStats.nWaitTime;
+
+			if (ReplayCycle(prs, &pbt->Bus))
+			{
+				++prs->dwCycles;
+			}
+			else
+			{
+				++prs->dwSkipped;
+			}
+
+			// WAIT held by the FDC delays the cycles that follow
+			nNext += nStep + (g_simStats.nWaitTime - nWaitTime);
+		}
+	}
+
+	ReplayRunUntil(prs, nNext);
+
+	while (prs->byCommandBusy && ((TimerGetTime() - nNext) < 5000000))
+	{
+		SimRun(1);
+		ReplayCheckCommand(prs);
+	}
+
+	prs->nEmulatedTime = TimerGetTime() - nStart;
+}
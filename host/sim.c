@@ -0,0 +1,433 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "fdc.h"
+#include "sim.h"
+
+#include "pico/stdlib.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation of the TRS-80 bus
+//
+// The Z80 side is a sequence of bus cycles.  SimIn() and SimOut() inject a DISKIN
+// or DISKOUT cycle for one of the FDC registers, SimDriveSelect() a DRVSEL cycle
+// and SimReadNmiStatus()/SimWriteNmiMask() the RDNMI and WRNMI cycles.  Each cycle
+// sets the inputs returned by BusGetInputs() and calls fdc_isr() as the PIO
+// interrupt does on the RP2040.
+//
+// The PIO holds WAIT for every cycle until fdc_isr() calls ReleaseWait().  When the
+// FDC keeps WAIT (DRVSEL with the WAIT bit) the simulation runs the main loop until
+// it is released and the Z80 is held for that time (g_simStats.nWaitTime).
+//
+// Between two cycles the main loop of main.c runs for g_dwSimCycleTime us of virtual
+// time (SimRun()).  A pass takes 1 us.  When the FDC is idle the clock jumps to the
+// next timer deadline, as the firmware sleeps with WFE until the timer interrupt.
+//
+// The storage worker runs in a thread.  After each pass SimLoop() waits for it to
+// finish the submitted requests and moves the clock forward by the time the SD-Card
+// accesses would have taken (see diskio.c), so a run is deterministic.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+// inputs with none of the bus strobes active (they are active low) and RESET high
+#define SIM_INPUTS_IDLE		(INTR_MASK | (1 << RESET_PIN))
+
+#define SIM_LOOP_TIME		1			// us per pass of the main loop
+#define SIM_WAIT_LIMIT		5000000		// us, a WAIT held longer than this is reported
+
+DWORD        g_dwSimInputs = SIM_INPUTS_IDLE;
+DWORD        g_dwSimOutputs;
+DWORD        g_dwSimCycleTime = 3;		// an IN or OUT instruction of a 4 MHz Z80 takes 11 T states
+SimStatsType g_simStats;
+
+// main.c is not part of the host build
+DWORD        g_dwRotationTime;
+DWORD        g_dwIndexTime;
+DWORD        g_dwResetTime;
+BYTE         g_byMonitorReset;
+BYTE         g_byFlushTraceBuffer;
+
+extern TimerType g_tmTimers[TIMER_COUNT];
+
+static BYTE   g_bySimData;				// value placed on the data bus by the last read cycle
+static BYTE   g_bySimWaitHeld;			// the PIO holds WAIT until ReleaseWait()
+static UINT64 g_nSimDiskCharged;		// part of g_hdStats.nBusyTime already added to the clock
+static BYTE   g_byStorageStarted;
+
+//-----------------------------------------------------------------------------
+DWORD BusGetInputs(void)
+{
+	return g_dwSimInputs;
+}
+
+//-----------------------------------------------------------------------------
+void BusPutData(BYTE byData)
+{
+	g_bySimData = byData;
+}
+
+//-----------------------------------------------------------------------------
+void BusSetLed(BYTE byOn)
+{
+	gpio_put(RED_LED_PIN, byOn);
+}
+
+//-----------------------------------------------------------------------------
+void ReleaseWait(void)
+{
+	g_bySimWaitHeld = 0;
+}
+
+//-----------------------------------------------------------------------------
+// prepares the SD-Card: the files of the host directory pszDir, or an empty volume
+// when pszDir is NULL (files can then be added with HostDiskAddFile())
+//
+BYTE SimInit(char* pszDir)
+{
+	g_dwSimInputs  = SIM_INPUTS_IDLE;
+	g_dwSimOutputs = 0;
+
+	InitVars();
+	TimerInit();
+
+	if (pszDir != NULL)
+	{
+		return HostDiskLoadDir(pszDir);
+	}
+
+	if (!HostDiskCreate(64 * 2048))
+	{
+		return FALSE;
+	}
+
+	FileSystemInit();
+
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// starts the storage worker and initializes the FDC (reads boot.cfg and mounts the
+// images), as main() does after power on
+//
+void SimStartFdc(void)
+{
+	if (!g_byStorageStarted)
+	{
+		StorageInit();
+		g_byStorageStarted = TRUE;
+	}
+
+	FdcInit();
+	SimLoop();
+	SimResetStats();
+}
+
+//-----------------------------------------------------------------------------
+void SimResetStats(void)
+{
+	memset(&g_simStats, 0, sizeof(g_simStats));
+	memset(&g_hdStats, 0, sizeof(g_hdStats));
+	g_nSimDiskCharged = 0;
+}
+
+//-----------------------------------------------------------------------------
+// adds the SD-Card time of the requests completed since the last call to the clock
+//
+static void SimChargeDiskTime(void)
+{
+	StorageWaitIdle();
+
+	if (g_hdStats.nBusyTime < g_nSimDiskCharged)
+	{
+		g_nSimDiskCharged = g_hdStats.nBusyTime;
+	}
+
+	if (g_hdStats.nBusyTime > g_nSimDiskCharged)
+	{
+		TimerAdvance((DWORD)(g_hdStats.nBusyTime - g_nSimDiskCharged));
+		g_nSimDiskCharged = g_hdStats.nBusyTime;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// one pass of the main loop of main.c
+//
+void SimLoop(void)
+{
+	DWORD dwEvents;
+
+	dwEvents = EventTake();
+
+	if (dwEvents & EVENT_TIMER)
+	{
+		TimerService();
+	}
+
+	FdcServiceStateMachine(dwEvents);
+	FdcUpdateStatus();
+
+	++g_fsStats.dwLoopCount;
+	++g_simStats.dwLoops;
+
+	SimChargeDiskTime();
+}
+
+//-----------------------------------------------------------------------------
+// returns the deadline of the next running timer, 0 if there is none
+//
+static UINT64 SimNextDeadline(void)
+{
+	UINT64 nNext = 0;
+	int    i;
+
+	for (i = 0; i < TIMER_COUNT; ++i)
+	{
+		if (g_tmTimers[i].byRunning && ((nNext == 0) || (g_tmTimers[i].nDeadline < nNext)))
+		{
+			nNext = g_tmTimers[i].nDeadline;
+		}
+	}
+
+	return nNext;
+}
+
+//-----------------------------------------------------------------------------
+// runs the main loop for dwTime us of virtual time
+//
+void SimRun(DWORD dwTime)
+{
+	UINT64 nEnd = TimerGetTime() + dwTime;
+	UINT64 nNow, nNext;
+
+	while ((nNow = TimerGetTime()) < nEnd)
+	{
+		SimLoop();
+
+		if (FdcIsIdle() && (g_dwEvents == 0))
+		{
+			// sleep until the next timer deadline (or the end of the run)
+			nNext = SimNextDeadline();
+
+			if ((nNext == 0) || (nNext > nEnd))
+			{
+				nNext = nEnd;
+			}
+
+			if (nNext > nNow)
+			{
+				++g_simStats.dwSleeps;
+				g_simStats.nSleepTime += nNext - nNow;
+				TimerSetTime(nNext);
+				continue;
+			}
+		}
+
+		TimerAdvance(SIM_LOOP_TIME);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// injects one bus cycle with the strobe dwStrobe (active low), the register
+// address nReg and the data byData, then lets the main loop run until the Z80
+// makes its next cycle
+//
+static BYTE SimCycle(DWORD dwStrobe, int nReg, BYTE byData)
+{
+	UINT64 nStart;
+	DWORD  dwHeld;
+
+	++g_simStats.dwCycles;
+
+	g_dwSimInputs = (SIM_INPUTS_IDLE & ~dwStrobe) | ((DWORD)(nReg & 0x03) << A0_PIN) | ((DWORD)byData << D0_PIN);
+	g_bySimData   = 0xFF;
+	g_bySimWaitHeld = 1;
+
+	fdc_isr();
+
+	g_dwSimInputs = SIM_INPUTS_IDLE;
+
+	if (g_bySimWaitHeld)
+	{
+		nStart = TimerGetTime();
+
+		while (g_bySimWaitHeld && ((TimerGetTime() - nStart) < SIM_WAIT_LIMIT))
+		{
+			SimRun(SIM_LOOP_TIME);
+		}
+
+		if (g_bySimWaitHeld)
+		{
+			printf("WAIT held for more than %u us\n", SIM_WAIT_LIMIT);
+			g_bySimWaitHeld = 0;
+		}
+
+		dwHeld = (DWORD)(TimerGetTime() - nStart);
+
+		++g_simStats.dwWaitHolds;
+		g_simStats.nWaitTime += dwHeld;
+
+		if (dwHeld > g_simStats.dwWaitMax)
+		{
+			g_simStats.dwWaitMax = dwHeld;
+		}
+	}
+
+	SimRun(g_dwSimCycleTime);
+
+	return g_bySimData;
+}
+
+//-----------------------------------------------------------------------------
+BYTE SimIn(int nReg)
+{
+	return SimCycle(DISKIN_MASK, nReg, 0xFF);
+}
+
+//-----------------------------------------------------------------------------
+void SimOut(int nReg, BYTE byData)
+{
+	SimCycle(DISKOUT_MASK, nReg, byData);
+}
+
+//-----------------------------------------------------------------------------
+void SimDriveSelect(BYTE byData)
+{
+	SimCycle(DRVSEL_MASK, 0, byData);
+}
+
+//-----------------------------------------------------------------------------
+BYTE SimReadNmiStatus(void)
+{
+	return SimCycle(RDNMI_MASK, 0, 0xFF);
+}
+
+//-----------------------------------------------------------------------------
+void SimWriteNmiMask(BYTE byData)
+{
+	SimCycle(WRNMI_MASK, 0, byData);
+}
+
+//-----------------------------------------------------------------------------
+// polls the status register until the busy bit is clear, returns the status
+// (SIM_STATUS_BUSY still set if dwTimeout us have passed)
+//
+BYTE SimWaitNotBusy(DWORD dwTimeout)
+{
+	UINT64 nEnd = TimerGetTime() + dwTimeout;
+	BYTE   byStatus;
+
+	do
+	{
+		byStatus = SimIn(SIM_REG_STATUS);
+	}
+	while ((byStatus & SIM_STATUS_BUSY) && (TimerGetTime() < nEnd));
+
+	return byStatus;
+}
+
+//-----------------------------------------------------------------------------
+// reads the data of a Type II or III command by polling DRQ, returns the number
+// of bytes read before the command ended (or dwTimeout us passed)
+//
+int SimReadData(BYTE* pby, int nSize, DWORD dwTimeout)
+{
+	UINT64 nEnd = TimerGetTime() + dwTimeout;
+	BYTE   byStatus;
+	int    nCount = 0;
+
+	while ((nCount < nSize) && (TimerGetTime() < nEnd))
+	{
+		byStatus = SimIn(SIM_REG_STATUS);
+
+		if (byStatus & SIM_STATUS_DRQ)
+		{
+			pby[nCount++] = SimIn(SIM_REG_DATA);
+		}
+		else if ((byStatus & SIM_STATUS_BUSY) == 0)
+		{
+			break;
+		}
+	}
+
+	return nCount;
+}
+
+//-----------------------------------------------------------------------------
+int SimWriteData(BYTE* pby, int nSize, DWORD dwTimeout)
+{
+	UINT64 nEnd = TimerGetTime() + dwTimeout;
+	BYTE   byStatus;
+	int    nCount = 0;
+
+	while ((nCount < nSize) && (TimerGetTime() < nEnd))
+	{
+		byStatus = SimIn(SIM_REG_STATUS);
+
+		if (byStatus & SIM_STATUS_DRQ)
+		{
+			SimOut(SIM_REG_DATA, pby[nCount++]);
+		}
+		else if ((byStatus & SIM_STATUS_BUSY) == 0)
+		{
+			break;
+		}
+	}
+
+	return nCount;
+}
+
+//-----------------------------------------------------------------------------
+// seeks the selected drive to byTrack (6 ms step rate), returns the status
+//
+BYTE SimSeek(BYTE byTrack)
+{
+	SimOut(SIM_REG_DATA, byTrack);
+	SimOut(SIM_REG_STATUS, 0x11);
+
+	return SimWaitNotBusy(5000000);
+}
+
+//-----------------------------------------------------------------------------
+// reads a sector of the selected drive and side, returns the status
+//
+BYTE SimReadSector(BYTE byTrack, BYTE bySector, BYTE* pby, int nSize)
+{
+	SimOut(SIM_REG_TRACK, byTrack);
+	SimOut(SIM_REG_SECTOR, bySector);
+	SimOut(SIM_REG_STATUS, 0x80);
+	SimReadData(pby, nSize, 2000000);
+
+	return SimWaitNotBusy(2000000);
+}
+
+//-----------------------------------------------------------------------------
+BYTE SimWriteSector(BYTE byTrack, BYTE bySector, BYTE* pby, int nSize)
+{
+	SimOut(SIM_REG_TRACK, byTrack);
+	SimOut(SIM_REG_SECTOR, bySector);
+	SimOut(SIM_REG_STATUS, 0xA0);
+	SimWriteData(pby, nSize, 2000000);
+
+	return SimWaitNotBusy(2000000);
+}
+
+//-----------------------------------------------------------------------------
+// formats the track under the head of the selected drive (Write Track) with the
+// nSize bytes of the format stream at pby, then writes gap bytes (0x4E) for as
+// long as the FDC requests data, returns the status
+//
+BYTE SimWriteTrack(BYTE* pby, int nSize)
+{
+	BYTE byGap = 0x4E;
+
+	SimOut(SIM_REG_STATUS, 0xF4);
+	SimWriteData(pby, nSize, 5000000);
+
+	while (SimWriteData(&byGap, 1, 5000000) == 1)
+	{
+	}
+
+	return SimWaitNotBusy(5000000);
+}
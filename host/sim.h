@@ -0,0 +1,115 @@
+#ifndef _SIM_H
+#define _SIM_H
+
+#include "Defines.h"
+
+// FDC ports of the TRS-80 Model III/4 decoded by the board
+//-----------------------------------------------------------------------------
+
+#define SIM_REG_STATUS		0	// 0xF0 read status / write command (DISKIN/DISKOUT, A1 A0 = 00)
+#define SIM_REG_TRACK		1	// 0xF1
+#define SIM_REG_SECTOR		2	// 0xF2
+#define SIM_REG_DATA		3	// 0xF3
+
+#define SIM_DRVSEL_SIDE1	0x10	// 0xF4 drive select latch (DRVSEL), bits 0-3 select drive 0-3
+#define SIM_DRVSEL_WAIT		0x40
+#define SIM_DRVSEL_MFM		0x80
+
+#define SIM_STATUS_BUSY		0x01
+#define SIM_STATUS_DRQ		0x02
+#define SIM_STATUS_RNF		0x10
+
+typedef struct {
+	DWORD  dwCycles;			// bus cycles injected
+	DWORD  dwWaitHolds;			// cycles after which the FDC held WAIT
+	UINT64 nWaitTime;			// us WAIT was held after those cycles
+	DWORD  dwWaitMax;			// longest single hold (us)
+	DWORD  dwNmiPulses;			// NMI outputs generated
+	DWORD  dwLoops;				// main loop passes
+	DWORD  dwSleeps;			// passes that found the FDC idle (the firmware sleeps with WFE)
+	UINT64 nSleepTime;			// us of virtual time skipped while idle
+} SimStatsType;
+
+typedef struct {
+	DWORD  dwReads;				// disk_read() calls
+	DWORD  dwReadSectors;
+	DWORD  dwWrites;			// disk_write() calls
+	DWORD  dwWriteSectors;
+	DWORD  dwAsyncReads;		// disk_read_start() calls
+	UINT64 nBusyTime;			// us the SD-Card would have taken (see HostDiskSetTiming())
+} HostDiskStatsType;
+
+typedef struct {
+	DWORD  dwCount;
+	UINT64 nTotalTime;			// us from the command write to the end of busy
+	DWORD  dwMaxTime;
+} ReplayCommandStatsType;
+
+typedef struct {
+	ReplayCommandStatsType csCommands[16];	// by the high nibble of the command
+	DWORD  dwCycles;			// cycles injected
+	DWORD  dwSkipped;			// records with no (or more than one) active strobe
+	DWORD  dwDataMismatches;	// register reads that returned another value than in the trace
+	UINT64 nTraceTime;			// us between the first and the last record of the trace
+	UINT64 nEmulatedTime;		// us of emulated time the replay took
+	BYTE   byCommand;			// command being measured
+	BYTE   byCommandBusy;
+	UINT64 nCommandStart;
+} ReplayStatsType;
+
+enum {
+	replayOk = 0,
+	replayErrorFile,
+	replayErrorSignature,
+	replayErrorVersion,
+	replayErrorEntrySize,
+	replayErrorTickRate,
+	replayErrorTruncated,
+	replayErrorMemory
+};
+
+extern DWORD             g_dwSimInputs;		// levels of the inputs read by gpio_get_all()
+extern DWORD             g_dwSimOutputs;		// levels of the outputs set by gpio_put()
+extern DWORD             g_dwSimCycleTime;	// us between two bus cycles of the Z80
+extern SimStatsType      g_simStats;
+extern HostDiskStatsType g_hdStats;
+
+// diskio.c
+//-----------------------------------------------------------------------------
+
+void HostDiskSetTiming(DWORD dwAccessTime, DWORD dwReadBlockTime, DWORD dwWriteBlockTime);
+BYTE HostDiskCreate(DWORD dwSectors);
+BYTE HostDiskAddFile(char* pszPath, char* pszName);
+BYTE HostDiskLoadDir(char* pszDir);
+BYTE HostDiskSaveDir(char* pszDir);
+
+// sim.c
+//-----------------------------------------------------------------------------
+
+BYTE  SimInit(char* pszDir);
+void  SimStartFdc(void);
+void  SimResetStats(void);
+void  SimLoop(void);
+void  SimRun(DWORD dwTime);
+BYTE  SimIn(int nReg);
+void  SimOut(int nReg, BYTE byData);
+void  SimDriveSelect(BYTE byData);
+BYTE  SimReadNmiStatus(void);
+void  SimWriteNmiMask(BYTE byData);
+
+BYTE  SimWaitNotBusy(DWORD dwTimeout);
+int   SimReadData(BYTE* pby, int nSize, DWORD dwTimeout);
+int   SimWriteData(BYTE* pby, int nSize, DWORD dwTimeout);
+BYTE  SimSeek(BYTE byTrack);
+BYTE  SimReadSector(BYTE byTrack, BYTE bySector, BYTE* pby, int nSize);
+BYTE  SimWriteSector(BYTE byTrack, BYTE bySector, BYTE* pby, int nSize);
+BYTE  SimWriteTrack(BYTE* pby, int nSize);
+
+// replay.c
+//-----------------------------------------------------------------------------
+
+char* ReplayErrorText(int nError);
+int   ReplayLoadTrace(char* pszPath, TraceFileHeaderType* pthHeader, FDC_BusType** ppbtEntries);
+void  ReplayRun(FDC_BusType* pbtEntries, DWORD nEntries, DWORD nTickRate, ReplayStatsType* prs);
+
+#endif
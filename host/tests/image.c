@@ -0,0 +1,546 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "crc.h"
+#include "ff.h"
+#include "fdc.h"
+#include "image.h"
+
+#define IMAGE_MAX_TRACK 0x4000
+
+// HFE tracks: 250 kbit/s at 300 rpm, 100000 flux bits per side
+#define IMAGE_HFE_SIDE_LEN  12500
+#define IMAGE_HFE_TRACK_LEN (IMAGE_HFE_SIDE_LEN * 2)
+#define IMAGE_HFE_BLOCKS    ((IMAGE_HFE_TRACK_LEN + 511) / 512)
+
+int g_nErrors;
+
+static BYTE g_byHfeSide[IMAGE_HFE_SIDE_LEN];
+static int  g_nHfeBits;
+static BYTE g_byHfePrev;
+
+//-----------------------------------------------------------------------------
+void Check(BYTE byOk, char* pszWhat)
+{
+	if (!byOk)
+	{
+		printf("FAILED: %s\n", pszWhat);
+		++g_nErrors;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// the content of byte nIndex of a sector of the generated images
+//
+BYTE ImageSectorByte(int nTrack, int nSide, int nSector, int nIndex)
+{
+	return (BYTE)(nTrack * 31 + nSide * 17 + nSector * 7 + nIndex);
+}
+
+//-----------------------------------------------------------------------------
+static BYTE* ImageFill(BYTE* pby, BYTE byValue, int nCount)
+{
+	memset(pby, byValue, nCount);
+	return pby + nCount;
+}
+
+//-----------------------------------------------------------------------------
+// builds a DMK double density track (IDAM table included) with sectors 1..nSectors,
+// nInterleave apart, returns the track length (nTrackLength, 0 for the minimum)
+//
+int ImageBuildDmkTrack(BYTE* pby, int nTrackLength, int nTrack, int nSide, int nSectors, int nSectorSize, int nInterleave)
+{
+	BYTE  bySectors[0x80];
+	BYTE* p;
+	BYTE* pbyMark;
+	WORD  wCRC;
+	int   nGap3, nMinimum, i, j, nPos;
+
+	nMinimum = 128 + 32 + 16 + nSectors * (62 + nSectorSize);
+
+	if (nTrackLength == 0)
+	{
+		nTrackLength = nMinimum + nSectors * 24;
+	}
+
+	nGap3 = (nTrackLength - nMinimum) / nSectors;
+
+	if (nGap3 > 24)
+	{
+		nGap3 = 24;
+	}
+
+	if (nGap3 < 1)
+	{
+		return 0;
+	}
+
+	// physical order of the sector numbers
+	memset(bySectors, 0, sizeof(bySectors));
+
+	for (i = 0, nPos = 0; i < nSectors; ++i)
+	{
+		while (bySectors[nPos] != 0)
+		{
+			nPos = (nPos + 1) % nSectors;
+		}
+
+		bySectors[nPos] = i + 1;
+		nPos = (nPos + nInterleave) % nSectors;
+	}
+
+	memset(pby, 0, nTrackLength);
+	p = ImageFill(pby + 128, 0x4E, 32);
+
+	for (i = 0; i < nSectors; ++i)
+	{
+		p = ImageFill(p, 0x00, 12);
+		p = ImageFill(p, 0xA1, 3);
+
+		pbyMark = p;
+		pby[i * 2]     = (BYTE)(p - pby);
+		pby[i * 2 + 1] = (BYTE)(((p - pby) >> 8) | 0x80);
+
+		*p++ = 0xFE;
+		*p++ = nTrack;
+		*p++ = nSide;
+		*p++ = bySectors[i];
+		*p++ = (nSectorSize == 128) ? 0 : (nSectorSize == 256) ? 1 : (nSectorSize == 512) ? 2 : 3;
+
+		wCRC = Calculate_CRC_CCITT(pbyMark - 3, 8);
+		*p++ = wCRC >> 8;
+		*p++ = wCRC & 0xFF;
+
+		p = ImageFill(p, 0x4E, 22);
+		p = ImageFill(p, 0x00, 12);
+		p = ImageFill(p, 0xA1, 3);
+
+		pbyMark = p;
+		*p++ = 0xFB;
+
+		for (j = 0; j < nSectorSize; ++j)
+		{
+			*p++ = ImageSectorByte(nTrack, nSide, bySectors[i], j);
+		}
+
+		wCRC = Calculate_CRC_CCITT(pbyMark - 3, nSectorSize + 4);
+		*p++ = wCRC >> 8;
+		*p++ = wCRC & 0xFF;
+
+		p = ImageFill(p, 0x4E, nGap3);
+	}
+
+	ImageFill(p, 0x4E, nTrackLength - (p - pby));
+
+	return nTrackLength;
+}
+
+//-----------------------------------------------------------------------------
+// writes a DMK image with nSectors sectors of nSectorSize bytes on each track
+//
+BYTE ImageMakeDmk(char* pszName, int nTracks, int nSides, int nSectors, int nSectorSize, int nTrackLength)
+{
+	static BYTE byTrack[IMAGE_MAX_TRACK];
+	BYTE        byHeader[16];
+	FIL         f;
+	UINT        nWritten;
+	int         nTrack, nSide;
+
+	nTrackLength = ImageBuildDmkTrack(byTrack, nTrackLength, 0, 0, nSectors, nSectorSize, 1);
+
+	if ((nTrackLength == 0) || (nTrackLength > IMAGE_MAX_TRACK))
+	{
+		return FALSE;
+	}
+
+	memset(byHeader, 0, sizeof(byHeader));
+	byHeader[1] = nTracks;
+	byHeader[2] = nTrackLength & 0xFF;
+	byHeader[3] = nTrackLength >> 8;
+	byHeader[4] = (nSides == 1) ? 0x10 : 0x00;
+
+	if (f_open(&f, pszName, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+	{
+		return FALSE;
+	}
+
+	f_write(&f, byHeader, sizeof(byHeader), &nWritten);
+
+	for (nTrack = 0; nTrack < nTracks; ++nTrack)
+	{
+		for (nSide = 0; nSide < nSides; ++nSide)
+		{
+			ImageBuildDmkTrack(byTrack, nTrackLength, nTrack, nSide, nSectors, nSectorSize, 1);
+			f_write(&f, byTrack, nTrackLength, &nWritten);
+		}
+	}
+
+	f_close(&f);
+
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// appends a flux bit to g_byHfeSide, the first bit of a byte in bit 0
+//
+static void ImageHfeBit(int nBit)
+{
+	if (g_nHfeBits < (IMAGE_HFE_SIDE_LEN * 8))
+	{
+		g_byHfeSide[g_nHfeBits >> 3] |= nBit << (g_nHfeBits & 7);
+		++g_nHfeBits;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// MFM encodes byData, the clock bit of a 0 bit is set when the previous bit is a 0
+//
+static void ImageHfeMfmByte(BYTE byData)
+{
+	int i, nBit;
+
+	for (i = 7; i >= 0; --i)
+	{
+		nBit = (byData >> i) & 1;
+
+		ImageHfeBit(!g_byHfePrev && !nBit);
+		ImageHfeBit(nBit);
+
+		g_byHfePrev = nBit;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// the 0xA1 sync byte with a missing clock bit (0x4489)
+//
+static void ImageHfeMfmSync(void)
+{
+	int i;
+
+	for (i = 15; i >= 0; --i)
+	{
+		ImageHfeBit((0x4489 >> i) & 1);
+	}
+
+	g_byHfePrev = 1;
+}
+
+//-----------------------------------------------------------------------------
+static void ImageHfeMfmFill(BYTE byData, int nCount)
+{
+	while (nCount-- > 0)
+	{
+		ImageHfeMfmByte(byData);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// encodes an MFM track of sectors 1..nSectors into g_byHfeSide
+//
+static void ImageBuildHfeMfmSide(int nTrack, int nSide, int nSectors, int nSectorSize)
+{
+	BYTE byField[4 + 1024 + 2];
+	WORD wCRC;
+	int  nSector, i;
+
+	memset(g_byHfeSide, 0, sizeof(g_byHfeSide));
+	g_nHfeBits  = 0;
+	g_byHfePrev = 0;
+
+	ImageHfeMfmFill(0x4E, 80);
+
+	for (nSector = 1; nSector <= nSectors; ++nSector)
+	{
+		memset(byField, 0xA1, 3);
+		byField[3] = 0xFE;
+		byField[4] = nTrack;
+		byField[5] = nSide;
+		byField[6] = nSector;
+		byField[7] = (nSectorSize == 128) ? 0 : (nSectorSize == 256) ? 1 : (nSectorSize == 512) ? 2 : 3;
+
+		wCRC = Calculate_CRC_CCITT(byField, 8);
+		byField[8] = wCRC >> 8;
+		byField[9] = wCRC & 0xFF;
+
+		ImageHfeMfmFill(0x00, 12);
+		ImageHfeMfmSync();
+		ImageHfeMfmSync();
+		ImageHfeMfmSync();
+
+		for (i = 3; i < 10; ++i)
+		{
+			ImageHfeMfmByte(byField[i]);
+		}
+
+		ImageHfeMfmFill(0x4E, 22);
+
+		byField[3] = 0xFB;
+
+		for (i = 0; i < nSectorSize; ++i)
+		{
+			byField[4 + i] = ImageSectorByte(nTrack, nSide, nSector, i);
+		}
+
+		wCRC = Calculate_CRC_CCITT(byField, nSectorSize + 4);
+		byField[nSectorSize + 4] = wCRC >> 8;
+		byField[nSectorSize + 5] = wCRC & 0xFF;
+
+		ImageHfeMfmFill(0x00, 12);
+		ImageHfeMfmSync();
+		ImageHfeMfmSync();
+		ImageHfeMfmSync();
+
+		for (i = 3; i < (nSectorSize + 6); ++i)
+		{
+			ImageHfeMfmByte(byField[i]);
+		}
+
+		ImageHfeMfmFill(0x4E, 24);
+	}
+
+	while (g_nHfeBits < (IMAGE_HFE_SIDE_LEN * 8))
+	{
+		ImageHfeMfmByte(0x4E);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// FM encodes byData with the clock bits byClock, each bit is 4 flux bits (0, clock,
+// 0, data)
+//
+static void ImageHfeFmByte(BYTE byData, BYTE byClock)
+{
+	int i;
+
+	for (i = 7; i >= 0; --i)
+	{
+		ImageHfeBit(0);
+		ImageHfeBit((byClock >> i) & 1);
+		ImageHfeBit(0);
+		ImageHfeBit((byData >> i) & 1);
+	}
+}
+
+//-----------------------------------------------------------------------------
+static void ImageHfeFmFill(BYTE byData, int nCount)
+{
+	while (nCount-- > 0)
+	{
+		ImageHfeFmByte(byData, 0xFF);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// encodes an FM track of sectors 1..nSectors into g_byHfeSide, the address marks
+// have the clock bits 0xC7
+//
+static void ImageBuildHfeFmSide(int nTrack, int nSide, int nSectors, int nSectorSize)
+{
+	BYTE byField[1 + 1024 + 2];
+	WORD wCRC;
+	int  nSector, i;
+
+	memset(g_byHfeSide, 0, sizeof(g_byHfeSide));
+	g_nHfeBits = 0;
+
+	ImageHfeFmFill(0xFF, 16);
+
+	for (nSector = 1; nSector <= nSectors; ++nSector)
+	{
+		byField[0] = 0xFE;
+		byField[1] = nTrack;
+		byField[2] = nSide;
+		byField[3] = nSector;
+		byField[4] = (nSectorSize == 128) ? 0 : (nSectorSize == 256) ? 1 : (nSectorSize == 512) ? 2 : 3;
+
+		wCRC = Calculate_CRC_CCITT(byField, 5);
+		byField[5] = wCRC >> 8;
+		byField[6] = wCRC & 0xFF;
+
+		ImageHfeFmFill(0x00, 6);
+		ImageHfeFmByte(byField[0], 0xC7);
+
+		for (i = 1; i < 7; ++i)
+		{
+			ImageHfeFmByte(byField[i], 0xFF);
+		}
+
+		ImageHfeFmFill(0xFF, 11);
+
+		byField[0] = 0xFB;
+
+		for (i = 0; i < nSectorSize; ++i)
+		{
+			byField[1 + i] = ImageSectorByte(nTrack, nSide, nSector, i);
+		}
+
+		wCRC = Calculate_CRC_CCITT(byField, nSectorSize + 1);
+		byField[nSectorSize + 1] = wCRC >> 8;
+		byField[nSectorSize + 2] = wCRC & 0xFF;
+
+		ImageHfeFmFill(0x00, 6);
+		ImageHfeFmByte(byField[0], 0xC7);
+
+		for (i = 1; i < (nSectorSize + 3); ++i)
+		{
+			ImageHfeFmByte(byField[i], 0xFF);
+		}
+
+		ImageHfeFmFill(0xFF, 10);
+	}
+
+	while (g_nHfeBits < (IMAGE_HFE_SIDE_LEN * 8))
+	{
+		ImageHfeFmByte(0xFF, 0xFF);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// writes an MFM HFE image with nSectors sectors of nSectorSize bytes on each track
+// (at most 18 sectors of 256 bytes fit a track).  When nFmSectors is not 0 track 0
+// is FM (single density, track0s0/s1_encoding of the header) with nFmSectors
+// sectors (at most 10 of 256 bytes).
+//
+BYTE ImageMakeHfe(char* pszName, int nTracks, int nSides, int nSectors, int nSectorSize, int nFmSectors)
+{
+	static BYTE          byTrack[IMAGE_HFE_BLOCKS * 512];
+	BYTE                 byBlock[512];
+	picfileformatheader* phdr = (picfileformatheader*)byBlock;
+	pictrack*            plut = (pictrack*)byBlock;
+	FIL                  f;
+	UINT                 nWritten;
+	int                  nTrack, nSide, i;
+
+	if ((nTracks * (int)sizeof(pictrack)) > (int)sizeof(byBlock))
+	{
+		return FALSE;
+	}
+
+	if (f_open(&f, pszName, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+	{
+		return FALSE;
+	}
+
+	memset(byBlock, 0xFF, sizeof(byBlock));
+	memcpy(phdr->HEADERSIGNATURE, "HXCPICFE", 8);
+	phdr->formatrevision      = 0;
+	phdr->number_of_tracks    = nTracks;
+	phdr->number_of_sides     = nSides;
+	phdr->track_encoding      = ISOIBM_MFM_ENCODING;
+	phdr->bitRate             = 250;
+	phdr->floppyRPM           = 300;
+	phdr->floppyinterfacemode = 7;		// GENERIC_SHUGART_DD_FLOPPYMODE
+	phdr->dnu                 = 0;
+	phdr->track_list_offset   = 1;
+
+	if (nFmSectors != 0)
+	{
+		phdr->track0s0_altencoding = 0x00;
+		phdr->track0s0_encoding    = ISOIBM_FM_ENCODING;
+		phdr->track0s1_altencoding = 0x00;
+		phdr->track0s1_encoding    = ISOIBM_FM_ENCODING;
+	}
+
+	f_write(&f, byBlock, sizeof(byBlock), &nWritten);
+
+	// track list in block 1, the tracks from block 2
+	memset(byBlock, 0xFF, sizeof(byBlock));
+
+	for (nTrack = 0; nTrack < nTracks; ++nTrack)
+	{
+		plut[nTrack].offset    = 2 + nTrack * IMAGE_HFE_BLOCKS;
+		plut[nTrack].track_len = IMAGE_HFE_TRACK_LEN;
+	}
+
+	f_write(&f, byBlock, sizeof(byBlock), &nWritten);
+
+	for (nTrack = 0; nTrack < nTracks; ++nTrack)
+	{
+		memset(byTrack, 0, sizeof(byTrack));
+
+		for (nSide = 0; nSide < nSides; ++nSide)
+		{
+			if ((nTrack == 0) && (nFmSectors != 0))
+			{
+				ImageBuildHfeFmSide(nTrack, nSide, nFmSectors, nSectorSize);
+			}
+			else
+			{
+				ImageBuildHfeMfmSide(nTrack, nSide, nSectors, nSectorSize);
+			}
+
+			for (i = 0; i < IMAGE_HFE_SIDE_LEN; i += 256)
+			{
+				memcpy(byTrack + i * 2 + nSide * 256, g_byHfeSide + i, (IMAGE_HFE_SIDE_LEN - i < 256) ? IMAGE_HFE_SIDE_LEN - i : 256);
+			}
+		}
+
+		f_write(&f, byTrack, sizeof(byTrack), &nWritten);
+	}
+
+	f_close(&f);
+
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+BYTE ImageWriteFile(char* pszName, char* pszText)
+{
+	FIL  f;
+	UINT nWritten;
+
+	if (f_open(&f, pszName, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+	{
+		return FALSE;
+	}
+
+	f_write(&f, pszText, strlen(pszText), &nWritten);
+	f_close(&f);
+
+	return (nWritten == strlen(pszText));
+}
+
+//-----------------------------------------------------------------------------
+// writes boot.cfg and the ini file it names (test.ini) with the lines of pszIni
+//
+BYTE ImageWriteIni(char* pszIni)
+{
+	return ImageWriteFile("boot.cfg", "test.ini\r\n") && ImageWriteFile("test.ini", pszIni);
+}
+
+//-----------------------------------------------------------------------------
+BYTE ImageCheckSector(BYTE* pby, int nSize, int nTrack, int nSide, int nSector)
+{
+	int i;
+
+	for (i = 0; i < nSize; ++i)
+	{
+		if (pby[i] != ImageSectorByte(nTrack, nSide, nSector, i))
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// reads part of a file of the SD-Card (the storage worker must be idle)
+//
+BYTE ImageReadFile(char* pszName, DWORD dwOffset, BYTE* pby, DWORD dwSize)
+{
+	FIL  f;
+	UINT nRead = 0;
+
+	if (f_open(&f, pszName, FA_READ) != FR_OK)
+	{
+		return FALSE;
+	}
+
+	f_lseek(&f, dwOffset);
+	f_read(&f, pby, dwSize, &nRead);
+	f_close(&f);
+
+	return (nRead == dwSize);
+}
@@ -0,0 +1,27 @@
+#ifndef _IMAGE_H
+#define _IMAGE_H
+
+#include "Defines.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// test images for the host benchmarks, written to the SD-Card of the simulation,
+// and the checks of the tests: Check() prints the checks that fail and counts them
+// in g_nErrors, the exit code of the test
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+extern int g_nErrors;
+
+void  Check(BYTE byOk, char* pszWhat);
+
+BYTE  ImageSectorByte(int nTrack, int nSide, int nSector, int nIndex);
+int   ImageBuildDmkTrack(BYTE* pby, int nTrackLength, int nTrack, int nSide, int nSectors, int nSectorSize, int nInterleave);
+BYTE  ImageMakeDmk(char* pszName, int nTracks, int nSides, int nSectors, int nSectorSize, int nTrackLength);
+BYTE  ImageMakeHfe(char* pszName, int nTracks, int nSides, int nSectors, int nSectorSize, int nFmSectors);
+BYTE  ImageWriteFile(char* pszName, char* pszText);
+BYTE  ImageWriteIni(char* pszIni);
+BYTE  ImageCheckSector(BYTE* pby, int nSize, int nTrack, int nSide, int nSector);
+BYTE  ImageReadFile(char* pszName, DWORD dwOffset, BYTE* pby, DWORD dwSize);
+
+#endif
@@ -0,0 +1,721 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "Defines.h"
+#include "ff.h"
+#include "diskio.h"
+#include "sd_card.h"
+#include "hw_config.h"
+#include "sd_spi.h"
+#include "lib/no-OS-FatFS-SD-SPI-RPi-Pico/FatFs_SPI/sd_driver/crc.h"	// crc16(), crc.h of the FDC shadows it
+#include "spimock.h"
+
+#include "pico/stdlib.h"
+#include "pico/mutex.h"
+#include "pico/sem.h"
+#include "hardware/dma.h"
+#include "hardware/spi.h"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// SPI/DMA mock
+//
+// The SD driver talks to the card as on the RP2040: single bytes with
+// spi_write_read_blocking() and the data blocks by DMA (spi_transfer_start()).  The
+// card answers CMD17 (read single block), CMD18 (read multiple blocks) and CMD12
+// (stop transmission) from a sector image held in memory, and CMD9 with the CSD of
+// an SDHC card of that size (dwSectors of SpiMockCreate() is a multiple of 1024).
+//
+// Time is virtual (SpiMockGetTime()) and only moves with the SPI traffic:
+//   - each byte on the SPI takes 8 clocks of dwSpiClock;
+//   - the first data block of a read arrives dwAccessTime us after the command,
+//     the next blocks of CMD18 dwBlockGap us after the end of the previous one;
+//   - a DMA of a block runs for the time of its bytes and completes on its own,
+//     the caller sees it by polling dma_channel_is_busy();
+//   - a wait for the DMA (the semaphore of spi_transfer_wait()) jumps to its end,
+//     and tight_loop_contents() takes 1 us.
+// The work the FDC does between two polls is added with SpiMockAdvance().
+//
+// The card reads reliably up to the SPI clock set with SpiMockSetMaxClock(), the
+// data blocks sent while spi_set_baudrate() has set a faster clock have a bad CRC.
+//
+// The card initialization and the writes are not part of the model: glue.c is built
+// with disk_initialize() and disk_write() renamed (see CMakeLists.txt), the card is
+// ready at once and FatFs writes go straight to the image (to format the volume and
+// create the test files).
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#define SPI_MOCK_SECTOR_SIZE 512
+
+enum {
+	csIdle = 0,
+	csCommand,						// receiving the 6 bytes of a command
+	csStuff,						// the stuff byte that follows CMD12
+	csResponse,						// R1
+	csDataWait,						// 0xFF until the start token of the next block
+	csData,							// the block, by DMA or byte by byte (CSD)
+	csCrc1,
+	csCrc2
+};
+
+SpiMockStatsType g_smStats;
+
+systick_hw_t g_systickHost;			// system.c
+
+// File.c, sd_core.c replaces it when it is linked in (test_sdclock)
+__attribute__((weak)) BYTE sd_byCardInialized = 1;
+
+static BYTE*  g_pbyImage;
+static DWORD  g_dwImageSectors;
+
+static DWORD  g_dwAccessTime = 300;			// us from the command to the first block
+static DWORD  g_dwBlockGap   = 50;			// us between the blocks of CMD18
+static DWORD  g_dwSpiClock   = 25000000;	// Hz
+static DWORD  g_dwBaudRate;					// Hz, set by spi_set_baudrate()
+static DWORD  g_dwMaxClock;					// Hz, 0 when the card manages any clock
+static BYTE   g_byCid[16];
+
+static UINT64 g_nTimeNs;					// virtual clock
+
+static int    g_nCardState;
+static BYTE   g_byCommand[6];
+static int    g_nCommandLen;
+static BYTE   g_byMultiple;
+static DWORD  g_dwSector;
+static UINT64 g_nBlockReady;				// ns at which the start token of the next block is sent
+static BYTE   g_byBlock[SPI_MOCK_SECTOR_SIZE];
+static int    g_nBlockLen;
+static int    g_nBlockPos;
+static WORD   g_wBlockCrc;
+
+static dma_hw_t g_dmaHost;
+dma_hw_t*       dma_hw = &g_dmaHost;
+
+static spi_hw_t g_spiHost;
+static UINT64   g_nDmaDone;					// ns at which the DMA started last ends
+static int      g_nNextChannel;
+
+typedef struct {
+	volatile void* pWrite;
+	UINT           nCount;
+	BYTE           byWriteIncrement;
+} SpiMockChannelType;
+
+static SpiMockChannelType g_chChannels[2];
+
+static spi_t     g_spi = {.hw_inst = spi0, .baud_rate = 10000000};	// as in hw_config.c
+static sd_card_t g_sd  = {.pcName = "0:", .spi = &g_spi, .ss_gpio = 22};
+
+DSTATUS SpiMockGlueInitialize(BYTE pdrv);	// disk_initialize() of glue.c
+
+//-----------------------------------------------------------------------------
+// creates an empty card of dwSectors sectors
+//
+BYTE SpiMockCreate(DWORD dwSectors)
+{
+	free(g_pbyImage);
+
+	g_pbyImage       = calloc(dwSectors, SPI_MOCK_SECTOR_SIZE);
+	g_dwImageSectors = dwSectors;
+	g_nCardState     = csIdle;
+
+	memset(&g_smStats, 0, sizeof(g_smStats));
+
+	return (g_pbyImage != NULL);
+}
+
+//-----------------------------------------------------------------------------
+// sets the latency of the card (us) and the SPI clock (Hz)
+//
+void SpiMockSetTiming(DWORD dwAccessTime, DWORD dwBlockGap, DWORD dwSpiClock)
+{
+	g_dwAccessTime = dwAccessTime;
+	g_dwBlockGap   = dwBlockGap;
+	g_dwSpiClock   = dwSpiClock;
+}
+
+//-----------------------------------------------------------------------------
+// sets the fastest SPI clock (Hz) the card reads reliably at, 0 for no limit
+//
+void SpiMockSetMaxClock(DWORD dwMaxClock)
+{
+	g_dwMaxClock = dwMaxClock;
+}
+
+//-----------------------------------------------------------------------------
+// sets the CID (16 bytes) of the card, read by the next disk_initialize()
+//
+void SpiMockSetCid(BYTE* pbyCid)
+{
+	memcpy(g_byCid, pbyCid, sizeof(g_byCid));
+}
+
+//-----------------------------------------------------------------------------
+UINT64 SpiMockGetTime(void)
+{
+	return g_nTimeNs / 1000;
+}
+
+//-----------------------------------------------------------------------------
+void SpiMockAdvance(DWORD dwTime)
+{
+	g_nTimeNs += (UINT64)dwTime * 1000;
+}
+
+//-----------------------------------------------------------------------------
+static UINT64 SpiMockByteTime(size_t nBytes)
+{
+	return (UINT64)nBytes * 8 * 1000000000 / g_dwSpiClock;
+}
+
+//-----------------------------------------------------------------------------
+static void SpiMockLoadBlock(void)
+{
+	if (g_dwSector < g_dwImageSectors)
+	{
+		memcpy(g_byBlock, g_pbyImage + (size_t)g_dwSector * SPI_MOCK_SECTOR_SIZE, SPI_MOCK_SECTOR_SIZE);
+	}
+	else
+	{
+		memset(g_byBlock, 0, SPI_MOCK_SECTOR_SIZE);
+	}
+
+	g_nBlockLen = SPI_MOCK_SECTOR_SIZE;
+	g_wBlockCrc = crc16((const char*)g_byBlock, g_nBlockLen);
+
+	if (g_dwBaudRate > g_smStats.dwFastestClock)
+	{
+		g_smStats.dwFastestClock = g_dwBaudRate;
+	}
+
+	if ((g_dwMaxClock != 0) && (g_dwBaudRate > g_dwMaxClock))
+	{
+		g_wBlockCrc ^= 0xFFFF;
+		++g_smStats.dwCrcErrors;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// CSD version 2.0 (SDHC), C_SIZE (bits 69:48) is the size in 512 KB units - 1
+//
+static void SpiMockLoadCsd(void)
+{
+	DWORD dwSize = g_dwImageSectors / 1024 - 1;
+
+	memset(g_byBlock, 0, 16);
+
+	g_byBlock[0] = 0x40;
+	g_byBlock[7] = (dwSize >> 16) & 0x3F;
+	g_byBlock[8] = (dwSize >> 8) & 0xFF;
+	g_byBlock[9] = dwSize & 0xFF;
+
+	g_nBlockLen = 16;
+	g_wBlockCrc = crc16((const char*)g_byBlock, g_nBlockLen);
+}
+
+//-----------------------------------------------------------------------------
+// the byte sent by the card while the RP2040 sends byTx
+//
+static BYTE SpiMockCardByte(BYTE byTx)
+{
+	BYTE byCmd, byCrc;
+
+	g_nTimeNs += SpiMockByteTime(1);
+
+	// a command can be sent while the card waits to send the next block (CMD12)
+	if (((g_nCardState == csIdle) || (g_nCardState == csDataWait)) && ((byTx & 0xC0) == 0x40))
+	{
+		g_nCardState  = csCommand;
+		g_nCommandLen = 0;
+	}
+
+	switch (g_nCardState)
+	{
+		case csCommand:
+			g_byCommand[g_nCommandLen++] = byTx;
+
+			if (g_nCommandLen == sizeof(g_byCommand))
+			{
+				byCmd        = g_byCommand[0] & 0x3F;
+				g_dwSector   = ((DWORD)g_byCommand[1] << 24) | ((DWORD)g_byCommand[2] << 16) | ((DWORD)g_byCommand[3] << 8) | g_byCommand[4];
+				g_nCardState = (byCmd == 12) ? csStuff : csResponse;
+			}
+
+			return 0xFF;
+
+		case csStuff:
+			g_nCardState = csResponse;
+			return 0xFF;
+
+		case csResponse:
+			byCmd = g_byCommand[0] & 0x3F;
+
+			if ((byCmd == 17) || (byCmd == 18))
+			{
+				++g_smStats.dwCommands;
+				g_byMultiple  = (byCmd == 18);
+				g_nBlockReady = g_nTimeNs + (UINT64)g_dwAccessTime * 1000;
+				g_nCardState  = csDataWait;
+				SpiMockLoadBlock();
+			}
+			else if (byCmd == 9)
+			{
+				g_byMultiple  = FALSE;
+				g_nBlockReady = g_nTimeNs;
+				g_nCardState  = csDataWait;
+				SpiMockLoadCsd();
+			}
+			else
+			{
+				g_nCardState = csIdle;
+			}
+
+			return 0x00;
+
+		case csDataWait:
+			if (g_nTimeNs < g_nBlockReady)
+			{
+				return 0xFF;
+			}
+
+			g_nCardState = csData;
+			g_nBlockPos  = 0;
+			return 0xFE;
+
+		case csData:
+			if ((g_nBlockPos + 1) >= g_nBlockLen)
+			{
+				g_nCardState = csCrc1;
+			}
+
+			return g_byBlock[g_nBlockPos++];
+
+		case csCrc1:
+			g_nCardState = csCrc2;
+			return g_wBlockCrc >> 8;
+
+		case csCrc2:
+			byCrc = g_wBlockCrc & 0xFF;
+
+			if (g_byMultiple)
+			{
+				++g_dwSector;
+				SpiMockLoadBlock();
+				g_nBlockReady = g_nTimeNs + (UINT64)g_dwBlockGap * 1000;
+				g_nCardState  = csDataWait;
+			}
+			else
+			{
+				g_nCardState = csIdle;
+			}
+
+			return byCrc;
+	}
+
+	return 0xFF;
+}
+
+//-----------------------------------------------------------------------------
+int spi_write_read_blocking(spi_inst_t* spi, const uint8_t* src, uint8_t* dst, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; ++i)
+	{
+		dst[i] = SpiMockCardByte(src[i]);
+	}
+
+	return len;
+}
+
+//-----------------------------------------------------------------------------
+int spi_write_blocking(spi_inst_t* spi, const uint8_t* src, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; ++i)
+	{
+		SpiMockCardByte(src[i]);
+	}
+
+	return len;
+}
+
+//-----------------------------------------------------------------------------
+void dma_channel_configure(uint channel, const dma_channel_config* config, volatile void* write_addr,
+                           const volatile void* read_addr, uint transfer_count, bool trigger)
+{
+	if (channel < 2)
+	{
+		g_chChannels[channel].pWrite           = write_addr;
+		g_chChannels[channel].nCount           = transfer_count;
+		g_chChannels[channel].byWriteIncrement = (BYTE)config->ctrl;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// the receive channel is the one that does not write to the SPI data register
+//
+void dma_start_channel_mask(uint32_t chan_mask)
+{
+	SpiMockChannelType* pch = NULL;
+	int                 i;
+
+	for (i = 0; i < 2; ++i)
+	{
+		if ((chan_mask & (1u << i)) && (g_chChannels[i].pWrite != &g_spiHost.dr))
+		{
+			pch = &g_chChannels[i];
+		}
+	}
+
+	if (pch == NULL)
+	{
+		return;
+	}
+
+	if ((g_nCardState == csData) && pch->byWriteIncrement)
+	{
+		memcpy((void*)pch->pWrite, g_byBlock + g_nBlockPos, (pch->nCount < (UINT)(g_nBlockLen - g_nBlockPos)) ? pch->nCount : (UINT)(g_nBlockLen - g_nBlockPos));
+		g_nCardState = csCrc1;
+		++g_smStats.dwBlocks;
+	}
+
+	g_nDmaDone = g_nTimeNs + SpiMockByteTime(pch->nCount);
+	g_smStats.nDmaTime += SpiMockByteTime(pch->nCount) / 1000;
+}
+
+//-----------------------------------------------------------------------------
+bool dma_channel_is_busy(uint channel)
+{
+	if (g_nTimeNs < g_nDmaDone)
+	{
+		++g_smStats.dwDmaPolls;
+		return true;
+	}
+
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+void dma_channel_wait_for_finish_blocking(uint channel)
+{
+	if (g_nTimeNs < g_nDmaDone)
+	{
+		g_nTimeNs = g_nDmaDone;
+	}
+}
+
+//-----------------------------------------------------------------------------
+bool sem_acquire_timeout_ms(semaphore_t* sem, uint32_t timeout_ms)
+{
+	dma_channel_wait_for_finish_blocking(0);
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+void channel_config_set_write_increment(dma_channel_config* c, bool incr)
+{
+	c->ctrl = incr;
+}
+
+//-----------------------------------------------------------------------------
+void channel_config_set_read_increment(dma_channel_config* c, bool incr)
+{
+}
+
+//-----------------------------------------------------------------------------
+void channel_config_set_transfer_data_size(dma_channel_config* c, enum dma_channel_transfer_size size)
+{
+}
+
+//-----------------------------------------------------------------------------
+void channel_config_set_dreq(dma_channel_config* c, uint dreq)
+{
+}
+
+//-----------------------------------------------------------------------------
+dma_channel_config dma_channel_get_default_config(uint channel)
+{
+	dma_channel_config c = {0};
+
+	return c;
+}
+
+//-----------------------------------------------------------------------------
+int dma_claim_unused_channel(bool required)
+{
+	return g_nNextChannel++ & 1;
+}
+
+//-----------------------------------------------------------------------------
+void dma_channel_set_irq0_enabled(uint channel, bool enabled)
+{
+}
+
+//-----------------------------------------------------------------------------
+void dma_channel_set_irq1_enabled(uint channel, bool enabled)
+{
+}
+
+//-----------------------------------------------------------------------------
+spi_hw_t* spi_get_hw(spi_inst_t* spi)
+{
+	return &g_spiHost;
+}
+
+//-----------------------------------------------------------------------------
+uint spi_get_index(spi_inst_t* spi)
+{
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+uint spi_set_baudrate(spi_inst_t* spi, uint baudrate)
+{
+	if (baudrate != g_dwBaudRate)
+	{
+		++g_smStats.dwClockChanges;
+		g_dwBaudRate = baudrate;
+	}
+
+	return baudrate;
+}
+
+//-----------------------------------------------------------------------------
+uint spi_init(spi_inst_t* spi, uint baudrate)
+{
+	return spi_set_baudrate(spi, baudrate);
+}
+
+//-----------------------------------------------------------------------------
+void spi_set_format(spi_inst_t* spi, uint data_bits, spi_cpol_t cpol, spi_cpha_t cpha, spi_order_t order)
+{
+}
+
+//-----------------------------------------------------------------------------
+void sem_init(semaphore_t* sem, int16_t initial_permits, int16_t max_permits)
+{
+}
+
+//-----------------------------------------------------------------------------
+bool sem_release(semaphore_t* sem)
+{
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+void mutex_init(mutex_t* mtx)
+{
+}
+
+//-----------------------------------------------------------------------------
+void mutex_enter_blocking(mutex_t* mtx)
+{
+}
+
+//-----------------------------------------------------------------------------
+bool mutex_try_enter(mutex_t* mtx, uint32_t* owner_out)
+{
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+void mutex_exit(mutex_t* mtx)
+{
+}
+
+//-----------------------------------------------------------------------------
+bool mutex_is_initialized(mutex_t* mtx)
+{
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+void gpio_init(uint gpio)
+{
+}
+
+//-----------------------------------------------------------------------------
+void gpio_set_dir(uint gpio, bool out)
+{
+}
+
+//-----------------------------------------------------------------------------
+void gpio_pull_up(uint gpio)
+{
+}
+
+//-----------------------------------------------------------------------------
+void gpio_set_function(uint gpio, int fn)
+{
+}
+
+//-----------------------------------------------------------------------------
+bool gpio_get(uint gpio)
+{
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+void gpio_put(uint gpio, bool value)
+{
+}
+
+//-----------------------------------------------------------------------------
+uint32_t clock_get_hz(enum clock_index clk_index)
+{
+	return 125000000;
+}
+
+//-----------------------------------------------------------------------------
+void irq_set_exclusive_handler(uint irq, irq_handler_t handler)
+{
+}
+
+//-----------------------------------------------------------------------------
+void irq_add_shared_handler(uint irq, irq_handler_t handler, uint8_t order_priority)
+{
+}
+
+//-----------------------------------------------------------------------------
+void irq_set_enabled(uint irq, bool enabled)
+{
+}
+
+//-----------------------------------------------------------------------------
+uint32_t time_us_32(void)
+{
+	return (uint32_t)SpiMockGetTime();
+}
+
+//-----------------------------------------------------------------------------
+uint64_t time_us_64(void)
+{
+	return SpiMockGetTime();
+}
+
+//-----------------------------------------------------------------------------
+absolute_time_t get_absolute_time(void)
+{
+	return SpiMockGetTime();
+}
+
+//-----------------------------------------------------------------------------
+absolute_time_t make_timeout_time_ms(uint32_t ms)
+{
+	return SpiMockGetTime() + (uint64_t)ms * 1000;
+}
+
+//-----------------------------------------------------------------------------
+int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to)
+{
+	return (int64_t)(to - from);
+}
+
+//-----------------------------------------------------------------------------
+void busy_wait_us(uint64_t us)
+{
+	SpiMockAdvance((DWORD)us);
+}
+
+//-----------------------------------------------------------------------------
+void tight_loop_contents(void)
+{
+	SpiMockAdvance(1);
+}
+
+//-----------------------------------------------------------------------------
+void my_printf(const char* pcFormat, ...)
+{
+	va_list args;
+
+	va_start(args, pcFormat);
+	vprintf(pcFormat, args);
+	va_end(args);
+}
+
+//-----------------------------------------------------------------------------
+void my_assert_func(const char* file, int line, const char* func, const char* pred)
+{
+	printf("assertion \"%s\" failed: %s:%d %s\n", pred, file, line, func);
+	exit(1);
+}
+
+//-----------------------------------------------------------------------------
+size_t sd_get_num(void)
+{
+	return 1;
+}
+
+//-----------------------------------------------------------------------------
+sd_card_t* sd_get_by_num(size_t num)
+{
+	return (num == 0) ? &g_sd : NULL;
+}
+
+//-----------------------------------------------------------------------------
+size_t spi_get_num(void)
+{
+	return 1;
+}
+
+//-----------------------------------------------------------------------------
+spi_t* spi_get_by_num(size_t num)
+{
+	return (num == 0) ? &g_spi : NULL;
+}
+
+//-----------------------------------------------------------------------------
+// the card is initialized at once (SDHC, block addressing)
+//
+DSTATUS disk_initialize(BYTE pdrv)
+{
+	if ((pdrv != 0) || (g_pbyImage == NULL))
+	{
+		return STA_NOINIT;
+	}
+
+	if (!g_spi.initialized)
+	{
+		my_spi_init(&g_spi);
+		mutex_init(&g_sd.mutex);
+	}
+
+	g_sd.m_Status  = 0;
+	g_sd.card_type = 3;		// SDCARD_V2HC
+	g_sd.sectors   = g_dwImageSectors;
+	memcpy(g_sd.cid, g_byCid, sizeof(g_sd.cid));
+
+	// the card initialization ends at the hw_config.c rate
+	sd_spi_go_high_frequency(&g_sd);
+
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+DRESULT disk_write(BYTE pdrv, const BYTE* buff, LBA_t sector, UINT count)
+{
+	if ((g_pbyImage == NULL) || ((sector + count) > g_dwImageSectors))
+	{
+		return RES_PARERR;
+	}
+
+	memcpy(g_pbyImage + (size_t)sector * SPI_MOCK_SECTOR_SIZE, buff, (size_t)count * SPI_MOCK_SECTOR_SIZE);
+
+	return RES_OK;
+}
+
+//-----------------------------------------------------------------------------
+DWORD get_fattime(void)
+{
+	// 2024-01-01 00:00:00
+	return ((DWORD)(2024 - 1980) << 25) | ((DWORD)1 << 21) | ((DWORD)1 << 16);
+}
@@ -0,0 +1,32 @@
+#ifndef _SPIMOCK_H
+#define _SPIMOCK_H
+
+#include "Defines.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// SPI/DMA layer of the RP2040 with an SD-Card in SPI mode behind it, for the real
+// SD driver (sd_card.c, spi.c, sd_spi.c), glue.c, FatFs and File.c
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+	DWORD  dwCommands;			// CMD17/CMD18 received
+	DWORD  dwBlocks;			// data blocks sent
+	DWORD  dwDmaPolls;			// dma_channel_is_busy() calls that found the DMA running
+	UINT64 nDmaTime;			// us the DMA of the blocks took
+	DWORD  dwCrcErrors;			// data blocks sent with a bad CRC (SPI clock above SpiMockSetMaxClock())
+	DWORD  dwClockChanges;		// spi_set_baudrate() calls that changed the SPI clock
+	DWORD  dwFastestClock;		// fastest SPI clock a data block was sent at (Hz)
+} SpiMockStatsType;
+
+extern SpiMockStatsType g_smStats;
+
+BYTE   SpiMockCreate(DWORD dwSectors);
+void   SpiMockSetTiming(DWORD dwAccessTime, DWORD dwBlockGap, DWORD dwSpiClock);
+void   SpiMockSetMaxClock(DWORD dwMaxClock);
+void   SpiMockSetCid(BYTE* pbyCid);
+UINT64 SpiMockGetTime(void);
+void   SpiMockAdvance(DWORD dwTime);
+
+#endif
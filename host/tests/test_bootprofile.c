@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "fdc.h"
+#include "sim.h"
+#include "image.h"
+#include "timers.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// boot time of each timing profile (TIMING0=): the seeks with verify and sector
+// reads of a DOS boot (system files with directory lookups on track 17, then
+// programs and their overlays) on a 40 track double density image.  TURBO is the
+// fastest, REALISTIC takes at least the step time of the head moves, and CUSTOM
+// lies between them.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#define TRACKS    40
+#define SECTORS   18
+#define DIR_TRACK 17
+#define STEP_TIME 6000					// us, the step rate of the seeks (r1 r0 = 01)
+
+typedef struct {
+	char* pszName;
+	char* pszIni;
+} ProfileType;
+
+static ProfileType g_ptProfiles[] = {
+	{"TURBO",            "DRIVE0=boot.dmk\r\nTIMING0=TURBO\r\n"},
+	{"CUSTOM,50,50,50",  "DRIVE0=boot.dmk\r\nTIMING0=CUSTOM,50,50,50\r\n"},
+	{"CUSTOM,100,100,0", "DRIVE0=boot.dmk\r\nTIMING0=CUSTOM,100,100,0\r\n"},
+	{"REALISTIC",        "DRIVE0=boot.dmk\r\nTIMING0=REALISTIC\r\n"},
+};
+
+#define PROFILES (sizeof(g_ptProfiles) / sizeof(g_ptProfiles[0]))
+
+static BYTE g_byBoot[128];
+static int  g_nBootLen;
+
+//-----------------------------------------------------------------------------
+// the tracks read by the boot, in order
+//
+static void BuildBoot(void)
+{
+	int i;
+
+	g_nBootLen = 0;
+	g_byBoot[g_nBootLen++] = 0;
+	g_byBoot[g_nBootLen++] = DIR_TRACK;
+
+	// system files, with a directory lookup after every third one
+	for (i = 1; i <= 16; ++i)
+	{
+		g_byBoot[g_nBootLen++] = i;
+
+		if ((i % 3) == 0)
+		{
+			g_byBoot[g_nBootLen++] = DIR_TRACK;
+		}
+	}
+
+	// programs and their overlays
+	for (i = 0; i < 6; ++i)
+	{
+		g_byBoot[g_nBootLen++] = DIR_TRACK;
+		g_byBoot[g_nBootLen++] = 20 + i * 2;
+		g_byBoot[g_nBootLen++] = 21 + i * 2;
+		g_byBoot[g_nBootLen++] = 2 + i;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// the tracks stepped over by the boot
+//
+static DWORD BootSteps(void)
+{
+	DWORD dwSteps = 0;
+	int   i;
+
+	for (i = 1; i < g_nBootLen; ++i)
+	{
+		dwSteps += (g_byBoot[i] > g_byBoot[i - 1]) ? (g_byBoot[i] - g_byBoot[i - 1]) : (g_byBoot[i - 1] - g_byBoot[i]);
+	}
+
+	return dwSteps;
+}
+
+//-----------------------------------------------------------------------------
+// returns the us the boot took with the drive mounted by pszIni
+//
+static UINT64 Boot(char* pszIni)
+{
+	BYTE   byBuf[256];
+	UINT64 nStart;
+	BYTE   byTrack, bySector;
+	int    i;
+
+	Check(ImageWriteIni(pszIni), "ImageWriteIni");
+	SimStartFdc();
+
+	SimDriveSelect(0x01 | SIM_DRVSEL_MFM);
+	SimSeek(0);
+	nStart = TimerGetTime();
+
+	for (i = 0; i < g_nBootLen; ++i)
+	{
+		byTrack = g_byBoot[i];
+
+		// Seek with verify (V = 1)
+		SimOut(SIM_REG_DATA, byTrack);
+		SimOut(SIM_REG_STATUS, 0x15);
+		Check((SimWaitNotBusy(5000000) & SIM_STATUS_BUSY) == 0, "seek");
+
+		for (bySector = 1; bySector <= ((byTrack == DIR_TRACK) ? 2 : SECTORS); ++bySector)
+		{
+			Check(SimReadSector(byTrack, bySector, byBuf, sizeof(byBuf)) == 0, "read status");
+			Check(ImageCheckSector(byBuf, sizeof(byBuf), byTrack, 0, bySector), "read data");
+		}
+	}
+
+	nStart = TimerGetTime() - nStart;
+
+	FdcCloseAllFiles();
+
+	return nStart;
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	UINT64 nTime[PROFILES];
+	int    i;
+
+	BuildBoot();
+
+	Check(SimInit(NULL), "SimInit");
+	Check(ImageMakeDmk("boot.dmk", TRACKS, 1, SECTORS, 256, 0), "ImageMakeDmk");
+
+	printf("%d track loads, %lu tracks stepped\n", g_nBootLen, (unsigned long)BootSteps());
+
+	for (i = 0; i < (int)PROFILES; ++i)
+	{
+		nTime[i] = Boot(g_ptProfiles[i].pszIni);
+		printf("%-18s %8.1f ms\n", g_ptProfiles[i].pszName, nTime[i] / 1000.0);
+	}
+
+	Check(nTime[0] < nTime[1], "TURBO faster than CUSTOM");
+	Check(nTime[1] < nTime[3], "CUSTOM,50,50,50 faster than REALISTIC");
+	Check(nTime[2] < nTime[3], "no rotational delay faster than REALISTIC");
+	Check(nTime[2] >= BootSteps() * STEP_TIME, "step time of CUSTOM,100,100,0");
+	Check(nTime[3] >= BootSteps() * STEP_TIME, "step time of REALISTIC");
+
+	return (g_nErrors == 0) ? 0 : 1;
+}
@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "ff.h"
+#include "file.h"
+#include "sim.h"
+#include "image.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// direct access to contiguous images (dwStartSector): the track loads of a 40 track
+// double sided DMK image read with disk_read() at the LBA of the image take fewer
+// SD-Card operations than through FatFs, and the data is the same.  Sector writes
+// made through FatFs (unaligned) and direct (aligned) are seen by the other path.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#define TRACKS       80					// 40 tracks, 2 sides
+#define TRACK_LEN    0x1900
+#define TRACK_OFFSET 16					// the DMK header
+#define IMAGE_SIZE   (TRACK_OFFSET + TRACKS * TRACK_LEN)
+#define PASSES       20
+
+static BYTE g_byBuf[TRACK_LEN];
+
+//-----------------------------------------------------------------------------
+static BYTE ImageByte(DWORD dwOffset)
+{
+	return (BYTE)((dwOffset >> 9) * 13 + dwOffset);
+}
+
+//-----------------------------------------------------------------------------
+static BYTE CheckData(BYTE* pby, DWORD dwOffset, int nSize)
+{
+	int i;
+
+	for (i = 0; i < nSize; ++i)
+	{
+		if (pby[i] != ImageByte(dwOffset + i))
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+static BYTE CreateImage(char* pszName)
+{
+	DWORD dwOffset;
+	UINT  nWritten;
+	FIL   f;
+	BYTE  byOk = TRUE;
+	int   i;
+
+	if (f_open(&f, pszName, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+	{
+		return FALSE;
+	}
+
+	for (dwOffset = 0; dwOffset < IMAGE_SIZE; dwOffset += nWritten)
+	{
+		nWritten = ((IMAGE_SIZE - dwOffset) < TRACK_LEN) ? (IMAGE_SIZE - dwOffset) : TRACK_LEN;
+
+		for (i = 0; i < (int)nWritten; ++i)
+		{
+			g_byBuf[i] = ImageByte(dwOffset + i);
+		}
+
+		byOk &= (f_write(&f, g_byBuf, nWritten, &nWritten) == FR_OK) && (nWritten != 0);
+	}
+
+	f_close(&f);
+
+	return byOk;
+}
+
+//-----------------------------------------------------------------------------
+static BYTE LoadTracks(file* fp)
+{
+	DWORD dwOffset;
+	BYTE  byOk = TRUE;
+	int   nPass, t;
+
+	for (nPass = 0; nPass < PASSES; ++nPass)
+	{
+		for (t = 0; t < TRACKS; ++t)
+		{
+			dwOffset = TRACK_OFFSET + t * TRACK_LEN;
+
+			FileSeek(fp, dwOffset);
+			byOk &= (FileRead(fp, g_byBuf, TRACK_LEN) == TRACK_LEN) && CheckData(g_byBuf, dwOffset, TRACK_LEN);
+		}
+	}
+
+	return byOk;
+}
+
+//-----------------------------------------------------------------------------
+static void PrintStats(char* pszWhat)
+{
+	printf("%-6s %5.2f SD reads/track (%5.2f sectors), %4lu us/track, %lu direct reads\n", pszWhat,
+		(double)g_hdStats.dwReads / (PASSES * TRACKS), (double)g_hdStats.dwReadSectors / (PASSES * TRACKS),
+		(unsigned long)(g_hdStats.nBusyTime / (PASSES * TRACKS)), (unsigned long)g_flStats.dwDirectReads);
+}
+
+//-----------------------------------------------------------------------------
+// writes nSize bytes at dwOffset (the image data with each byte inverted), then
+// reads back the track that holds it
+//
+static BYTE WriteBack(file* fp, DWORD dwOffset, int nSize)
+{
+	DWORD dwTrack = TRACK_OFFSET + ((dwOffset - TRACK_OFFSET) / TRACK_LEN) * TRACK_LEN;
+	int   i;
+
+	for (i = 0; i < nSize; ++i)
+	{
+		g_byBuf[i] = ~ImageByte(dwOffset + i);
+	}
+
+	FileSeek(fp, dwOffset);
+
+	if (FileWrite(fp, g_byBuf, nSize) != nSize)
+	{
+		return FALSE;
+	}
+
+	FileFlush(fp);
+	FileSeek(fp, dwTrack);
+
+	if (FileRead(fp, g_byBuf, TRACK_LEN) != TRACK_LEN)
+	{
+		return FALSE;
+	}
+
+	for (i = 0; i < TRACK_LEN; ++i)
+	{
+		BYTE byExpected = ImageByte(dwTrack + i);
+
+		if (((dwTrack + i) >= dwOffset) && ((dwTrack + i) < (dwOffset + nSize)))
+		{
+			byExpected = ~byExpected;
+		}
+
+		if (g_byBuf[i] != byExpected)
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	HostDiskStatsType hdFatFs;
+	DWORD             dwStartSector;
+	file*             fp;
+
+	Check(SimInit(NULL), "SimInit");
+	Check(CreateImage("disk.dmk"), "CreateImage");
+
+	fp = FileOpen("disk.dmk", FA_READ | FA_WRITE);
+	Check(fp != NULL, "FileOpen");
+
+	if (fp == NULL)
+	{
+		return 1;
+	}
+
+	Check(FileEnableFastSeek(fp), "FileEnableFastSeek");
+	Check(fp->dwStartSector != 0, "contiguous image");
+	dwStartSector = fp->dwStartSector;
+
+	// through FatFs
+	fp->dwStartSector = 0;
+
+	memset(&g_flStats, 0, sizeof(g_flStats));
+	memset(&g_hdStats, 0, sizeof(g_hdStats));
+	Check(LoadTracks(fp), "data through FatFs");
+	PrintStats("FatFs");
+	hdFatFs = g_hdStats;
+	Check(g_flStats.dwDirectReads == 0, "no direct reads");
+
+	// at the LBA of the image
+	fp->dwStartSector = dwStartSector;
+
+	memset(&g_flStats, 0, sizeof(g_flStats));
+	memset(&g_hdStats, 0, sizeof(g_hdStats));
+	Check(LoadTracks(fp), "data read direct");
+	PrintStats("direct");
+
+	Check(g_flStats.dwDirectReads > 0, "direct reads");
+	Check(g_hdStats.dwReads < hdFatFs.dwReads, "fewer SD reads direct");
+	Check(g_hdStats.nBusyTime < hdFatFs.nBusyTime, "less SD-Card time direct");
+
+	// a sector data field written through FatFs, then a whole aligned block direct
+	memset(&g_flStats, 0, sizeof(g_flStats));
+	Check(WriteBack(fp, TRACK_OFFSET + 5 * TRACK_LEN + 300, 262), "unaligned write read back");
+	Check(WriteBack(fp, 0x2000, 0x1000), "aligned write read back");
+	Check(g_flStats.dwDirectWrites > 0, "direct writes");
+	Check(fp->dwStartSector == dwStartSector, "still direct");
+
+	// a track added to the image goes through FatFs, the link map is rebuilt after
+	// it and the image is still contiguous (the next cluster was free)
+	memset(&g_flStats, 0, sizeof(g_flStats));
+	Check(WriteBack(fp, IMAGE_SIZE, TRACK_LEN), "track added at the end read back");
+	Check(g_flStats.dwLinkMapBuilds > 0, "link map rebuilt");
+	Check((fp->f.cltbl != NULL) && (fp->dwStartSector == dwStartSector), "direct after the file grew");
+
+	FileClose(fp);
+
+	return (g_nErrors == 0) ? 0 : 1;
+}
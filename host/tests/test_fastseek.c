@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "ff.h"
+#include "file.h"
+#include "sim.h"
+#include "image.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// cluster link map of the mounted images (FileEnableFastSeek()): the track loads of
+// an 80 track HFE image whose clusters are split by another file every 64 clusters
+// read FAT sectors on each seek without the map and none with it.  The map is kept
+// when the image grows, and an image with more fragments than FILE_LINK_MAP_SIZE
+// holds keeps the normal seek.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#define TRACKS     80
+#define TRACK_LEN  0x6200				// HFE track, both sides
+#define IMAGE_SIZE (TRACKS * TRACK_LEN)
+#define LOADS      200
+
+extern FATFS g_FatFs;
+
+static BYTE g_byBuf[TRACK_LEN];
+
+//-----------------------------------------------------------------------------
+static BYTE ImageByte(DWORD dwOffset)
+{
+	return (BYTE)((dwOffset >> 9) * 7 + dwOffset);
+}
+
+//-----------------------------------------------------------------------------
+static BYTE CheckData(BYTE* pby, DWORD dwOffset, int nSize)
+{
+	int i;
+
+	for (i = 0; i < nSize; ++i)
+	{
+		if (pby[i] != ImageByte(dwOffset + i))
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// writes the image a cluster at a time, with a cluster of the other file after
+// each nFragment clusters of the image
+//
+static BYTE CreateFragmented(char* pszName, char* pszOther, int nFragment)
+{
+	UINT  nCluster, nWritten;
+	DWORD dwOffset;
+	FIL   f, fOther;
+	BYTE  byOk = TRUE;
+	UINT  i, nCount = 0;
+
+	if (f_open(&f, pszName, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+	{
+		return FALSE;
+	}
+
+	if (f_open(&fOther, pszOther, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+	{
+		f_close(&f);
+		return FALSE;
+	}
+
+	// the volume is mounted by the first f_open()
+	nCluster = g_FatFs.csize * FF_MIN_SS;
+
+	for (dwOffset = 0; dwOffset < IMAGE_SIZE; dwOffset += nCluster)
+	{
+		for (i = 0; i < nCluster; ++i)
+		{
+			g_byBuf[i] = ImageByte(dwOffset + i);
+		}
+
+		byOk &= (f_write(&f, g_byBuf, nCluster, &nWritten) == FR_OK) && (nWritten == nCluster);
+
+		if ((++nCount % nFragment) == 0)
+		{
+			byOk &= (f_write(&fOther, g_byBuf, nCluster, &nWritten) == FR_OK);
+		}
+	}
+
+	f_close(&fOther);
+	f_close(&f);
+
+	return byOk;
+}
+
+//-----------------------------------------------------------------------------
+// the track loads of a disk copy that goes back to the directory track between
+// the others, returns the data check
+//
+static BYTE LoadTracks(file* fp)
+{
+	DWORD dwOffset;
+	BYTE  byOk = TRUE;
+	int   i;
+
+	for (i = 0; i < LOADS; ++i)
+	{
+		dwOffset = ((i & 1) ? (TRACKS - 1) : ((i * 7) % TRACKS)) * TRACK_LEN;
+
+		FileSeek(fp, dwOffset);
+		byOk &= (FileRead(fp, g_byBuf, TRACK_LEN / 2) == (TRACK_LEN / 2)) && CheckData(g_byBuf, dwOffset, TRACK_LEN / 2);
+	}
+
+	return byOk;
+}
+
+//-----------------------------------------------------------------------------
+static void PrintStats(char* pszWhat, file* fp)
+{
+	printf("%-9s %lu seeks, %lu FAT sectors read (%.2f per seek), %lu items, %llu us\n", pszWhat,
+		(unsigned long)g_flStats.dwSeeks, (unsigned long)g_flStats.dwSeekReads,
+		(g_flStats.dwSeeks != 0) ? (double)g_flStats.dwSeekReads / g_flStats.dwSeeks : 0.0,
+		(unsigned long)fp->dwLinkMapItems, (unsigned long long)g_hdStats.nBusyTime);
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	DWORD  dwNormalReads;
+	UINT64 nNormalTime;
+	file*  fp;
+	int    i;
+
+	Check(SimInit(NULL), "SimInit");
+	Check(CreateFragmented("disk.hfe", "other.bin", 64), "CreateFragmented disk.hfe");
+	Check(CreateFragmented("frag.hfe", "other2.bin", 1), "CreateFragmented frag.hfe");
+
+	fp = FileOpen("disk.hfe", FA_READ | FA_WRITE);
+	Check(fp != NULL, "FileOpen disk.hfe");
+
+	if (fp == NULL)
+	{
+		return 1;
+	}
+
+	// without the link map
+	memset(&g_flStats, 0, sizeof(g_flStats));
+	memset(&g_hdStats, 0, sizeof(g_hdStats));
+	Check(LoadTracks(fp), "data without the link map");
+	PrintStats("normal", fp);
+	dwNormalReads = g_flStats.dwSeekReads;
+	nNormalTime   = g_hdStats.nBusyTime;
+
+	// with the link map
+	Check(FileEnableFastSeek(fp), "FileEnableFastSeek disk.hfe");
+	Check((fp->dwLinkMapItems > 4) && (fp->dwLinkMapItems <= FILE_LINK_MAP_SIZE), "link map of a fragmented file");
+	Check(fp->dwStartSector == 0, "no direct access to a fragmented file");
+
+	memset(&g_flStats, 0, sizeof(g_flStats));
+	memset(&g_hdStats, 0, sizeof(g_hdStats));
+	Check(LoadTracks(fp), "data with the link map");
+	PrintStats("fast seek", fp);
+
+	Check(dwNormalReads > 0, "FAT sectors read without the link map");
+	Check(g_flStats.dwSeekReads == 0, "no FAT sectors read with the link map");
+	Check(g_hdStats.nBusyTime < nNormalTime, "less SD-Card time with the link map");
+
+	// a track written past the end of the image, the map is rebuilt
+	for (i = 0; i < TRACK_LEN; ++i)
+	{
+		g_byBuf[i] = ImageByte(IMAGE_SIZE + i);
+	}
+
+	memset(&g_flStats, 0, sizeof(g_flStats));
+	FileSeek(fp, IMAGE_SIZE);
+	Check(FileWrite(fp, g_byBuf, TRACK_LEN) == TRACK_LEN, "write past the end");
+	FileFlush(fp);
+
+	Check(fp->byFastSeek && (fp->f.cltbl != NULL), "link map kept after the file grew");
+	Check(g_flStats.dwLinkMapBuilds > 0, "link map rebuilt");
+
+	memset(g_byBuf, 0, sizeof(g_byBuf));
+	FileSeek(fp, IMAGE_SIZE);
+	Check((FileRead(fp, g_byBuf, TRACK_LEN) == TRACK_LEN) && CheckData(g_byBuf, IMAGE_SIZE, TRACK_LEN), "data past the old end");
+	Check(LoadTracks(fp), "data after the file grew");
+
+	FileClose(fp);
+
+	// too many fragments for the map
+	fp = FileOpen("frag.hfe", FA_READ);
+	Check(fp != NULL, "FileOpen frag.hfe");
+
+	if (fp != NULL)
+	{
+		Check(!FileEnableFastSeek(fp), "no link map for too many fragments");
+		Check(fp->dwLinkMapItems > FILE_LINK_MAP_SIZE, "required link map size");
+		Check(fp->f.cltbl == NULL, "normal seek");
+
+		memset(&g_flStats, 0, sizeof(g_flStats));
+		memset(&g_hdStats, 0, sizeof(g_hdStats));
+		Check(LoadTracks(fp), "data with too many fragments");
+		PrintStats("frag", fp);
+
+		FileClose(fp);
+	}
+
+	return (g_nErrors == 0) ? 0 : 1;
+}
@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "crc.h"
+#include "ff.h"
+#include "file.h"
+#include "fdc.h"
+#include "sim.h"
+#include "image.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// block cache of File.c: the sector writes of a disk copy to a DMK image (the
+// nSectorSize+6 bytes of each data field at its unaligned offset, one write-back
+// of FdcWriteTrack() per sector) are made through File.c and directly with FatFs,
+// with the sectors of each track in order and with a 2:1 interleave.  Both files
+// have a cluster link map, as the mounted images do (FileEnableFastSeek()).  Both
+// images get the same data, the cache combines the writes to the same block and
+// takes less SD-Card time.  An aligned track sized read bypasses the cache.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#define TRACKS       40
+#define SECTORS      18
+#define SECTOR_SIZE  256
+#define TRACK_LEN    0x1900
+#define FIELD_OFFSET 41						// from the 0xFE of the ID field to the first 0xA1 of the data field
+
+static BYTE g_byTrack[TRACK_LEN];
+static int  g_nFieldOffset[SECTORS + 1];	// track offset of the data field of each sector
+
+// the orders in which the copy writes the sectors of a track
+static int  g_nOrder[2][SECTORS] = {
+	{1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18},
+	{1, 3, 5, 7, 9, 11, 13, 15, 17, 2, 4, 6, 8, 10, 12, 14, 16, 18}
+};
+
+static char* g_pszOrder[2] = {"in order", "2:1 interleave"};
+
+//-----------------------------------------------------------------------------
+// the data field written to sector nSector of track nTrack (0xA1 x 3, 0xFB, data, CRC)
+//
+static void BuildField(BYTE* pby, int nTrack, int nSector)
+{
+	WORD wCRC;
+	int  i;
+
+	memset(pby, 0xA1, 3);
+	pby[3] = 0xFB;
+
+	for (i = 0; i < SECTOR_SIZE; ++i)
+	{
+		pby[4 + i] = ImageSectorByte(nTrack + 1, 1, nSector, i);
+	}
+
+	wCRC = Calculate_CRC_CCITT(pby, SECTOR_SIZE + 4);
+	pby[SECTOR_SIZE + 4] = wCRC >> 8;
+	pby[SECTOR_SIZE + 5] = wCRC & 0xFF;
+}
+
+//-----------------------------------------------------------------------------
+static DWORD FieldOffset(int nTrack, int nSector)
+{
+	return DMK_HEADER_SIZE + nTrack * TRACK_LEN + g_nFieldOffset[nSector];
+}
+
+//-----------------------------------------------------------------------------
+// the copy through File.c, flushed at the end of each track
+//
+static BYTE CopyWithCache(char* pszName, int* pnOrder)
+{
+	BYTE  byField[SECTOR_SIZE + 6];
+	file* fp = FileOpen(pszName, FA_READ | FA_WRITE);
+	int   nTrack, i;
+
+	if ((fp == NULL) || !FileEnableFastSeek(fp))
+	{
+		return FALSE;
+	}
+
+	for (nTrack = 0; nTrack < TRACKS; ++nTrack)
+	{
+		for (i = 0; i < SECTORS; ++i)
+		{
+			BuildField(byField, nTrack, pnOrder[i]);
+			FileSeek(fp, FieldOffset(nTrack, pnOrder[i]));
+			FileWrite(fp, byField, sizeof(byField));
+		}
+
+		FileFlush(fp);
+	}
+
+	FileClose(fp);
+
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// the same copy with FatFs, synced at the end of each track
+//
+static BYTE CopyWithFatFs(char* pszName, int* pnOrder)
+{
+	DWORD dwLinkMap[FILE_LINK_MAP_SIZE];
+	BYTE  byField[SECTOR_SIZE + 6];
+	FIL   f;
+	UINT  nWritten;
+	int   nTrack, i;
+
+	if (f_open(&f, pszName, FA_READ | FA_WRITE) != FR_OK)
+	{
+		return FALSE;
+	}
+
+	dwLinkMap[0] = FILE_LINK_MAP_SIZE;
+	f.cltbl      = dwLinkMap;
+
+	if (f_lseek(&f, CREATE_LINKMAP) != FR_OK)
+	{
+		f_close(&f);
+		return FALSE;
+	}
+
+	for (nTrack = 0; nTrack < TRACKS; ++nTrack)
+	{
+		for (i = 0; i < SECTORS; ++i)
+		{
+			BuildField(byField, nTrack, pnOrder[i]);
+			f_lseek(&f, FieldOffset(nTrack, pnOrder[i]));
+			f_write(&f, byField, sizeof(byField), &nWritten);
+		}
+
+		f_sync(&f);
+	}
+
+	f_close(&f);
+
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+static BYTE CheckCopy(char* pszName)
+{
+	BYTE byField[SECTOR_SIZE + 6];
+	int  nTrack, nSector;
+
+	for (nTrack = 0; nTrack < TRACKS; ++nTrack)
+	{
+		if (!ImageReadFile(pszName, DMK_HEADER_SIZE + nTrack * TRACK_LEN, g_byTrack, TRACK_LEN))
+		{
+			return FALSE;
+		}
+
+		for (nSector = 1; nSector <= SECTORS; ++nSector)
+		{
+			BuildField(byField, nTrack, nSector);
+
+			if (memcmp(g_byTrack + g_nFieldOffset[nSector], byField, sizeof(byField)) != 0)
+			{
+				return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+static void PrintStats(char* pszWhat, HostDiskStatsType* phd)
+{
+	printf("  %-6s %5lu SD reads (%5lu sectors), %5lu SD writes (%5lu sectors), %7lu us\n", pszWhat,
+		(unsigned long)phd->dwReads, (unsigned long)phd->dwReadSectors, (unsigned long)phd->dwWrites,
+		(unsigned long)phd->dwWriteSectors, (unsigned long)phd->nBusyTime);
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	static BYTE       byBuf[0x4000];
+	HostDiskStatsType hdCache, hdFatFs;
+	file*             fp;
+	int               i, nIDAM;
+
+	Check(SimInit(NULL), "SimInit");
+	Check(ImageMakeDmk("cache.dmk", TRACKS, 1, SECTORS, SECTOR_SIZE, TRACK_LEN), "ImageMakeDmk");
+	Check(ImageMakeDmk("fatfs.dmk", TRACKS, 1, SECTORS, SECTOR_SIZE, TRACK_LEN), "ImageMakeDmk");
+
+	// where the data fields are (the IDAM table of the track)
+	ImageBuildDmkTrack(g_byTrack, TRACK_LEN, 0, 0, SECTORS, SECTOR_SIZE, 1);
+
+	for (i = 0; i < SECTORS; ++i)
+	{
+		nIDAM = g_byTrack[i * 2] | ((g_byTrack[i * 2 + 1] & 0x3F) << 8);
+		g_nFieldOffset[g_byTrack[nIDAM + 3]] = nIDAM + FIELD_OFFSET;
+	}
+
+	printf("%d sector writes of %d bytes, %d blocks per file\n", TRACKS * SECTORS, SECTOR_SIZE + 6, FILE_CACHE_BLOCKS);
+
+	for (i = 0; i < 2; ++i)
+	{
+		memset(&g_flStats, 0, sizeof(g_flStats));
+		memset(&g_hdStats, 0, sizeof(g_hdStats));
+		Check(CopyWithCache("cache.dmk", g_nOrder[i]), "copy through File.c");
+		hdCache = g_hdStats;
+
+		memset(&g_hdStats, 0, sizeof(g_hdStats));
+		Check(CopyWithFatFs("fatfs.dmk", g_nOrder[i]), "copy with FatFs");
+		hdFatFs = g_hdStats;
+
+		printf("%s\n", g_pszOrder[i]);
+		PrintStats("File.c", &hdCache);
+		PrintStats("FatFs", &hdFatFs);
+		printf("  block hits %lu, misses %lu, combined writes %lu\n", (unsigned long)g_flStats.dwBlockHits,
+			(unsigned long)g_flStats.dwBlockMisses, (unsigned long)g_flStats.dwCombined);
+
+		Check(g_flStats.dwCombined > 0, "writes combined");
+		Check(hdCache.dwWriteSectors <= hdFatFs.dwWriteSectors, "no more sectors written");
+		Check(hdCache.nBusyTime < hdFatFs.nBusyTime, "less SD-Card time");
+	}
+
+	Check(CheckCopy("cache.dmk"), "data written through File.c");
+	Check(CheckCopy("fatfs.dmk"), "data written with FatFs");
+
+	// a read of whole aligned blocks bypasses the cache
+	fp = FileOpen("cache.dmk", FA_READ);
+	Check(fp != NULL, "FileOpen");
+
+	if (fp != NULL)
+	{
+		memset(&g_flStats, 0, sizeof(g_flStats));
+		FileSeek(fp, 0x4000);
+		Check(FileRead(fp, byBuf, sizeof(byBuf)) == sizeof(byBuf), "aligned read");
+		Check((g_flStats.dwPassThrough > 0) && (g_flStats.dwBlockMisses == 0), "aligned read bypasses the cache");
+		FileClose(fp);
+	}
+
+	return (g_nErrors == 0) ? 0 : 1;
+}
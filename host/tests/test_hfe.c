@@ -0,0 +1,426 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "Defines.h"
+#include "fdc.h"
+#include "sim.h"
+#include "image.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// HFE track decoding: the sectors of an MFM HFE image and of an image with an FM
+// track 0 (TRS-80 Model III boot track) are read by the FDC, and the table driven
+// decoders of LoadHfeTrack() produce the same ID and data fields as bit-serial
+// decoders (one flux bit shifted in at a time, as hfe.c did before).  Prints the
+// decode time per track of both.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#define TRACKS      40
+#define SIDES       2
+#define SECTORS     18
+#define SECTOR_SIZE 256
+#define FM_SECTORS  10					// track 0 of mixed.hfe
+#define REPEAT      20					// decodes of each track timed
+
+#define SIDE_LEN    12500				// flux bytes of a side, see image.c
+#define TRACK_SIZE  (((SIDE_LEN * 2 + 511) / 512) * 512)
+#define IMAGE_SIZE  (1024 + TRACKS * TRACK_SIZE)
+
+static TrackType g_tdTrack;
+static BYTE      g_byImage[2][IMAGE_SIZE];
+static BYTE      g_bySide[SIDE_LEN];
+
+// fields found by the bit-serial decoder
+typedef struct {
+	int  nFields;
+	BYTE byMark[MAX_SECTORS_PER_TRACK * 2];
+	BYTE byData[MAX_SECTORS_PER_TRACK * 2][SECTOR_SIZE + 3];
+} RefTrackType;
+
+static RefTrackType g_rtRef;
+
+//-----------------------------------------------------------------------------
+static UINT64 WallTime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (UINT64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//-----------------------------------------------------------------------------
+static int RefBit(int bitpos)
+{
+	return (g_bySide[bitpos >> 3] >> (bitpos & 7)) & 1;
+}
+
+//-----------------------------------------------------------------------------
+// the data bits of the nCellBits * 8 flux bits at bitpos, the data bit is the last
+// one of each cell (clock, data for MFM and 0, clock, 0, data for FM)
+//
+static BYTE RefByte(int bitpos, int nCellBits)
+{
+	BYTE by = 0;
+	int  i;
+
+	for (i = 0; i < 8; ++i)
+	{
+		by = (by << 1) | RefBit(bitpos + (i + 1) * nCellBits - 1);
+	}
+
+	return by;
+}
+
+//-----------------------------------------------------------------------------
+// decodes the field of the address mark at bitpos, returns its length in bytes
+// (0 if it is not an address mark or it does not fit the track)
+//
+static int RefDecodeField(RefTrackType* prt, int bitpos, int nCellBits, int* pnSize)
+{
+	BYTE byMark = RefByte(bitpos, nCellBits);
+	int  nLen, i;
+
+	if (byMark == 0xFE)
+	{
+		nLen = 7;
+	}
+	else if ((byMark == 0xFB) || (byMark == 0xF8))
+	{
+		nLen = *pnSize + 3;
+	}
+	else
+	{
+		return 0;
+	}
+
+	if ((bitpos + nLen * nCellBits * 8) > (SIDE_LEN * 8))
+	{
+		return 0;
+	}
+
+	for (i = 0; i < nLen; ++i)
+	{
+		prt->byData[prt->nFields][i] = RefByte(bitpos + i * nCellBits * 8, nCellBits);
+	}
+
+	if (byMark == 0xFE)
+	{
+		*pnSize = 128 << (prt->byData[prt->nFields][4] & 3);
+	}
+
+	prt->byMark[prt->nFields++] = byMark;
+
+	return nLen;
+}
+
+//-----------------------------------------------------------------------------
+// bit-serial MFM decoder: searches 0x4489 one flux bit at a time and decodes the
+// address marks that follow the syncs
+//
+static void RefDecodeMfmSide(RefTrackType* prt)
+{
+	WORD mfm = 0;
+	int  nFluxLen = SIDE_LEN * 8;
+	int  bitpos = 0, nSize = 0, nLen;
+
+	prt->nFields = 0;
+
+	while ((bitpos < nFluxLen) && (prt->nFields < (MAX_SECTORS_PER_TRACK * 2)))
+	{
+		mfm = (mfm << 1) | RefBit(bitpos++);
+
+		if (mfm != MFM_MARK_A1)
+		{
+			continue;
+		}
+
+		// skip the other syncs of the mark
+		while (((bitpos + 16) <= nFluxLen) && (RefByte(bitpos, 2) == 0xA1))
+		{
+			bitpos += 16;
+		}
+
+		if ((bitpos + 16) > nFluxLen)
+		{
+			break;
+		}
+
+		nLen    = RefDecodeField(prt, bitpos, 2, &nSize);
+		bitpos += nLen * 16;
+
+		if (nLen != 0)
+		{
+			mfm = 0;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// bit-serial FM decoder: compares the last 32 flux bits with the address marks
+// after each bit
+//
+static void RefDecodeFmSide(RefTrackType* prt)
+{
+	DWORD fm = 0;
+	int   nFluxLen = SIDE_LEN * 8;
+	int   bitpos = 0, nSize = 0, nLen;
+
+	prt->nFields = 0;
+
+	while ((bitpos < nFluxLen) && (prt->nFields < (MAX_SECTORS_PER_TRACK * 2)))
+	{
+		fm = (fm << 1) | RefBit(bitpos++);
+
+		if ((fm != FM_MARK_FE) && (fm != FM_MARK_FB) && (fm != FM_MARK_F8))
+		{
+			continue;
+		}
+
+		nLen = RefDecodeField(prt, bitpos - 32, 4, &nSize);
+
+		if (nLen != 0)
+		{
+			bitpos += (nLen - 1) * 32;
+			fm      = 0;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// the raw side nSide of track nTrack of the image of drive nDrive (read before it
+// is mounted)
+//
+static void GetRawSide(int nDrive, int nTrack, int nSide)
+{
+	pictrack* plut = (pictrack*)(g_byImage[nDrive] + 512);
+	BYTE*     pby  = g_byImage[nDrive] + plut[nTrack].offset * 512;
+	int       i;
+
+	for (i = 0; i < SIDE_LEN; i += 256)
+	{
+		memcpy(g_bySide + i, pby + i * 2 + nSide * 256, ((SIDE_LEN - i) < 256) ? (SIDE_LEN - i) : 256);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// decodes track nTrack side nSide of drive nDrive with LoadHfeTrack() into g_tdTrack
+//
+static void LoadTrack(int nDrive, int nTrack, int nSide)
+{
+	g_tdTrack.nType      = eHFE;
+	g_tdTrack.nDrive     = nDrive;
+	g_tdTrack.nTrack     = nTrack;
+	g_tdTrack.nSide      = nSide;
+	g_tdTrack.nTrackSize = sizeof(g_tdTrack.byTrackData);
+
+	LoadHfeTrack(g_dtDives[nDrive].f, nTrack, nSide, &g_dtDives[nDrive].hfe, &g_tdTrack, g_tdTrack.byTrackData, sizeof(g_tdTrack.byTrackData));
+}
+
+//-----------------------------------------------------------------------------
+// the fields of g_tdTrack are those found by the bit-serial decoder
+//
+static BYTE CompareTrack(RefTrackType* prt, int nSectors)
+{
+	BYTE* pby;
+	int   i, nSector = -1, nSize;
+
+	if (prt->nFields != (nSectors * 2))
+	{
+		return FALSE;
+	}
+
+	for (i = 0; i < prt->nFields; ++i)
+	{
+		if (prt->byMark[i] == 0xFE)
+		{
+			nSector = prt->byData[i][3];
+
+			if ((nSector >= 0x80) || (g_tdTrack.nSectorIDAM[nSector] < 0) || !g_tdTrack.bySectorIdCrcOk[nSector])
+			{
+				return FALSE;
+			}
+
+			if (memcmp(g_tdTrack.byTrackData + g_tdTrack.nSectorIDAM[nSector], prt->byData[i], 7) != 0)
+			{
+				return FALSE;
+			}
+
+			continue;
+		}
+
+		if ((nSector < 0) || (g_tdTrack.nSectorDAM[nSector] < 0))
+		{
+			return FALSE;
+		}
+
+		nSize = g_tdTrack.nSectorSize[nSector];
+		pby   = g_tdTrack.byTrackData + g_tdTrack.nSectorDAM[nSector] + 3;
+
+		if (memcmp(pby, prt->byData[i], nSize + 3) != 0)
+		{
+			return FALSE;
+		}
+
+		if (!ImageCheckSector(pby + 1, nSize, g_tdTrack.nTrack, g_tdTrack.nSide, nSector))
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// decodes a track with both decoders, adds the time of REPEAT decodes of each
+// and returns TRUE if the fields are the same
+//
+static BYTE DecodeTrack(int nDrive, int nTrack, int nSide, BYTE byFm, UINT64* pnTable, UINT64* pnSerial)
+{
+	UINT64 nStart;
+	int    i;
+
+	GetRawSide(nDrive, nTrack, nSide);
+
+	// the first load reads the track from the SD-Card
+	LoadTrack(nDrive, nTrack, nSide);
+
+	nStart = WallTime();
+
+	for (i = 0; i < REPEAT; ++i)
+	{
+		LoadTrack(nDrive, nTrack, nSide);
+	}
+
+	*pnTable += WallTime() - nStart;
+	nStart    = WallTime();
+
+	for (i = 0; i < REPEAT; ++i)
+	{
+		if (byFm)
+		{
+			RefDecodeFmSide(&g_rtRef);
+		}
+		else
+		{
+			RefDecodeMfmSide(&g_rtRef);
+		}
+	}
+
+	*pnSerial += WallTime() - nStart;
+
+	if (g_tdTrack.byDensity != (byFm ? eSD : eDD))
+	{
+		return FALSE;
+	}
+
+	return CompareTrack(&g_rtRef, byFm ? FM_SECTORS : SECTORS);
+}
+
+//-----------------------------------------------------------------------------
+// reads a sector of drive nDrive through the FDC
+//
+static BYTE ReadSector(int nDrive, int nTrack, int nSide, int nSector, BYTE byFm)
+{
+	BYTE byBuf[SECTOR_SIZE];
+
+	SimDriveSelect((1 << nDrive) | (byFm ? 0 : SIM_DRVSEL_MFM) | (nSide ? SIM_DRVSEL_SIDE1 : 0));
+	SimSeek(nTrack);
+
+	memset(byBuf, 0, sizeof(byBuf));
+
+	if (SimReadSector(nTrack, nSector, byBuf, sizeof(byBuf)) != 0)
+	{
+		return FALSE;
+	}
+
+	return ImageCheckSector(byBuf, sizeof(byBuf), nTrack, nSide, nSector);
+}
+
+//-----------------------------------------------------------------------------
+static void PrintTime(char* pszWhat, UINT64 nTable, UINT64 nSerial, int nTracks)
+{
+	printf("%-10s table decoder %6.1f us/track, bit-serial decoder %6.1f us/track (%.1fx)\n", pszWhat,
+		(double)nTable / (nTracks * REPEAT * 1000), (double)nSerial / (nTracks * REPEAT * 1000),
+		(double)nSerial / (nTable ? nTable : 1));
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	UINT64 nTable = 0, nSerial = 0, nFmTable = 0, nFmSerial = 0, nMixedTable = 0, nMixedSerial = 0;
+	BYTE   byOk = TRUE;
+	int    nTrack, nSide;
+
+	Check(SimInit(NULL), "SimInit");
+	Check(ImageMakeHfe("disk.hfe", TRACKS, SIDES, SECTORS, SECTOR_SIZE, 0), "ImageMakeHfe");
+	Check(ImageMakeHfe("mixed.hfe", TRACKS, SIDES, SECTORS, SECTOR_SIZE, FM_SECTORS), "ImageMakeHfe FM track 0");
+	Check(ImageWriteIni("DRIVE0=disk.hfe\r\nDRIVE1=mixed.hfe\r\nTIMING0=TURBO\r\nTIMING1=TURBO\r\n"), "ImageWriteIni");
+	Check(ImageReadFile("disk.hfe", 0, g_byImage[0], IMAGE_SIZE), "ImageReadFile");
+	Check(ImageReadFile("mixed.hfe", 0, g_byImage[1], IMAGE_SIZE), "ImageReadFile FM track 0");
+
+	SimStartFdc();
+
+	Check((g_dtDives[0].nDriveFormat == eHFE) && (g_dtDives[1].nDriveFormat == eHFE), "HFE mounted");
+
+	// sectors read by the FDC
+	for (nTrack = 0; nTrack < TRACKS; nTrack += 13)
+	{
+		for (nSide = 0; nSide < SIDES; ++nSide)
+		{
+			byOk &= ReadSector(0, nTrack, nSide, 1 + nTrack % SECTORS, FALSE);
+		}
+	}
+
+	Check(byOk, "sectors read by the FDC");
+
+	// single density track 0, double density on the next tracks
+	Check(ReadSector(1, 0, 0, FM_SECTORS, TRUE), "FM sector of track 0");
+	Check(ReadSector(1, 0, 1, 1, TRUE), "FM sector of track 0 side 1");
+	Check(ReadSector(1, 1, 0, SECTORS, FALSE), "MFM sector of track 1");
+
+	// the same fields as the bit-serial decoders, and the time of each
+	byOk = TRUE;
+
+	for (nTrack = 0; nTrack < TRACKS; ++nTrack)
+	{
+		for (nSide = 0; nSide < SIDES; ++nSide)
+		{
+			byOk &= DecodeTrack(0, nTrack, nSide, FALSE, &nTable, &nSerial);
+		}
+	}
+
+	Check(byOk, "fields of the MFM table decoder");
+
+	byOk = TRUE;
+
+	for (nSide = 0; nSide < SIDES; ++nSide)
+	{
+		byOk &= DecodeTrack(1, 0, nSide, TRUE, &nFmTable, &nFmSerial);
+	}
+
+	Check(byOk, "fields of the FM table decoder");
+
+	byOk = TRUE;
+
+	for (nTrack = 1; nTrack < TRACKS; ++nTrack)
+	{
+		for (nSide = 0; nSide < SIDES; ++nSide)
+		{
+			byOk &= DecodeTrack(1, nTrack, nSide, FALSE, &nMixedTable, &nMixedSerial);
+		}
+	}
+
+	Check(byOk, "fields of the MFM tracks after an FM track 0");
+
+	PrintTime("MFM", nTable, nSerial, TRACKS * SIDES);
+	PrintTime("FM", nFmTable, nFmSerial, SIDES);
+	PrintTime("mixed", nMixedTable + nFmTable, nMixedSerial + nFmSerial, TRACKS * SIDES);
+
+	Check(nTable < nSerial, "MFM table decoder faster");
+	Check(nFmTable < nFmSerial, "FM table decoder faster");
+
+	return (g_nErrors == 0) ? 0 : 1;
+}
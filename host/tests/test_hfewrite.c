@@ -0,0 +1,227 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "fdc.h"
+#include "sim.h"
+#include "image.h"
+#include "timers.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// HFE write round trip: sector writes to a double sided MFM HFE image re-encode the
+// data fields in the flux data of the track and write only the changed 512 byte
+// blocks back, far fewer than the blocks of the track.  The written sectors read
+// back before and after the image is mounted again, and the other sectors of the
+// track keep their data.  On an image whose header does not allow writes, Write
+// Sector and Write Track end with Write Protect and INTRQ and nothing is written.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#define TRACKS       40
+#define SIDES        2
+#define SECTORS      18
+#define SECTOR_SIZE  256
+#define TEST_TRACK   10
+#define TRACK_BLOCKS 49						// 512 byte blocks of a track, both sides
+#define FIELD_BLOCKS 4						// blocks a data field can span (524 flux bytes of a side)
+
+typedef struct {
+	BYTE bySide;
+	BYTE bySector;
+} WriteType;
+
+static WriteType g_wtWrites[] = {{0, 5}, {0, 6}, {1, 9}, {1, 18}};
+
+#define WRITES (sizeof(g_wtWrites) / sizeof(g_wtWrites[0]))
+
+//-----------------------------------------------------------------------------
+static void BuildSector(BYTE* pby, BYTE bySide, BYTE bySector)
+{
+	int i;
+
+	for (i = 0; i < SECTOR_SIZE; ++i)
+	{
+		pby[i] = (BYTE)(i * 3 + bySide * 0x40 + bySector) ^ 0x5A;
+	}
+}
+
+//-----------------------------------------------------------------------------
+static BYTE IsWritten(BYTE bySide, BYTE bySector)
+{
+	int i;
+
+	for (i = 0; i < (int)WRITES; ++i)
+	{
+		if ((g_wtWrites[i].bySide == bySide) && (g_wtWrites[i].bySector == bySector))
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+//-----------------------------------------------------------------------------
+// reads every sector of both sides of the test track, returns TRUE if the written
+// sectors hold their new data and the others the data of the image
+//
+static BYTE CheckTrack(void)
+{
+	BYTE byBuf[SECTOR_SIZE];
+	BYTE byExpected[SECTOR_SIZE];
+	BYTE bySide, bySector;
+	BYTE byOk = TRUE;
+
+	for (bySide = 0; bySide < SIDES; ++bySide)
+	{
+		SimDriveSelect(0x01 | SIM_DRVSEL_MFM | (bySide ? SIM_DRVSEL_SIDE1 : 0));
+
+		for (bySector = 1; bySector <= SECTORS; ++bySector)
+		{
+			memset(byBuf, 0, sizeof(byBuf));
+			byOk &= (SimReadSector(TEST_TRACK, bySector, byBuf, sizeof(byBuf)) == 0);
+
+			if (IsWritten(bySide, bySector))
+			{
+				BuildSector(byExpected, bySide, bySector);
+				byOk &= (memcmp(byBuf, byExpected, sizeof(byBuf)) == 0);
+			}
+			else
+			{
+				byOk &= ImageCheckSector(byBuf, sizeof(byBuf), TEST_TRACK, bySide, bySector);
+			}
+		}
+	}
+
+	return byOk;
+}
+
+//-----------------------------------------------------------------------------
+// clears write_allowed in the header of the HFE image pszName
+//
+static BYTE ProtectImage(char* pszName)
+{
+	FIL  f;
+	BYTE byAllowed = 0;
+	UINT nWritten = 0;
+
+	if (f_open(&f, pszName, FA_WRITE) != FR_OK)
+	{
+		return FALSE;
+	}
+
+	f_lseek(&f, offsetof(picfileformatheader, write_allowed));
+	f_write(&f, &byAllowed, 1, &nWritten);
+	f_close(&f);
+
+	return (nWritten == 1);
+}
+
+//-----------------------------------------------------------------------------
+// writes to a write protected image, the commands end with Write Protect and
+// INTRQ and no block is written
+//
+static void TestProtected(void)
+{
+	BYTE  byBuf[SECTOR_SIZE];
+	BYTE  byStatus;
+	DWORD dwPulses;
+
+	Check(ImageMakeHfe("protect.hfe", TRACKS, SIDES, SECTORS, SECTOR_SIZE, 0), "ImageMakeHfe");
+	Check(ProtectImage("protect.hfe"), "write_allowed = 0");
+	Check(ImageWriteIni("DRIVE0=protect.hfe\r\n"), "ImageWriteIni");
+
+	SimStartFdc();
+	SimWriteNmiMask(0x80);
+	SimDriveSelect(0x01 | SIM_DRVSEL_MFM);
+	SimSeek(TEST_TRACK);
+
+	Check((SimIn(SIM_REG_STATUS) & 0x40) != 0, "Type I status protected");
+	Check(SimReadSector(TEST_TRACK, 1, byBuf, sizeof(byBuf)) == 0, "protected read status");
+
+	memset(&g_hdStats, 0, sizeof(g_hdStats));
+
+	// Write Sector
+	BuildSector(byBuf, 0, 5);
+	dwPulses = g_simStats.dwNmiPulses;
+	byStatus = SimWriteSector(TEST_TRACK, 5, byBuf, sizeof(byBuf));
+	Check((byStatus & (SIM_STATUS_BUSY | 0x40)) == 0x40, "Write Sector ends with Write Protect");
+	Check(g_simStats.dwNmiPulses > dwPulses, "Write Sector INTRQ");
+
+	// Write Track
+	dwPulses = g_simStats.dwNmiPulses;
+	SimOut(SIM_REG_STATUS, 0xF4);
+	byStatus = SimWaitNotBusy(2000000);
+	Check((byStatus & (SIM_STATUS_BUSY | 0x40)) == 0x40, "Write Track ends with Write Protect");
+	Check(g_simStats.dwNmiPulses > dwPulses, "Write Track INTRQ");
+
+	SimRun(WRITEBACK_MAX_DIRTY_AGE * 2);
+
+	printf("write protected image: %lu blocks written\n", (unsigned long)g_hdStats.dwWriteSectors);
+
+	Check(g_hdStats.dwWriteSectors == 0, "no blocks written to a protected image");
+
+	Check(SimReadSector(TEST_TRACK, 5, byBuf, sizeof(byBuf)) == 0, "protected read back status");
+	Check(ImageCheckSector(byBuf, sizeof(byBuf), TEST_TRACK, 0, 5), "protected sector unchanged");
+
+	FdcCloseAllFiles();
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	BYTE   byBuf[SECTOR_SIZE];
+	UINT64 nStart, nWrite;
+	int    i;
+
+	Check(SimInit(NULL), "SimInit");
+	Check(ImageMakeHfe("disk.hfe", TRACKS, SIDES, SECTORS, SECTOR_SIZE, 0), "ImageMakeHfe");
+	Check(ImageWriteIni("DRIVE0=disk.hfe\r\n"), "ImageWriteIni");
+
+	SimStartFdc();
+	SimDriveSelect(0x01 | SIM_DRVSEL_MFM);
+	SimSeek(TEST_TRACK);
+
+	// the track is loaded before the writes
+	Check(SimReadSector(TEST_TRACK, 1, byBuf, sizeof(byBuf)) == 0, "read status");
+
+	memset(&g_hdStats, 0, sizeof(g_hdStats));
+	nStart = TimerGetTime();
+
+	for (i = 0; i < (int)WRITES; ++i)
+	{
+		BuildSector(byBuf, g_wtWrites[i].bySide, g_wtWrites[i].bySector);
+		SimDriveSelect(0x01 | SIM_DRVSEL_MFM | (g_wtWrites[i].bySide ? SIM_DRVSEL_SIDE1 : 0));
+		Check(SimWriteSector(TEST_TRACK, g_wtWrites[i].bySector, byBuf, sizeof(byBuf)) == 0, "write status");
+	}
+
+	nWrite = TimerGetTime() - nStart;
+
+	// read back from the track cache
+	Check(CheckTrack(), "data before the write-back");
+
+	// the write-back of the storage worker
+	SimRun(WRITEBACK_MAX_DIRTY_AGE * 2);
+
+	printf("%d sector writes %.1f ms, write-back %lu SD writes of %lu blocks (%d blocks a track), %lu us\n", (int)WRITES,
+		nWrite / 1000.0, (unsigned long)g_hdStats.dwWrites, (unsigned long)g_hdStats.dwWriteSectors, TRACK_BLOCKS,
+		(unsigned long)g_hdStats.nBusyTime);
+
+	Check(g_hdStats.dwWriteSectors > 0, "write-back");
+	Check(g_hdStats.dwWriteSectors <= WRITES * FIELD_BLOCKS, "only the changed blocks written");
+
+	// read back from the image
+	FdcCloseAllFiles();
+	SimStartFdc();
+	SimDriveSelect(0x01 | SIM_DRVSEL_MFM);
+	SimSeek(TEST_TRACK);
+
+	Check(CheckTrack(), "data after the image is mounted again");
+
+	FdcCloseAllFiles();
+	TestProtected();
+
+	return (g_nErrors == 0) ? 0 : 1;
+}
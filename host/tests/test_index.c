@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "fdc.h"
+#include "sim.h"
+#include "image.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// turbo timing: consecutive Read Address commands return consecutive ID fields and
+// sector accesses do not move the index pulse
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+//-----------------------------------------------------------------------------
+static int ReadAddress(void)
+{
+	BYTE byId[6];
+
+	memset(byId, 0, sizeof(byId));
+	SimOut(SIM_REG_STATUS, 0xC0);
+	SimReadData(byId, sizeof(byId), 2000000);
+	SimWaitNotBusy(2000000);
+
+	return byId[2];
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	BYTE  byBuf[256];
+	DWORD dwPhase;
+	int   i, nSector, nPrev;
+
+	Check(SimInit(NULL), "SimInit");
+	Check(ImageMakeDmk("index.dmk", 40, 1, 18, 256, 0), "ImageMakeDmk");
+	Check(ImageWriteIni("DRIVE0=index.dmk\r\nTIMING0=TURBO\r\n"), "ImageWriteIni");
+
+	SimStartFdc();
+	SimDriveSelect(0x01 | SIM_DRVSEL_MFM);
+	SimSeek(2);
+
+	dwPhase = g_FDC.dwIndexStart % g_dwRotationTime;
+	nPrev   = ReadAddress();
+
+	for (i = 0; i < 40; ++i)
+	{
+		nSector = ReadAddress();
+		Check(nSector == (nPrev % 18) + 1, "next ID field");
+		nPrev = nSector;
+	}
+
+	// a sector access moves the search position to the following ID field
+	SimReadSector(2, 7, byBuf, sizeof(byBuf));
+	Check(ReadAddress() == 8, "ID field after the sector read");
+
+	Check((g_FDC.dwIndexStart % g_dwRotationTime) == dwPhase, "index pulse free running");
+
+	printf("%llu us emulated, index phase %lu us\n", (unsigned long long)TimerGetTime(), (unsigned long)dwPhase);
+
+	return (g_nErrors == 0) ? 0 : 1;
+}
@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "Defines.h"
+#include "fdc.h"
+#include "sim.h"
+#include "image.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// sector indexer micro-benchmark: FdcIndexDmkTrack() walks the IDAM pointer table
+// of a DMK track once.  The lookup it replaced (FdcFillSectorOffset()) searched
+// the whole table for each of the 128 sector numbers and byte-scanned forward for
+// each data mark, it is kept here as the reference.  The corpus holds the tracks of
+// both sides of 40 track images in the layouts of common TRS-80 formats, built with
+// the track length of a DMK image (0x1900).  Both indexers must find the same ID
+// fields and data marks for the sectors of the format.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#define TRACKS       40
+#define SIDES        2
+#define TRACK_LENGTH 0x1900
+#define PASSES       20
+
+typedef struct {
+	char* pszName;
+	int   nSectors;
+	int   nSectorSize;
+	int   nInterleave;
+} FormatType;
+
+static FormatType g_ftFormats[] = {
+	{"LDOS 18x256",     18,  256, 1},
+	{"TRSDOS 6 18x256", 18,  256, 3},
+	{"DD 10x256",       10,  256, 2},
+	{"CP/M 8x512",       8,  512, 2},
+	{"CP/M 5x1024",      5, 1024, 1},
+};
+
+#define FORMATS (sizeof(g_ftFormats) / sizeof(g_ftFormats[0]))
+
+static TrackType g_tdTrack;
+static BYTE      g_byCorpus[TRACKS * SIDES][TRACK_LENGTH];
+
+//-----------------------------------------------------------------------------
+static UINT64 WallTime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (UINT64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//-----------------------------------------------------------------------------
+// the lookup of FdcFillSectorOffset(): the whole IDAM table for each sector number,
+// then a byte scan from the ID field to the first data mark
+//
+static void RefIndexTrack(TrackType* ptdTrack)
+{
+	BYTE* pby;
+	int   nSector, i, nOffset, nIDAM, nDAM;
+
+	for (nSector = 0; nSector < 0x80; ++nSector)
+	{
+		nIDAM = -1;
+
+		for (i = 0; i < 0x80; ++i)
+		{
+			nOffset = FdcGetIDAM_Index(ptdTrack, i);
+			pby     = ptdTrack->byTrackData + nOffset;
+
+			if ((*(pby+1) == ptdTrack->nTrack) && (*(pby+2) == ptdTrack->nSide) && (*(pby+3) == nSector))
+			{
+				nIDAM = nOffset;
+				break;
+			}
+		}
+
+		nDAM = -1;
+
+		for (nOffset = nIDAM; (nIDAM >= 0) && (nOffset < ptdTrack->nTrackSize - 3); ++nOffset)
+		{
+			pby = ptdTrack->byTrackData + nOffset;
+
+			if ((pby[0] == 0xA1) && (pby[1] == 0xA1) && (pby[2] == 0xA1) && ((pby[3] == 0xFB) || (pby[3] == 0xF8)))
+			{
+				nDAM = nOffset;
+				break;
+			}
+		}
+
+		ptdTrack->nSectorIDAM[nSector] = nIDAM;
+		ptdTrack->nSectorDAM[nSector]  = nDAM;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// copies track nTrack of the corpus into the track buffer
+//
+static void LoadTrack(int nTrack)
+{
+	memcpy(g_tdTrack.byTrackData, g_byCorpus[nTrack], TRACK_LENGTH);
+	g_tdTrack.nTrack     = nTrack / SIDES;
+	g_tdTrack.nSide      = nTrack % SIDES;
+	g_tdTrack.nTrackSize = TRACK_LENGTH;
+	g_tdTrack.byDensity  = eDD;
+}
+
+//-----------------------------------------------------------------------------
+// returns TRUE if both indexers find the same ID fields and data marks for the sectors
+// of the format on every track, and the single pass indexer finds no other sector.
+// The reference reads 128 table entries where a DMK track has 64, the entries past
+// the table are track data and can give it a false match (sector 0 of track 0).
+//
+static BYTE CompareIndex(FormatType* pft)
+{
+	int  nRefIDAM[0x80], nRefDAM[0x80];
+	int  nTrack, nSector;
+	BYTE byOk = TRUE;
+
+	for (nTrack = 0; nTrack < TRACKS * SIDES; ++nTrack)
+	{
+		LoadTrack(nTrack);
+		RefIndexTrack(&g_tdTrack);
+		memcpy(nRefIDAM, g_tdTrack.nSectorIDAM, sizeof(nRefIDAM));
+		memcpy(nRefDAM, g_tdTrack.nSectorDAM, sizeof(nRefDAM));
+
+		FdcIndexDmkTrack(&g_tdTrack, NULL);
+
+		for (nSector = 0; nSector < 0x80; ++nSector)
+		{
+			if ((nSector >= 1) && (nSector <= pft->nSectors))
+			{
+				byOk &= (g_tdTrack.nSectorIDAM[nSector] == nRefIDAM[nSector]);
+				byOk &= (g_tdTrack.nSectorDAM[nSector] == nRefDAM[nSector]);
+				byOk &= (g_tdTrack.nSectorDAM[nSector] > g_tdTrack.nSectorIDAM[nSector]);
+				byOk &= (g_tdTrack.nSectorSize[nSector] == pft->nSectorSize);
+				byOk &= g_tdTrack.bySectorIdCrcOk[nSector];
+			}
+			else
+			{
+				byOk &= (g_tdTrack.nSectorIDAM[nSector] < 0);
+			}
+		}
+	}
+
+	return byOk;
+}
+
+//-----------------------------------------------------------------------------
+// returns the ns a track takes to index with the reference (byRef) or the single pass indexer
+//
+static double TimeIndex(BYTE byRef)
+{
+	UINT64 nStart, nTime = 0;
+	int    i, nTrack;
+
+	for (i = 0; i < PASSES; ++i)
+	{
+		for (nTrack = 0; nTrack < TRACKS * SIDES; ++nTrack)
+		{
+			LoadTrack(nTrack);
+			nStart = WallTime();
+
+			if (byRef)
+			{
+				RefIndexTrack(&g_tdTrack);
+			}
+			else
+			{
+				FdcIndexDmkTrack(&g_tdTrack, NULL);
+			}
+
+			nTime += WallTime() - nStart;
+		}
+	}
+
+	return (double)nTime / (PASSES * TRACKS * SIDES);
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	double dRef, dIndex, dRefTotal = 0, dIndexTotal = 0;
+	int    i, nTrack;
+
+	for (i = 0; i < (int)FORMATS; ++i)
+	{
+		for (nTrack = 0; nTrack < TRACKS * SIDES; ++nTrack)
+		{
+			Check(ImageBuildDmkTrack(g_byCorpus[nTrack], TRACK_LENGTH, nTrack / SIDES, nTrack % SIDES,
+				g_ftFormats[i].nSectors, g_ftFormats[i].nSectorSize, g_ftFormats[i].nInterleave) != 0, "ImageBuildDmkTrack");
+		}
+
+		Check(CompareIndex(&g_ftFormats[i]), "same index as the reference");
+
+		dRef   = TimeIndex(TRUE);
+		dIndex = TimeIndex(FALSE);
+
+		dRefTotal   += dRef;
+		dIndexTotal += dIndex;
+
+		printf("%-18s table lookup %8.0f ns a track, single pass %7.0f ns a track (%5.1fx)\n", g_ftFormats[i].pszName,
+			dRef, dIndex, dRef / dIndex);
+	}
+
+	printf("%-18s table lookup %8.0f ns a track, single pass %7.0f ns a track (%5.1fx)\n", "all formats",
+		dRefTotal / FORMATS, dIndexTotal / FORMATS, dRefTotal / dIndexTotal);
+
+	Check(dIndexTotal < dRefTotal, "single pass faster");
+
+	return (g_nErrors == 0) ? 0 : 1;
+}
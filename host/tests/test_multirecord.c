@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "fdc.h"
+#include "sim.h"
+#include "image.h"
+#include "timers.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// full track transfers of an 18 sector MFM track: one Read Sector (0x80) per
+// sector against a single multiple record Read Sector (0x90), which ends with
+// Record Not Found after the last sector, and the same for Write Sector (0xA0 and
+// 0xB0), with the default (turbo) timing and with TIMING0=ACCURATE.  The multiple
+// record commands move the same data in less time, except a write with accurate
+// timing: the data of a single record write takes no rotation time, so the next
+// Write Sector still finds its sector in the same revolution.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#define TRACKS      40
+#define SECTORS     18
+#define SECTOR_SIZE 256
+#define TEST_TRACK  5
+
+static BYTE g_byData[SECTORS * SECTOR_SIZE];
+
+//-----------------------------------------------------------------------------
+static BYTE CheckTrack(BYTE* pby, BYTE byInvert)
+{
+	BYTE byExpected[SECTOR_SIZE];
+	int  i, nSector;
+
+	for (nSector = 1; nSector <= SECTORS; ++nSector)
+	{
+		for (i = 0; i < SECTOR_SIZE; ++i)
+		{
+			byExpected[i] = ImageSectorByte(TEST_TRACK, 0, nSector, i) ^ byInvert;
+		}
+
+		if (memcmp(pby + (nSector - 1) * SECTOR_SIZE, byExpected, SECTOR_SIZE) != 0)
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+static void PrintTime(char* pszWhat, UINT64 nTime, DWORD dwCommands)
+{
+	printf("  %-22s %2lu commands, %7.1f ms, %6.0f bytes/s\n", pszWhat, (unsigned long)dwCommands,
+		nTime / 1000.0, (double)sizeof(g_byData) * 1000000.0 / nTime);
+}
+
+//-----------------------------------------------------------------------------
+// the transfers with the drive mounted by pszIni
+//
+static void Transfers(char* pszWhat, char* pszIni, BYTE byWriteFaster)
+{
+	UINT64 nStart, nSingle, nMulti;
+	BYTE   byStatus;
+	int    i, nSector;
+
+	Check(ImageWriteIni(pszIni), "ImageWriteIni");
+	SimStartFdc();
+	printf("%s\n", pszWhat);
+
+	SimDriveSelect(0x01 | SIM_DRVSEL_MFM);
+	SimSeek(TEST_TRACK);
+
+	// load the track, so both transfers start from a track in memory
+	Check(SimReadSector(TEST_TRACK, 1, g_byData, SECTOR_SIZE) == 0, "read status");
+
+	// single record reads
+	memset(g_byData, 0, sizeof(g_byData));
+	nStart = TimerGetTime();
+
+	for (nSector = 1; nSector <= SECTORS; ++nSector)
+	{
+		Check(SimReadSector(TEST_TRACK, nSector, g_byData + (nSector - 1) * SECTOR_SIZE, SECTOR_SIZE) == 0, "read status");
+	}
+
+	nSingle = TimerGetTime() - nStart;
+	Check(CheckTrack(g_byData, 0), "single record read data");
+	PrintTime("single record read", nSingle, SECTORS);
+
+	// multiple record read
+	memset(g_byData, 0, sizeof(g_byData));
+	nStart = TimerGetTime();
+
+	SimOut(SIM_REG_TRACK, TEST_TRACK);
+	SimOut(SIM_REG_SECTOR, 1);
+	SimOut(SIM_REG_STATUS, 0x90);
+	Check(SimReadData(g_byData, sizeof(g_byData), 5000000) == sizeof(g_byData), "multiple record read count");
+	byStatus = SimWaitNotBusy(5000000);
+
+	nMulti = TimerGetTime() - nStart;
+	Check(CheckTrack(g_byData, 0), "multiple record read data");
+	Check((byStatus & ~SIM_STATUS_RNF) == 0, "multiple record read status");
+	Check(SimIn(SIM_REG_SECTOR) == SECTORS + 1, "sector register after the last record");
+	PrintTime("multiple record read", nMulti, 1);
+
+	Check(nMulti < nSingle, "multiple record read faster");
+
+	// single record writes
+	for (i = 0; i < (int)sizeof(g_byData); ++i)
+	{
+		g_byData[i] = ImageSectorByte(TEST_TRACK, 0, i / SECTOR_SIZE + 1, i % SECTOR_SIZE) ^ 0xFF;
+	}
+
+	nStart = TimerGetTime();
+
+	for (nSector = 1; nSector <= SECTORS; ++nSector)
+	{
+		Check(SimWriteSector(TEST_TRACK, nSector, g_byData + (nSector - 1) * SECTOR_SIZE, SECTOR_SIZE) == 0, "write status");
+	}
+
+	nSingle = TimerGetTime() - nStart;
+	PrintTime("single record write", nSingle, SECTORS);
+
+	// multiple record write, back to the original data
+	for (i = 0; i < (int)sizeof(g_byData); ++i)
+	{
+		g_byData[i] ^= 0xFF;
+	}
+
+	nStart = TimerGetTime();
+
+	SimOut(SIM_REG_TRACK, TEST_TRACK);
+	SimOut(SIM_REG_SECTOR, 1);
+	SimOut(SIM_REG_STATUS, 0xB0);
+	Check(SimWriteData(g_byData, sizeof(g_byData), 5000000) == sizeof(g_byData), "multiple record write count");
+	byStatus = SimWaitNotBusy(5000000);
+
+	nMulti = TimerGetTime() - nStart;
+	Check((byStatus & ~SIM_STATUS_RNF) == 0, "multiple record write status");
+	PrintTime("multiple record write", nMulti, 1);
+
+	if (byWriteFaster)
+	{
+		Check(nMulti < nSingle, "multiple record write faster");
+	}
+
+	// read back the written track
+	memset(g_byData, 0, sizeof(g_byData));
+
+	for (nSector = 1; nSector <= SECTORS; ++nSector)
+	{
+		Check(SimReadSector(TEST_TRACK, nSector, g_byData + (nSector - 1) * SECTOR_SIZE, SECTOR_SIZE) == 0, "read status");
+	}
+
+	Check(CheckTrack(g_byData, 0), "multiple record write data");
+
+	FdcCloseAllFiles();
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	Check(SimInit(NULL), "SimInit");
+	Check(ImageMakeDmk("disk.dmk", TRACKS, 1, SECTORS, SECTOR_SIZE, 0), "ImageMakeDmk");
+
+	Transfers("turbo", "DRIVE0=disk.dmk\r\n", TRUE);
+	Transfers("accurate", "DRIVE0=disk.dmk\r\nTIMING0=ACCURATE\r\n", FALSE);
+
+	return (g_nErrors == 0) ? 0 : 1;
+}
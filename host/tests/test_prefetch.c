@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "fdc.h"
+#include "sim.h"
+#include "image.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// read-ahead loads the next tracks into slots other than the active track, and is
+// skipped when a RAM disk image leaves the cache with a single slot
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+//-----------------------------------------------------------------------------
+static void ReadAndIdle(BYTE byTrack, int nDrive)
+{
+	BYTE byBuf[256];
+
+	SimDriveSelect((1 << nDrive) | SIM_DRVSEL_MFM);
+	SimSeek(byTrack);
+	Check(SimReadSector(byTrack, 1, byBuf, sizeof(byBuf)) == 0, "read sector");
+	Check(ImageCheckSector(byBuf, sizeof(byBuf), byTrack, 0, 1), "sector contents");
+
+	SimRun(PREFETCH_IDLE_TIME * 20);
+
+	Check((g_ptdTrack->nDrive == nDrive) && (g_ptdTrack->nSide == 0) && (g_ptdTrack->nTrack == byTrack), "active track kept");
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	DWORD dwPrefetches;
+
+	Check(SimInit(NULL), "SimInit");
+	Check(ImageMakeDmk("data.dmk", 40, 2, 18, 256, 0), "ImageMakeDmk");
+	Check(ImageMakeDmk("ram.dmk", 40, 1, 9, 256, 0x0CC0), "ImageMakeDmk");
+	Check(ImageWriteIni("DRIVE0=data.dmk\r\nDRIVE1=ram.dmk\r\n"), "ImageWriteIni");
+
+	SimStartFdc();
+	Check(TrackCacheSlotCount() >= 2, "slot count");
+
+	ReadAndIdle(3, 0);
+	Check(g_tcsStats.dwPrefetches == PREFETCH_DEPTH, "read-ahead");
+	Check(TrackCacheContains(0, 1, 3) && TrackCacheContains(0, 0, 4), "read-ahead tracks");
+
+	// the RAM image leaves a single slot, which holds the active track
+	FdcCloseAllFiles();
+	Check(ImageWriteIni("DRIVE0=data.dmk\r\nDRIVE1=ram.dmk\r\nRAM1=YES\r\n"), "ImageWriteIni");
+	SimStartFdc();
+
+	printf("%d slots of %lu bytes, %d with the RAM image\n", (int)TRACK_CACHE_SLOTS, (unsigned long)sizeof(TrackType), TrackCacheSlotCount());
+
+	Check(TrackCacheSlotCount() == 1, "single slot");
+
+	dwPrefetches = g_tcsStats.dwPrefetches;
+	ReadAndIdle(5, 0);
+	Check(g_tcsStats.dwPrefetches == dwPrefetches, "no read-ahead with one slot");
+	Check(FdcIsIdle(), "idle with one slot");
+
+	return (g_nErrors == 0) ? 0 : 1;
+}
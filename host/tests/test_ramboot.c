@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "fdc.h"
+#include "sim.h"
+#include "image.h"
+#include "timers.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// boot of a 40 track single sided DMK image from the SD-Card and from RAM (RAM0=YES):
+// the sector reads of a DOS boot (system files with directory lookups on track 17,
+// then programs and their overlays) and a directory update.  From RAM the boot
+// reads no blocks from the SD-Card and takes less time, and the directory update
+// reaches the SD-Card through the background write-back.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#define TRACKS    40
+#define SECTORS   9
+#define TRACK_LEN 0x0CC0
+#define DIR_TRACK 17
+
+static BYTE g_byBoot[128];
+static int  g_nBootLen;
+
+//-----------------------------------------------------------------------------
+// the tracks read by the boot, in order
+//
+static void BuildBoot(void)
+{
+	int i;
+
+	g_nBootLen = 0;
+	g_byBoot[g_nBootLen++] = 0;
+	g_byBoot[g_nBootLen++] = DIR_TRACK;
+	g_byBoot[g_nBootLen++] = DIR_TRACK;
+
+	// system files, with a directory lookup after every third one
+	for (i = 1; i <= 16; ++i)
+	{
+		g_byBoot[g_nBootLen++] = i;
+
+		if ((i % 3) == 0)
+		{
+			g_byBoot[g_nBootLen++] = DIR_TRACK;
+		}
+	}
+
+	// programs and their overlays
+	for (i = 0; i < 6; ++i)
+	{
+		g_byBoot[g_nBootLen++] = DIR_TRACK;
+		g_byBoot[g_nBootLen++] = 20 + i * 2;
+		g_byBoot[g_nBootLen++] = 21 + i * 2;
+		g_byBoot[g_nBootLen++] = 2 + i;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// returns the us the boot took
+//
+static UINT64 Boot(char* pszWhat, BYTE* pbyDir)
+{
+	BYTE   byBuf[256];
+	UINT64 nStart;
+	DWORD  dwReadSectors;
+	BYTE   byTrack, bySector;
+	int    i;
+
+	SimDriveSelect(0x01 | SIM_DRVSEL_MFM);
+	nStart        = TimerGetTime();
+	dwReadSectors = g_hdStats.dwReadSectors;
+
+	for (i = 0; i < g_nBootLen; ++i)
+	{
+		byTrack = g_byBoot[i];
+		SimSeek(byTrack);
+
+		for (bySector = 1; bySector <= ((byTrack == DIR_TRACK) ? 2 : SECTORS); ++bySector)
+		{
+			Check(SimReadSector(byTrack, bySector, byBuf, sizeof(byBuf)) == 0, "read status");
+			Check(ImageCheckSector(byBuf, sizeof(byBuf), byTrack, 0, bySector), "read data");
+		}
+	}
+
+	SimSeek(DIR_TRACK);
+	Check(SimWriteSector(DIR_TRACK, SECTORS, pbyDir, 256) == 0, "directory update");
+
+	printf("%-7s %3d track loads, %7.1f ms, %4lu SD blocks read\n", pszWhat, g_nBootLen,
+		(TimerGetTime() - nStart) / 1000.0, (unsigned long)(g_hdStats.dwReadSectors - dwReadSectors));
+
+	return TimerGetTime() - nStart;
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	BYTE   byDir[256];
+	BYTE   byTrack[TRACK_LEN];
+	UINT64 nSd, nRam, nStart;
+	DWORD  dwReadSectors;
+	int    i;
+
+	BuildBoot();
+	memset(byDir, 0xE5, sizeof(byDir));
+
+	Check(SimInit(NULL), "SimInit");
+	Check(ImageMakeDmk("boot.dmk", TRACKS, 1, SECTORS, 256, TRACK_LEN), "ImageMakeDmk");
+
+	// from the SD-Card
+	Check(ImageWriteIni("DRIVE0=boot.dmk\r\n"), "ImageWriteIni");
+	SimStartFdc();
+	Check(g_dtDives[0].pbyRamImage == NULL, "image on the SD-Card");
+
+	nSd = Boot("SD", byDir);
+	FdcCloseAllFiles();
+
+	// from RAM
+	Check(ImageWriteIni("DRIVE0=boot.dmk\r\nRAM0=YES\r\n"), "ImageWriteIni");
+
+	nStart = TimerGetTime();
+	SimStartFdc();
+	printf("RAM mount %.1f ms, %d track cache slots left\n", (TimerGetTime() - nStart) / 1000.0, TrackCacheSlotCount());
+	Check(g_dtDives[0].pbyRamImage != NULL, "image in RAM");
+
+	dwReadSectors = g_hdStats.dwReadSectors;
+	byDir[0]      = 0x5A;
+	nRam          = Boot("RAM", byDir);
+
+	Check(g_hdStats.dwReadSectors == dwReadSectors, "no SD blocks read from RAM");
+	Check(nRam < nSd, "RAM boot faster");
+
+	SimRun(WRITEBACK_MAX_DIRTY_AGE * 2);
+	Check(g_rdStats.dwWriteBacks > 0, "background write-back");
+	printf("write-back %lu runs, %lu bytes\n", (unsigned long)g_rdStats.dwWriteBacks, (unsigned long)g_rdStats.dwWriteBackBytes);
+
+	// the directory update of the RAM boot is on the SD-Card
+	FdcCloseAllFiles();
+	Check(ImageReadFile("boot.dmk", DMK_HEADER_SIZE + DIR_TRACK * TRACK_LEN, byTrack, sizeof(byTrack)), "ImageReadFile");
+
+	for (i = 0; i + (int)sizeof(byDir) <= (int)sizeof(byTrack); ++i)
+	{
+		if (memcmp(byTrack + i, byDir, sizeof(byDir)) == 0)
+		{
+			break;
+		}
+	}
+
+	Check(i + (int)sizeof(byDir) <= (int)sizeof(byTrack), "directory update on the SD-Card");
+
+	return (g_nErrors == 0) ? 0 : 1;
+}
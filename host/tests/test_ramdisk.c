@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "fdc.h"
+#include "sim.h"
+#include "image.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// a 40 track single sided DMK image (track length 0x0CC0) is held in RAM, reads
+// are served from RAM and a write reaches the SD-Card
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	BYTE  byBuf[256];
+	BYTE  byTrack[0x0CC0];
+	DWORD dwReads;
+	int   i, nTrack;
+
+	Check(SimInit(NULL), "SimInit");
+	Check(ImageMakeDmk("ram40.dmk", 40, 1, 9, 256, 0x0CC0), "ImageMakeDmk");
+	Check(ImageWriteIni("DRIVE0=ram40.dmk\r\nRAM0=YES\r\n"), "ImageWriteIni");
+
+	SimStartFdc();
+	Check(g_dtDives[0].pbyRamImage != NULL, "RAM image");
+	Check(g_dtDives[0].dwRamImageSize == DMK_HEADER_SIZE + 40 * 0x0CC0, "RAM image size");
+	Check(TrackCacheSlotCount() >= TRACK_CACHE_MIN_SLOTS, "slots left");
+
+	printf("%d slots of %lu bytes, %d with the RAM image\n", (int)TRACK_CACHE_SLOTS, (unsigned long)sizeof(TrackType), TrackCacheSlotCount());
+
+	SimDriveSelect(0x01 | SIM_DRVSEL_MFM);
+	dwReads = g_hdStats.dwReads;
+
+	for (nTrack = 0; nTrack < 40; nTrack += 13)
+	{
+		SimSeek(nTrack);
+		memset(byBuf, 0, sizeof(byBuf));
+		Check((SimReadSector(nTrack, 5, byBuf, sizeof(byBuf)) & 0xFC) == 0, "read status");
+		Check(ImageCheckSector(byBuf, sizeof(byBuf), nTrack, 0, 5), "read data");
+	}
+
+	Check(g_hdStats.dwReads == dwReads, "reads served from RAM");
+
+	// the write is held in RAM and written to the SD-Card in the background
+	SimSeek(39);
+	memset(byBuf, 0xA5, sizeof(byBuf));
+	Check((SimWriteSector(39, 9, byBuf, sizeof(byBuf)) & 0xFC) == 0, "write status");
+	SimSeek(0);
+	SimRun(WRITEBACK_MAX_DIRTY_AGE * 2);
+
+	Check(g_rdStats.dwWriteBacks > 0, "background write-back");
+
+	// the image is open for writing until it is closed
+	FdcCloseAllFiles();
+	Check(ImageReadFile("ram40.dmk", DMK_HEADER_SIZE + 39 * 0x0CC0, byTrack, sizeof(byTrack)), "ImageReadFile");
+
+	for (i = 0; i + (int)sizeof(byBuf) <= (int)sizeof(byTrack); ++i)
+	{
+		if (memcmp(byTrack + i, byBuf, sizeof(byBuf)) == 0)
+		{
+			break;
+		}
+	}
+
+	Check(i + (int)sizeof(byBuf) <= (int)sizeof(byTrack), "write reached the SD-Card");
+
+	return (g_nErrors == 0) ? 0 : 1;
+}
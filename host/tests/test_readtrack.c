@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "fdc.h"
+#include "sim.h"
+#include "image.h"
+#include "timers.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// Read Track (0xE0) of a 6 KB MFM track: the Z80 gets the DMK track as it is in the
+// image, without the IDAM table, at the data rate of the drive, with the default
+// (turbo) timing and with TIMING0=ACCURATE.  The track of an HFE image holds the
+// ID and data fields of its sectors.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#define TRACKS      40
+#define SECTORS     18
+#define SECTOR_SIZE 256
+#define TRACK_LEN   0x1900
+#define IDAM_TABLE  0x80
+#define TEST_TRACK  7
+
+static BYTE g_byImage[TRACK_LEN];
+static BYTE g_byTrack[TRACK_LEN];
+
+//-----------------------------------------------------------------------------
+// returns the number of bytes read, *pnTime is the us from the command to the end
+// of busy
+//
+static int ReadTrack(BYTE byTrack, BYTE* pby, int nSize, UINT64* pnTime)
+{
+	UINT64 nStart = TimerGetTime();
+	int    nCount;
+
+	SimOut(SIM_REG_TRACK, byTrack);
+	SimOut(SIM_REG_STATUS, 0xE0);
+	nCount = SimReadData(pby, nSize, 5000000);
+	SimWaitNotBusy(5000000);
+
+	*pnTime = TimerGetTime() - nStart;
+
+	return nCount;
+}
+
+//-----------------------------------------------------------------------------
+static void DmkReadTrack(char* pszWhat, char* pszIni)
+{
+	UINT64 nTime;
+	int    nCount;
+
+	Check(ImageWriteIni(pszIni), "ImageWriteIni");
+	SimStartFdc();
+
+	SimDriveSelect(0x01 | SIM_DRVSEL_MFM);
+	SimSeek(TEST_TRACK);
+
+	memset(&g_fsStats, 0, sizeof(g_fsStats));
+	memset(g_byTrack, 0, sizeof(g_byTrack));
+	nCount = ReadTrack(TEST_TRACK, g_byTrack, sizeof(g_byTrack), &nTime);
+
+	printf("%-8s %5d bytes, %6.1f ms, %6.0f bytes/s (%lu bytes/s from the first DRQ)\n", pszWhat, nCount,
+		nTime / 1000.0, nCount * 1000000.0 / nTime,
+		(g_fsStats.nTrackReadTime != 0) ? (unsigned long)(g_fsStats.dwTrackReadBytes * 1000000ULL / g_fsStats.nTrackReadTime) : 0UL);
+
+	Check(nCount == TRACK_LEN - IDAM_TABLE, "track length");
+	Check(memcmp(g_byTrack, g_byImage + IDAM_TABLE, TRACK_LEN - IDAM_TABLE) == 0, "track data");
+	Check((g_fsStats.dwTrackReads == 1) && (g_fsStats.dwTrackReadBytes == (DWORD)nCount), "track read counters");
+
+	FdcCloseAllFiles();
+}
+
+//-----------------------------------------------------------------------------
+// the data fields (0xA1 x 3, 0xFB and the data) of the sectors of an HFE track
+//
+static void HfeReadTrack(void)
+{
+	BYTE   byField[4 + SECTOR_SIZE];
+	UINT64 nTime;
+	int    nCount, nSector, nFound = 0;
+	int    i;
+
+	Check(ImageWriteIni("DRIVE0=disk.hfe\r\n"), "ImageWriteIni");
+	SimStartFdc();
+
+	SimDriveSelect(0x01 | SIM_DRVSEL_MFM);
+	SimSeek(TEST_TRACK);
+
+	memset(g_byTrack, 0, sizeof(g_byTrack));
+	nCount = ReadTrack(TEST_TRACK, g_byTrack, sizeof(g_byTrack), &nTime);
+
+	for (nSector = 1; nSector <= SECTORS; ++nSector)
+	{
+		memset(byField, 0xA1, 3);
+		byField[3] = 0xFB;
+
+		for (i = 0; i < SECTOR_SIZE; ++i)
+		{
+			byField[4 + i] = ImageSectorByte(TEST_TRACK, 0, nSector, i);
+		}
+
+		for (i = 0; i + (int)sizeof(byField) <= nCount; ++i)
+		{
+			if (memcmp(g_byTrack + i, byField, sizeof(byField)) == 0)
+			{
+				++nFound;
+				break;
+			}
+		}
+	}
+
+	printf("HFE      %5d bytes, %6.1f ms, %d of %d data fields\n", nCount, nTime / 1000.0, nFound, SECTORS);
+
+	Check(nCount > SECTORS * (SECTOR_SIZE + 4), "HFE track length");
+	Check(nFound == SECTORS, "HFE data fields");
+
+	FdcCloseAllFiles();
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	Check(SimInit(NULL), "SimInit");
+	Check(ImageMakeDmk("disk.dmk", TRACKS, 1, SECTORS, SECTOR_SIZE, TRACK_LEN), "ImageMakeDmk");
+	Check(ImageMakeHfe("disk.hfe", TRACKS, 1, SECTORS, SECTOR_SIZE, 0), "ImageMakeHfe");
+	Check(ImageReadFile("disk.dmk", DMK_HEADER_SIZE + TEST_TRACK * TRACK_LEN, g_byImage, TRACK_LEN), "ImageReadFile");
+
+	DmkReadTrack("turbo", "DRIVE0=disk.dmk\r\n");
+	DmkReadTrack("accurate", "DRIVE0=disk.dmk\r\nTIMING0=ACCURATE\r\n");
+	HfeReadTrack();
+
+	return (g_nErrors == 0) ? 0 : 1;
+}
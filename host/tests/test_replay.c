@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "fdc.h"
+#include "sim.h"
+#include "image.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// trace.bin files with a header that does not match this build are refused, and
+// the replay of a captured Read Sector reports its latency and reads the data
+// of the trace
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#define TRACE_PATH      "test_replay.bin"
+#define TRACE_TICK_RATE 2000000			// ticks per second of the test trace
+#define TRACE_MAX       4096
+
+static FDC_BusType g_btTrace[TRACE_MAX];
+static int         g_nTraceCount;
+
+//-----------------------------------------------------------------------------
+// adds a record of nCount cycles with the strobe dwStrobe (one of the *_MASK of
+// Defines.h) lasting dwUs us, as RecordBusHistory() stores them
+//
+static void AddRecord(DWORD dwStrobe, int nReg, BYTE byData, int nCount, DWORD dwUs)
+{
+	FDC_BusType* pbt = &g_btTrace[g_nTraceCount++];
+
+	pbt->Bus.dw = ((INTR_MASK & ~dwStrobe) | (1 << RESET_PIN)) >> 6;
+	pbt->Bus.b.DATA  = byData;
+	pbt->Bus.b.A0    = nReg & 1;
+	pbt->Bus.b.A1    = (nReg >> 1) & 1;
+	pbt->Bus.b.Count = nCount;
+	pbt->dwTicks     = dwUs * (TRACE_TICK_RATE / 1000000);
+}
+
+//-----------------------------------------------------------------------------
+static void WriteTrace(TraceFileHeaderType* pthHeader, int nEntries)
+{
+	FILE* fp = fopen(TRACE_PATH, "wb");
+
+	fwrite(pthHeader, sizeof(TraceFileHeaderType), 1, fp);
+	fwrite(g_btTrace, sizeof(FDC_BusType), nEntries, fp);
+	fclose(fp);
+}
+
+//-----------------------------------------------------------------------------
+static int LoadHeader(TraceFileHeaderType* pthHeader, int nEntries)
+{
+	TraceFileHeaderType thRead;
+	FDC_BusType*        pbt;
+	int                 nResult;
+
+	WriteTrace(pthHeader, nEntries);
+	nResult = ReplayLoadTrace(TRACE_PATH, &thRead, &pbt);
+	free(pbt);
+
+	return nResult;
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	TraceFileHeaderType thHeader, thBad;
+	FDC_BusType*        pbtEntries;
+	ReplayStatsType     rs;
+	DWORD               dwTicks = 0;
+	int                 i;
+
+	// a capture of a Read Sector of track 0 sector 1 polled by the Z80
+	AddRecord(0, 0, 0, 0, 50);
+	AddRecord(DRVSEL_MASK, 0, 0x81, 1, 20);
+	AddRecord(DISKOUT_MASK, SIM_REG_TRACK, 0, 1, 10);
+	AddRecord(DISKOUT_MASK, SIM_REG_SECTOR, 1, 1, 10);
+	AddRecord(DISKOUT_MASK, SIM_REG_STATUS, 0x80, 1, 10);
+
+	for (i = 0; i < 8; ++i)
+	{
+		AddRecord(DISKIN_MASK, SIM_REG_STATUS, 0x03, 255, 255 * 10);
+	}
+
+	for (i = 0; i < 256; ++i)
+	{
+		AddRecord(DISKIN_MASK, SIM_REG_STATUS, 0x03, 1, 10);
+		AddRecord(DISKIN_MASK, SIM_REG_DATA, ImageSectorByte(0, 0, 1, i), 1, 10);
+	}
+
+	AddRecord(DISKIN_MASK, SIM_REG_STATUS, 0x00, 1, 10);
+
+	for (i = 0; i < g_nTraceCount; ++i)
+	{
+		dwTicks += g_btTrace[i].dwTicks;
+	}
+
+	memset(&thHeader, 0, sizeof(thHeader));
+	memcpy(thHeader.szSignature, TRACE_FILE_SIGNATURE, sizeof(thHeader.szSignature));
+	thHeader.nVersion   = TRACE_FILE_VERSION;
+	thHeader.nEntrySize = sizeof(FDC_BusType);
+	thHeader.nEntries   = g_nTraceCount;
+	thHeader.nTickRate  = TRACE_TICK_RATE;
+
+	// header checks
+	thBad = thHeader;
+	thBad.szSignature[0] = 'X';
+	Check(LoadHeader(&thBad, g_nTraceCount) == replayErrorSignature, "signature");
+
+	thBad = thHeader;
+	thBad.nVersion = TRACE_FILE_VERSION + 1;
+	Check(LoadHeader(&thBad, g_nTraceCount) == replayErrorVersion, "version");
+
+	thBad = thHeader;
+	thBad.nEntrySize = sizeof(FDC_BusType) + 4;
+	Check(LoadHeader(&thBad, g_nTraceCount) == replayErrorEntrySize, "entry size");
+
+	thBad = thHeader;
+	thBad.nTickRate = 0;
+	Check(LoadHeader(&thBad, g_nTraceCount) == replayErrorTickRate, "tick rate");
+
+	Check(LoadHeader(&thHeader, g_nTraceCount - 1) == replayErrorTruncated, "truncated");
+	Check(ReplayLoadTrace("missing.bin", &thBad, &pbtEntries) == replayErrorFile, "missing file");
+
+	// replay
+	WriteTrace(&thHeader, g_nTraceCount);
+	Check(ReplayLoadTrace(TRACE_PATH, &thHeader, &pbtEntries) == replayOk, "ReplayLoadTrace");
+	Check(thHeader.nEntries == (DWORD)g_nTraceCount, "entry count");
+
+	Check(SimInit(NULL), "SimInit");
+	Check(ImageMakeDmk("replay.dmk", 40, 1, 18, 256, 0), "ImageMakeDmk");
+	Check(ImageWriteIni("DRIVE0=replay.dmk\r\nTIMING0=TURBO\r\n"), "ImageWriteIni");
+	SimStartFdc();
+
+	ReplayRun(pbtEntries, thHeader.nEntries, thHeader.nTickRate, &rs);
+	free(pbtEntries);
+
+	printf("Read Sector %lu us, %lu cycles, trace %llu us, emulated %llu us\n", (unsigned long)rs.csCommands[8].dwMaxTime,
+		(unsigned long)rs.dwCycles, (unsigned long long)rs.nTraceTime, (unsigned long long)rs.nEmulatedTime);
+
+	Check(rs.csCommands[8].dwCount == 1, "Read Sector measured");
+	Check((rs.csCommands[8].dwMaxTime > 0) && (rs.csCommands[8].dwMaxTime <= rs.nEmulatedTime), "Read Sector latency");
+	Check(rs.dwCycles == 4 + 8 * 255 + 2 * 256 + 1, "cycles");
+	Check(rs.dwSkipped == 0, "skipped");
+	Check(rs.dwDataMismatches == 0, "data read");
+	Check(rs.nTraceTime == (UINT64)dwTicks * 1000000 / TRACE_TICK_RATE, "trace time");
+	Check(rs.nEmulatedTime >= rs.nTraceTime, "emulated time");
+
+	remove(TRACE_PATH);
+
+	return (g_nErrors == 0) ? 0 : 1;
+}
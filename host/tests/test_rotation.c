@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "fdc.h"
+#include "sim.h"
+#include "image.h"
+#include "timers.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// rotational position model, TURBO against ACCURATE timing: 18 Read Address
+// commands return the ID fields of an 18 sector track in the order they pass the
+// head, a revolution's worth in accurate timing and at once in turbo timing.  The
+// reads of each sector of the track in turn take more than a revolution in accurate
+// timing, and a read of the sector just read waits a whole revolution.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#define TRACKS     40
+#define SECTORS    18
+#define TEST_TRACK 3
+
+//-----------------------------------------------------------------------------
+// returns the sector number of the ID field read, 0 on an error
+//
+static BYTE ReadAddress(void)
+{
+	BYTE byId[6];
+
+	SimOut(SIM_REG_STATUS, 0xC0);
+
+	if ((SimReadData(byId, sizeof(byId), 2000000) != sizeof(byId)) || (SimWaitNotBusy(2000000) != 0))
+	{
+		return 0;
+	}
+
+	return (byId[0] == TEST_TRACK) ? byId[2] : 0;
+}
+
+//-----------------------------------------------------------------------------
+// the work of the test in one timing mode, *pnAddress is the us of the Read Address
+// commands, *pnSectors the us of the sector reads and *pnSame the us of the second
+// read of the last sector
+//
+static void Run(char* pszWhat, char* pszIni, UINT64* pnAddress, UINT64* pnSectors, UINT64* pnSame)
+{
+	BYTE   bySeen[SECTORS + 1];
+	BYTE   byBuf[256];
+	UINT64 nStart;
+	BYTE   bySector, byPrev = 0;
+	int    i, nInOrder = 0;
+
+	Check(ImageWriteIni(pszIni), "ImageWriteIni");
+	SimStartFdc();
+
+	SimDriveSelect(0x01 | SIM_DRVSEL_MFM);
+	SimSeek(TEST_TRACK);
+	Check(SimReadSector(TEST_TRACK, 1, byBuf, sizeof(byBuf)) == 0, "read status");
+
+	// the ID fields in the order they pass the head
+	memset(bySeen, 0, sizeof(bySeen));
+	nStart = TimerGetTime();
+
+	for (i = 0; i < SECTORS; ++i)
+	{
+		bySector = ReadAddress();
+		Check((bySector >= 1) && (bySector <= SECTORS), "Read Address");
+
+		if ((bySector >= 1) && (bySector <= SECTORS))
+		{
+			bySeen[bySector] = TRUE;
+		}
+
+		if ((byPrev != 0) && (bySector == (byPrev % SECTORS) + 1))
+		{
+			++nInOrder;
+		}
+
+		byPrev = bySector;
+	}
+
+	*pnAddress = TimerGetTime() - nStart;
+
+	for (i = 1; i <= SECTORS; ++i)
+	{
+		Check(bySeen[i], "every ID field once a revolution");
+	}
+
+	Check(nInOrder == SECTORS - 1, "ID fields in track order");
+
+	// each sector in turn
+	nStart = TimerGetTime();
+
+	for (bySector = 1; bySector <= SECTORS; ++bySector)
+	{
+		Check(SimReadSector(TEST_TRACK, bySector, byBuf, sizeof(byBuf)) == 0, "read status");
+		Check(ImageCheckSector(byBuf, sizeof(byBuf), TEST_TRACK, 0, bySector), "read data");
+	}
+
+	*pnSectors = TimerGetTime() - nStart;
+
+	// the same sector again
+	nStart = TimerGetTime();
+	Check(SimReadSector(TEST_TRACK, SECTORS, byBuf, sizeof(byBuf)) == 0, "read status");
+	*pnSame = TimerGetTime() - nStart;
+
+	printf("%-8s 18 Read Address %6.1f ms, 18 Read Sector %6.1f ms, same sector again %6.1f ms\n", pszWhat,
+		*pnAddress / 1000.0, *pnSectors / 1000.0, *pnSame / 1000.0);
+
+	FdcCloseAllFiles();
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	UINT64 nTurboAddress, nTurboSectors, nTurboSame, nAddress, nSectors, nSame;
+
+	Check(SimInit(NULL), "SimInit");
+	Check(ImageMakeDmk("disk.dmk", TRACKS, 1, SECTORS, 256, 0), "ImageMakeDmk");
+
+	Run("turbo", "DRIVE0=disk.dmk\r\n", &nTurboAddress, &nTurboSectors, &nTurboSame);
+	Run("accurate", "DRIVE0=disk.dmk\r\nTIMING0=ACCURATE\r\n", &nAddress, &nSectors, &nSame);
+
+	printf("revolution %lu us\n", (unsigned long)g_dwRotationTime);
+
+	// a revolution (less the first ID field, which can be reached at once)
+	Check((nAddress > g_dwRotationTime * (SECTORS - 1) / SECTORS) && (nAddress < g_dwRotationTime * 2), "Read Address in accurate timing");
+	Check(nTurboAddress < nAddress / 10, "Read Address in turbo timing");
+
+	// the sectors pass the head once a revolution
+	Check(nSectors > g_dwRotationTime, "sector reads in accurate timing");
+	Check(nSame > g_dwRotationTime * (SECTORS - 1) / SECTORS, "same sector in accurate timing");
+	Check(nTurboSectors < nSectors / 10, "sector reads in turbo timing");
+	Check(nTurboSame < nSame / 10, "same sector in turbo timing");
+
+	return (g_nErrors == 0) ? 0 : 1;
+}
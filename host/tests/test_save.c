@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "fdc.h"
+#include "sim.h"
+#include "image.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// SD-Card writes of a TRSDOS style save: the DOS reads the GAT and the directory
+// sector, writes the sectors of the file one at a time with the time it takes to
+// move the next 256 bytes in between, then writes back the GAT and the directory
+// entry.  All of it on one DMK track, replayed once with the writes held in the
+// track cache (default WRITEDELAY) and once flushed after each write (WRITEDELAY=0).
+// The image must hold the same track afterwards.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#define TRACKS       40
+#define SECTORS      18
+#define SECTOR_SIZE  256
+#define TRACK_LEN    0x1900
+#define SAVE_TRACK   17
+#define GAT_SECTOR   1
+#define DIR_SECTOR   2
+#define FILE_FIRST   3						// the file fills the rest of the track
+#define DOS_TIME     2000					// us the DOS takes between two sector writes
+
+typedef struct {
+	DWORD dwSectorWrites;					// Write Sector commands
+	DWORD dwWrites;							// SD-Card write calls
+	DWORD dwWriteBytes;						// bytes written to the SD-Card
+} SaveStatsType;
+
+static BYTE g_byTrack[2][TRACK_LEN];
+
+//-----------------------------------------------------------------------------
+static void WriteSector(BYTE bySector, BYTE byFill, SaveStatsType* pss)
+{
+	BYTE byBuf[SECTOR_SIZE];
+	int  i;
+
+	for (i = 0; i < SECTOR_SIZE; ++i)
+	{
+		byBuf[i] = byFill + i;
+	}
+
+	Check(SimWriteSector(SAVE_TRACK, bySector, byBuf, sizeof(byBuf)) == 0, "write status");
+	++pss->dwSectorWrites;
+
+	SimRun(DOS_TIME);
+}
+
+//-----------------------------------------------------------------------------
+// replays the save with pszIni and copies the saved track of the image to pbyTrack
+//
+static void Save(char* pszWhat, char* pszIni, BYTE* pbyTrack, SaveStatsType* pss)
+{
+	BYTE byBuf[SECTOR_SIZE];
+	BYTE bySector;
+
+	memset(pss, 0, sizeof(*pss));
+
+	Check(ImageMakeDmk("save.dmk", TRACKS, 1, SECTORS, SECTOR_SIZE, TRACK_LEN), "ImageMakeDmk");
+	Check(ImageWriteIni(pszIni), "ImageWriteIni");
+
+	SimStartFdc();
+	SimDriveSelect(0x01 | SIM_DRVSEL_MFM);
+	SimSeek(SAVE_TRACK);
+
+	Check(SimReadSector(SAVE_TRACK, GAT_SECTOR, byBuf, sizeof(byBuf)) == 0, "GAT read");
+	Check(SimReadSector(SAVE_TRACK, DIR_SECTOR, byBuf, sizeof(byBuf)) == 0, "directory read");
+	SimRun(WRITEBACK_IDLE_TIME);
+	SimResetStats();
+
+	for (bySector = FILE_FIRST; bySector <= SECTORS; ++bySector)
+	{
+		WriteSector(bySector, bySector, pss);
+	}
+
+	WriteSector(GAT_SECTOR, 0xA0, pss);
+	WriteSector(DIR_SECTOR, 0xB0, pss);
+
+	// the held writes are written back once the DOS has stopped issuing commands
+	SimRun(WRITEBACK_IDLE_TIME + 10000);
+
+	pss->dwWrites     = g_hdStats.dwWrites;
+	pss->dwWriteBytes = g_hdStats.dwWriteSectors * 512;
+
+	printf("%-10s %lu sector writes: %3lu SD writes, %6lu bytes written\n", pszWhat, (unsigned long)pss->dwSectorWrites,
+		(unsigned long)pss->dwWrites, (unsigned long)pss->dwWriteBytes);
+
+	FdcCloseAllFiles();
+
+	Check(ImageReadFile("save.dmk", DMK_HEADER_SIZE + SAVE_TRACK * TRACK_LEN, pbyTrack, TRACK_LEN), "ImageReadFile");
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	SaveStatsType ssDeferred, ssImmediate;
+	BYTE          byOriginal[TRACK_LEN];
+
+	Check(SimInit(NULL), "SimInit");
+
+	Save("deferred", "DRIVE0=save.dmk\r\n", g_byTrack[0], &ssDeferred);
+	Save("immediate", "DRIVE0=save.dmk\r\nWRITEDELAY=0\r\n", g_byTrack[1], &ssImmediate);
+
+	printf("%.1fx fewer SD writes, %.1fx fewer bytes written with the write-back deferred\n",
+		(double)ssImmediate.dwWrites / ssDeferred.dwWrites, (double)ssImmediate.dwWriteBytes / ssDeferred.dwWriteBytes);
+
+	// both reach the image
+	Check(ImageBuildDmkTrack(byOriginal, TRACK_LEN, SAVE_TRACK, 0, SECTORS, SECTOR_SIZE, 1) != 0, "ImageBuildDmkTrack");
+	Check(memcmp(g_byTrack[0], byOriginal, TRACK_LEN) != 0, "saved track written");
+	Check(memcmp(g_byTrack[0], g_byTrack[1], TRACK_LEN) == 0, "same track with either write-back");
+
+	// an immediate flush writes each sector on its own, the deferred write-back the whole save at once
+	Check(ssImmediate.dwWrites >= ssImmediate.dwSectorWrites, "a write for each sector with WRITEDELAY=0");
+	Check(ssDeferred.dwWrites < ssImmediate.dwWrites, "fewer SD writes deferred");
+	Check(ssDeferred.dwWriteBytes < ssImmediate.dwWriteBytes, "fewer bytes written deferred");
+
+	return (g_nErrors == 0) ? 0 : 1;
+}
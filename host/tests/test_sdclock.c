@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "ff.h"
+#include "sd_core.h"
+#include "spimock.h"
+#include "image.h"
+#include "hardware/clocks.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// SPI clock tuning of sd_core.c (SdTuneClock()) through the real SD driver and the
+// SPI/DMA mock.  The mock card sends blocks with a bad CRC above a given clock.
+// Mounting a card (IdentifySdCard()) tries the rates of the divisor ladder up from
+// the hw_config.c rate, keeps the fastest one that reads back the test sectors and
+// saves it in sdclock.cfg with the CID of the card.  A remount of the same card
+// verifies only the saved rate.  A card that no longer reads at the saved rate goes
+// through the ladder again, and another card does not use the rate of the first.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#define CARD_SECTORS 0x20000			// 64 MB
+
+static BYTE g_byCid[2][16] = {
+	{0x03, 'S', 'D', 'S', 'L', '0', '8', 'G', 0x80, 0x12, 0x34, 0x56, 0x78, 0x01, 0x4A, 0xB1},
+	{0x27, 'P', 'H', 'S', 'D', '3', '2', 'G', 0x30, 0x9A, 0xBC, 0xDE, 0xF0, 0x01, 0x57, 0x3D},
+};
+
+//-----------------------------------------------------------------------------
+static BYTE CreateVolume(void)
+{
+	static BYTE byWork[FF_MAX_SS * 8];
+	MKFS_PARM   opt = {FM_FAT32, 1, 0, 0, 0};
+
+	return (f_mkfs("", &opt, byWork, sizeof(byWork)) == FR_OK);
+}
+
+//-----------------------------------------------------------------------------
+// returns TRUE if sdclock.cfg holds the CID of card nCard and dwRate
+//
+static BYTE CheckClockFile(int nCard, DWORD dwRate)
+{
+	FIL  fil;
+	char szLine[64];
+	char szExpected[64];
+	int  i;
+
+	for (i = 0; i < (int)sizeof(g_byCid[nCard]); ++i)
+	{
+		sprintf(szExpected+i*2, "%02x", g_byCid[nCard][i]);
+	}
+
+	sprintf(szExpected+i*2, " %lu\n", (unsigned long)dwRate);
+
+	if (f_open(&fil, "sdclock.cfg", FA_READ) != FR_OK)
+	{
+		return FALSE;
+	}
+
+	memset(szLine, 0, sizeof(szLine));
+	f_gets(szLine, sizeof(szLine), &fil);
+	f_close(&fil);
+
+	// f_gets() keeps the \n of the \r\n
+	if (strchr(szLine, '\r') != NULL)
+	{
+		strcpy(strchr(szLine, '\r'), "\n");
+	}
+
+	return (strcmp(szLine, szExpected) == 0);
+}
+
+//-----------------------------------------------------------------------------
+// mounts card nCard that reads reliably up to dwMaxClock, returns the us it took
+//
+static UINT64 Mount(char* pszWhat, int nCard, DWORD dwMaxClock)
+{
+	UINT64 nStart;
+
+	SpiMockSetCid(g_byCid[nCard]);
+	SpiMockSetMaxClock(dwMaxClock);
+	memset(&g_smStats, 0, sizeof(g_smStats));
+
+	nStart = SpiMockGetTime();
+	IdentifySdCard();
+	nStart = SpiMockGetTime() - nStart;
+
+	printf("%-28s %8lu Hz, %2lu clock changes, %3lu bad CRCs, fastest clock tried %8lu Hz, %6.1f ms\n", pszWhat,
+		(unsigned long)g_dwSdClockRate, (unsigned long)g_smStats.dwClockChanges, (unsigned long)g_smStats.dwCrcErrors,
+		(unsigned long)g_smStats.dwFastestClock, nStart / 1000.0);
+
+	Check(sd_byCardInialized, "card mounted");
+
+	return nStart;
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	DWORD  dwPeri = clock_get_hz(clk_peri);
+	UINT64 nTune, nRemount;
+
+	Check(SpiMockCreate(CARD_SECTORS), "SpiMockCreate");
+	Check(CreateVolume(), "CreateVolume");
+
+	// the ladder stops at the first rate above clk_peri / 6
+	nTune = Mount("first mount, max clk_peri/6", 0, dwPeri / 6);
+
+	Check(g_dwSdClockRate == dwPeri / 6, "fastest rate the card reads at");
+	Check(g_smStats.dwFastestClock == dwPeri / 4, "next rate of the ladder tried");
+	Check(g_smStats.dwCrcErrors > 0, "bad CRCs above the limit");
+	Check(CheckClockFile(0, dwPeri / 6), "rate saved with the CID");
+
+	// the same card again: only the saved rate is verified
+	nRemount = Mount("remount", 0, dwPeri / 6);
+
+	Check(g_dwSdClockRate == dwPeri / 6, "saved rate kept");
+	Check(g_smStats.dwClockChanges == 2, "only the hw_config.c rate and the saved rate");
+	Check(g_smStats.dwFastestClock == dwPeri / 6, "no faster rate tried");
+	Check(g_smStats.dwCrcErrors == 0, "no bad CRCs");
+	Check(nRemount < nTune, "remount faster than the tuning");
+
+	// the saved rate no longer reads back: tuned again and saved
+	Mount("remount, max clk_peri/8", 0, dwPeri / 8);
+
+	Check(g_dwSdClockRate == dwPeri / 8, "rate tuned again");
+	Check(g_smStats.dwCrcErrors > 0, "saved rate failed");
+	Check(CheckClockFile(0, dwPeri / 8), "new rate saved");
+
+	// another card does not use the saved rate
+	Mount("other card, no limit", 1, 0);
+
+	Check(g_dwSdClockRate == dwPeri / 4, "fastest rate of the ladder");
+	Check(g_smStats.dwClockChanges > 2, "ladder tried");
+	Check(CheckClockFile(1, dwPeri / 4), "rate saved with the CID of the other card");
+
+	return (g_nErrors == 0) ? 0 : 1;
+}
@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "fdc.h"
+#include "sim.h"
+#include "image.h"
+#include "timers.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// data register throughput of Read Sector: fdc_isr() hands out the bytes of a
+// 256 byte sector from the track buffer and keeps DRQ set, so the transfer runs at
+// the speed of the Z80 polling loop (a status read and a data read per byte) and
+// every status read finds DRQ set.  Measured at several bus cycle times, from the
+// first DRQ to the last byte (g_fsStats).
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#define TRACKS      40
+#define SECTORS     18
+#define SECTOR_SIZE 256
+#define TEST_TRACK  5
+#define PASSES      10
+
+static DWORD g_dwCycleTimes[] = {1, 3, 5};
+
+#define CYCLE_TIMES (sizeof(g_dwCycleTimes) / sizeof(g_dwCycleTimes[0]))
+
+//-----------------------------------------------------------------------------
+// reads a sector with a status read before each data read, adds the status reads
+// of the data phase to *pdwPolls and returns the number of bytes read
+//
+static int ReadSector(BYTE bySector, BYTE* pby, DWORD* pdwPolls)
+{
+	BYTE byStatus;
+	int  nCount = 0;
+
+	SimOut(SIM_REG_TRACK, TEST_TRACK);
+	SimOut(SIM_REG_SECTOR, bySector);
+	SimOut(SIM_REG_STATUS, 0x80);
+
+	// the first DRQ, after the track load and the rotational delay
+	do
+	{
+		byStatus = SimIn(SIM_REG_STATUS);
+	}
+	while ((byStatus & (SIM_STATUS_BUSY | SIM_STATUS_DRQ)) == SIM_STATUS_BUSY);
+
+	while ((nCount < SECTOR_SIZE) && (byStatus & SIM_STATUS_BUSY))
+	{
+		if (byStatus & SIM_STATUS_DRQ)
+		{
+			pby[nCount++] = SimIn(SIM_REG_DATA);
+		}
+
+		if (nCount < SECTOR_SIZE)
+		{
+			byStatus = SimIn(SIM_REG_STATUS);
+			++*pdwPolls;
+		}
+	}
+
+	Check((SimWaitNotBusy(2000000) & (SIM_STATUS_BUSY | SIM_STATUS_RNF)) == 0, "read status");
+
+	return nCount;
+}
+
+//-----------------------------------------------------------------------------
+// returns the bytes/s of the sector reads with dwCycleTime us between two bus cycles
+//
+static DWORD Measure(DWORD dwCycleTime)
+{
+	BYTE  byBuf[SECTOR_SIZE];
+	DWORD dwPolls = 0, dwRate;
+	BYTE  bySector;
+	int   i;
+
+	g_dwSimCycleTime = dwCycleTime;
+
+	// the track is in the cache before the measurement
+	Check(SimReadSector(TEST_TRACK, 1, byBuf, sizeof(byBuf)) == 0, "track load");
+
+	memset(&g_fsStats, 0, sizeof(g_fsStats));
+	SimResetStats();
+
+	for (i = 0; i < PASSES; ++i)
+	{
+		for (bySector = 1; bySector <= SECTORS; ++bySector)
+		{
+			Check(ReadSector(bySector, byBuf, &dwPolls) == SECTOR_SIZE, "sector size");
+			Check(ImageCheckSector(byBuf, sizeof(byBuf), TEST_TRACK, 0, bySector), "read data");
+		}
+	}
+
+	dwRate = (DWORD)(((UINT64)g_fsStats.dwSectorReadBytes * 1000000) / g_fsStats.nSectorReadTime);
+
+	printf("%lu us bus cycle: %lu sectors, %7lu bytes/s, %6.1f us a sector, %.2f status reads a byte, %lu WAIT holds\n",
+		(unsigned long)dwCycleTime, (unsigned long)g_fsStats.dwSectorReads, (unsigned long)dwRate,
+		(double)g_fsStats.nSectorReadTime / g_fsStats.dwSectorReads, (double)dwPolls / g_fsStats.dwSectorReadBytes,
+		(unsigned long)g_simStats.dwWaitHolds);
+
+	Check(g_fsStats.dwSectorReads == PASSES * SECTORS, "sector reads counted");
+	Check(g_fsStats.dwSectorReadBytes == PASSES * SECTORS * SECTOR_SIZE, "sector bytes counted");
+
+	// one status read a byte: DRQ is set again before the Z80 looks at it
+	Check(dwPolls <= g_fsStats.dwSectorReadBytes, "DRQ set at every status read");
+	Check(g_simStats.dwWaitHolds == 0, "no WAIT holds");
+
+	// the rate of the Z80 loop, two bus cycles a byte
+	Check(dwRate >= (1000000 / (2 * dwCycleTime)) * 9 / 10, "rate of the Z80 polling loop");
+
+	return dwRate;
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	DWORD dwRate[CYCLE_TIMES];
+	int   i;
+
+	Check(SimInit(NULL), "SimInit");
+	Check(ImageMakeDmk("disk.dmk", TRACKS, 1, SECTORS, SECTOR_SIZE, 0), "ImageMakeDmk");
+	Check(ImageWriteIni("DRIVE0=disk.dmk\r\n"), "ImageWriteIni");
+
+	SimStartFdc();
+	SimDriveSelect(0x01 | SIM_DRVSEL_MFM);
+	SimSeek(TEST_TRACK);
+
+	for (i = 0; i < (int)CYCLE_TIMES; ++i)
+	{
+		dwRate[i] = Measure(g_dwCycleTimes[i]);
+	}
+
+	Check(dwRate[0] > dwRate[CYCLE_TIMES - 1], "faster with a faster Z80");
+
+	FdcCloseAllFiles();
+
+	return (g_nErrors == 0) ? 0 : 1;
+}
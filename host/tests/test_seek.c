@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "fdc.h"
+#include "sim.h"
+#include "image.h"
+#include "timers.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// seek latency with read-ahead: a program load reads both sides of each track of
+// a double sided disk in turn, and works on the data between the tracks.  With a
+// single slot there is no read-ahead and each seek waits for its track to be read
+// from the SD-Card; with all the slots the next tracks are loaded while the FDC is
+// idle, and the seek and the first sector read after it take less time.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#define TRACKS     40
+#define SECTORS    18
+#define LOAD_FROM  1
+#define LOAD_TO    30
+#define WORK_TIME  20000				// us the program works on the data of a track
+
+//-----------------------------------------------------------------------------
+// returns the average us from a seek to the end of the first sector read on the
+// new track with nSlots slots in the track cache (0 for all of them)
+//
+static DWORD Load(char* pszWhat, int nSlots)
+{
+	BYTE   byBuf[256];
+	UINT64 nStart, nLatency = 0;
+	DWORD  dwLatencyMax = 0, dwLatency, dwSeeks = 0;
+	BYTE   byTrack, bySide, bySector;
+
+	SimStartFdc();
+
+	if (nSlots != 0)
+	{
+		TrackCacheReserve((TRACK_CACHE_SLOTS - nSlots) * sizeof(TrackType));
+	}
+
+	memset(&g_tcsStats, 0, sizeof(g_tcsStats));
+
+	for (byTrack = LOAD_FROM; byTrack <= LOAD_TO; ++byTrack)
+	{
+		for (bySide = 0; bySide < 2; ++bySide)
+		{
+			SimDriveSelect(0x01 | SIM_DRVSEL_MFM | (bySide ? SIM_DRVSEL_SIDE1 : 0));
+			nStart = TimerGetTime();
+
+			if (bySide == 0)
+			{
+				SimSeek(byTrack);
+			}
+
+			for (bySector = 1; bySector <= SECTORS; ++bySector)
+			{
+				Check(SimReadSector(byTrack, bySector, byBuf, sizeof(byBuf)) == 0, "read status");
+				Check(ImageCheckSector(byBuf, sizeof(byBuf), byTrack, bySide, bySector), "read data");
+
+				if (bySector == 1)
+				{
+					dwLatency    = (DWORD)(TimerGetTime() - nStart);
+					nLatency    += dwLatency;
+					dwLatencyMax = (dwLatency > dwLatencyMax) ? dwLatency : dwLatencyMax;
+					++dwSeeks;
+				}
+			}
+
+			SimRun(WORK_TIME);
+		}
+	}
+
+	FdcCloseAllFiles();
+
+	printf("%-10s first sector after a track change %5lu us average, %5lu us max, %lu read-ahead loads, %lu used\n", pszWhat,
+		(unsigned long)(nLatency / dwSeeks), (unsigned long)dwLatencyMax, (unsigned long)g_tcsStats.dwPrefetches,
+		(unsigned long)g_tcsStats.dwPrefetchHits);
+
+	return (DWORD)(nLatency / dwSeeks);
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	DWORD dwSingle, dwCache;
+
+	Check(SimInit(NULL), "SimInit");
+	Check(ImageMakeDmk("disk.dmk", TRACKS, 2, SECTORS, 256, 0), "ImageMakeDmk");
+	Check(ImageWriteIni("DRIVE0=disk.dmk\r\n"), "ImageWriteIni");
+
+	dwSingle = Load("1 slot", 1);
+	dwCache  = Load("all slots", 0);
+
+	Check(g_tcsStats.dwPrefetchHits > 0, "read-ahead tracks used");
+	Check(dwCache < dwSingle, "lower latency with read-ahead");
+
+	return (g_nErrors == 0) ? 0 : 1;
+}
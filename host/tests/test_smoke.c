@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "fdc.h"
+#include "sim.h"
+#include "image.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// mounts a 40 track double sided DMK image and reads and writes sectors of it
+// through the bus cycles of the Z80
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	BYTE byBuf[256];
+	BYTE byStatus;
+	int  nTrack, nSector;
+
+	Check(SimInit(NULL), "SimInit");
+	Check(ImageMakeDmk("smoke.dmk", 40, 2, 18, 256, 0), "ImageMakeDmk");
+	Check(ImageWriteIni("DRIVE0=smoke.dmk\r\n"), "ImageWriteIni");
+
+	SimStartFdc();
+	SimDriveSelect(0x01 | SIM_DRVSEL_MFM);
+
+	for (nTrack = 0; nTrack < 40; nTrack += 13)
+	{
+		byStatus = SimSeek(nTrack);
+		Check((byStatus & (SIM_STATUS_BUSY | SIM_STATUS_RNF)) == 0, "seek");
+
+		for (nSector = 1; nSector <= 18; nSector += 5)
+		{
+			memset(byBuf, 0, sizeof(byBuf));
+			byStatus = SimReadSector(nTrack, nSector, byBuf, sizeof(byBuf));
+
+			Check((byStatus & 0xFC) == 0, "read status");
+			Check(ImageCheckSector(byBuf, sizeof(byBuf), nTrack, 0, nSector), "read data");
+		}
+	}
+
+	// a sector that does not exist
+	byStatus = SimReadSector(nTrack - 13, 30, byBuf, sizeof(byBuf));
+	Check((byStatus & SIM_STATUS_RNF) != 0, "record not found");
+
+	// write and read back on the second side
+	SimDriveSelect(0x01 | SIM_DRVSEL_MFM | SIM_DRVSEL_SIDE1);
+	SimSeek(5);
+	memset(byBuf, 0x5A, sizeof(byBuf));
+	byStatus = SimWriteSector(5, 3, byBuf, sizeof(byBuf));
+	Check((byStatus & 0xFC) == 0, "write status");
+
+	memset(byBuf, 0, sizeof(byBuf));
+	SimReadSector(5, 3, byBuf, sizeof(byBuf));
+	Check((byBuf[0] == 0x5A) && (byBuf[255] == 0x5A), "read back");
+
+	memset(byBuf, 0, sizeof(byBuf));
+	SimReadSector(5, 4, byBuf, sizeof(byBuf));
+	Check(ImageCheckSector(byBuf, sizeof(byBuf), 5, 1, 4), "neighbour sector");
+
+	// writes to a sector that does not exist and with no drive selected end with
+	// Record Not Found and leave the track unchanged
+	memset(byBuf, 0xE5, sizeof(byBuf));
+	byStatus = SimWriteSector(5, 30, byBuf, sizeof(byBuf));
+	Check((byStatus & (SIM_STATUS_BUSY | SIM_STATUS_RNF)) == SIM_STATUS_RNF, "write record not found");
+
+	SimDriveSelect(SIM_DRVSEL_MFM);
+	byStatus = SimWriteSector(5, 4, byBuf, sizeof(byBuf));
+	Check(g_FDC.stStatus.byNotFound && !g_FDC.stStatus.byBusy && !g_FDC.byIsrDataWrite, "write without drive");
+
+	SimDriveSelect(0x01 | SIM_DRVSEL_MFM | SIM_DRVSEL_SIDE1);
+	memset(byBuf, 0, sizeof(byBuf));
+	SimReadSector(5, 4, byBuf, sizeof(byBuf));
+	Check(ImageCheckSector(byBuf, sizeof(byBuf), 5, 1, 4), "track unchanged");
+
+	printf("%llu us emulated, %lu SD reads, %lu SD writes\n", (unsigned long long)TimerGetTime(),
+		(unsigned long)g_hdStats.dwReads, (unsigned long)g_hdStats.dwWrites);
+
+	return (g_nErrors == 0) ? 0 : 1;
+}
@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "ff.h"
+#include "file.h"
+#include "spimock.h"
+#include "image.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// the track reads of File.c through the real SD driver and the SPI/DMA mock:
+// a track read while the previous one is decoded (FileReadStart(), FileReadPoll()
+// and FileReadComplete()) takes less time than a read followed by the decode, and
+// the data is the same
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#define CARD_SECTORS 0x20000			// 64 MB
+#define TRACKS       80
+#define TRACK_LEN    0x1900
+#define TRACK_OFFSET 16					// the DMK header
+#define DECODE_TIME  1000				// us to decode (index) a track
+#define DECODE_STEPS 16					// FileReadPoll() calls during the decode
+
+static BYTE g_byTrack[2][TRACK_LEN];
+
+//-----------------------------------------------------------------------------
+static BYTE TrackByte(int nTrack, int i)
+{
+	return (BYTE)(nTrack * 7 + i);
+}
+
+//-----------------------------------------------------------------------------
+static BYTE CheckTrack(BYTE* pby, int nTrack)
+{
+	int i;
+
+	for (i = 0; i < TRACK_LEN; ++i)
+	{
+		if (pby[i] != TrackByte(nTrack, i))
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// the work of the FDC on a loaded track, with a read in progress advanced at
+// each step when fp is not NULL
+//
+static void DecodeTrack(file* fp)
+{
+	int i;
+
+	for (i = 0; i < DECODE_STEPS; ++i)
+	{
+		SpiMockAdvance(DECODE_TIME / DECODE_STEPS);
+
+		if (fp != NULL)
+		{
+			FileReadPoll(fp);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+static BYTE CreateImage(void)
+{
+	static BYTE byWork[FF_MAX_SS * 8];
+	MKFS_PARM   opt = {FM_FAT32, 1, 0, 0, 0};
+	FATFS       fs;
+	FIL         f;
+	UINT        nWritten;
+	BYTE        byOk;
+	int         t, i;
+
+	if (f_mkfs("", &opt, byWork, sizeof(byWork)) != FR_OK)
+	{
+		return FALSE;
+	}
+
+	f_mount(&fs, "", 0);
+
+	if (f_open(&f, "disk.dmk", FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+	{
+		return FALSE;
+	}
+
+	memset(byWork, 0, TRACK_OFFSET);
+	byOk = (f_write(&f, byWork, TRACK_OFFSET, &nWritten) == FR_OK);
+
+	for (t = 0; t < TRACKS; ++t)
+	{
+		for (i = 0; i < TRACK_LEN; ++i)
+		{
+			g_byTrack[0][i] = TrackByte(t, i);
+		}
+
+		byOk &= (f_write(&f, g_byTrack[0], TRACK_LEN, &nWritten) == FR_OK) && (nWritten == TRACK_LEN);
+	}
+
+	f_close(&f);
+	f_unmount("");
+
+	return byOk;
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	file*  fp;
+	UINT64 nStart, nSerial, nOverlap, nRead;
+	DWORD  dwPolls = 0;
+	BYTE   byOk = TRUE;
+	int    t;
+
+	Check(SpiMockCreate(CARD_SECTORS), "SpiMockCreate");
+	Check(CreateImage(), "CreateImage");
+
+	FileSystemInit();
+
+	fp = FileOpen("disk.dmk", FA_READ);
+	Check(fp != NULL, "FileOpen");
+
+	if (fp == NULL)
+	{
+		return 1;
+	}
+
+	Check(FileEnableFastSeek(fp), "FileEnableFastSeek");
+
+	// read, then decode
+	nStart = SpiMockGetTime();
+
+	for (t = 0; t < TRACKS; ++t)
+	{
+		FileSeek(fp, TRACK_OFFSET + t * TRACK_LEN);
+		byOk &= (FileRead(fp, g_byTrack[0], TRACK_LEN) == TRACK_LEN) && CheckTrack(g_byTrack[0], t);
+		DecodeTrack(NULL);
+	}
+
+	nSerial = SpiMockGetTime() - nStart;
+	Check(byOk, "serial data");
+
+	// the read of track t+1 is in progress while track t is decoded
+	memset(&g_flStats, 0, sizeof(g_flStats));
+	memset(&g_smStats, 0, sizeof(g_smStats));
+	nStart = SpiMockGetTime();
+
+	FileSeek(fp, TRACK_OFFSET);
+	FileReadStart(fp, g_byTrack[0], TRACK_LEN);
+
+	for (t = 0; t < TRACKS; ++t)
+	{
+		byOk &= (FileReadComplete(fp) == TRACK_LEN) && CheckTrack(g_byTrack[t & 1], t);
+
+		if ((t + 1) < TRACKS)
+		{
+			FileSeek(fp, TRACK_OFFSET + (t + 1) * TRACK_LEN);
+			FileReadStart(fp, g_byTrack[(t + 1) & 1], TRACK_LEN);
+		}
+
+		DecodeTrack(fp);
+	}
+
+	nOverlap = SpiMockGetTime() - nStart;
+	Check(byOk, "overlapped data");
+	Check(g_flStats.dwAsyncReads > 0, "asynchronous reads");
+	Check(g_smStats.dwDmaPolls > 0, "DMA polled");
+
+	// a service loop polling the read until it ends
+	nStart = SpiMockGetTime();
+
+	for (t = 0; t < TRACKS; ++t)
+	{
+		FileSeek(fp, TRACK_OFFSET + t * TRACK_LEN);
+		FileReadStart(fp, g_byTrack[0], TRACK_LEN);
+
+		while (FileReadPoll(fp))
+		{
+			SpiMockAdvance(1);
+			++dwPolls;
+		}
+
+		byOk &= (FileReadComplete(fp) == TRACK_LEN) && CheckTrack(g_byTrack[0], t);
+	}
+
+	nRead = SpiMockGetTime() - nStart;
+	Check(byOk, "polled data");
+
+	FileClose(fp);
+
+	printf("serial     %6llu us/track\n", (unsigned long long)(nSerial / TRACKS));
+	printf("overlapped %6llu us/track (%llu%% of serial)\n", (unsigned long long)(nOverlap / TRACKS),
+		(unsigned long long)(nOverlap * 100 / nSerial));
+	printf("read only  %6llu us/track, %lu service passes/track while the read ran\n",
+		(unsigned long long)(nRead / TRACKS), (unsigned long)(dwPolls / TRACKS));
+	printf("%lu commands, %lu blocks, %lu asynchronous reads\n", (unsigned long)g_smStats.dwCommands,
+		(unsigned long)g_smStats.dwBlocks, (unsigned long)g_flStats.dwAsyncReads);
+
+	Check(nOverlap < nSerial, "overlapped read faster than serial");
+
+	return (g_nErrors == 0) ? 0 : 1;
+}
@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "fdc.h"
+#include "sim.h"
+#include "image.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// the response of the Read Status request of the host interface (DRVSEL 0x0F,
+// command 1) stays in the transfer buffer with four long image names, the last
+// one held in RAM
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	char szIni[1024];
+	char szName[101];
+	char szResponse[512];
+	int  i, nLen;
+
+	memset(szName, 'N', sizeof(szName)-5);
+	strcpy(szName + sizeof(szName)-5, ".DMK");
+	szIni[0] = 0;
+
+	for (i = 0; i < 3; ++i)
+	{
+		szName[0] = '0' + i;
+		snprintf(szIni + strlen(szIni), sizeof(szIni) - strlen(szIni), "DRIVE%d=%s\r\n", i, szName);
+	}
+
+	// FileOpen() refuses names longer than 61 characters, drive 3 gets one
+	// that can be mounted so that its " (RAM)" suffix lands past the end of the buffer
+	strcpy(szName + 56, ".DMK");
+	snprintf(szIni + strlen(szIni), sizeof(szIni) - strlen(szIni), "DRIVE3=%s\r\nRAM3=YES\r\n", szName);
+
+	Check(SimInit(NULL), "SimInit");
+	Check(ImageMakeDmk(szName, 35, 1, 9, 256, 0x0CC0), "ImageMakeDmk");
+	Check(ImageWriteIni(szIni), "ImageWriteIni");
+
+	SimStartFdc();
+	Check(g_dtDives[3].pbyRamImage != NULL, "RAM image");
+
+	SimDriveSelect(0x0F);
+	SimOut(SIM_REG_STATUS, 1);
+	SimRun(1000);
+
+	Check(g_FDC.nTransferSize <= (int)sizeof(g_FDC.byTransferBuffer), "transfer size");
+
+	// the first byte is 0, the response follows
+	SimIn(SIM_REG_DATA);
+
+	for (nLen = 0; nLen < (int)sizeof(szResponse) - 1; ++nLen)
+	{
+		szResponse[nLen] = SimIn(SIM_REG_DATA);
+
+		if (szResponse[nLen] == 0)
+		{
+			break;
+		}
+	}
+
+	szResponse[nLen] = 0;
+
+	printf("%d bytes: %.40s...\n", nLen, szResponse);
+	Check((nLen > 0) && (nLen <= (int)sizeof(g_FDC.byTransferBuffer) - 2), "response length");
+	Check(strncmp(szResponse, "Pico FDC Version", 16) == 0, "response");
+
+	return (g_nErrors == 0) ? 0 : 1;
+}
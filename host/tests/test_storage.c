@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "Defines.h"
+#include "fdc.h"
+#include "sim.h"
+#include "image.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// storage worker queue ordering: core0 submits track loads, write-backs and calls
+// interleaved, faster than the worker completes them, so the queue wraps and the
+// producer waits for free entries.  Each call checks on the worker that the load
+// and the write-back queued in front of it are complete, and logs its sequence
+// number.  Two waiter threads wait for the last submitted ticket meanwhile and check
+// that all the calls with an earlier ticket have run when it is complete.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#define TRACKS  40
+#define ROUNDS  3000
+#define WAITERS 2
+#define WORDS   64							// DWORDs written to the log file in turn
+
+typedef struct {
+	int        nRound;
+	TrackType* ptdTrack;					// slot loaded in front of the call
+	int        nTrack;
+	DWORD      dwTicket;					// ticket of the call, set by the producer
+} CallType;
+
+static file*          g_fLog;
+static CallType       g_ctCalls[ROUNDS];
+static DWORD          g_dwWriteData[ROUNDS];
+static volatile int   g_nCallsSubmitted;	// calls whose ticket is in g_ctCalls (producer)
+static volatile BYTE  g_byCallDone[ROUNDS];	// set by the worker
+static int            g_nCallLog[ROUNDS];	// call sequence in the order the worker ran them
+static volatile int   g_nCallLogCount;
+static volatile int   g_nOrderErrors;		// checks failed on the worker
+static volatile int   g_nWaitErrors;		// checks failed by the waiter threads
+static volatile BYTE  g_byDone;
+
+//-----------------------------------------------------------------------------
+// creates the log file, called on the worker
+//
+static UINT32 OpenLog(void* pArg)
+{
+	g_fLog = FileOpen("order.bin", FA_READ | FA_WRITE | FA_CREATE_ALWAYS);
+
+	return (g_fLog != NULL);
+}
+
+//-----------------------------------------------------------------------------
+static UINT32 CloseLog(void* pArg)
+{
+	FileClose(g_fLog);
+
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+// called on the worker behind the load and the write-back of its round
+//
+static UINT32 CheckRound(void* pArg)
+{
+	CallType* pct = (CallType*)pArg;
+	DWORD     dwWord = 0xFFFFFFFF;
+	BYTE*     pby;
+	int       nIDAM;
+
+	// the write-back of the round has reached the file
+	FileSeek(g_fLog, (pct->nRound % WORDS) * sizeof(DWORD));
+
+	if ((FileRead(g_fLog, (BYTE*)&dwWord, sizeof(dwWord)) != sizeof(dwWord)) || (dwWord != (DWORD)pct->nRound))
+	{
+		++g_nOrderErrors;
+	}
+
+	// the track of the round has been loaded and decoded
+	nIDAM = pct->ptdTrack->nSectorIDAM[1];
+	pby   = pct->ptdTrack->byTrackData + nIDAM;
+
+	if ((nIDAM < 0) || (pby[1] != pct->nTrack))
+	{
+		++g_nOrderErrors;
+	}
+
+	g_nCallLog[g_nCallLogCount] = pct->nRound;
+	__sync_synchronize();
+	++g_nCallLogCount;
+
+	g_byCallDone[pct->nRound] = TRUE;
+
+	return pct->nRound;
+}
+
+//-----------------------------------------------------------------------------
+// waits for the last submitted ticket, then every call with an earlier ticket must have run
+//
+static void* Waiter(void* pArg)
+{
+	DWORD dwTicket;
+	int   i, nCalls;
+
+	while (!g_byDone)
+	{
+		nCalls = g_nCallsSubmitted;
+		__sync_synchronize();
+
+		dwTicket = StorageLastTicket();
+		StorageWait(dwTicket);
+
+		if (!StorageIsComplete(dwTicket))
+		{
+			++g_nWaitErrors;
+		}
+
+		for (i = 0; i < nCalls; ++i)
+		{
+			if (((INT32)(dwTicket - g_ctCalls[i].dwTicket) >= 0) && !g_byCallDone[i])
+			{
+				++g_nWaitErrors;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	StorageRequestType sr;
+	pthread_t          thWaiters[WAITERS];
+	DWORD              dwFirst, dwLast;
+	int                i, nInOrder = 0;
+
+	Check(SimInit(NULL), "SimInit");
+	Check(ImageMakeDmk("disk.dmk", TRACKS, 1, 18, 256, 0), "ImageMakeDmk");
+	Check(ImageWriteIni("DRIVE0=disk.dmk\r\n"), "ImageWriteIni");
+
+	SimStartFdc();
+	Check(StorageCallFunction(OpenLog, NULL), "log file");
+
+	for (i = 0; i < WAITERS; ++i)
+	{
+		pthread_create(&thWaiters[i], NULL, Waiter, NULL);
+	}
+
+	dwFirst = StorageLastTicket();
+
+	for (i = 0; i < ROUNDS; ++i)
+	{
+		// track load
+		g_ctCalls[i].nRound   = i;
+		g_ctCalls[i].nTrack   = (i * 7) % TRACKS;
+		g_ctCalls[i].ptdTrack = FdcFillTrackSlot(0, 0, g_ctCalls[i].nTrack);
+
+		// write-back
+		g_dwWriteData[i] = i;
+
+		memset(&sr, 0, sizeof(sr));
+		sr.nRequest = srWriteBack;
+		sr.f        = g_fLog;
+		sr.nOffset  = (i % WORDS) * sizeof(DWORD);
+		sr.pbyData  = (BYTE*)&g_dwWriteData[i];
+		sr.nSize    = sizeof(DWORD);
+		StorageSubmit(&sr);
+
+		// call
+		memset(&sr, 0, sizeof(sr));
+		sr.nRequest = srCall;
+		sr.pCall    = CheckRound;
+		sr.pArg     = &g_ctCalls[i];
+		g_ctCalls[i].dwTicket = StorageSubmit(&sr);
+
+		__sync_synchronize();
+		g_nCallsSubmitted = i + 1;
+	}
+
+	dwLast = StorageLastTicket();
+	StorageWaitIdle();
+
+	g_byDone = TRUE;
+
+	for (i = 0; i < WAITERS; ++i)
+	{
+		pthread_join(thWaiters[i], NULL);
+	}
+
+	for (i = 0; i < g_nCallLogCount; ++i)
+	{
+		nInOrder += (g_nCallLog[i] == i);
+	}
+
+	printf("%lu tickets (%d rounds of load, write-back and call) through a queue of %d entries\n",
+		(unsigned long)(dwLast - dwFirst), ROUNDS, STORAGE_QUEUE_SIZE);
+	printf("%d calls run, %d in submission order, %d worker order errors, %d waiter errors\n",
+		g_nCallLogCount, nInOrder, g_nOrderErrors, g_nWaitErrors);
+
+	Check(dwLast - dwFirst == ROUNDS * 3, "tickets");
+	Check(g_nCallLogCount == ROUNDS, "all calls run");
+	Check(nInOrder == ROUNDS, "calls run in submission order");
+	Check(g_nOrderErrors == 0, "load and write-back complete before the call behind them");
+	Check(g_nWaitErrors == 0, "a complete ticket completes the tickets before it");
+
+	StorageCallFunction(CloseLog, NULL);
+	FdcCloseAllFiles();
+
+	return (g_nErrors == 0) ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "fdc.h"
+#include "sim.h"
+#include "image.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// REALISTIC timing: the step rate of a Seek and the rotational delay of a Read
+// Sector are emulated by the FDC timers, and the main loop sleeps (FdcIsIdle())
+// while only timers are pending: head moves, sector arrival and held writes
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#define POLL_TIME		500		// us between two status reads of the Z80
+#define SD_LOAD_TIME	10000	// us, upper bound of the time taken by the track loads of a command
+
+//-----------------------------------------------------------------------------
+// issues a command and returns the time in us until it is no longer busy or (byMask SIM_STATUS_DRQ) requests the first data byte
+//
+static DWORD TimeCommand(BYTE byCommand, BYTE byMask)
+{
+	UINT64 nStart;
+	BYTE   byStatus;
+
+	nStart = TimerGetTime();
+	SimOut(SIM_REG_STATUS, byCommand);
+
+	do
+	{
+		SimRun(POLL_TIME);
+		byStatus = SimIn(SIM_REG_STATUS);
+	}
+	while ((byStatus & SIM_STATUS_BUSY) && !(byStatus & byMask) && ((TimerGetTime() - nStart) < 5000000));
+
+	return (DWORD)(TimerGetTime() - nStart);
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	BYTE  byBuf[256];
+	DWORD dwTime, dwLoops;
+
+	Check(SimInit(NULL), "SimInit");
+	Check(ImageMakeDmk("timing.dmk", 40, 1, 18, 256, 0), "ImageMakeDmk");
+	Check(ImageWriteIni("DRIVE0=timing.dmk\r\nTIMING0=REALISTIC\r\n"), "ImageWriteIni");
+
+	SimStartFdc();
+	SimDriveSelect(0x01 | SIM_DRVSEL_MFM);
+
+	// 20 steps at 6 ms, after the track has been read from the SD-Card (SD_LOAD_TIME)
+	SimOut(SIM_REG_DATA, 20);
+	dwLoops = g_simStats.dwLoops;
+	dwTime  = TimeCommand(0x11, 0);
+
+	printf("seek 20 tracks: %lu us, %lu loop passes\n", (unsigned long)dwTime, (unsigned long)(g_simStats.dwLoops - dwLoops));
+	Check((dwTime >= 120000) && (dwTime < 120000 + SD_LOAD_TIME + 2 * POLL_TIME), "step time");
+	Check((g_simStats.dwLoops - dwLoops) < (dwTime / 100), "sleeps while the head moves");
+
+	// a sector read waits for the sector to reach the head (at most one revolution)
+	SimOut(SIM_REG_TRACK, 20);
+	SimOut(SIM_REG_SECTOR, 9);
+	dwLoops = g_simStats.dwLoops;
+	dwTime  = TimeCommand(0x80, SIM_STATUS_DRQ);
+
+	printf("read sector: %lu us, %lu loop passes\n", (unsigned long)dwTime, (unsigned long)(g_simStats.dwLoops - dwLoops));
+	Check(dwTime <= g_dwRotationTime + SD_LOAD_TIME + 2 * POLL_TIME, "rotational delay");
+	Check((g_simStats.dwLoops - dwLoops) < (dwTime / 100), "sleeps until the sector arrives");
+
+	SimReadData(byBuf, sizeof(byBuf), 2000000);
+	Check(ImageCheckSector(byBuf, sizeof(byBuf), 20, 0, 9), "read data");
+
+	SimReadSector(20, 10, byBuf, sizeof(byBuf));
+	Check(ImageCheckSector(byBuf, sizeof(byBuf), 20, 0, 10), "read data");
+
+	// a held write is written back WRITEBACK_IDLE_TIME after the last command
+	memset(byBuf, 0x33, sizeof(byBuf));
+	SimWriteSector(20, 11, byBuf, sizeof(byBuf));
+
+	dwLoops = g_simStats.dwLoops;
+	dwTime  = g_hdStats.dwWrites;
+	SimRun(WRITEBACK_IDLE_TIME + 10000);
+
+	printf("write-back: %lu SD writes, %lu loop passes\n", (unsigned long)(g_hdStats.dwWrites - dwTime), (unsigned long)(g_simStats.dwLoops - dwLoops));
+	Check(g_hdStats.dwWrites != dwTime, "write-back");
+	Check((g_simStats.dwLoops - dwLoops) < 100, "sleeps until the write-back");
+
+	return (g_nErrors == 0) ? 0 : 1;
+}
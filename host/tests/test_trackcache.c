@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "fdc.h"
+#include "sim.h"
+#include "image.h"
+#include "timers.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// hit rate of the track cache: a sector by sector copy of a disk from drive 0 to
+// drive 1, which goes to the directory track of drive 1 after each track, with a
+// single slot (the one track buffer the FDC had before the cache) and with all
+// the slots.  The copy writes the complement of each sector, so the target shows
+// the writes.  The cache serves the drive changes of the copy from its slots and
+// reads fewer bytes from the SD-Card.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#define TRACKS    20
+#define SECTORS   18
+#define DIR_TRACK 17
+
+typedef struct {
+	DWORD  dwHits;
+	DWORD  dwMisses;
+	DWORD  dwReadBytes;
+	UINT64 nTime;
+} CopyStatsType;
+
+//-----------------------------------------------------------------------------
+// copies the disk in drive 0 to drive 1 with nSlots slots in the track cache
+// (0 for all of them)
+//
+static void Copy(char* pszWhat, int nSlots, CopyStatsType* pcs)
+{
+	BYTE   byBuf[256];
+	UINT64 nStart;
+	BYTE   byTrack, bySector;
+	int    i;
+
+	SimStartFdc();
+
+	if (nSlots != 0)
+	{
+		TrackCacheReserve((TRACK_CACHE_SLOTS - nSlots) * sizeof(TrackType));
+	}
+
+	memset(&g_tcsStats, 0, sizeof(g_tcsStats));
+	memset(&g_hdStats, 0, sizeof(g_hdStats));
+	nStart = TimerGetTime();
+
+	for (byTrack = 0; byTrack < TRACKS; ++byTrack)
+	{
+		for (bySector = 1; bySector <= SECTORS; ++bySector)
+		{
+			SimDriveSelect(0x01 | SIM_DRVSEL_MFM);
+			SimSeek(byTrack);
+			Check(SimReadSector(byTrack, bySector, byBuf, sizeof(byBuf)) == 0, "read status");
+			Check(ImageCheckSector(byBuf, sizeof(byBuf), byTrack, 0, bySector), "read data");
+
+			for (i = 0; i < (int)sizeof(byBuf); ++i)
+			{
+				byBuf[i] ^= 0xFF;
+			}
+
+			SimDriveSelect(0x02 | SIM_DRVSEL_MFM);
+			SimSeek(byTrack);
+			Check(SimWriteSector(byTrack, bySector, byBuf, sizeof(byBuf)) == 0, "write status");
+		}
+
+		// the directory of the target disk
+		SimSeek(DIR_TRACK);
+		Check(SimReadSector(DIR_TRACK, 1, byBuf, sizeof(byBuf)) == 0, "directory read status");
+	}
+
+	FdcCloseAllFiles();
+
+	pcs->dwHits      = g_tcsStats.dwHits;
+	pcs->dwMisses    = g_tcsStats.dwMisses;
+	pcs->dwReadBytes = g_hdStats.dwReadSectors * 512;
+	pcs->nTime       = TimerGetTime() - nStart;
+
+	printf("%-10s %5lu hits, %5lu misses (%4.1f%% hits), %8lu bytes read from the SD-Card, %7.1f ms\n", pszWhat,
+		(unsigned long)pcs->dwHits, (unsigned long)pcs->dwMisses,
+		(pcs->dwHits + pcs->dwMisses) ? pcs->dwHits * 100.0 / (pcs->dwHits + pcs->dwMisses) : 0.0,
+		(unsigned long)pcs->dwReadBytes, pcs->nTime / 1000.0);
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	CopyStatsType csSingle, csCache;
+	BYTE          byBuf[256];
+	BYTE          byTrack, bySector;
+	int           i;
+
+	Check(SimInit(NULL), "SimInit");
+	Check(ImageMakeDmk("source.dmk", 40, 1, SECTORS, 256, 0), "ImageMakeDmk");
+	Check(ImageMakeDmk("target.dmk", 40, 1, SECTORS, 256, 0), "ImageMakeDmk");
+	Check(ImageWriteIni("DRIVE0=source.dmk\r\nDRIVE1=target.dmk\r\n"), "ImageWriteIni");
+
+	printf("%d track cache slots\n", (int)TRACK_CACHE_SLOTS);
+
+	Copy("1 slot", 1, &csSingle);
+	Copy("all slots", 0, &csCache);
+
+	Check(csCache.dwMisses < csSingle.dwMisses, "fewer misses");
+	Check(csCache.dwReadBytes < csSingle.dwReadBytes, "fewer bytes read from the SD-Card");
+	Check(csCache.nTime < csSingle.nTime, "faster copy");
+
+	// the copy reached the target
+	SimStartFdc();
+	SimDriveSelect(0x02 | SIM_DRVSEL_MFM);
+
+	for (byTrack = 0; byTrack < TRACKS; byTrack += 7)
+	{
+		SimSeek(byTrack);
+
+		for (bySector = 1; bySector <= SECTORS; bySector += 5)
+		{
+			Check(SimReadSector(byTrack, bySector, byBuf, sizeof(byBuf)) == 0, "target read status");
+
+			for (i = 0; i < (int)sizeof(byBuf); ++i)
+			{
+				byBuf[i] ^= 0xFF;
+			}
+
+			Check(ImageCheckSector(byBuf, sizeof(byBuf), byTrack, 0, bySector), "target data");
+		}
+	}
+
+	return (g_nErrors == 0) ? 0 : 1;
+}
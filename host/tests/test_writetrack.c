@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "fdc.h"
+#include "sim.h"
+#include "image.h"
+#include "timers.h"
+#include "crc.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// Write Track (format) through fdc_isr(): the Z80 writes the format stream of a
+// TRS-80 format utility (10 sectors of 512 bytes, 2:1 interleave, filled with 0xE5)
+// over tracks of an 18 x 256 DMK image.  fdc_isr() stores the bytes and keeps DRQ
+// set, so every status read finds DRQ.  The formatted tracks in the image have an
+// IDAM table of the new sectors, valid ID and data CRCs, and read back through the
+// FDC.  Reports the format time per track.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+#define TRACKS       40
+#define TRACK_LEN    0x1900
+#define IDAM_TABLE   0x80
+#define SECTORS      10
+#define SECTOR_SIZE  512
+#define SIZE_CODE    2
+#define INTERLEAVE   2
+#define FILL_BYTE    0xE5
+#define FORMAT_FROM  3
+#define FORMAT_TO    8
+
+static BYTE g_byStream[TRACK_LEN];
+static BYTE g_byTrack[TRACK_LEN];
+static BYTE g_bySectorOrder[SECTORS];
+
+//-----------------------------------------------------------------------------
+static BYTE* Fill(BYTE* pby, BYTE byValue, int nCount)
+{
+	memset(pby, byValue, nCount);
+	return pby + nCount;
+}
+
+//-----------------------------------------------------------------------------
+// physical order of the sector numbers
+//
+static void BuildSectorOrder(void)
+{
+	int i, nPos;
+
+	memset(g_bySectorOrder, 0, sizeof(g_bySectorOrder));
+
+	for (i = 0, nPos = 0; i < SECTORS; ++i)
+	{
+		while (g_bySectorOrder[nPos] != 0)
+		{
+			nPos = (nPos + 1) % SECTORS;
+		}
+
+		g_bySectorOrder[nPos] = i + 1;
+		nPos = (nPos + INTERLEAVE) % SECTORS;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// the Write Track stream of an MFM track (0xF5 writes 0xA1, 0xF7 the two CRC bytes),
+// returns its length
+//
+static int BuildStream(BYTE byTrack)
+{
+	BYTE* p = g_byStream;
+	int   i;
+
+	p = Fill(p, 0x4E, 32);
+
+	for (i = 0; i < SECTORS; ++i)
+	{
+		p = Fill(p, 0x00, 12);
+		p = Fill(p, 0xF5, 3);
+		*p++ = 0xFE;
+		*p++ = byTrack;
+		*p++ = 0;
+		*p++ = g_bySectorOrder[i];
+		*p++ = SIZE_CODE;
+		*p++ = 0xF7;
+		p = Fill(p, 0x4E, 22);
+		p = Fill(p, 0x00, 12);
+		p = Fill(p, 0xF5, 3);
+		*p++ = 0xFB;
+		p = Fill(p, FILL_BYTE, SECTOR_SIZE);
+		*p++ = 0xF7;
+		p = Fill(p, 0x4E, 24);
+	}
+
+	return (int)(p - g_byStream);
+}
+
+//-----------------------------------------------------------------------------
+// returns TRUE if the CRC that follows the nSize bytes at pby (from the first 0xA1)
+// is valid
+//
+static BYTE CrcOk(BYTE* pby, int nSize)
+{
+	WORD wCRC = Calculate_CRC_CCITT(pby, nSize);
+
+	return (pby[nSize] == (wCRC >> 8)) && (pby[nSize + 1] == (wCRC & 0xFF));
+}
+
+//-----------------------------------------------------------------------------
+// checks the IDAM table, the ID fields and the data fields of a formatted track of the image
+//
+static BYTE CheckImageTrack(BYTE byTrack)
+{
+	BYTE* pby;
+	WORD  wIDAM;
+	int   i, j, nOffset;
+	BYTE  byOk = TRUE;
+
+	byOk &= ImageReadFile("disk.dmk", DMK_HEADER_SIZE + byTrack * TRACK_LEN, g_byTrack, TRACK_LEN);
+
+	for (i = 0; i < IDAM_TABLE / 2; ++i)
+	{
+		wIDAM   = g_byTrack[i * 2] + (g_byTrack[i * 2 + 1] << 8);
+		nOffset = wIDAM & 0x3FFF;
+
+		if (i >= SECTORS)
+		{
+			byOk &= (wIDAM == 0);
+			continue;
+		}
+
+		// double density, pointing at the 0xFE of the ID field
+		byOk &= ((wIDAM & 0x8000) != 0);
+		byOk &= (nOffset > IDAM_TABLE) && (nOffset < TRACK_LEN - 7);
+
+		pby   = g_byTrack + nOffset;
+		byOk &= (pby[0] == 0xFE) && (pby[1] == byTrack) && (pby[3] == g_bySectorOrder[i]) && (pby[4] == SIZE_CODE);
+		byOk &= CrcOk(pby - 3, 8);
+
+		// the data field follows the ID field
+		for (j = 7; (j < 64) && !((pby[j] == 0xA1) && (pby[j + 1] == 0xA1) && (pby[j + 2] == 0xA1) && (pby[j + 3] == 0xFB)); ++j)
+		{
+		}
+
+		byOk &= (j < 64);
+		byOk &= (j < 64) && CrcOk(pby + j, 4 + SECTOR_SIZE);
+	}
+
+	return byOk;
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	BYTE   bySector[SECTOR_SIZE];
+	BYTE   byExpected[SECTOR_SIZE];
+	UINT64 nStart, nTime = 0;
+	DWORD  dwPolls;
+	BYTE   byTrack, byStatus;
+	int    i, nStream, nFormats = 0;
+
+	Check(SimInit(NULL), "SimInit");
+	Check(ImageMakeDmk("disk.dmk", TRACKS, 1, 18, 256, TRACK_LEN), "ImageMakeDmk");
+	Check(ImageWriteIni("DRIVE0=disk.dmk\r\n"), "ImageWriteIni");
+
+	BuildSectorOrder();
+
+	SimStartFdc();
+	SimDriveSelect(0x01 | SIM_DRVSEL_MFM);
+
+	memset(&g_fsStats, 0, sizeof(g_fsStats));
+	dwPolls = g_simStats.dwCycles;
+
+	for (byTrack = FORMAT_FROM; byTrack <= FORMAT_TO; ++byTrack)
+	{
+		SimSeek(byTrack);
+		nStream = BuildStream(byTrack);
+
+		nStart   = TimerGetTime();
+		byStatus = SimWriteTrack(g_byStream, nStream);
+		nTime   += TimerGetTime() - nStart;
+		++nFormats;
+
+		Check((byStatus & (SIM_STATUS_BUSY | 0x40 | 0x04)) == 0, "Write Track status");
+	}
+
+	dwPolls = g_simStats.dwCycles - dwPolls;
+
+	// the write-back of the storage worker
+	SimRun(WRITEBACK_MAX_DIRTY_AGE * 2);
+
+	printf("%d tracks formatted, %.1f ms a track (%.1f ms from the first DRQ to the track write), %.2f bus cycles a byte\n",
+		nFormats, nTime / 1000.0 / nFormats, g_fsStats.nTrackWriteTime / 1000.0 / nFormats,
+		(double)dwPolls / (nFormats * TRACK_LEN));
+
+	Check(g_fsStats.dwTrackWrites == (DWORD)nFormats, "track writes counted");
+
+	// the new sectors read back, the tracks next to them keep the old format
+	memset(byExpected, FILL_BYTE, sizeof(byExpected));
+
+	for (byTrack = FORMAT_FROM; byTrack <= FORMAT_TO; ++byTrack)
+	{
+		SimSeek(byTrack);
+
+		for (i = 1; i <= SECTORS; ++i)
+		{
+			memset(bySector, 0, sizeof(bySector));
+			Check(SimReadSector(byTrack, i, bySector, sizeof(bySector)) == 0, "formatted sector read status");
+			Check(memcmp(bySector, byExpected, sizeof(bySector)) == 0, "formatted sector data");
+		}
+
+		Check((SimReadSector(byTrack, SECTORS + 1, bySector, sizeof(bySector)) & SIM_STATUS_RNF) != 0, "no sector past the new format");
+	}
+
+	SimSeek(FORMAT_TO + 1);
+	Check(SimReadSector(FORMAT_TO + 1, 18, bySector, 256) == 0, "next track read status");
+	Check(ImageCheckSector(bySector, 256, FORMAT_TO + 1, 0, 18), "next track data");
+
+	// the image, once the FDC has closed it
+	FdcCloseAllFiles();
+
+	for (byTrack = FORMAT_FROM; byTrack <= FORMAT_TO; ++byTrack)
+	{
+		Check(CheckImageTrack(byTrack), "IDAM table and CRCs of the formatted track");
+	}
+
+	return (g_nErrors == 0) ? 0 : 1;
+}
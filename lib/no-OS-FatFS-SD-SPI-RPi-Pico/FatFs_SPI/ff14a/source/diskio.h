@@ -32,6 +32,11 @@ DRESULT disk_read (BYTE pdrv, BYTE* buff, LBA_t sector, UINT count);
 DRESULT disk_write (BYTE pdrv, const BYTE* buff, LBA_t sector, UINT count);
 DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff);
 
+/* Asynchronous read (glue.c), not used by FatFs */
+DRESULT disk_read_start (BYTE pdrv, BYTE* buff, LBA_t sector, UINT count);
+int disk_read_busy (BYTE pdrv);
+DRESULT disk_read_finish (BYTE pdrv);
+
 
 /* Disk Status Bits (DSTATUS) */
 
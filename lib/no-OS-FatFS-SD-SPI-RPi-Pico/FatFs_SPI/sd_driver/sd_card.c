@@ -728,6 +728,18 @@ static uint64_t sd_sectors_nolock(sd_card_t *pSD) {
     };
     return blocks;
 }
+static int sd_cid_nolock(sd_card_t *pSD) {
+    // CMD10, Response R2 (R1 byte + 16-byte block read)
+    if (sd_cmd(pSD, CMD10_SEND_CID, 0x0, false, 0) != 0x0) {
+        DBG_PRINTF("Didn't get a response from the disk\r\n");
+        return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+    }
+    if (sd_read_bytes(pSD, pSD->cid, sizeof(pSD->cid)) != 0) {
+        DBG_PRINTF("Couldn't read cid response from disk\r\n");
+        return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+    }
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
 uint64_t sd_sectors(sd_card_t *pSD) {
     sd_acquire(pSD);
     uint64_t sectors = sd_sectors_nolock(pSD);
@@ -874,6 +886,137 @@ int sd_read_blocks(sd_card_t *pSD, uint8_t *buffer, uint64_t ulSectorNumber,
     return status;
 }
 
+/* Asynchronous multiple block read.
+   sd_read_blocks_start() sends the read command and returns.  Each block is
+   received by DMA while the caller is free to do other work; the caller calls
+   sd_read_blocks_poll() from time to time, which takes the CRC of a finished
+   block and starts the DMA of the next one as soon as its start token has
+   arrived.  sd_read_blocks_complete() waits for the end of the read.
+   The card stays selected (and its mutex held) until the read has ended, so
+   nothing else may use the card (or its SPI) in the meantime. */
+
+static int sd_read_blocks_stop(sd_card_t *pSD, int rd_status) {
+    int status = SD_BLOCK_DEVICE_ERROR_NONE;
+
+    // Send CMD12(0x00000000) to stop the transmission for multi-block transfer
+    if (pSD->rd_count > 1) {
+        status = sd_cmd(pSD, CMD12_STOP_TRANSMISSION, 0x0, false, 0);
+    }
+    sd_release(pSD);
+    pSD->rd_busy = false;
+    pSD->rd_status = rd_status ? rd_status : status;
+    return pSD->rd_status;
+}
+
+// Returns SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK while the read is in progress,
+// otherwise the result of the read
+int sd_read_blocks_poll(sd_card_t *pSD) {
+    uint16_t crc;
+
+    if (!pSD->rd_busy) return pSD->rd_status;
+
+    while (pSD->rd_blocks) {
+        if (!pSD->rd_dma) {
+            // waiting for the start byte (0xFE) of the next block
+            if (SPI_START_BLOCK != sd_spi_write(pSD, SPI_FILL_CHAR)) {
+                if (0 < absolute_time_diff_us(get_absolute_time(),
+                                              pSD->rd_timeout)) {
+                    return SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK;
+                }
+                DBG_PRINTF("%s:%d Read timeout\r\n", __FILE__, __LINE__);
+                return sd_read_blocks_stop(pSD,
+                                           SD_BLOCK_DEVICE_ERROR_NO_RESPONSE);
+            }
+            spi_transfer_start(pSD->spi, NULL, pSD->rd_buffer, _block_size);
+            pSD->rd_dma = true;
+        }
+        if (spi_transfer_busy(pSD->spi)) {
+            return SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK;
+        }
+        pSD->rd_dma = false;
+        if (!spi_transfer_wait(pSD->spi)) {
+            return sd_read_blocks_stop(pSD, SD_BLOCK_DEVICE_ERROR_NO_RESPONSE);
+        }
+        // Read the CRC16 checksum for the data block
+        crc = (sd_spi_write(pSD, SPI_FILL_CHAR) << 8);
+        crc |= sd_spi_write(pSD, SPI_FILL_CHAR);
+
+#if SD_CRC_ENABLED
+        if (crc_on) {
+            uint32_t crc_result;
+            // Compute and verify checksum
+            crc_result = crc16((void *)pSD->rd_buffer, _block_size);
+            if ((uint16_t)crc_result != crc) {
+                DBG_PRINTF("%s: Invalid CRC received 0x%" PRIx16
+                           " result of computation 0x%" PRIx16 "\r\n",
+                           __FUNCTION__, crc, (uint16_t)crc_result);
+                return sd_read_blocks_stop(pSD, SD_BLOCK_DEVICE_ERROR_CRC);
+            }
+        }
+#endif
+        pSD->rd_buffer += _block_size;
+        --pSD->rd_blocks;
+        pSD->rd_timeout = make_timeout_time_ms(SD_COMMAND_TIMEOUT);
+    }
+    return sd_read_blocks_stop(pSD, SD_BLOCK_DEVICE_ERROR_NONE);
+}
+
+int sd_read_blocks_start(sd_card_t *pSD, uint8_t *buffer,
+                         uint64_t ulSectorNumber, uint32_t ulSectorCount) {
+    sd_acquire(pSD);
+    TRACE_PRINTF("sd_read_blocks_start(0x%p, 0x%llx, 0x%lx)\r\n", buffer,
+                 ulSectorNumber, ulSectorCount);
+
+    pSD->rd_busy = false;
+    pSD->rd_status = SD_BLOCK_DEVICE_ERROR_PARAMETER;
+
+    if ((ulSectorNumber + ulSectorCount > pSD->sectors) ||
+        (pSD->m_Status & (STA_NOINIT | STA_NODISK)) || (0 == ulSectorCount)) {
+        sd_release(pSD);
+        return pSD->rd_status;
+    }
+    uint64_t addr;
+    // SDSC Card (CCS=0) uses byte unit address
+    // SDHC and SDXC Cards (CCS=1) use block unit address (512 Bytes unit)
+    if (SDCARD_V2HC == pSD->card_type) {
+        addr = ulSectorNumber;
+    } else {
+        addr = ulSectorNumber * _block_size;
+    }
+    // Write command ro receive data
+    int status;
+    if (ulSectorCount > 1) {
+        status = sd_cmd(pSD, CMD18_READ_MULTIPLE_BLOCK, addr, false, 0);
+    } else {
+        status = sd_cmd(pSD, CMD17_READ_SINGLE_BLOCK, addr, false, 0);
+    }
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+        sd_release(pSD);
+        pSD->rd_status = status;
+        return status;
+    }
+    pSD->rd_buffer = buffer;
+    pSD->rd_blocks = ulSectorCount;
+    pSD->rd_count = ulSectorCount;
+    pSD->rd_dma = false;
+    pSD->rd_timeout = make_timeout_time_ms(SD_COMMAND_TIMEOUT);
+    pSD->rd_busy = true;
+
+    status = sd_read_blocks_poll(pSD);
+    return (SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK == status)
+               ? SD_BLOCK_DEVICE_ERROR_NONE
+               : status;
+}
+
+int sd_read_blocks_complete(sd_card_t *pSD) {
+    int status;
+    while (SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK ==
+           (status = sd_read_blocks_poll(pSD))) {
+        tight_loop_contents();
+    }
+    return status;
+}
+
 static uint8_t sd_write_block(sd_card_t *pSD, const uint8_t *buffer,
                               uint8_t token, uint32_t length) {
     uint16_t crc = (~0);
@@ -1143,6 +1286,11 @@ int sd_init_card(sd_card_t *pSD) {
         sd_unlock(pSD);
         return pSD->m_Status;
     }
+    // The CID is only used to identify the card (e.g. to remember its
+    // clock rate), a card that doesn't return it can still be used
+    if (sd_cid_nolock(pSD) != SD_BLOCK_DEVICE_ERROR_NONE) {
+        memset(pSD->cid, 0, sizeof(pSD->cid));
+    }
     // Set block length to 512 (CMD16)
     if (sd_cmd(pSD, CMD16_SET_BLOCKLEN, _block_size, false, 0) != 0) {
         DBG_PRINTF("Set %" PRIu32 "-byte block timed out\r\n", _block_size);
@@ -44,9 +44,18 @@ typedef struct {
     int m_Status;                                    // Card status
     uint64_t sectors;                                // Assigned dynamically
     int card_type;                                   // Assigned dynamically
+    uint8_t cid[16];                                 // Assigned dynamically
     mutex_t mutex;
     FATFS fatfs;
     bool mounted;
+    // State of the asynchronous read (sd_read_blocks_start()):
+    uint8_t *rd_buffer;              // Buffer for the next block
+    uint32_t rd_blocks;              // Blocks not received yet
+    uint32_t rd_count;               // Blocks requested
+    absolute_time_t rd_timeout;      // For the start token of the next block
+    bool rd_dma;                     // DMA of a block in progress
+    bool rd_busy;                    // Read in progress
+    int rd_status;                   // Result of the last read
 } sd_card_t;
 
 #define SD_BLOCK_DEVICE_ERROR_NONE 0
@@ -80,6 +89,10 @@ int sd_write_blocks(sd_card_t *pSD, const uint8_t *buffer,
                     uint64_t ulSectorNumber, uint32_t blockCnt);
 int sd_read_blocks(sd_card_t *pSD, uint8_t *buffer, uint64_t ulSectorNumber,
                    uint32_t ulSectorCount);
+int sd_read_blocks_start(sd_card_t *pSD, uint8_t *buffer,
+                         uint64_t ulSectorNumber, uint32_t ulSectorCount);
+int sd_read_blocks_poll(sd_card_t *pSD);
+int sd_read_blocks_complete(sd_card_t *pSD);
 bool sd_card_detect(sd_card_t *pSD);
 uint64_t sd_sectors(sd_card_t *pSD);
 
@@ -31,6 +31,14 @@ void sd_spi_go_high_frequency(sd_card_t *pSD) {
     uint actual = spi_set_baudrate(pSD->spi->hw_inst, pSD->spi->baud_rate);
     TRACE_PRINTF("%s: Actual frequency: %lu\n", __FUNCTION__, (long)actual);
 }
+// Sets SCK for data transfer to baud (or the next rate below it that the
+// SPI can make) and returns the actual frequency. Used to try rates above
+// spi->baud_rate once the card is up; sd_spi_go_high_frequency() goes back.
+uint sd_spi_set_frequency(sd_card_t *pSD, uint baud) {
+    uint actual = spi_set_baudrate(pSD->spi->hw_inst, baud);
+    TRACE_PRINTF("%s: Actual frequency: %lu\n", __FUNCTION__, (long)actual);
+    return actual;
+}
 void sd_spi_go_low_frequency(sd_card_t *pSD) {
     uint actual = spi_set_baudrate(pSD->spi->hw_inst, 100 * 1000);
     TRACE_PRINTF("%s: Actual frequency: %lu\n", __FUNCTION__, (long)actual);
@@ -26,6 +26,7 @@ void sd_spi_acquire(sd_card_t *pSD);
 void sd_spi_release(sd_card_t *pSD);
 void sd_spi_go_low_frequency(sd_card_t *this);
 void sd_spi_go_high_frequency(sd_card_t *this);
+uint sd_spi_set_frequency(sd_card_t *this, uint baud);
 bool sd_spi_init(sd_card_t *this);
 
 /* 
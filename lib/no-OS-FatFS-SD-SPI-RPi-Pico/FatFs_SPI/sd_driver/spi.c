@@ -46,12 +46,11 @@ void set_spi_dma_irq_channel(bool useChannel1, bool shared) {
     irqShared = shared;
 }
 
-// SPI Transfer: Read & Write (simultaneously) on SPI bus
-//   If the data that will be received is not important, pass NULL as rx.
-//   If the data that will be transmitted is not important,
-//     pass NULL as tx and then the SPI_FILL_CHAR is sent out as each data
-//     element.
-bool spi_transfer(spi_t *pSPI, const uint8_t *tx, uint8_t *rx, size_t length) {
+// Starts an SPI transfer and returns without waiting for the DMA to finish.
+//   The buffers must remain valid until spi_transfer_wait() has returned.
+//   tx and rx may be NULL, as for spi_transfer().
+void spi_transfer_start(spi_t *pSPI, const uint8_t *tx, uint8_t *rx,
+                        size_t length) {
     // myASSERT(512 == length || 1 == length);
     myASSERT(tx || rx);
     // myASSERT(!(tx && rx));
@@ -92,7 +91,17 @@ bool spi_transfer(spi_t *pSPI, const uint8_t *tx, uint8_t *rx, size_t length) {
     // start them exactly simultaneously to avoid races (in extreme cases
     // the FIFO could overflow)
     dma_start_channel_mask((1u << pSPI->tx_dma) | (1u << pSPI->rx_dma));
+}
+
+// True while the DMA started by spi_transfer_start() is still running.
+// Does not block, so the caller can do other work until the transfer is done.
+bool spi_transfer_busy(spi_t *pSPI) {
+    return dma_channel_is_busy(pSPI->tx_dma) ||
+           dma_channel_is_busy(pSPI->rx_dma);
+}
 
+// Waits for the end of the transfer started by spi_transfer_start()
+bool spi_transfer_wait(spi_t *pSPI) {
     /* Timeout 1 sec */
     uint32_t timeOut = 1000;
     /* Wait until master completes transfer or time out has occured. */
@@ -113,6 +122,16 @@ bool spi_transfer(spi_t *pSPI, const uint8_t *tx, uint8_t *rx, size_t length) {
     return true;
 }
 
+// SPI Transfer: Read & Write (simultaneously) on SPI bus
+//   If the data that will be received is not important, pass NULL as rx.
+//   If the data that will be transmitted is not important,
+//     pass NULL as tx and then the SPI_FILL_CHAR is sent out as each data
+//     element.
+bool spi_transfer(spi_t *pSPI, const uint8_t *tx, uint8_t *rx, size_t length) {
+    spi_transfer_start(pSPI, tx, rx, length);
+    return spi_transfer_wait(pSPI);
+}
+
 bool my_spi_init(spi_t *pSPI) {
     auto_init_mutex(my_spi_init_mutex);
     mutex_enter_blocking(&my_spi_init_mutex);
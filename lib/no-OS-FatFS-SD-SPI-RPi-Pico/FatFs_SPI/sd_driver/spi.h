@@ -52,6 +52,10 @@ extern "C" {
 void spi_irq_handler(spi_t *pSPI);
 
 bool spi_transfer(spi_t *pSPI, const uint8_t *tx, uint8_t *rx, size_t length);
+void spi_transfer_start(spi_t *pSPI, const uint8_t *tx, uint8_t *rx,
+                        size_t length);
+bool spi_transfer_busy(spi_t *pSPI);
+bool spi_transfer_wait(spi_t *pSPI);
 bool my_spi_init(spi_t *pSPI);
 void set_spi_dma_irq_channel(bool useChannel1, bool shared);
 
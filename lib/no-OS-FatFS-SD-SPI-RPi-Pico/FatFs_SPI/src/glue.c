@@ -85,6 +85,10 @@ static int sdrc2dresult(int sd_rc) {
 /* Read Sector(s)                                                        */
 /*-----------------------------------------------------------------------*/
 
+/* Sectors read by disk_read(), used by the application to count the FAT */
+/* sectors read while seeking                                            */
+DWORD disk_read_sectors;
+
 DRESULT disk_read(BYTE pdrv,  /* Physical drive nmuber to identify the drive */
                   BYTE *buff, /* Data buffer to store read data */
                   LBA_t sector, /* Start sector in LBA */
@@ -93,10 +97,42 @@ DRESULT disk_read(BYTE pdrv,  /* Physical drive nmuber to identify the drive */
     TRACE_PRINTF(">>> %s\n", __FUNCTION__);
     sd_card_t *p_sd = sd_get_by_num(pdrv);
     if (!p_sd) return RES_PARERR;
+    disk_read_sectors += count;
     int rc = sd_read_blocks(p_sd, buff, sector, count);
     return sdrc2dresult(rc);
 }
 
+/*-----------------------------------------------------------------------*/
+/* Asynchronous Read Sector(s)                                           */
+/*-----------------------------------------------------------------------*/
+/* disk_read_start() returns once the read has been started, the blocks  */
+/* are received by DMA while disk_read_busy() returns non-zero.          */
+/* disk_read_finish() waits for the end of the read and returns its      */
+/* result.  No other disk function may be called in the meantime.        */
+
+DRESULT disk_read_start(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count) {
+    TRACE_PRINTF(">>> %s\n", __FUNCTION__);
+    sd_card_t *p_sd = sd_get_by_num(pdrv);
+    if (!p_sd) return RES_PARERR;
+    disk_read_sectors += count;
+    int rc = sd_read_blocks_start(p_sd, buff, sector, count);
+    return sdrc2dresult(rc);
+}
+
+int disk_read_busy(BYTE pdrv) {
+    sd_card_t *p_sd = sd_get_by_num(pdrv);
+    if (!p_sd) return 0;
+    return SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK == sd_read_blocks_poll(p_sd);
+}
+
+DRESULT disk_read_finish(BYTE pdrv) {
+    TRACE_PRINTF(">>> %s\n", __FUNCTION__);
+    sd_card_t *p_sd = sd_get_by_num(pdrv);
+    if (!p_sd) return RES_PARERR;
+    int rc = sd_read_blocks_complete(p_sd);
+    return sdrc2dresult(rc);
+}
+
 /*-----------------------------------------------------------------------*/
 /* Write Sector(s)                                                       */
 /*-----------------------------------------------------------------------*/
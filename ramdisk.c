@@ -0,0 +1,361 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "fdc.h"
+
+#include "pico/stdlib.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// RAM disk
+//
+// A DMK image mounted on a drive with RAMn=YES in the ini file is read into RAM in
+// full when it is mounted.  The track loads of the drive are then copied from RAM by
+// the storage worker instead of being read from the SD-Card.  Tracks written back
+// from the track cache are copied into RAM and the modified blocks are written to
+// the SD-Card in the background (RamDiskServiceWriteBack()), and when the image is
+// unmounted.
+//
+// The images are held at the end of the track cache RAM (TRACK_CACHE_RAM_BUDGET),
+// packed in the order they were mounted, and the cache slots they cover are taken
+// out of the cache while they are mounted.  An image that would leave fewer than
+// TRACK_CACHE_MIN_SLOTS slots is refused and the drive is read from the SD-Card.
+//
+// pbyRamImage is written on core0 only, the storage worker reads it for track loads
+// and write-backs.  A block is not modified while a write-back that reads it may be
+// in progress (see dwRamIoTicket).
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+DWORD            g_dwRamDiskUsed;		// bytes at the end of the track cache RAM held by images
+RamDiskStatsType g_rdStats;
+
+//-----------------------------------------------------------------------------
+void RamDiskInit(void)
+{
+	g_dwRamDiskUsed = 0;
+	memset(&g_rdStats, 0, sizeof(g_rdStats));
+}
+
+//-----------------------------------------------------------------------------
+// returns the number of bytes available for another image
+//
+DWORD RamDiskFree(void)
+{
+	DWORD dwKeep = TRACK_CACHE_MIN_SLOTS * sizeof(TrackType) + g_dwRamDiskUsed;
+	DWORD dwSize = TRACK_CACHE_RAM_BUDGET;
+
+	if (dwKeep >= dwSize)
+	{
+		return 0;
+	}
+
+	return dwSize - dwKeep;
+}
+
+//-----------------------------------------------------------------------------
+// reads the image of the drive (DriveType*)pArg into its RAM, called on the storage worker
+//
+static UINT32 RamDiskReadImage(void* pArg)
+{
+	DriveType* pdt = (DriveType*)pArg;
+
+	FileSeek(pdt->f, 0);
+
+	return FileRead(pdt->f, pdt->pbyRamImage, pdt->dwRamImageSize);
+}
+
+//-----------------------------------------------------------------------------
+// reads the image of a drive that has just been mounted into RAM, returns FALSE if
+// it does not fit (the drive is then read from the SD-Card).  Called on core0, the
+// image is read by the storage worker.
+//
+BYTE RamDiskMount(int nDrive)
+{
+	DriveType* pdt = &g_dtDives[nDrive];
+	TrackType* ptdTrack;
+	DWORD      dwSize, dwStart;
+	int        nSlots, i;
+
+	dwSize = pdt->f->dwSize;
+
+	if ((dwSize == 0) || (dwSize > RamDiskFree()) || (dwSize > (RAM_DISK_MAX_BLOCKS * RAM_DISK_BLOCK_SIZE)))
+	{
+		++g_rdStats.dwRefused;
+		return FALSE;
+	}
+
+	dwStart = time_us_32();
+
+	// write back the slots that the image is about to cover
+	nSlots = (TRACK_CACHE_RAM_BUDGET - g_dwRamDiskUsed - dwSize) / sizeof(TrackType);
+
+	for (i = nSlots; i < TrackCacheSlotCount(); ++i)
+	{
+		ptdTrack = TrackCacheGetSlot(i);
+
+		if (ptdTrack->nDrive >= 0)
+		{
+			FdcWriteBackTrack(ptdTrack);
+		}
+	}
+
+	StorageWaitIdle();
+
+	g_dwRamDiskUsed += dwSize;
+	TrackCacheReserve(g_dwRamDiskUsed);
+
+	pdt->pbyRamImage    = TrackCacheRamEnd() - g_dwRamDiskUsed;
+	pdt->dwRamImageSize = dwSize;
+	pdt->dwRamDirtyTime = 0;
+	pdt->dwRamIoTicket  = StorageLastTicket();
+	memset(pdt->dwRamDirty, 0, sizeof(pdt->dwRamDirty));
+
+	if (StorageCallFunction(RamDiskReadImage, pdt) != dwSize)
+	{
+		pdt->pbyRamImage = NULL;
+		g_dwRamDiskUsed -= dwSize;
+		TrackCacheReserve(g_dwRamDiskUsed);
+		++g_rdStats.dwRefused;
+		return FALSE;
+	}
+
+	++g_rdStats.dwImages;
+	g_rdStats.dwLoadTime = time_us_32() - dwStart;
+
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// writes the modified blocks of the image of a drive to the SD-Card and frees its
+// RAM.  The images mounted after it are moved up to close the gap.
+//
+void RamDiskRelease(int nDrive)
+{
+	DriveType* pdt = &g_dtDives[nDrive];
+	BYTE*      pbyLow;
+	DWORD      dwSize;
+	int        i;
+
+	if (pdt->pbyRamImage == NULL)
+	{
+		return;
+	}
+
+	RamDiskFlush(nDrive);
+
+	pbyLow = TrackCacheRamEnd() - g_dwRamDiskUsed;
+	dwSize = pdt->dwRamImageSize;
+
+	memmove(pbyLow + dwSize, pbyLow, pdt->pbyRamImage - pbyLow);
+
+	for (i = 0; i < MAX_DRIVES; ++i)
+	{
+		if ((g_dtDives[i].pbyRamImage != NULL) && (g_dtDives[i].pbyRamImage < pdt->pbyRamImage))
+		{
+			g_dtDives[i].pbyRamImage += dwSize;
+		}
+	}
+
+	pdt->pbyRamImage    = NULL;
+	pdt->dwRamImageSize = 0;
+
+	g_dwRamDiskUsed -= dwSize;
+	TrackCacheReserve(g_dwRamDiskUsed);
+}
+
+//-----------------------------------------------------------------------------
+// called by the storage worker to load a track of a drive held in RAM
+//
+void RamDiskReadTrack(int nDrive, int nOffset, BYTE* pby, int nSize)
+{
+	DriveType* pdt = &g_dtDives[nDrive];
+	int        nCopy = 0;
+
+	if (nOffset < pdt->dwRamImageSize)
+	{
+		nCopy = pdt->dwRamImageSize - nOffset;
+
+		if (nCopy > nSize)
+		{
+			nCopy = nSize;
+		}
+
+		memcpy(pby, pdt->pbyRamImage + nOffset, nCopy);
+	}
+
+	memset(pby + nCopy, 0, nSize - nCopy);
+	++g_rdStats.dwTrackReads;
+}
+
+//-----------------------------------------------------------------------------
+// copies nSize bytes at pby to nOffset of the image and marks the blocks modified
+//
+void RamDiskWrite(int nDrive, int nOffset, BYTE* pby, int nSize)
+{
+	DriveType* pdt = &g_dtDives[nDrive];
+	int        nBlock;
+
+	if ((nOffset < 0) || (nOffset >= pdt->dwRamImageSize))
+	{
+		return;
+	}
+
+	if ((nOffset + nSize) > pdt->dwRamImageSize)
+	{
+		nSize = pdt->dwRamImageSize - nOffset;
+	}
+
+	StorageWait(pdt->dwRamIoTicket);	// a write-back may still be reading the image
+
+	memcpy(pdt->pbyRamImage + nOffset, pby, nSize);
+
+	if (RamDiskDirtyBlocks(nDrive) == 0)
+	{
+		pdt->dwRamDirtyTime = time_us_32();
+	}
+
+	for (nBlock = nOffset / RAM_DISK_BLOCK_SIZE; nBlock <= (nOffset + nSize - 1) / RAM_DISK_BLOCK_SIZE; ++nBlock)
+	{
+		pdt->dwRamDirty[nBlock / 32] |= (DWORD)1 << (nBlock % 32);
+	}
+
+	++g_rdStats.dwTrackWrites;
+}
+
+//-----------------------------------------------------------------------------
+// queues a write of the first run of modified blocks of the image (at most
+// RAM_DISK_WRITE_BLOCKS) and marks them clean, returns FALSE if there are none
+//
+static BYTE RamDiskWriteNextRun(int nDrive)
+{
+	DriveType*         pdt = &g_dtDives[nDrive];
+	StorageRequestType sr;
+	int                nBlock, nCount, nBlocks;
+
+	nBlocks = (pdt->dwRamImageSize + RAM_DISK_BLOCK_SIZE - 1) / RAM_DISK_BLOCK_SIZE;
+
+	for (nBlock = 0; nBlock < nBlocks; ++nBlock)
+	{
+		if (pdt->dwRamDirty[nBlock / 32] & ((DWORD)1 << (nBlock % 32)))
+		{
+			break;
+		}
+	}
+
+	if (nBlock >= nBlocks)
+	{
+		return FALSE;
+	}
+
+	nCount = 0;
+
+	while (((nBlock + nCount) < nBlocks) && (nCount < RAM_DISK_WRITE_BLOCKS) && (pdt->dwRamDirty[(nBlock + nCount) / 32] & ((DWORD)1 << ((nBlock + nCount) % 32))))
+	{
+		pdt->dwRamDirty[(nBlock + nCount) / 32] &= ~((DWORD)1 << ((nBlock + nCount) % 32));
+		++nCount;
+	}
+
+	sr.nRequest = srWriteBack;
+	sr.f        = pdt->f;
+	sr.nOffset  = nBlock * RAM_DISK_BLOCK_SIZE;
+	sr.pbyData  = pdt->pbyRamImage + sr.nOffset;
+	sr.nSize    = nCount * RAM_DISK_BLOCK_SIZE;
+
+	if ((sr.nOffset + sr.nSize) > pdt->dwRamImageSize)
+	{
+		sr.nSize = pdt->dwRamImageSize - sr.nOffset;
+	}
+
+	pdt->dwRamIoTicket = StorageSubmit(&sr);
+
+	++g_rdStats.dwWriteBacks;
+	g_rdStats.dwWriteBackBytes += sr.nSize;
+
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// queues a write of one run of modified blocks when the storage worker is idle and
+// the FDC has been idle for WRITEBACK_IDLE_TIME (byIdle) or the oldest modification
+// of the image is older than dwMaxDirtyAge.
+//
+void RamDiskServiceWriteBack(BYTE byIdle, DWORD dwMaxDirtyAge)
+{
+	DriveType* pdt;
+	int        i;
+
+	if (!StorageIsIdle())
+	{
+		return;
+	}
+
+	for (i = 0; i < MAX_DRIVES; ++i)
+	{
+		pdt = &g_dtDives[i];
+
+		if ((pdt->pbyRamImage == NULL) || (RamDiskDirtyBlocks(i) == 0))
+		{
+			continue;
+		}
+
+		if (byIdle || ((time_us_32() - pdt->dwRamDirtyTime) >= dwMaxDirtyAge))
+		{
+			RamDiskWriteNextRun(i);
+			return;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// writes all modified blocks of the image of a drive to the SD-Card and waits for them
+//
+void RamDiskFlush(int nDrive)
+{
+	if (g_dtDives[nDrive].pbyRamImage == NULL)
+	{
+		return;
+	}
+
+	while (RamDiskWriteNextRun(nDrive))
+	{
+	}
+
+	StorageWaitIdle();
+}
+
+//-----------------------------------------------------------------------------
+// returns TRUE if an image holds modifications that have not been written to the SD-Card
+//
+BYTE RamDiskIsDirty(void)
+{
+	int i;
+
+	for (i = 0; i < MAX_DRIVES; ++i)
+	{
+		if ((g_dtDives[i].pbyRamImage != NULL) && (RamDiskDirtyBlocks(i) != 0))
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+//-----------------------------------------------------------------------------
+int RamDiskDirtyBlocks(int nDrive)
+{
+	DWORD dwBits;
+	int   i, nCount = 0;
+
+	for (i = 0; i < (RAM_DISK_MAX_BLOCKS / 32); ++i)
+	{
+		for (dwBits = g_dtDives[nDrive].dwRamDirty[i]; dwBits != 0; dwBits &= dwBits - 1)
+		{
+			++nCount;
+		}
+	}
+
+	return nCount;
+}
@@ -13,6 +13,9 @@
 #include "f_util.h"
 #include "hw_config.h"
 #include "sd_card.h"
+#include "sd_spi.h"
+#include "crc.h"
+#include "hardware/clocks.h"
 
 ////////////////////////////////////////////////////////////////////////////////////
 
@@ -24,10 +27,44 @@ BYTE    sd_byCardInialized;
 BYTE    sd_byPreviousCdState;
 BYTE    sd_byPreviousWpState;
 WORD    sd_wCardInitTries;
-DWORD   g_dwSdCardPresenceCount;
 DWORD   g_dwSdCardMaxPresenceCount;
+DWORD   g_dwSdClockRate;
 
 ////////////////////////////////////////////////////////////////////////////////////
+// SPI clock tuning
+//
+// The SPI rate in hw_config.c is one that any card can manage.  Once a card has
+// been mounted the rates of sd_byClockDivisors (clk_peri / n) are tried from the
+// slowest up, and the fastest one at which the test reads of SdReadTestSectors()
+// return good blocks (the driver checks the CRC of each) with the same contents
+// as at the hw_config.c rate is kept.  The rate is saved in SD_CLOCK_FILE along
+// with the CID of the card, so that the next time the same card is mounted only
+// that rate needs to be verified.
+
+#define SD_CLOCK_FILE   "sdclock.cfg"
+#define SD_TUNE_SECTORS 4						// sectors of the multiple block test read
+#define SD_TUNE_CRCS    (3 + SD_TUNE_SECTORS)	// CRCs of the test sectors (3 single block reads)
+#define SD_TUNE_PASSES  4						// times the test reads are repeated at each rate
+
+static const BYTE sd_byClockDivisors[] = {10, 8, 6, 4};
+
+static BYTE sd_byTuneBuffer[SD_TUNE_SECTORS*512];
+
+////////////////////////////////////////////////////////////////////////////////////
+static sd_card_t *sd_get_card_by_name(const char *name)
+{
+    for (size_t i = 0; i < sd_get_num(); ++i)
+	{
+        if (0 == strcmp(sd_get_by_num(i)->pcName, name))
+		{
+			return sd_get_by_num(i);
+		}
+	}
+
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
 static FATFS *sd_get_fs_by_name(const char *name)
 {
     for (size_t i = 0; i < sd_get_num(); ++i)
@@ -87,7 +124,6 @@ BYTE sd_getfreespace(void)
 {
 	char*   pszDrive = "0:";
     DWORD   fre_clust, fre_sect, tot_sect;
-	UINT64  nSecPerCluster, nFree;
 
     /* Get volume information and free clusters of drive */
     FATFS* pfs = sd_get_fs_by_name(pszDrive);
@@ -123,6 +159,182 @@ BYTE sd_getfreespace(void)
 	return 0;
 }
 
+////////////////////////////////////////////////////////////////////////////////////
+// reads the boot sector, the first FAT sector and the first data sectors of the
+// volume and returns the CRC of each sector in wCrc[SD_TUNE_CRCS]
+static BYTE SdReadTestSectors(sd_card_t* pSD, FATFS* pfs, WORD wCrc[])
+{
+	LBA_t dwSector[3];
+	int   i, n;
+
+	dwSector[0] = pfs->volbase;
+	dwSector[1] = pfs->fatbase;
+	dwSector[2] = pfs->database;
+	n = 0;
+
+	for (i = 0; i < 3; ++i)
+	{
+		if (sd_read_blocks(pSD, sd_byTuneBuffer, dwSector[i], 1) != SD_BLOCK_DEVICE_ERROR_NONE)
+		{
+			return FALSE;
+		}
+
+		wCrc[n++] = Calculate_CRC_CCITT(sd_byTuneBuffer, 512);
+	}
+
+	if (sd_read_blocks(pSD, sd_byTuneBuffer, pfs->database, SD_TUNE_SECTORS) != SD_BLOCK_DEVICE_ERROR_NONE)
+	{
+		return FALSE;
+	}
+
+	for (i = 0; i < SD_TUNE_SECTORS; ++i)
+	{
+		wCrc[n++] = Calculate_CRC_CCITT(sd_byTuneBuffer+i*512, 512);
+	}
+
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// returns TRUE if the test reads at the current SPI rate match wReference every time
+static BYTE SdVerifyClock(sd_card_t* pSD, FATFS* pfs, WORD wReference[])
+{
+	WORD wCrc[SD_TUNE_CRCS];
+	int  i;
+
+	for (i = 0; i < SD_TUNE_PASSES; ++i)
+	{
+		if (!SdReadTestSectors(pSD, pfs, wCrc))
+		{
+			return FALSE;
+		}
+
+		if (memcmp(wCrc, wReference, sizeof(wCrc)) != 0)
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// returns the rate saved in SD_CLOCK_FILE for the card with the CID pszCid, 0 if none
+static DWORD SdReadClockFile(char* pszCid)
+{
+	FIL           fil;
+	char          szLine[64];
+	char          szCid[40];
+	unsigned long nRate;
+
+	if (f_open(&fil, SD_CLOCK_FILE, FA_READ) != FR_OK)
+	{
+		return 0;
+	}
+
+	nRate = 0;
+
+	if (f_gets(szLine, sizeof(szLine), &fil) != NULL)
+	{
+		if ((sscanf(szLine, "%39s %lu", szCid, &nRate) != 2) || (strcmp(szCid, pszCid) != 0))
+		{
+			nRate = 0;
+		}
+	}
+
+	f_close(&fil);
+
+	return (DWORD)nRate;
+}
+
+//-----------------------------------------------------------------------------
+static void SdWriteClockFile(char* pszCid, DWORD dwRate)
+{
+	FIL fil;
+
+	if (f_open(&fil, SD_CLOCK_FILE, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+	{
+		return;
+	}
+
+	f_printf(&fil, "%s %lu\r\n", pszCid, (unsigned long)dwRate);
+	f_close(&fil);
+}
+
+//-----------------------------------------------------------------------------
+// sets g_dwSdClockRate to the fastest SPI rate that the mounted card pSD reads reliably at
+static void SdTuneClock(sd_card_t* pSD)
+{
+	FATFS* pfs = &pSD->fatfs;
+	WORD   wReference[SD_TUNE_CRCS];
+	char   szCid[sizeof(pSD->cid)*2+1];
+	DWORD  dwBaseRate, dwBest, dwRate;
+	int    i;
+
+	dwBaseRate      = sd_spi_set_frequency(pSD, pSD->spi->baud_rate);
+	g_dwSdClockRate = dwBaseRate;
+
+	if (!SdReadTestSectors(pSD, pfs, wReference))
+	{
+		return;
+	}
+
+	for (i = 0; i < sizeof(pSD->cid); ++i)
+	{
+		sprintf(szCid+i*2, "%02x", pSD->cid[i]);
+	}
+
+	dwRate = SdReadClockFile(szCid);
+
+	if ((dwRate != 0) && (dwRate <= dwBaseRate)) // this card is known not to manage a faster rate
+	{
+		return;
+	}
+
+	if (dwRate != 0)
+	{
+		dwRate = sd_spi_set_frequency(pSD, dwRate);
+
+		if (SdVerifyClock(pSD, pfs, wReference))
+		{
+			g_dwSdClockRate = dwRate;
+			return;
+		}
+	}
+
+	dwBest = dwBaseRate;
+
+	for (i = 0; i < sizeof(sd_byClockDivisors); ++i)
+	{
+		dwRate = clock_get_hz(clk_peri) / sd_byClockDivisors[i];
+
+		if (dwRate <= dwBest)
+		{
+			continue;
+		}
+
+		dwRate = sd_spi_set_frequency(pSD, dwRate);
+
+		if (!SdVerifyClock(pSD, pfs, wReference))
+		{
+			break;
+		}
+
+		dwBest = dwRate;
+	}
+
+	g_dwSdClockRate = sd_spi_set_frequency(pSD, dwBest);
+
+	// make sure the card has recovered from any failed reads before relying on it
+	if (!SdVerifyClock(pSD, pfs, wReference))
+	{
+		g_dwSdClockRate = sd_spi_set_frequency(pSD, dwBaseRate);
+		return;
+	}
+
+	SdWriteClockFile(szCid, g_dwSdClockRate);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////
 void IdentifySdCard(void)
 {
@@ -166,6 +378,7 @@ void IdentifySdCard(void)
 
 			if (fr == FR_OK)
 			{
+				SdTuneClock(sd_get_card_by_name(pszDrive));
 				nRet = sd_getfreespace();
 
 				if (nRet == 0)
@@ -198,19 +411,39 @@ void IdentifySdCard(void)
 }
 
 ////////////////////////////////////////////////////////////////////////////////////
+// called by the tmSdPresence timer when the insertion debounce has expired
+static void SdPresenceTimeout(void)
+{
+	PostEvent(EVENT_CARD_DETECT);
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+// called by the main loop for each EVENT_CARD_DETECT
 void TestSdCardInsertion(void)
 {
 	sd_byCurrentCdState = get_cd();		// 0 => card removed; 1 => card inserted;
 	sd_byCurrentWpState = get_wp();		// 0 => not write protected; 1 => write protected;
 
+	if (sd_byCurrentCdState == 0)
+	{
+		TimerStop(tmSdPresence);
+	}
+
 	if (sd_byCurrentCdState != sd_byPreviousCdState)
 	{
 		if (sd_byCurrentCdState != 0)	// card has been inserted
 		{
-			if (g_dwSdCardPresenceCount < g_dwSdCardMaxPresenceCount) // wait for Sd-Card insertion to debounce
+			if (!TimerHasExpired(tmSdPresence)) // wait for Sd-Card insertion to debounce
 			{
+				if (!TimerIsRunning(tmSdPresence))
+				{
+					TimerStart(tmSdPresence, g_dwSdCardMaxPresenceCount);
+				}
+
 				return;
 			}
+
+			TimerStop(tmSdPresence);
 			
 			sd_byCardRemoved  = TRUE;
 			sd_wCardInitTries = 0;
@@ -248,6 +481,8 @@ void SDHC_Init(void)
 	sd_byPreviousWpState       = sd_byCurrentWpState;
 	sd_wCardInitTries          = 0;
 	g_dwSdCardMaxPresenceCount = 10000; //g_dwTimerFrequency / 100;
+
+	TimerSetCallback(tmSdPresence, SdPresenceTimeout);
 	
 	IdentifySdCard();
 }
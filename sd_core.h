@@ -12,8 +12,8 @@ extern "C" {
 /* global variable declarations ==========================================*/
 
 extern BYTE    sd_byCardInialized;
-extern DWORD   g_dwSdCardPresenceCount;
 extern DWORD   g_dwSdCardMaxPresenceCount;
+extern DWORD   g_dwSdClockRate;			// SPI clock of the SD-Card (Hz), see SdTuneClock()
 
 /* function prototypes ==========================================*/
 
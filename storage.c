@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "fdc.h"
+
+#ifdef FDC_HOST_BUILD
+	#include <pthread.h>
+	#include <sched.h>
+
+	#define StorageBarrier()	__sync_synchronize()
+	#define StorageSignal()
+	#define StorageSleep()		sched_yield()
+	#define StoragePause()		sched_yield()
+#else
+	#include "pico/stdlib.h"
+	#include "pico/multicore.h"
+	#include "hardware/sync.h"
+
+	#define StorageBarrier()	__dmb()
+	#define StorageSignal()		__sev()
+	#define StorageSleep()		__wfe()
+	#define StoragePause()		tight_loop_contents()
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// Storage worker
+//
+// All SD-Card (FatFs) access made on behalf of the Z80 while a disk is in use is
+// done by a worker running on core1, so that a slow SD-Card operation does not
+// delay the release of WAIT or the handling of DRQ on core0.
+//
+// core0 is the only producer and core1 the only consumer of the request queue.
+// Each request is identified by a ticket (a sequence number).  The producer only
+// writes g_dwStorageHead and the consumer only writes g_dwStorageTail, so no lock
+// is required.  Requests are completed in the order they were submitted, which
+// means a request is complete once the tail has reached its ticket.
+//
+// FatFs is not reentrant (FF_FS_REENTRANT 0), so the worker is the only caller of
+// the File functions while the FDC runs.  core0 hands the file access it needs
+// (mounting an image, reading the ini file, the host file commands) to the worker
+// with StorageCallFunction(), which is queued behind the pending track loads and
+// write-backs.  A function called this way runs on core1 and must not wait for the
+// worker itself.  The SD-Card driver init and the volume mount on card detection
+// stay on core0: they are made only while the worker is idle (StorageIsIdle()),
+// and they use the timers, which belong to core0.
+//
+// When the request that follows a track load is also a track load, the read of
+// its track is started before the current track is decoded, so the SD-Card
+// transfer (DMA) runs while the worker builds the sector index.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+StorageRequestType g_srStorageQueue[STORAGE_QUEUE_SIZE];
+volatile DWORD     g_dwStorageHead;		// ticket of the last submitted request (written by core0)
+volatile DWORD     g_dwStorageTail;		// ticket of the last completed request (written by core1)
+BYTE               g_byStorageLoadStarted;	// the track of the next request is being read (core1 only)
+
+//-----------------------------------------------------------------------------
+static void StorageLoadTrack(DWORD dwTicket)
+{
+	StorageRequestType* psr = &g_srStorageQueue[dwTicket % STORAGE_QUEUE_SIZE];
+	StorageRequestType* psrNext;
+	TrackType*          ptdLoading = NULL;
+
+	FdcFinishTrackLoad(psr->ptdTrack, g_byStorageLoadStarted);
+	g_byStorageLoadStarted = FALSE;
+
+	// the next request has been submitted, start reading its track before decoding this one
+	if (g_dwStorageHead != dwTicket)
+	{
+		StorageBarrier();	// read the request only after the head that published it
+
+		psrNext = &g_srStorageQueue[(dwTicket + 1) % STORAGE_QUEUE_SIZE];
+
+		if (psrNext->nRequest == srLoadTrack)
+		{
+			g_byStorageLoadStarted = FdcStartTrackLoad(psrNext->ptdTrack);
+
+			if (g_byStorageLoadStarted)
+			{
+				ptdLoading = psrNext->ptdTrack;
+				++g_tcsStats.dwOverlappedLoads;
+			}
+		}
+	}
+
+	FdcDecodeTrack(psr->ptdTrack, ptdLoading);
+	psr->nResult = 0;
+}
+
+//-----------------------------------------------------------------------------
+static void StorageExecute(DWORD dwTicket)
+{
+	StorageRequestType* psr = &g_srStorageQueue[dwTicket % STORAGE_QUEUE_SIZE];
+
+	switch (psr->nRequest)
+	{
+		case srLoadTrack:
+			StorageLoadTrack(dwTicket);
+			break;
+
+		case srWriteBack:
+			FileSeek(psr->f, psr->nOffset);
+			psr->nResult = FileWrite(psr->f, psr->pbyData, psr->nSize);
+			FileFlush(psr->f);
+			++g_fsStats.dwSdWrites;
+			g_fsStats.dwSdWriteBytes += psr->nResult;
+			break;
+
+		case srFileRead:
+			psr->nResult = FileRead(psr->f, psr->pbyData, psr->nSize);
+			break;
+
+		case srWriteBackHfe:
+			psr->nResult = FdcSaveHfeTrack(psr->ptdTrack, psr->nOffset, psr->nOffset + psr->nSize);
+
+			if (psr->nResult > 0)
+			{
+				++g_fsStats.dwSdWrites;
+				g_fsStats.dwSdWriteBytes += psr->nResult;
+			}
+			break;
+
+		case srLoadHfeTrackStream:
+			psr->nResult = FdcLoadHfeTrackStream(psr->ptdTrack);
+			break;
+
+		case srFileWrite:
+			psr->nResult = FileWrite(psr->f, psr->pbyData, psr->nSize);
+			++g_fsStats.dwSdWrites;
+			g_fsStats.dwSdWriteBytes += psr->nResult;
+			break;
+
+		case srCall:
+			psr->nResult = psr->pCall(psr->pArg);
+			break;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// services all queued requests, returns TRUE if at least one was processed
+//
+BYTE StorageServiceQueue(void)
+{
+	DWORD dwTicket;
+	BYTE  byWork = FALSE;
+
+	while (g_dwStorageTail != g_dwStorageHead)
+	{
+		StorageBarrier();	// read the request only after the head that published it
+
+		dwTicket = g_dwStorageTail + 1;
+		StorageExecute(dwTicket);
+
+		StorageBarrier();	// results must be visible before the request is marked complete
+		g_dwStorageTail = dwTicket;
+		StorageSignal();
+
+		byWork = TRUE;
+	}
+
+	return byWork;
+}
+
+//-----------------------------------------------------------------------------
+void StorageWorker(void)
+{
+	while (TRUE)
+	{
+		if (!StorageServiceQueue())
+		{
+			StorageSleep();
+		}
+	}
+}
+
+#ifdef FDC_HOST_BUILD
+//-----------------------------------------------------------------------------
+static void* StorageThread(void* pArg)
+{
+	StorageWorker();
+	return NULL;
+}
+#endif
+
+//-----------------------------------------------------------------------------
+void StorageInit(void)
+{
+	g_dwStorageHead        = 0;
+	g_dwStorageTail        = 0;
+	g_byStorageLoadStarted = FALSE;
+
+#ifdef FDC_HOST_BUILD
+	pthread_t thread;
+
+	pthread_create(&thread, NULL, StorageThread, NULL);
+	pthread_detach(thread);
+#else
+	multicore_launch_core1(StorageWorker);
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// queues a copy of the request for the worker and returns its ticket.
+// waits for a free entry if the queue is full.
+//
+DWORD StorageSubmit(StorageRequestType* psr)
+{
+	DWORD dwTicket = g_dwStorageHead + 1;
+
+	while ((dwTicket - g_dwStorageTail) > STORAGE_QUEUE_SIZE)
+	{
+		StoragePause();
+	}
+
+	StorageBarrier();	// the entry being reused has been completely consumed
+
+	g_srStorageQueue[dwTicket % STORAGE_QUEUE_SIZE] = *psr;
+
+	StorageBarrier();	// the request must be visible before the head that publishes it
+	g_dwStorageHead = dwTicket;
+	StorageSignal();
+
+	return dwTicket;
+}
+
+//-----------------------------------------------------------------------------
+BYTE StorageIsComplete(DWORD dwTicket)
+{
+	return ((INT32)(g_dwStorageTail - dwTicket) >= 0);
+}
+
+//-----------------------------------------------------------------------------
+BYTE StorageIsIdle(void)
+{
+	return (g_dwStorageTail == g_dwStorageHead);
+}
+
+//-----------------------------------------------------------------------------
+void StorageWait(DWORD dwTicket)
+{
+	while (!StorageIsComplete(dwTicket))
+	{
+		StoragePause();
+	}
+
+	StorageBarrier();
+}
+
+//-----------------------------------------------------------------------------
+void StorageWaitIdle(void)
+{
+	StorageWait(g_dwStorageHead);
+}
+
+//-----------------------------------------------------------------------------
+// returns the ticket of the last submitted request
+//
+DWORD StorageLastTicket(void)
+{
+	return g_dwStorageHead;
+}
+
+//-----------------------------------------------------------------------------
+// submits the request and waits for it to complete, returns the request result
+//
+UINT32 StorageCall(StorageRequestType* psr)
+{
+	DWORD dwTicket = StorageSubmit(psr);
+
+	StorageWait(dwTicket);
+
+	return g_srStorageQueue[dwTicket % STORAGE_QUEUE_SIZE].nResult;
+}
+
+//-----------------------------------------------------------------------------
+// calls pCall(pArg) on the worker and waits for it to return, returns its result
+//
+UINT32 StorageCallFunction(UINT32 (*pCall)(void* pArg), void* pArg)
+{
+	StorageRequestType sr;
+
+	sr.nRequest = srCall;
+	sr.pCall    = pCall;
+	sr.pArg     = pArg;
+
+	return StorageCall(&sr);
+}
@@ -11,8 +11,12 @@ typedef unsigned short WORD;
 #endif
 
 #ifndef DWORD
+#ifdef FDC_HOST_BUILD
+typedef uint32_t DWORD;
+#else
 typedef unsigned long DWORD;
 #endif
+#endif
 
 // structures
 //-----------------------------------------------------------------------------
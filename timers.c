@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Defines.h"
+#include "timers.h"
+
+#include "pico/stdlib.h"
+
+#ifdef FDC_HOST_BUILD
+	UINT64 g_nTimerClock;
+
+	#define TimerNow()			g_nTimerClock
+	#define TimerLock()			0
+	#define TimerUnlock(n)		(void)(n)
+	#define TimerArm(n)
+	#define EventSleep()
+#else
+	#include "hardware/sync.h"
+	#include "hardware/timer.h"
+
+	static int g_nTimerAlarm;
+
+	static void TimerArmAlarm(UINT64 nDeadline);
+
+	#define TimerNow()			time_us_64()
+	#define TimerLock()			save_and_disable_interrupts()
+	#define TimerUnlock(n)		restore_interrupts(n)
+	#define TimerArm(n)			TimerArmAlarm(n)
+	#define EventSleep()		__wfe()
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// Timers
+//
+// Each timeout used by the FDC (WAIT timeout, motor on, index pulse, RESET input,
+// process function states and the SD-Card debounce) is a deadline in us.  A timer
+// is started with TimerStart() and either polled with TimerIsRunning() and
+// TimerHasExpired() or given a callback with TimerSetCallback().
+//
+// TimerStart() may be called from fdc_isr().  It only records the deadline and posts
+// EVENT_TIMER.  TimerService() is called by the main loop for each EVENT_TIMER, it
+// marks the timers that have reached their deadline as expired, calls their
+// callbacks and arms a hardware alarm for the next deadline.  The alarm interrupt
+// posts EVENT_TIMER, so nothing is done until a timer is started or a deadline is
+// reached.
+//
+// The interrupt handlers post events with PostEvent(), which also executes SEV.
+// When the FDC has nothing to do the main loop calls EventWait(), which sleeps
+// (WFE) until an interrupt posts an event or the storage worker on core1 signals
+// the completion of a request.
+//
+// For a host build (FDC_HOST_BUILD) the time is a virtual clock that only moves
+// when the simulation calls TimerSetTime() or TimerAdvance().
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+TimerType     g_tmTimers[TIMER_COUNT];
+volatile DWORD g_dwEvents;
+
+#ifndef FDC_HOST_BUILD
+//-----------------------------------------------------------------------------
+static void __not_in_flash_func(TimerAlarmIrq)(uint nAlarm)
+{
+	PostEvent(EVENT_TIMER);
+}
+
+//-----------------------------------------------------------------------------
+static void TimerArmAlarm(UINT64 nDeadline)
+{
+	// returns true if the deadline has already passed
+	if (hardware_alarm_set_target(g_nTimerAlarm, from_us_since_boot(nDeadline)))
+	{
+		PostEvent(EVENT_TIMER);
+	}
+}
+#endif
+
+//-----------------------------------------------------------------------------
+void TimerInit(void)
+{
+	memset(g_tmTimers, 0, sizeof(g_tmTimers));
+	g_dwEvents = 0;
+
+#ifdef FDC_HOST_BUILD
+	g_nTimerClock = 0;
+#else
+	g_nTimerAlarm = hardware_alarm_claim_unused(true);
+	hardware_alarm_set_callback(g_nTimerAlarm, TimerAlarmIrq);
+#endif
+}
+
+//-----------------------------------------------------------------------------
+void TimerSetCallback(int nTimer, TimerCallback pCallback)
+{
+	g_tmTimers[nTimer].pCallback = pCallback;
+}
+
+//-----------------------------------------------------------------------------
+// (re)starts the timer, it expires dwDelay us from now
+//
+void __not_in_flash_func(TimerStart)(int nTimer, DWORD dwDelay)
+{
+	uint32_t nIrq = TimerLock();
+
+	g_tmTimers[nTimer].nDeadline = TimerNow() + dwDelay;
+	g_tmTimers[nTimer].byRunning = 1;
+	g_tmTimers[nTimer].byExpired = 0;
+	PostEvent(EVENT_TIMER);
+
+	TimerUnlock(nIrq);
+}
+
+//-----------------------------------------------------------------------------
+// stops the timer without calling its callback and clears its expired state
+//
+void __not_in_flash_func(TimerStop)(int nTimer)
+{
+	uint32_t nIrq = TimerLock();
+
+	g_tmTimers[nTimer].byRunning = 0;
+	g_tmTimers[nTimer].byExpired = 0;
+
+	TimerUnlock(nIrq);
+}
+
+//-----------------------------------------------------------------------------
+// returns TRUE if the timer has been started and its deadline has not been reached
+//
+BYTE TimerIsRunning(int nTimer)
+{
+	uint32_t nIrq = TimerLock();
+	BYTE     byRunning;
+
+	byRunning = g_tmTimers[nTimer].byRunning && (TimerNow() < g_tmTimers[nTimer].nDeadline);
+
+	TimerUnlock(nIrq);
+
+	return byRunning;
+}
+
+//-----------------------------------------------------------------------------
+// returns TRUE if the deadline has been reached since the timer was last started
+//
+BYTE TimerHasExpired(int nTimer)
+{
+	uint32_t nIrq = TimerLock();
+	BYTE     byExpired;
+
+	byExpired = g_tmTimers[nTimer].byExpired || (g_tmTimers[nTimer].byRunning && (TimerNow() >= g_tmTimers[nTimer].nDeadline));
+
+	TimerUnlock(nIrq);
+
+	return byExpired;
+}
+
+//-----------------------------------------------------------------------------
+UINT64 TimerGetTime(void)
+{
+	return TimerNow();
+}
+
+//-----------------------------------------------------------------------------
+// expires the timers that have reached their deadline and calls their callbacks.
+// Called by the main loop when EventTake() returns EVENT_TIMER.  Callbacks are
+// called with interrupts enabled and may restart any timer.
+//
+void TimerService(void)
+{
+	BYTE     byFire[TIMER_COUNT];
+	UINT64   nNow, nNext;
+	uint32_t nIrq;
+	int      i;
+
+	nIrq  = TimerLock();
+	nNow  = TimerNow();
+	nNext = 0;
+
+	for (i = 0; i < TIMER_COUNT; ++i)
+	{
+		byFire[i] = 0;
+
+		if (!g_tmTimers[i].byRunning)
+		{
+			continue;
+		}
+
+		if (nNow >= g_tmTimers[i].nDeadline)
+		{
+			g_tmTimers[i].byRunning = 0;
+			g_tmTimers[i].byExpired = 1;
+			byFire[i] = 1;
+		}
+		else if ((nNext == 0) || (g_tmTimers[i].nDeadline < nNext))
+		{
+			nNext = g_tmTimers[i].nDeadline;
+		}
+	}
+
+	TimerUnlock(nIrq);
+
+	for (i = 0; i < TIMER_COUNT; ++i)
+	{
+		if (byFire[i] && (g_tmTimers[i].pCallback != NULL))
+		{
+			g_tmTimers[i].pCallback();
+		}
+	}
+
+	// a timer started by a callback has posted EVENT_TIMER and is armed by the next call
+	if (nNext != 0)
+	{
+		TimerArm(nNext);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// returns and clears the posted events
+//
+DWORD EventTake(void)
+{
+	uint32_t nIrq = TimerLock();
+	DWORD    dwEvents;
+
+	dwEvents   = g_dwEvents;
+	g_dwEvents = 0;
+
+	TimerUnlock(nIrq);
+
+	return dwEvents;
+}
+
+//-----------------------------------------------------------------------------
+// sleeps until the next event (or SEV from core1), returns the time slept in us.
+// An event posted after the test has also executed SEV so WFE does not sleep.
+//
+DWORD EventWait(void)
+{
+	UINT64 nStart;
+
+	if (g_dwEvents != 0)
+	{
+		return 0;
+	}
+
+	nStart = TimerNow();
+	EventSleep();
+
+	return (DWORD)(TimerNow() - nStart);
+}
+
+#ifdef FDC_HOST_BUILD
+//-----------------------------------------------------------------------------
+void TimerSetTime(UINT64 nTime)
+{
+	g_nTimerClock = nTime;
+	g_dwEvents   |= EVENT_TIMER;
+}
+
+//-----------------------------------------------------------------------------
+void TimerAdvance(DWORD dwTime)
+{
+	TimerSetTime(g_nTimerClock + dwTime);
+}
+#endif
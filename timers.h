@@ -0,0 +1,78 @@
+#ifndef _TIMERS_H
+#define _TIMERS_H
+
+#include "Defines.h"
+
+#ifdef FDC_HOST_BUILD
+	#define EventSignal()
+#else
+	#include "hardware/sync.h"
+
+	#define EventSignal()	__sev()		// wakes the main loop from EventWait()
+#endif
+
+// events posted to the main loop (g_dwEvents)
+//-----------------------------------------------------------------------------
+
+#define EVENT_COMMAND		0x01	// a command has been written to the command register
+#define EVENT_DATA			0x02	// the data register has been read or written (DRQ serviced)
+#define EVENT_DRIVE_SEL		0x04	// the drive select latch has been written
+#define EVENT_TIMER			0x08	// a timer has been started or has reached its deadline
+#define EVENT_CARD_DETECT	0x10	// the SD-Card detect input has changed or its debounce has expired
+
+// may be used by interrupt handlers, the main loop clears the events with EventTake()
+#define PostEvent(dwEvent)	{ g_dwEvents |= (dwEvent); EventSignal(); }
+
+// timers (one deadline each)
+//-----------------------------------------------------------------------------
+
+enum {
+	tmWaitTimeout,		// WAIT has been held for too long, calls FdcReleaseWait()
+	tmMotorOn,			// running while the drive motor is considered to be ON (reloaded by each DRV_SEL write)
+	tmIndex,			// next edge of the index pulse
+	tmReset,			// FDC RESET input has been low for g_dwResetTime
+	tmStateCounter,		// timeout of the current state of a process function
+	tmSdPresence,		// SD-Card insertion debounce
+	tmHeadMove,			// step and head settle time of the current type 1 command
+	tmSectorArrival,	// the field accessed by the current type 2 or 3 command reaches the head
+	tmWriteBack,		// the next held write is due to be written back (see FdcGetWriteBackDelay())
+	tmPrefetch,			// PREFETCH_IDLE_TIME after the last command, read-ahead may start
+	TIMER_COUNT
+};
+
+typedef void (*TimerCallback)(void);
+
+typedef struct {
+	UINT64        nDeadline;	// in us (time_us_64() or the virtual clock)
+	BYTE          byRunning;
+	BYTE          byExpired;
+	TimerCallback pCallback;	// called by TimerService() when the deadline is reached, may be NULL
+} TimerType;
+
+// variables
+
+extern volatile DWORD g_dwEvents;
+
+// function definitions
+//-----------------------------------------------------------------------------
+
+void     TimerInit(void);
+void     TimerSetCallback(int nTimer, TimerCallback pCallback);
+void     TimerStart(int nTimer, DWORD dwDelay);
+void     TimerStop(int nTimer);
+BYTE     TimerIsRunning(int nTimer);
+BYTE     TimerHasExpired(int nTimer);
+UINT64   TimerGetTime(void);
+void     TimerService(void);
+
+DWORD    EventTake(void);
+DWORD    EventWait(void);
+
+#ifdef FDC_HOST_BUILD
+void     TimerSetTime(UINT64 nTime);
+void     TimerAdvance(DWORD dwTime);
+#endif
+
+#endif
+
+/* END OF FILE */